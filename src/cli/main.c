@@ -37,6 +37,7 @@
 #include "common/points.h"
 #include "config.h"
 #include "control/conf.h"
+#include "control/jobs/control_jobs.h"
 #include "develop/imageop.h"
 #include "imageio/imageio_common.h"
 #include "imageio/imageio_jpeg.h"
@@ -60,6 +61,30 @@
 // Make sure it's OK to limit output extension length
 #define DT_MAX_OUTPUT_EXT_LENGTH 5
 
+typedef struct _export_t
+{
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata;
+  dt_imageio_module_format_t *format;
+  int total;
+  gboolean high_quality, upscale, export_masks;
+  dt_colorspaces_color_profile_type_t icc_type;
+  gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+  dt_export_metadata_t *metadata;
+} _export_t;
+
+static int _export_image(const dt_imgid_t imgid,
+                         const int num,
+                         dt_imageio_module_data_t *fdata,
+                         void *user_data)
+{
+  _export_t *e = (_export_t *)user_data;
+  return e->storage->store(e->storage, e->sdata, imgid, e->format, fdata, num, e->total,
+                           e->high_quality, e->upscale, e->export_masks,
+                           e->icc_type, e->icc_filename, e->icc_intent, e->metadata);
+}
+
 static void usage(const char *progname)
 {
 fprintf(stderr, "darktable %s\n"
@@ -94,6 +119,8 @@ fprintf(stderr, "darktable %s\n"
                 "                          if specified, takes preference over output\n"
                 "   --import <file or dir> specify input file or dir, can be used'\n"
                 "                          multiple times instead of input file\n"
+                "   --jobs <n> number of images exported at the same time, default: 1\n"
+                "              0 = pick from cpu cores and memory\n"
                 "   --icc-type <type> specify icc type, default to NONE\n"
                 "                     use --help icc-type for list of supported types\n"
                 "   --icc-file <file> specify icc filename, default to NONE\n"
@@ -218,7 +245,7 @@ int main(int argc, char *arg[])
   gchar *output_ext = NULL;
   char *style = NULL;
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
+  int width = 0, height = 0, bpp = 0, jobs = 1;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE,
            style_overwrite = FALSE, custom_presets = TRUE, export_masks = FALSE,
            output_to_dir = FALSE;
@@ -257,6 +284,11 @@ int main(int argc, char *arg[])
         k++;
         width = MAX(atoi(arg[k]), 0);
       }
+      else if(!strcmp(arg[k], "--jobs") && argc > k + 1)
+      {
+        k++;
+        jobs = MAX(atoi(arg[k]), 0);
+      }
       else if(!strcmp(arg[k], "--height") && argc > k + 1)
       {
         k++;
@@ -771,18 +803,24 @@ int main(int argc, char *arg[])
 
   // TODO: add a callback to set the bpp without going through the config
 
-  int num = 1, res = 0;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
-  {
-    const int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    if(storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, export_masks,
-                      icc_type, icc_filename, icc_intent, &metadata) != 0)
-      res = 1;
-  }
+  // TODO: have a parameter in command line to get the export presets
+  dt_export_metadata_t metadata;
+  metadata.flags = dt_lib_export_metadata_default_flags();
+  metadata.list = NULL;
+
+  _export_t export = { .storage = storage,
+                       .sdata = sdata,
+                       .format = format,
+                       .total = total,
+                       .high_quality = high_quality,
+                       .upscale = upscale,
+                       .export_masks = export_masks,
+                       .icc_type = icc_type,
+                       .icc_filename = icc_filename,
+                       .icc_intent = icc_intent,
+                       .metadata = &metadata };
+  jobs = dt_control_export_concurrency(jobs, storage, format, fdata, g_list_length(id_list));
+  const int res = dt_control_export_images(NULL, id_list, jobs, format, fdata, _export_image, NULL, &export) ? 1 : 0;
 
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
@@ -16,10 +16,12 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef DT_UNIT_TEST
 #include "config.h"
+#include "common/darktable.h"
+#endif
 
 #include "common/cache.h"
-#include "common/darktable.h"
 #include "common/dtpthread.h"
 
 #include <assert.h>
@@ -29,52 +31,174 @@
 
 // this implements a concurrent LRU cache
 
-void dt_cache_init(dt_cache_t *cache,
-                   const size_t entry_size,
-                   const size_t cost_quota)
+#define DT_CACHE_SLAB_ENTRIES 64
+
+typedef struct dt_cache_slab_t
+{
+  struct dt_cache_slab_t *next;
+  dt_cache_entry_t entries[DT_CACHE_SLAB_ENTRIES];
+} dt_cache_slab_t;
+
+// the following need the shard lock
+
+static inline void _lru_unlink(dt_cache_shard_t *shard,
+                               dt_cache_entry_t *entry)
+{
+  if(entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+  else shard->lru_head = entry->lru_next;
+  if(entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+  else shard->lru_tail = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+static inline void _lru_append(dt_cache_shard_t *shard,
+                               dt_cache_entry_t *entry)
+{
+  entry->lru_next = NULL;
+  entry->lru_prev = shard->lru_tail;
+  if(shard->lru_tail) shard->lru_tail->lru_next = entry;
+  else shard->lru_head = entry;
+  shard->lru_tail = entry;
+}
+
+// bubble up in lru list
+static inline void _lru_touch(dt_cache_shard_t *shard,
+                              dt_cache_entry_t *entry)
+{
+  if(shard->lru_tail == entry) return;
+  _lru_unlink(shard, entry);
+  _lru_append(shard, entry);
+}
+
+static dt_cache_entry_t *_entry_alloc(dt_cache_shard_t *shard)
+{
+  if(!shard->free_entries)
+  {
+    dt_cache_slab_t *slab = (dt_cache_slab_t *)calloc(1, sizeof(dt_cache_slab_t));
+    if(!slab) return NULL;
+    slab->next = shard->slabs;
+    shard->slabs = slab;
+    for(int k = DT_CACHE_SLAB_ENTRIES - 1; k >= 0; k--)
+    {
+      slab->entries[k].lru_next = shard->free_entries;
+      shard->free_entries = slab->entries + k;
+    }
+  }
+  dt_cache_entry_t *entry = shard->free_entries;
+  shard->free_entries = entry->lru_next;
+  entry->lru_next = NULL;
+  return entry;
+}
+
+static inline void _entry_free(dt_cache_shard_t *shard,
+                               dt_cache_entry_t *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = shard->free_entries;
+  shard->free_entries = entry;
+}
+
+static inline dt_cache_shard_t *_cache_shard(dt_cache_t *cache,
+                                             const uint32_t key)
+{
+  // keys are image ids, possibly with the mip level in the upper bits. mix them
+  // so consecutive ids end up in different shards.
+  const uint32_t h = key * 0x9E3779B1u;
+  return cache->shards + ((h >> 16) % cache->num_shards);
+}
+
+void dt_cache_init_sharded(dt_cache_t *cache,
+                           const size_t entry_size,
+                           const size_t cost_quota,
+                           const int shards)
 {
-  cache->cost = 0;
-  cache->lru = 0;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+
+  cache->num_shards = MAX(1, shards);
+  cache->shards = (dt_cache_shard_t *)calloc(cache->num_shards, sizeof(dt_cache_shard_t));
+  for(int k = 0; k < cache->num_shards; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    shard->cost = 0;
+    shard->cost_quota = cost_quota / cache->num_shards;
+    shard->lru_head = shard->lru_tail = NULL;
+    shard->slabs = NULL;
+    shard->free_entries = NULL;
+    shard->hashtable = g_hash_table_new(0, 0);
+    dt_pthread_mutex_init(&shard->lock, 0);
+  }
 }
 
-void dt_cache_cleanup(dt_cache_t *cache)
+void dt_cache_init(dt_cache_t *cache,
+                   const size_t entry_size,
+                   const size_t cost_quota)
 {
-  g_hash_table_destroy(cache->hashtable);
-  for(GList *l = cache->lru; l; l = g_list_next(l))
+  dt_cache_init_sharded(cache, entry_size, cost_quota, 1);
+}
+
+static void _cache_entry_free(dt_cache_t *cache,
+                              dt_cache_entry_t *entry)
+{
+  if(cache->cleanup)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
+    assert(entry->data_size);
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
 
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+    cache->cleanup(cache->cleanup_data, entry);
+  }
+  else
+    dt_free_align(entry->data);
+}
 
-      cache->cleanup(cache->cleanup_data, entry);
+void dt_cache_cleanup(dt_cache_t *cache)
+{
+  for(int k = 0; k < cache->num_shards; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    g_hash_table_destroy(shard->hashtable);
+    for(dt_cache_entry_t *entry = shard->lru_head; entry; entry = entry->lru_next)
+    {
+      _cache_entry_free(cache, entry);
+      dt_pthread_rwlock_destroy(&entry->lock);
     }
-    else
-      dt_free_align(entry->data);
+    while(shard->slabs)
+    {
+      dt_cache_slab_t *next = shard->slabs->next;
+      free(shard->slabs);
+      shard->slabs = next;
+    }
+    dt_pthread_mutex_destroy(&shard->lock);
+  }
+  free(cache->shards);
+  cache->shards = NULL;
+  cache->num_shards = 0;
+}
 
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+size_t dt_cache_get_cost(dt_cache_t *cache)
+{
+  size_t cost = 0;
+  for(int k = 0; k < cache->num_shards; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    cost += shard->cost;
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
+  return cost;
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache,
                           const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
+  int32_t result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
@@ -83,25 +207,70 @@ int dt_cache_for_all
    int (*process)(const uint32_t key, const void *data, void *user_data),
    void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while(g_hash_table_iter_next (&iter, &key, &value))
+  for(int k = 0; k < cache->num_shards; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, shard->hashtable);
+    while(g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&shard->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
+// best-effort garbage collection. never blocks, never fails. well,
+// sometimes it just doesn't free anything. shard lock must be held.
+static void _cache_gc_shard(dt_cache_t *cache,
+                            dt_cache_shard_t *shard,
+                            const float fill_ratio)
+{
+  dt_cache_entry_t *next = shard->lru_head;
+  while(next)
+  {
+    dt_cache_entry_t *entry = next;
+    next = entry->lru_next; // we might remove this element, so walk to
+                            // the next one while we still have the
+                            // pointer..
+    if(shard->cost < shard->cost_quota * fill_ratio)
+      break;
+
+    // if still locked by anyone else give up:
+    if(dt_pthread_rwlock_trywrlock(&entry->lock))
+      continue;
+
+    if(entry->_lock_demoting)
+    {
+      // oops, we are currently demoting (rw -> r) lock to this entry
+      // in some thread. do not touch!
+      dt_pthread_rwlock_unlock(&entry->lock);
+      continue;
+    }
+
+    // delete!
+    g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+    _lru_unlink(shard, entry);
+    shard->cost -= entry->cost;
+
+    _cache_entry_free(cache, entry);
+
+    dt_pthread_rwlock_unlock(&entry->lock);
+    dt_pthread_rwlock_destroy(&entry->lock);
+    _entry_free(shard, entry);
+  }
+}
+
 // return read locked bucket, or NULL if it's not already there.
 // never attempt to allocate a new slot.
 dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
@@ -109,9 +278,10 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
                                    const char mode)
 {
   gpointer orig_key, value;
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
   const double start = dt_get_debug_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  dt_pthread_mutex_lock(&shard->lock);
+  const gboolean res = g_hash_table_lookup_extended(shard->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
@@ -125,13 +295,11 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       return 0;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
     const double end = dt_get_debug_wtime();
     if(end - start > 0.1)
       dt_print(DT_DEBUG_ALWAYS, "try+ wait time %.06fs mode %c \n", end - start, mode);
@@ -146,7 +314,7 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   const double end = dt_get_debug_wtime();
   if(end - start > 0.1)
     dt_print(DT_DEBUG_ALWAYS, "try- wait time %.06fs\n", end - start);
@@ -163,10 +331,11 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache,
                                            const int line)
 {
   gpointer orig_key, value;
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
   const double start = dt_get_debug_wtime();
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  dt_pthread_mutex_lock(&shard->lock);
+  const gboolean res = g_hash_table_lookup_extended(shard->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
@@ -181,14 +350,12 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -217,25 +384,25 @@ restart:
 
   // first try to clean up.
   // also wait if we can't free more than the requested fill ratio.
-  if(cache->cost > 0.8f * cache->cost_quota)
+  if(shard->cost > 0.8f * shard->cost_quota)
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _cache_gc_shard(cache, shard, 0.8f);
   }
 
   // here dies your 32-bit system:
-  dt_cache_entry_t *entry = (dt_cache_entry_t *)g_slice_alloc(sizeof(dt_cache_entry_t));
+  dt_cache_entry_t *entry = _entry_alloc(shard);
   const int ret = dt_pthread_rwlock_init(&entry->lock, 0);
   if(ret) dt_print(DT_DEBUG_ALWAYS, "rwlock init: %d\n", ret);
 
   entry->data = 0;
   entry->data_size = cache->entry_size;
   entry->cost = 1;
-  entry->link = g_list_append(0, entry);
+  entry->lru_prev = entry->lru_next = NULL;
   entry->key = key;
   entry->_lock_demoting = FALSE;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -256,12 +423,12 @@ restart:
   else
     dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  shard->cost += entry->cost;
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  _lru_append(shard, entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   const double end = dt_get_debug_wtime();
   if(end - start > 0.1)
     dt_print(DT_DEBUG_ALWAYS, "wait time %.06fs\n", end - start);
@@ -276,24 +443,25 @@ int dt_cache_remove(dt_cache_t *cache,
 {
   dt_cache_entry_t *entry;
   gpointer orig_key, value;
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
 
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  const gboolean res = g_hash_table_lookup_extended(shard->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return 1;
   }
   // need write lock to be able to delete:
   const int result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
@@ -303,81 +471,36 @@ restart:
     // oops, we are currently demoting (rw -> r) lock to this entry in
     // some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  _lru_unlink(shard, entry);
 
-  if(cache->cleanup)
-  {
-    assert(entry->data_size);
-    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-    cache->cleanup(cache->cleanup_data, entry);
-  }
-  else
-    dt_free_align(entry->data);
+  _cache_entry_free(cache, entry);
 
   dt_pthread_rwlock_unlock(&entry->lock);
   dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
-  g_slice_free1(sizeof(*entry), entry);
+  shard->cost -= entry->cost;
+  _entry_free(shard, entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
-// best-effort garbage collection. never blocks, never fails. well,
-// sometimes it just doesn't free anything.
 void dt_cache_gc(dt_cache_t *cache,
                  const float fill_ratio)
 {
-  GList *l = cache->lru;
-  while(l)
+  for(int k = 0; k < cache->num_shards; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to
-                        // the next one while we still have the
-                        // pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio)
-      break;
-
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock))
-      continue;
-
-    if(entry->_lock_demoting)
-    {
-      // oops, we are currently demoting (rw -> r) lock to this entry
-      // in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
-      continue;
-    }
-
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
-
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    _cache_gc_shard(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
   }
 }
 
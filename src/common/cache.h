@@ -1,6 +1,6 @@
 /*
     This file is part of darktable,
-    Copyright (C) 2011-2020 darktable developers.
+    Copyright (C) 2011-2024 darktable developers.
 
     darktable is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -28,7 +28,7 @@ typedef struct dt_cache_entry_t
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  struct dt_cache_entry_t *lru_prev, *lru_next; // neighbours in the lru list of the shard
   dt_pthread_rwlock_t lock;
   gboolean _lock_demoting;
   uint32_t key;
@@ -38,16 +38,32 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
+// keys are spread over shards which are independent LRU caches with their own lock
+// and a share of the quota, so threads working on different images don't wait on each other.
+typedef struct dt_cache_shard_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_pthread_mutex_t lock;
 
-  size_t entry_size; // cache line allocation
   size_t cost;       // user supplied cost per cache line (bytes?)
   size_t cost_quota; // quota to try and meet. but don't use as hard limit.
 
   GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+  dt_cache_entry_t *lru_head; // about to be kicked from cache
+  dt_cache_entry_t *lru_tail; // most recently used
+
+  // entries are carved out of slabs and recycled, the hot path never calls malloc
+  struct dt_cache_slab_t *slabs;
+  dt_cache_entry_t *free_entries; // linked through lru_next
+}
+__attribute__((aligned(64))) dt_cache_shard_t;
+
+typedef struct dt_cache_t
+{
+  size_t entry_size; // cache line allocation
+  size_t cost_quota; // quota over all shards
+
+  int num_shards;
+  dt_cache_shard_t *shards;
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -61,8 +77,17 @@ dt_cache_t;
 void dt_cache_init(dt_cache_t *cache,
                    const size_t entry_size,
                    const size_t cost_quota);
+// same but with independent shards, each one gets cost_quota / shards.
+// only useful if single entries are small compared to that.
+void dt_cache_init_sharded(dt_cache_t *cache,
+                           const size_t entry_size,
+                           const size_t cost_quota,
+                           const int shards);
 void dt_cache_cleanup(dt_cache_t *cache);
 
+// current cost over all shards
+size_t dt_cache_get_cost(dt_cache_t *cache);
+
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache,
                                                   dt_cache_allocate_t allocate_cb,
                                                   void *allocate_data)
@@ -101,10 +126,10 @@ int32_t dt_cache_contains(dt_cache_t *cache,
 // returns 0 on success, 1 if the key was not found.
 int32_t dt_cache_remove(dt_cache_t *cache,
                         const uint32_t key);
-// removes from the tip of the lru list, until the fill ratio of the hashtable
+// removes from the tip of the lru lists, until the fill ratio of every shard
 // goes below the given parameter, in terms of the user defined cost measure.
-// will never lock and never fail, but sometimes not free memory (in case all
-// is locked)
+// will never block on an entry and never fail, but sometimes not free memory
+// (in case all is locked)
 void dt_cache_gc(dt_cache_t *cache,
                  const float fill_ratio);
 
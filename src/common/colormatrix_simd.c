@@ -0,0 +1,484 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_UNIT_TEST
+#include "common/darktable.h"
+#endif
+
+#include "common/colormatrix_simd.h"
+#include "common/lut.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef DT_HAVE_AVX_KERNELS
+
+#include <immintrin.h>
+
+#define DT_TARGET_AVX2 __attribute__((target("avx2")))
+#define DT_TARGET_AVX512 __attribute__((target("avx512f")))
+
+// the constants of the per-pixel code in colorspaces_inline_conversions.h
+#define LAB_EPSILON (216.0f / 24389.0f)
+#define LAB_EPSILON_INV 0.20689655172413796f // cbrtf(216.0f/24389.0f)
+#define LAB_KAPPA (24389.0f / 27.0f)
+#define CBRT_MAGIC 709921077
+
+static const dt_aligned_pixel_t d50 = { 0.9642f, 1.0f, 0.8249f, 0.0f };
+
+/* ---------------------------------------------------------------------------------------------- */
+/*  AVX2, 8 pixels at a time                                                                      */
+/* ---------------------------------------------------------------------------------------------- */
+
+// 8 interleaved pixels to one vector per channel, alpha is dropped.
+// the pixels end up in the order 0 2 4 6 1 3 5 7, _store_avx2() undoes that.
+DT_TARGET_AVX2 static inline void _load_avx2(const float *const in, __m256 *x, __m256 *y, __m256 *z)
+{
+  const __m256 p0 = _mm256_loadu_ps(in);
+  const __m256 p1 = _mm256_loadu_ps(in + 8);
+  const __m256 p2 = _mm256_loadu_ps(in + 16);
+  const __m256 p3 = _mm256_loadu_ps(in + 24);
+  const __m256 t0 = _mm256_unpacklo_ps(p0, p1);
+  const __m256 t1 = _mm256_unpackhi_ps(p0, p1);
+  const __m256 t2 = _mm256_unpacklo_ps(p2, p3);
+  const __m256 t3 = _mm256_unpackhi_ps(p2, p3);
+  *x = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  *y = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  *z = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+}
+
+DT_TARGET_AVX2 static inline void _store_avx2(float *const out,
+                                              const __m256 x,
+                                              const __m256 y,
+                                              const __m256 z,
+                                              const gboolean stream)
+{
+  const __m256 w = _mm256_setzero_ps();
+  const __m256 t0 = _mm256_unpacklo_ps(x, y);
+  const __m256 t1 = _mm256_unpackhi_ps(x, y);
+  const __m256 t2 = _mm256_unpacklo_ps(z, w);
+  const __m256 t3 = _mm256_unpackhi_ps(z, w);
+  const __m256 p0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 p1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 p2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 p3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  if(stream)
+  {
+    _mm256_stream_ps(out, p0);
+    _mm256_stream_ps(out + 8, p1);
+    _mm256_stream_ps(out + 16, p2);
+    _mm256_stream_ps(out + 24, p3);
+  }
+  else
+  {
+    _mm256_storeu_ps(out, p0);
+    _mm256_storeu_ps(out + 8, p1);
+    _mm256_storeu_ps(out + 16, p2);
+    _mm256_storeu_ps(out + 24, p3);
+  }
+}
+
+DT_TARGET_AVX2 static inline __m256 _lab_f_avx2(const __m256 x)
+{
+  // cbrt_5f(): divide the bit pattern by 3 as a multiply-high, one 64 bit product per lane pair
+  const __m256i bits = _mm256_castps_si256(x);
+  const __m256i third = _mm256_set1_epi32(0xaaaaaaab);
+  const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(bits, third), 33);
+  const __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(bits, 32), third), 33);
+  const __m256i div = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+  const __m256 a = _mm256_castsi256_ps(_mm256_add_epi32(div, _mm256_set1_epi32(CBRT_MAGIC)));
+  // cbrta_halleyf()
+  const __m256 a3 = a * a * a;
+  const __m256 cube = a * (a3 + x + x) / (a3 + a3 + x);
+  const __m256 linear = (_mm256_set1_ps(LAB_KAPPA) * x + _mm256_set1_ps(16.0f)) / _mm256_set1_ps(116.0f);
+  return _mm256_blendv_ps(linear, cube, _mm256_cmp_ps(x, _mm256_set1_ps(LAB_EPSILON), _CMP_GT_OQ));
+}
+
+DT_TARGET_AVX2 static inline __m256 _lab_f_inv_avx2(const __m256 x)
+{
+  const __m256 cube = x * x * x;
+  const __m256 linear = (_mm256_set1_ps(116.0f) * x - _mm256_set1_ps(16.0f)) / _mm256_set1_ps(LAB_KAPPA);
+  return _mm256_blendv_ps(linear, cube, _mm256_cmp_ps(x, _mm256_set1_ps(LAB_EPSILON_INV), _CMP_GT_OQ));
+}
+
+DT_TARGET_AVX2 static inline void _matrix_avx2(const __m256 m[3][3], __m256 *x, __m256 *y, __m256 *z)
+{
+  const __m256 r = m[0][0] * *x + m[0][1] * *y + m[0][2] * *z;
+  const __m256 g = m[1][0] * *x + m[1][1] * *y + m[1][2] * *z;
+  const __m256 b = m[2][0] * *x + m[2][1] * *y + m[2][2] * *z;
+  *x = r;
+  *y = g;
+  *z = b;
+}
+
+DT_TARGET_AVX2 static inline void _load_matrix_avx2(__m256 m[3][3], const dt_colormatrix_t matrix)
+{
+  for(int r = 0; r < 3; r++)
+    for(int c = 0; c < 3; c++)
+      m[r][c] = _mm256_set1_ps(matrix[r][c]);
+}
+
+DT_TARGET_AVX2 static void _rgb_to_Lab_avx2(float *const out,
+                                            const float *const in,
+                                            const size_t npixels,
+                                            const dt_aligned_pixel_t corr,
+                                            const dt_colormatrix_curves_t *const curves,
+                                            const dt_colormatrix_t nmatrix,
+                                            const dt_colormatrix_t matrix)
+{
+  __m256 n[3][3], m[3][3];
+  if(nmatrix) _load_matrix_avx2(n, nmatrix);
+  _load_matrix_avx2(m, matrix);
+  const __m256 corr0 = _mm256_set1_ps(corr[0]);
+  const __m256 corr1 = _mm256_set1_ps(corr[1]);
+  const __m256 corr2 = _mm256_set1_ps(corr[2]);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const gboolean stream = ((uintptr_t)out & 31) == 0;
+
+  for(size_t k = 0; k < npixels; k += 8)
+  {
+    // the last few pixels go through a padded copy
+    const size_t count = MIN(npixels - k, 8);
+    DT_ALIGNED_ARRAY float tail[32] = { 0.0f };
+    if(count < 8) memcpy(tail, in + 4 * k, sizeof(float) * 4 * count);
+
+    __m256 x, y, z;
+    _load_avx2(count < 8 ? tail : in + 4 * k, &x, &y, &z);
+    x *= corr0;
+    y *= corr1;
+    z *= corr2;
+    if(curves)
+    {
+      if(curves->lut[0]) x = dt_lut_lookup_1d_unbounded_avx2(curves->lut[0], curves->coeffs[0], x, curves->lutsize);
+      if(curves->lut[1]) y = dt_lut_lookup_1d_unbounded_avx2(curves->lut[1], curves->coeffs[1], y, curves->lutsize);
+      if(curves->lut[2]) z = dt_lut_lookup_1d_unbounded_avx2(curves->lut[2], curves->coeffs[2], z, curves->lutsize);
+    }
+    if(nmatrix)
+    {
+      // clip to the gamut of the gamut-clipping colorspace
+      _matrix_avx2(n, &x, &y, &z);
+      x = _mm256_min_ps(_mm256_max_ps(x, zero), one);
+      y = _mm256_min_ps(_mm256_max_ps(y, zero), one);
+      z = _mm256_min_ps(_mm256_max_ps(z, zero), one);
+    }
+    _matrix_avx2(m, &x, &y, &z);
+
+    const __m256 fx = _lab_f_avx2(x * _mm256_set1_ps(1.0f / d50[0]));
+    const __m256 fy = _lab_f_avx2(y);
+    const __m256 fz = _lab_f_avx2(z * _mm256_set1_ps(1.0f / d50[2]));
+    const __m256 L = _mm256_set1_ps(116.0f) * fy - _mm256_set1_ps(16.0f);
+    const __m256 a = _mm256_set1_ps(500.0f) * (fx - fy);
+    const __m256 b = _mm256_set1_ps(-200.0f) * (fz - fy);
+
+    if(count < 8)
+    {
+      _store_avx2(tail, L, a, b, FALSE);
+      memcpy(out + 4 * k, tail, sizeof(float) * 4 * count);
+    }
+    else
+      _store_avx2(out + 4 * k, L, a, b, stream);
+  }
+  if(stream) _mm_sfence();
+}
+
+DT_TARGET_AVX2 static void _Lab_to_rgb_avx2(float *const out,
+                                            const float *const in,
+                                            const size_t npixels,
+                                            const dt_colormatrix_t matrix,
+                                            const dt_colormatrix_curves_t *const curves)
+{
+  __m256 m[3][3];
+  _load_matrix_avx2(m, matrix);
+  const gboolean stream = ((uintptr_t)out & 31) == 0;
+
+  for(size_t k = 0; k < npixels; k += 8)
+  {
+    const size_t count = MIN(npixels - k, 8);
+    DT_ALIGNED_ARRAY float tail[32] = { 0.0f };
+    if(count < 8) memcpy(tail, in + 4 * k, sizeof(float) * 4 * count);
+
+    __m256 L, a, b;
+    _load_avx2(count < 8 ? tail : in + 4 * k, &L, &a, &b);
+    const __m256 fy = (L + _mm256_set1_ps(16.0f)) * _mm256_set1_ps(1.0f / 116.0f);
+    const __m256 fx = a * _mm256_set1_ps(1.0f / 500.0f);
+    const __m256 fz = b * _mm256_set1_ps(-1.0f / 200.0f);
+    __m256 x = _mm256_set1_ps(d50[0]) * _lab_f_inv_avx2(fx + fy);
+    __m256 y = _lab_f_inv_avx2(fy);
+    __m256 z = _mm256_set1_ps(d50[2]) * _lab_f_inv_avx2(fz + fy);
+    _matrix_avx2(m, &x, &y, &z);
+    if(curves)
+    {
+      if(curves->lut[0]) x = dt_lut_lookup_1d_unbounded_avx2(curves->lut[0], curves->coeffs[0], x, curves->lutsize);
+      if(curves->lut[1]) y = dt_lut_lookup_1d_unbounded_avx2(curves->lut[1], curves->coeffs[1], y, curves->lutsize);
+      if(curves->lut[2]) z = dt_lut_lookup_1d_unbounded_avx2(curves->lut[2], curves->coeffs[2], z, curves->lutsize);
+    }
+
+    if(count < 8)
+    {
+      _store_avx2(tail, x, y, z, FALSE);
+      memcpy(out + 4 * k, tail, sizeof(float) * 4 * count);
+    }
+    else
+      _store_avx2(out + 4 * k, x, y, z, stream);
+  }
+  if(stream) _mm_sfence();
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+/*  AVX-512, 16 pixels at a time                                                                  */
+/* ---------------------------------------------------------------------------------------------- */
+
+// same transposition as _load_avx2(), within each 128 bit lane.
+// the pixels end up in the order 0 4 8 12 1 5 9 13 2 6 10 14 3 7 11 15.
+DT_TARGET_AVX512 static inline void _load_avx512(const float *const in, __m512 *x, __m512 *y, __m512 *z)
+{
+  const __m512 p0 = _mm512_loadu_ps(in);
+  const __m512 p1 = _mm512_loadu_ps(in + 16);
+  const __m512 p2 = _mm512_loadu_ps(in + 32);
+  const __m512 p3 = _mm512_loadu_ps(in + 48);
+  const __m512 t0 = _mm512_unpacklo_ps(p0, p1);
+  const __m512 t1 = _mm512_unpackhi_ps(p0, p1);
+  const __m512 t2 = _mm512_unpacklo_ps(p2, p3);
+  const __m512 t3 = _mm512_unpackhi_ps(p2, p3);
+  *x = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  *y = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  *z = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+}
+
+DT_TARGET_AVX512 static inline void _store_avx512(float *const out,
+                                                  const __m512 x,
+                                                  const __m512 y,
+                                                  const __m512 z,
+                                                  const gboolean stream)
+{
+  const __m512 w = _mm512_setzero_ps();
+  const __m512 t0 = _mm512_unpacklo_ps(x, y);
+  const __m512 t1 = _mm512_unpackhi_ps(x, y);
+  const __m512 t2 = _mm512_unpacklo_ps(z, w);
+  const __m512 t3 = _mm512_unpackhi_ps(z, w);
+  const __m512 p0 = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m512 p1 = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m512 p2 = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m512 p3 = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  if(stream)
+  {
+    _mm512_stream_ps(out, p0);
+    _mm512_stream_ps(out + 16, p1);
+    _mm512_stream_ps(out + 32, p2);
+    _mm512_stream_ps(out + 48, p3);
+  }
+  else
+  {
+    _mm512_storeu_ps(out, p0);
+    _mm512_storeu_ps(out + 16, p1);
+    _mm512_storeu_ps(out + 32, p2);
+    _mm512_storeu_ps(out + 48, p3);
+  }
+}
+
+DT_TARGET_AVX512 static inline __m512 _lab_f_avx512(const __m512 x)
+{
+  const __m512i bits = _mm512_castps_si512(x);
+  const __m512i third = _mm512_set1_epi32(0xaaaaaaab);
+  const __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(bits, third), 33);
+  const __m512i odd = _mm512_srli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(bits, 32), third), 33);
+  const __m512i div = _mm512_mask_blend_epi32(0xaaaa, even, _mm512_slli_epi64(odd, 32));
+  const __m512 a = _mm512_castsi512_ps(_mm512_add_epi32(div, _mm512_set1_epi32(CBRT_MAGIC)));
+  const __m512 a3 = a * a * a;
+  const __m512 cube = a * (a3 + x + x) / (a3 + a3 + x);
+  const __m512 linear = (_mm512_set1_ps(LAB_KAPPA) * x + _mm512_set1_ps(16.0f)) / _mm512_set1_ps(116.0f);
+  return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(LAB_EPSILON), _CMP_GT_OQ), linear, cube);
+}
+
+DT_TARGET_AVX512 static inline __m512 _lab_f_inv_avx512(const __m512 x)
+{
+  const __m512 cube = x * x * x;
+  const __m512 linear = (_mm512_set1_ps(116.0f) * x - _mm512_set1_ps(16.0f)) / _mm512_set1_ps(LAB_KAPPA);
+  return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(LAB_EPSILON_INV), _CMP_GT_OQ), linear, cube);
+}
+
+DT_TARGET_AVX512 static inline void _matrix_avx512(const __m512 m[3][3], __m512 *x, __m512 *y, __m512 *z)
+{
+  const __m512 r = m[0][0] * *x + m[0][1] * *y + m[0][2] * *z;
+  const __m512 g = m[1][0] * *x + m[1][1] * *y + m[1][2] * *z;
+  const __m512 b = m[2][0] * *x + m[2][1] * *y + m[2][2] * *z;
+  *x = r;
+  *y = g;
+  *z = b;
+}
+
+DT_TARGET_AVX512 static inline void _load_matrix_avx512(__m512 m[3][3], const dt_colormatrix_t matrix)
+{
+  for(int r = 0; r < 3; r++)
+    for(int c = 0; c < 3; c++)
+      m[r][c] = _mm512_set1_ps(matrix[r][c]);
+}
+
+DT_TARGET_AVX512 static void _rgb_to_Lab_avx512(float *const out,
+                                                const float *const in,
+                                                const size_t npixels,
+                                                const dt_aligned_pixel_t corr,
+                                                const dt_colormatrix_curves_t *const curves,
+                                                const dt_colormatrix_t nmatrix,
+                                                const dt_colormatrix_t matrix)
+{
+  __m512 n[3][3], m[3][3];
+  if(nmatrix) _load_matrix_avx512(n, nmatrix);
+  _load_matrix_avx512(m, matrix);
+  const __m512 corr0 = _mm512_set1_ps(corr[0]);
+  const __m512 corr1 = _mm512_set1_ps(corr[1]);
+  const __m512 corr2 = _mm512_set1_ps(corr[2]);
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const gboolean stream = ((uintptr_t)out & 63) == 0;
+
+  for(size_t k = 0; k < npixels; k += 16)
+  {
+    const size_t count = MIN(npixels - k, 16);
+    DT_ALIGNED_ARRAY float tail[64] = { 0.0f };
+    if(count < 16) memcpy(tail, in + 4 * k, sizeof(float) * 4 * count);
+
+    __m512 x, y, z;
+    _load_avx512(count < 16 ? tail : in + 4 * k, &x, &y, &z);
+    x *= corr0;
+    y *= corr1;
+    z *= corr2;
+    if(curves)
+    {
+      if(curves->lut[0]) x = dt_lut_lookup_1d_unbounded_avx512(curves->lut[0], curves->coeffs[0], x, curves->lutsize);
+      if(curves->lut[1]) y = dt_lut_lookup_1d_unbounded_avx512(curves->lut[1], curves->coeffs[1], y, curves->lutsize);
+      if(curves->lut[2]) z = dt_lut_lookup_1d_unbounded_avx512(curves->lut[2], curves->coeffs[2], z, curves->lutsize);
+    }
+    if(nmatrix)
+    {
+      _matrix_avx512(n, &x, &y, &z);
+      x = _mm512_min_ps(_mm512_max_ps(x, zero), one);
+      y = _mm512_min_ps(_mm512_max_ps(y, zero), one);
+      z = _mm512_min_ps(_mm512_max_ps(z, zero), one);
+    }
+    _matrix_avx512(m, &x, &y, &z);
+
+    const __m512 fx = _lab_f_avx512(x * _mm512_set1_ps(1.0f / d50[0]));
+    const __m512 fy = _lab_f_avx512(y);
+    const __m512 fz = _lab_f_avx512(z * _mm512_set1_ps(1.0f / d50[2]));
+    const __m512 L = _mm512_set1_ps(116.0f) * fy - _mm512_set1_ps(16.0f);
+    const __m512 a = _mm512_set1_ps(500.0f) * (fx - fy);
+    const __m512 b = _mm512_set1_ps(-200.0f) * (fz - fy);
+
+    if(count < 16)
+    {
+      _store_avx512(tail, L, a, b, FALSE);
+      memcpy(out + 4 * k, tail, sizeof(float) * 4 * count);
+    }
+    else
+      _store_avx512(out + 4 * k, L, a, b, stream);
+  }
+  if(stream) _mm_sfence();
+}
+
+DT_TARGET_AVX512 static void _Lab_to_rgb_avx512(float *const out,
+                                                const float *const in,
+                                                const size_t npixels,
+                                                const dt_colormatrix_t matrix,
+                                                const dt_colormatrix_curves_t *const curves)
+{
+  __m512 m[3][3];
+  _load_matrix_avx512(m, matrix);
+  const gboolean stream = ((uintptr_t)out & 63) == 0;
+
+  for(size_t k = 0; k < npixels; k += 16)
+  {
+    const size_t count = MIN(npixels - k, 16);
+    DT_ALIGNED_ARRAY float tail[64] = { 0.0f };
+    if(count < 16) memcpy(tail, in + 4 * k, sizeof(float) * 4 * count);
+
+    __m512 L, a, b;
+    _load_avx512(count < 16 ? tail : in + 4 * k, &L, &a, &b);
+    const __m512 fy = (L + _mm512_set1_ps(16.0f)) * _mm512_set1_ps(1.0f / 116.0f);
+    const __m512 fx = a * _mm512_set1_ps(1.0f / 500.0f);
+    const __m512 fz = b * _mm512_set1_ps(-1.0f / 200.0f);
+    __m512 x = _mm512_set1_ps(d50[0]) * _lab_f_inv_avx512(fx + fy);
+    __m512 y = _lab_f_inv_avx512(fy);
+    __m512 z = _mm512_set1_ps(d50[2]) * _lab_f_inv_avx512(fz + fy);
+    _matrix_avx512(m, &x, &y, &z);
+    if(curves)
+    {
+      if(curves->lut[0]) x = dt_lut_lookup_1d_unbounded_avx512(curves->lut[0], curves->coeffs[0], x, curves->lutsize);
+      if(curves->lut[1]) y = dt_lut_lookup_1d_unbounded_avx512(curves->lut[1], curves->coeffs[1], y, curves->lutsize);
+      if(curves->lut[2]) z = dt_lut_lookup_1d_unbounded_avx512(curves->lut[2], curves->coeffs[2], z, curves->lutsize);
+    }
+
+    if(count < 16)
+    {
+      _store_avx512(tail, x, y, z, FALSE);
+      memcpy(out + 4 * k, tail, sizeof(float) * 4 * count);
+    }
+    else
+      _store_avx512(out + 4 * k, x, y, z, stream);
+  }
+  if(stream) _mm_sfence();
+}
+
+#endif // DT_HAVE_AVX_KERNELS
+
+gboolean dt_colormatrix_simd_available(void)
+{
+#ifdef DT_HAVE_AVX_KERNELS
+  return darktable.codepath.AVX2 || darktable.codepath.AVX512;
+#else
+  return FALSE;
+#endif
+}
+
+void dt_colormatrix_simd_rgb_to_Lab(float *const out,
+                                    const float *const in,
+                                    const size_t npixels,
+                                    const dt_aligned_pixel_t corr,
+                                    const dt_colormatrix_curves_t *const curves,
+                                    const dt_colormatrix_t nmatrix,
+                                    const dt_colormatrix_t matrix)
+{
+#ifdef DT_HAVE_AVX_KERNELS
+  if(darktable.codepath.AVX512)
+    _rgb_to_Lab_avx512(out, in, npixels, corr, curves, nmatrix, matrix);
+  else if(darktable.codepath.AVX2)
+    _rgb_to_Lab_avx2(out, in, npixels, corr, curves, nmatrix, matrix);
+#endif
+}
+
+void dt_colormatrix_simd_Lab_to_rgb(float *const out,
+                                    const float *const in,
+                                    const size_t npixels,
+                                    const dt_colormatrix_t matrix,
+                                    const dt_colormatrix_curves_t *const curves)
+{
+#ifdef DT_HAVE_AVX_KERNELS
+  if(darktable.codepath.AVX512)
+    _Lab_to_rgb_avx512(out, in, npixels, matrix, curves);
+  else if(darktable.codepath.AVX2)
+    _Lab_to_rgb_avx2(out, in, npixels, matrix, curves);
+#endif
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,65 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dttypes.h"
+#include <glib.h>
+#include <stddef.h>
+
+/**
+ * explicitly vectorized versions of the matrix fast paths of colorin and colorout.
+ *
+ * the kernels work on 8 (AVX2) or 16 (AVX-512) pixels at a time, transposing them to one
+ * vector per channel, and look up the tone curves with gathers. they give the same results as
+ * the plain per-pixel code up to float rounding. the alpha channel of the output is set to 0.
+ */
+
+/** per channel tone curves applied to the rgb side of the matrix */
+typedef struct dt_colormatrix_curves_t
+{
+  const float *lut[3];    // sampled on [0, 1), NULL for linear channels
+  const float *coeffs[3]; // above 1.0: coeffs[1] * powf(x * coeffs[0], coeffs[2])
+  int lutsize;
+} dt_colormatrix_curves_t;
+
+/** TRUE if the cpu can run the kernels and they aren't disabled */
+gboolean dt_colormatrix_simd_available(void);
+
+/** camera or working rgb to Lab: in * corr, tone curves (optional), clip in the gamut of nmatrix (optional),
+ *  matrix to XYZ and XYZ to Lab. only call if dt_colormatrix_simd_available(). */
+void dt_colormatrix_simd_rgb_to_Lab(float *const out,
+                                    const float *const in,
+                                    const size_t npixels,
+                                    const dt_aligned_pixel_t corr,
+                                    const dt_colormatrix_curves_t *const curves,
+                                    const dt_colormatrix_t nmatrix,
+                                    const dt_colormatrix_t matrix);
+
+/** Lab to XYZ, matrix to rgb and tone curves (optional). only call if dt_colormatrix_simd_available(). */
+void dt_colormatrix_simd_Lab_to_rgb(float *const out,
+                                    const float *const in,
+                                    const size_t npixels,
+                                    const dt_colormatrix_t matrix,
+                                    const dt_colormatrix_curves_t *const curves);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -436,14 +436,28 @@ dt_imgid_t dt_load_from_string(const gchar *input,
 
 static void dt_codepaths_init()
 {
-  // we no longer do explicit runtime selection of code paths, so initialize to "none"
-  // (there are still functions where the compiler creates runtime selection due to "target_clones"
-  // directives, but those are not affected by this code)
+  // most code relies on the compiler for vectorization, either on its own or through "target_clones"
+  // directives. only the few hand written AVX2 and AVX-512 kernels are selected here.
 
   memset(&(darktable.codepath), 0, sizeof(darktable.codepath));
 
-  // do we have any intrinsics sets enabled? (nope)
-  darktable.codepath._no_intrinsics = 1;
+#ifdef DT_HAVE_AVX_KERNELS
+  if(dt_conf_get_bool("codepaths/avx"))
+  {
+    __builtin_cpu_init();
+    darktable.codepath.AVX2 = __builtin_cpu_supports("avx2");
+    darktable.codepath.AVX512 = __builtin_cpu_supports("avx512f");
+    darktable.codepath.F16C = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+  }
+#endif
+
+  // do we have any intrinsics sets enabled?
+  darktable.codepath._no_intrinsics = !darktable.codepath.AVX2 && !darktable.codepath.AVX512;
+
+  dt_print(DT_DEBUG_DEV, "[dt_codepaths_init] AVX2 kernels %s, AVX-512 kernels %s, F16C %s\n",
+           darktable.codepath.AVX2 ? "enabled" : "disabled",
+           darktable.codepath.AVX512 ? "enabled" : "disabled",
+           darktable.codepath.F16C ? "enabled" : "disabled");
 }
 
 static inline size_t _get_total_memory()
@@ -1548,6 +1562,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
+  dt_dev_pixelpipe_cache_disk_init();
+
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to
   // register their keyboard accelerators
@@ -1826,6 +1842,7 @@ void dt_cleanup()
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
   free(darktable.mipmap_cache);
+  dt_dev_pixelpipe_cache_disk_cleanup();
   if(init_gui)
   {
     dt_control_cleanup(darktable.control);
@@ -2049,16 +2066,23 @@ int dt_worker_threads()
   return wthreads;
 }
 
+static __thread int _available_mem_parts = 1;
+
+void dt_set_available_mem_parts(const int parts)
+{
+  _available_mem_parts = MAX(1, parts);
+}
+
 size_t dt_get_available_mem()
 {
   dt_sys_resources_t *res = &darktable.dtresources;
   const int level = res->level;
   const size_t total_mem = res->total_memory;
   if(level < 0)
-    return res->refresource[4*(-level-1)] * 1024lu * 1024lu;
+    return res->refresource[4*(-level-1)] * 1024lu * 1024lu / _available_mem_parts;
 
   const int fraction = res->fractions[darktable.dtresources.group];
-  return MAX(512lu * 1024lu * 1024lu, total_mem / 1024lu * fraction);
+  return MAX(512lu * 1024lu * 1024lu, total_mem / 1024lu * fraction) / _available_mem_parts;
 }
 
 size_t dt_get_singlebuffer_mem()
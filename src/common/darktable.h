@@ -324,6 +324,9 @@ typedef enum dt_debug_thread_t
 typedef struct dt_codepath_t
 {
   unsigned int _no_intrinsics : 1;
+  unsigned int AVX2 : 1;
+  unsigned int AVX512 : 1;
+  unsigned int F16C : 1;
 } dt_codepath_t;
 
 typedef struct dt_sys_resources_t
@@ -461,6 +464,9 @@ void dt_print_nts_ext(const char *msg, ...)
 int dt_worker_threads();
 size_t dt_get_available_mem();
 size_t dt_get_singlebuffer_mem();
+// pipes run by the calling thread only get 1/parts of the available memory,
+// used when several exports are processed at the same time
+void dt_set_available_mem_parts(const int parts);
 
 void dt_dump_pfm_file(const char *pipe,
                       const void *data,
@@ -0,0 +1,899 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_UNIT_TEST
+#include "common/darktable.h"
+#endif
+
+#include "common/demosaic_simd.h"
+
+#include <float.h>
+
+#ifdef DT_HAVE_AVX_KERNELS
+
+#include <immintrin.h>
+
+#define DT_TARGET_AVX2 __attribute__((target("avx2")))
+#define DT_TARGET_AVX512 __attribute__((target("avx512f")))
+
+// the constants of rcd.c and amaze.cc
+#define RCD_EPS 1e-5f
+#define RCD_EPSSQ 1e-10f
+#define AMAZE_EPS 1e-5f
+#define AMAZE_ARTHRESH 0.75f
+
+/* ---------------------------------------------------------------------------------------------- */
+/*  AVX2, 8 sensels at a time                                                                     */
+/* ---------------------------------------------------------------------------------------------- */
+
+DT_TARGET_AVX2 static inline __m256 _ld_avx2(const float *const p)
+{
+  return _mm256_loadu_ps(p);
+}
+
+// p[0], p[2] ... p[14], reading nothing beyond p[14]
+DT_TARGET_AVX2 static inline __m256 _ld2_avx2(const float *const p)
+{
+  const __m256 lo = _mm256_permutevar8x32_ps(_mm256_loadu_ps(p), _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+  const __m256 hi = _mm256_permutevar8x32_ps(_mm256_loadu_ps(p + 7), _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7));
+  return _mm256_blend_ps(lo, hi, 0xf0);
+}
+
+// to p[0], p[2] ... p[14], the odd sensels are left alone
+DT_TARGET_AVX2 static inline void _st2_avx2(float *const p, const __m256 v)
+{
+  const __m256i even = _mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+  _mm256_maskstore_ps(p, even, _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3)));
+  _mm256_maskstore_ps(p + 8, even, _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7)));
+}
+
+DT_TARGET_AVX2 static inline __m256 _abs_avx2(const __m256 x)
+{
+  return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+}
+
+// rcd's refined discrimination: the neighbourhood if it is further away from 0.5 than the centre
+DT_TARGET_AVX2 static inline __m256 _disc_avx2(const __m256 central, const __m256 neighbourhood)
+{
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 further
+      = _mm256_cmp_ps(_abs_avx2(half - central), _abs_avx2(half - neighbourhood), _CMP_LT_OQ);
+  return _mm256_blendv_ps(central, neighbourhood, further);
+}
+
+// interpolatef() of rcd.c
+DT_TARGET_AVX2 static inline __m256 _interp_avx2(const __m256 a, const __m256 b, const __m256 c)
+{
+  return a * (b - c) + c;
+}
+
+DT_TARGET_AVX2 static int _rcd_hpf_avx2(float *const out, const float *const cfa, const int n, const int step)
+{
+  const __m256 three = _mm256_set1_ps(3.0f);
+  const __m256 six = _mm256_set1_ps(6.0f);
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+  {
+    const float *const c = cfa + i;
+    const __m256 hpf = (_ld_avx2(c - 3 * step) - _ld_avx2(c - step) - _ld_avx2(c + step) + _ld_avx2(c + 3 * step))
+                       - three * (_ld_avx2(c - 2 * step) + _ld_avx2(c + 2 * step)) + six * _ld_avx2(c);
+    _mm256_storeu_ps(out + i, hpf * hpf);
+  }
+  return i;
+}
+
+DT_TARGET_AVX2 static int _rcd_vh_dir_avx2(float *const VH_Dir,
+                                           const float *const V0,
+                                           const float *const V1,
+                                           const float *const V2,
+                                           const float *const H,
+                                           const int n)
+{
+  const __m256 epssq = _mm256_set1_ps(RCD_EPSSQ);
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+  {
+    const __m256 V_Stat = _mm256_max_ps(epssq, _ld_avx2(V0 + i) + _ld_avx2(V1 + i) + _ld_avx2(V2 + i));
+    const __m256 H_Stat = _mm256_max_ps(epssq, _ld_avx2(H + i) + _ld_avx2(H + i + 1) + _ld_avx2(H + i + 2));
+    _mm256_storeu_ps(VH_Dir + i, V_Stat / (V_Stat + H_Stat));
+  }
+  return i;
+}
+
+DT_TARGET_AVX2 static int _rcd_green_avx2(float *const green,
+                                          const float *const cfa,
+                                          const float *const lpf,
+                                          const float *const VH_Dir,
+                                          const int n,
+                                          const int w1)
+{
+  const __m256 eps = _mm256_set1_ps(RCD_EPS);
+  const __m256 quarter = _mm256_set1_ps(0.25f);
+  const int w2 = 2 * w1, w3 = 3 * w1, w4 = 4 * w1;
+  int t = 0;
+  for(; t + 8 <= n; t += 8)
+  {
+    const float *const c = cfa + 2 * t;
+    const float *const vh = VH_Dir + 2 * t;
+    const float *const lp = lpf + t;
+    const __m256 cfai = _ld2_avx2(c);
+    const __m256 n1 = _ld2_avx2(c - w1), n2 = _ld2_avx2(c - w2), n3 = _ld2_avx2(c - w3), n4 = _ld2_avx2(c - w4);
+    const __m256 s1 = _ld2_avx2(c + w1), s2 = _ld2_avx2(c + w2), s3 = _ld2_avx2(c + w3), s4 = _ld2_avx2(c + w4);
+    const __m256 w_1 = _ld2_avx2(c - 1), w_2 = _ld2_avx2(c - 2), w_3 = _ld2_avx2(c - 3), w_4 = _ld2_avx2(c - 4);
+    const __m256 e1 = _ld2_avx2(c + 1), e2 = _ld2_avx2(c + 2), e3 = _ld2_avx2(c + 3), e4 = _ld2_avx2(c + 4);
+
+    // cardinal gradients
+    const __m256 ns = _abs_avx2(n1 - s1);
+    const __m256 we = _abs_avx2(w_1 - e1);
+    const __m256 N_Grad = eps + ns + _abs_avx2(cfai - n2) + _abs_avx2(n1 - n3) + _abs_avx2(n2 - n4);
+    const __m256 S_Grad = eps + ns + _abs_avx2(cfai - s2) + _abs_avx2(s1 - s3) + _abs_avx2(s2 - s4);
+    const __m256 W_Grad = eps + we + _abs_avx2(cfai - w_2) + _abs_avx2(w_1 - w_3) + _abs_avx2(w_2 - w_4);
+    const __m256 E_Grad = eps + we + _abs_avx2(cfai - e2) + _abs_avx2(e1 - e3) + _abs_avx2(e2 - e4);
+
+    // cardinal pixel estimations
+    const __m256 lpfi = _ld_avx2(lp);
+    const __m256 lpfi2 = lpfi + lpfi;
+    const __m256 N_Est = n1 * lpfi2 / (eps + lpfi + _ld_avx2(lp - w1));
+    const __m256 S_Est = s1 * lpfi2 / (eps + lpfi + _ld_avx2(lp + w1));
+    const __m256 W_Est = w_1 * lpfi2 / (eps + lpfi + _ld_avx2(lp - 1));
+    const __m256 E_Est = e1 * lpfi2 / (eps + lpfi + _ld_avx2(lp + 1));
+
+    const __m256 V_Est = (S_Grad * N_Est + N_Grad * S_Est) / (N_Grad + S_Grad);
+    const __m256 H_Est = (W_Grad * E_Est + E_Grad * W_Est) / (E_Grad + W_Grad);
+
+    const __m256 VH_Neighbourhood = quarter * (_ld2_avx2(vh - w1 - 1) + _ld2_avx2(vh - w1 + 1)
+                                               + _ld2_avx2(vh + w1 - 1) + _ld2_avx2(vh + w1 + 1));
+    const __m256 VH_Disc = _disc_avx2(_ld2_avx2(vh), VH_Neighbourhood);
+
+    _st2_avx2(green + 2 * t, _interp_avx2(VH_Disc, H_Est, V_Est));
+  }
+  return t;
+}
+
+DT_TARGET_AVX2 static int _rcd_rb_at_rb_avx2(float *const rgbc,
+                                             const float *const green,
+                                             const float *const PQ_Dir,
+                                             const float *const PQ_up,
+                                             const float *const PQ_down,
+                                             const int n,
+                                             const int w1)
+{
+  const __m256 eps = _mm256_set1_ps(RCD_EPS);
+  const __m256 quarter = _mm256_set1_ps(0.25f);
+  const int w2 = 2 * w1, w3 = 3 * w1;
+  int t = 0;
+  for(; t + 8 <= n; t += 8)
+  {
+    const float *const c = rgbc + 2 * t;
+    const float *const g = green + 2 * t;
+    const __m256 PQ_Neighbourhood = quarter * (_ld_avx2(PQ_up + t) + _ld_avx2(PQ_up + t + 1)
+                                               + _ld_avx2(PQ_down + t) + _ld_avx2(PQ_down + t + 1));
+    const __m256 PQ_Disc = _disc_avx2(_ld_avx2(PQ_Dir + t), PQ_Neighbourhood);
+
+    const __m256 nw = _ld2_avx2(c - w1 - 1), ne = _ld2_avx2(c - w1 + 1);
+    const __m256 sw = _ld2_avx2(c + w1 - 1), se = _ld2_avx2(c + w1 + 1);
+    const __m256 g0 = _ld2_avx2(g);
+
+    // diagonal gradients
+    const __m256 NW_Grad = eps + _abs_avx2(nw - se) + _abs_avx2(nw - _ld2_avx2(c - w3 - 3)) + _abs_avx2(g0 - _ld2_avx2(g - w2 - 2));
+    const __m256 NE_Grad = eps + _abs_avx2(ne - sw) + _abs_avx2(ne - _ld2_avx2(c - w3 + 3)) + _abs_avx2(g0 - _ld2_avx2(g - w2 + 2));
+    const __m256 SW_Grad = eps + _abs_avx2(ne - sw) + _abs_avx2(sw - _ld2_avx2(c + w3 - 3)) + _abs_avx2(g0 - _ld2_avx2(g + w2 - 2));
+    const __m256 SE_Grad = eps + _abs_avx2(nw - se) + _abs_avx2(se - _ld2_avx2(c + w3 + 3)) + _abs_avx2(g0 - _ld2_avx2(g + w2 + 2));
+
+    // diagonal colour differences
+    const __m256 NW_Est = nw - _ld2_avx2(g - w1 - 1);
+    const __m256 NE_Est = ne - _ld2_avx2(g - w1 + 1);
+    const __m256 SW_Est = sw - _ld2_avx2(g + w1 - 1);
+    const __m256 SE_Est = se - _ld2_avx2(g + w1 + 1);
+
+    const __m256 P_Est = (NW_Grad * SE_Est + SE_Grad * NW_Est) / (NW_Grad + SE_Grad);
+    const __m256 Q_Est = (NE_Grad * SW_Est + SW_Grad * NE_Est) / (NE_Grad + SW_Grad);
+
+    _st2_avx2(rgbc + 2 * t, g0 + _interp_avx2(PQ_Disc, Q_Est, P_Est));
+  }
+  return t;
+}
+
+DT_TARGET_AVX2 static int _rcd_rb_at_green_avx2(float *const red,
+                                                float *const blue,
+                                                const float *const green,
+                                                const float *const VH_Dir,
+                                                const int n,
+                                                const int w1)
+{
+  const __m256 eps = _mm256_set1_ps(RCD_EPS);
+  const __m256 quarter = _mm256_set1_ps(0.25f);
+  const int w2 = 2 * w1, w3 = 3 * w1;
+  int t = 0;
+  for(; t + 8 <= n; t += 8)
+  {
+    const float *const g = green + 2 * t;
+    const float *const vh = VH_Dir + 2 * t;
+    const __m256 VH_Neighbourhood = quarter * (_ld2_avx2(vh - w1 - 1) + _ld2_avx2(vh - w1 + 1)
+                                               + _ld2_avx2(vh + w1 - 1) + _ld2_avx2(vh + w1 + 1));
+    const __m256 VH_Disc = _disc_avx2(_ld2_avx2(vh), VH_Neighbourhood);
+
+    const __m256 g0 = _ld2_avx2(g);
+    const __m256 N1 = eps + _abs_avx2(g0 - _ld2_avx2(g - w2));
+    const __m256 S1 = eps + _abs_avx2(g0 - _ld2_avx2(g + w2));
+    const __m256 W1 = eps + _abs_avx2(g0 - _ld2_avx2(g - 2));
+    const __m256 E1 = eps + _abs_avx2(g0 - _ld2_avx2(g + 2));
+    const __m256 gn = _ld2_avx2(g - w1), gs = _ld2_avx2(g + w1), gw = _ld2_avx2(g - 1), ge = _ld2_avx2(g + 1);
+
+    float *const rgbc[2] = { red + 2 * t, blue + 2 * t };
+    for(int k = 0; k < 2; k++)
+    {
+      const float *const c = rgbc[k];
+      const __m256 cn = _ld2_avx2(c - w1), cs = _ld2_avx2(c + w1), cw = _ld2_avx2(c - 1), ce = _ld2_avx2(c + 1);
+      const __m256 SNabs = _abs_avx2(cn - cs);
+      const __m256 EWabs = _abs_avx2(cw - ce);
+
+      // cardinal gradients
+      const __m256 N_Grad = N1 + SNabs + _abs_avx2(cn - _ld2_avx2(c - w3));
+      const __m256 S_Grad = S1 + SNabs + _abs_avx2(cs - _ld2_avx2(c + w3));
+      const __m256 W_Grad = W1 + EWabs + _abs_avx2(cw - _ld2_avx2(c - 3));
+      const __m256 E_Grad = E1 + EWabs + _abs_avx2(ce - _ld2_avx2(c + 3));
+
+      // cardinal colour differences
+      const __m256 N_Est = cn - gn;
+      const __m256 S_Est = cs - gs;
+      const __m256 W_Est = cw - gw;
+      const __m256 E_Est = ce - ge;
+
+      const __m256 V_Est = (N_Grad * S_Est + S_Grad * N_Est) / (N_Grad + S_Grad);
+      const __m256 H_Est = (E_Grad * W_Est + W_Grad * E_Est) / (E_Grad + W_Grad);
+
+      _st2_avx2(rgbc[k], g0 + _interp_avx2(VH_Disc, H_Est, V_Est));
+    }
+  }
+  return t;
+}
+
+DT_TARGET_AVX2 static int _amaze_gradients_avx2(float *const dirwts0,
+                                                float *const dirwts1,
+                                                float *const delhvsqsum,
+                                                const float *const cfa,
+                                                const int n,
+                                                const int v1)
+{
+  const __m256 eps = _mm256_set1_ps(AMAZE_EPS);
+  const int v2 = 2 * v1;
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+  {
+    const float *const c = cfa + i;
+    const __m256 c0 = _ld_avx2(c);
+    const __m256 delh = _abs_avx2(_ld_avx2(c + 1) - _ld_avx2(c - 1));
+    const __m256 delv = _abs_avx2(_ld_avx2(c + v1) - _ld_avx2(c - v1));
+    _mm256_storeu_ps(dirwts0 + i, eps + _abs_avx2(_ld_avx2(c + v2) - c0) + _abs_avx2(c0 - _ld_avx2(c - v2)) + delv);
+    _mm256_storeu_ps(dirwts1 + i, eps + _abs_avx2(_ld_avx2(c + 2) - c0) + _abs_avx2(c0 - _ld_avx2(c - 2)) + delh);
+    _mm256_storeu_ps(delhvsqsum + i, delh * delh + delv * delv);
+  }
+  return i;
+}
+
+// the adaptive ratio guess if the ratio is close enough to 1, the Hamilton-Adams one otherwise
+DT_TARGET_AVX2 static inline __m256 _amaze_ar_avx2(const __m256 c0, const __m256 ratio, const __m256 ha)
+{
+  const __m256 close = _mm256_cmp_ps(_abs_avx2(_mm256_set1_ps(1.0f) - ratio), _mm256_set1_ps(AMAZE_ARTHRESH), _CMP_LT_OQ);
+  return _mm256_blendv_ps(ha, c0 * ratio, close);
+}
+
+DT_TARGET_AVX2 static int _amaze_color_diffs_avx2(float *const vcd,
+                                                  float *const hcd,
+                                                  float *const vcdalt,
+                                                  float *const hcdalt,
+                                                  float *const dgintv,
+                                                  float *const dginth,
+                                                  const float *const cfa,
+                                                  const float *const dirwts0,
+                                                  const float *const dirwts1,
+                                                  const int n,
+                                                  const int v1,
+                                                  const gboolean fcswitch,
+                                                  const float clip_pt8)
+{
+  const __m256 eps = _mm256_set1_ps(AMAZE_EPS);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 clip = _mm256_set1_ps(clip_pt8);
+  // lanes where the colour difference is cfa - G
+  const __m256i odd = _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1);
+  const __m256 minus_g = _mm256_castsi256_ps(fcswitch ? _mm256_xor_si256(odd, _mm256_set1_epi32(-1)) : odd);
+  const int v2 = 2 * v1;
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+  {
+    const float *const c = cfa + i;
+    const float *const d0 = dirwts0 + i;
+    const float *const d1 = dirwts1 + i;
+    const __m256 c0 = _ld_avx2(c);
+    const __m256 cu1 = _ld_avx2(c - v1), cu2 = _ld_avx2(c - v2), cd1 = _ld_avx2(c + v1), cd2 = _ld_avx2(c + v2);
+    const __m256 cl1 = _ld_avx2(c - 1), cl2 = _ld_avx2(c - 2), cr1 = _ld_avx2(c + 1), cr2 = _ld_avx2(c + 2);
+    const __m256 d0c = _ld_avx2(d0), d0u = _ld_avx2(d0 - v2), d0d = _ld_avx2(d0 + v2);
+    const __m256 d1c = _ld_avx2(d1), d1l = _ld_avx2(d1 - 2), d1r = _ld_avx2(d1 + 2);
+
+    // colour ratios in each cardinal direction
+    const __m256 cru = cu1 * (d0u + d0c) / (d0u * (eps + c0) + d0c * (eps + cu2));
+    const __m256 crd = cd1 * (d0d + d0c) / (d0d * (eps + c0) + d0c * (eps + cd2));
+    const __m256 crl = cl1 * (d1l + d1c) / (d1l * (eps + c0) + d1c * (eps + cl2));
+    const __m256 crr = cr1 * (d1r + d1c) / (d1r * (eps + c0) + d1c * (eps + cr2));
+
+    // G interpolated in vert/hor directions using Hamilton-Adams method
+    const __m256 guha = cu1 + half * (c0 - cu2);
+    const __m256 gdha = cd1 + half * (c0 - cd2);
+    const __m256 glha = cl1 + half * (c0 - cl2);
+    const __m256 grha = cr1 + half * (c0 - cr2);
+
+    // G interpolated in vert/hor directions using adaptive ratios
+    __m256 guar = _amaze_ar_avx2(c0, cru, guha);
+    __m256 gdar = _amaze_ar_avx2(c0, crd, gdha);
+    __m256 glar = _amaze_ar_avx2(c0, crl, glha);
+    __m256 grar = _amaze_ar_avx2(c0, crr, grha);
+
+    // adaptive weights for vertical/horizontal directions
+    const __m256 hwt = _ld_avx2(d1 - 1) / (_ld_avx2(d1 - 1) + _ld_avx2(d1 + 1));
+    const __m256 vwt = _ld_avx2(d0 - v1) / (_ld_avx2(d0 + v1) + _ld_avx2(d0 - v1));
+
+    const __m256 Gintvha = vwt * gdha + (one - vwt) * guha;
+    const __m256 Ginthha = hwt * grha + (one - hwt) * glha;
+    const __m256 Gintvar = vwt * gdar + (one - vwt) * guar;
+    const __m256 Ginthar = hwt * grar + (one - hwt) * glar;
+
+    // interpolated colour differences
+    const __m256 vdiffalt = _mm256_blendv_ps(Gintvha - c0, c0 - Gintvha, minus_g);
+    const __m256 hdiffalt = _mm256_blendv_ps(Ginthha - c0, c0 - Ginthha, minus_g);
+    __m256 vdiff = _mm256_blendv_ps(Gintvar - c0, c0 - Gintvar, minus_g);
+    __m256 hdiff = _mm256_blendv_ps(Ginthar - c0, c0 - Ginthar, minus_g);
+
+    // use HA if highlights are (nearly) clipped
+    const __m256 clipped = _mm256_or_ps(_mm256_cmp_ps(c0, clip, _CMP_GT_OQ),
+                                        _mm256_or_ps(_mm256_cmp_ps(Gintvha, clip, _CMP_GT_OQ),
+                                                     _mm256_cmp_ps(Ginthha, clip, _CMP_GT_OQ)));
+    guar = _mm256_blendv_ps(guar, guha, clipped);
+    gdar = _mm256_blendv_ps(gdar, gdha, clipped);
+    glar = _mm256_blendv_ps(glar, glha, clipped);
+    grar = _mm256_blendv_ps(grar, grha, clipped);
+    vdiff = _mm256_blendv_ps(vdiff, vdiffalt, clipped);
+    hdiff = _mm256_blendv_ps(hdiff, hdiffalt, clipped);
+
+    _mm256_storeu_ps(vcd + i, vdiff);
+    _mm256_storeu_ps(hcd + i, hdiff);
+    _mm256_storeu_ps(vcdalt + i, vdiffalt);
+    _mm256_storeu_ps(hcdalt + i, hdiffalt);
+
+    // differences of interpolations in opposite directions
+    const __m256 vha = guha - gdha, var = guar - gdar, hha = glha - grha, har = glar - grar;
+    _mm256_storeu_ps(dgintv + i, _mm256_min_ps(vha * vha, var * var));
+    _mm256_storeu_ps(dginth + i, _mm256_min_ps(hha * hha, har * har));
+  }
+  return i;
+}
+
+DT_TARGET_AVX2 static int _markesteijn_homogeneity_avx2(uint8_t *const homo,
+                                                        const float *const drv,
+                                                        const int ndir,
+                                                        const int n,
+                                                        const int stride,
+                                                        const size_t plane)
+{
+  const __m256 eight = _mm256_set1_ps(8.0f);
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+  {
+    // the operand order of min keeps the plain code's behaviour for NaN
+    __m256 tr = _mm256_set1_ps(FLT_MAX);
+    for(int d = 0; d < ndir; d++) tr = _mm256_min_ps(_ld_avx2(drv + d * plane + i), tr);
+    tr = tr * eight;
+    for(int d = 0; d < ndir; d++)
+    {
+      const float *const dx = drv + d * plane + i;
+      __m256i count = _mm256_setzero_si256();
+      // a true comparison is all ones, that is -1
+      for(int v = -1; v <= 1; v++)
+        for(int h = -1; h <= 1; h++)
+          count = _mm256_sub_epi32(count, _mm256_castps_si256(_mm256_cmp_ps(_ld_avx2(dx + v * stride + h), tr,
+                                                                            _CMP_LE_OQ)));
+      const __m128i c16 = _mm_packus_epi32(_mm256_castsi256_si128(count), _mm256_extracti128_si256(count, 1));
+      _mm_storel_epi64((__m128i *)(homo + d * plane + i), _mm_packus_epi16(c16, c16));
+    }
+  }
+  return i;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+/*  AVX-512, 16 sensels at a time                                                                 */
+/* ---------------------------------------------------------------------------------------------- */
+
+DT_TARGET_AVX512 static inline __m512 _ld_avx512(const float *const p)
+{
+  return _mm512_loadu_ps(p);
+}
+
+// p[0], p[2] ... p[30], reading nothing beyond p[30]
+DT_TARGET_AVX512 static inline __m512 _ld2_avx512(const float *const p)
+{
+  const __m512i idx = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 17, 19, 21, 23, 25, 27, 29, 31);
+  return _mm512_permutex2var_ps(_mm512_loadu_ps(p), idx, _mm512_loadu_ps(p + 15));
+}
+
+// to p[0], p[2] ... p[30], the odd sensels are left alone
+DT_TARGET_AVX512 static inline void _st2_avx512(float *const p, const __m512 v)
+{
+  const __m512i lo = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+  const __m512i hi = _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15);
+  _mm512_mask_storeu_ps(p, 0x5555, _mm512_permutexvar_ps(lo, v));
+  _mm512_mask_storeu_ps(p + 16, 0x5555, _mm512_permutexvar_ps(hi, v));
+}
+
+DT_TARGET_AVX512 static inline __m512 _abs_avx512(const __m512 x)
+{
+  return _mm512_abs_ps(x);
+}
+
+DT_TARGET_AVX512 static inline __m512 _disc_avx512(const __m512 central, const __m512 neighbourhood)
+{
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __mmask16 further
+      = _mm512_cmp_ps_mask(_abs_avx512(half - central), _abs_avx512(half - neighbourhood), _CMP_LT_OQ);
+  return _mm512_mask_blend_ps(further, central, neighbourhood);
+}
+
+DT_TARGET_AVX512 static inline __m512 _interp_avx512(const __m512 a, const __m512 b, const __m512 c)
+{
+  return a * (b - c) + c;
+}
+
+DT_TARGET_AVX512 static int _rcd_hpf_avx512(float *const out, const float *const cfa, const int n, const int step)
+{
+  const __m512 three = _mm512_set1_ps(3.0f);
+  const __m512 six = _mm512_set1_ps(6.0f);
+  int i = 0;
+  for(; i + 16 <= n; i += 16)
+  {
+    const float *const c = cfa + i;
+    const __m512 hpf = (_ld_avx512(c - 3 * step) - _ld_avx512(c - step) - _ld_avx512(c + step) + _ld_avx512(c + 3 * step))
+                       - three * (_ld_avx512(c - 2 * step) + _ld_avx512(c + 2 * step)) + six * _ld_avx512(c);
+    _mm512_storeu_ps(out + i, hpf * hpf);
+  }
+  return i;
+}
+
+DT_TARGET_AVX512 static int _rcd_vh_dir_avx512(float *const VH_Dir,
+                                               const float *const V0,
+                                               const float *const V1,
+                                               const float *const V2,
+                                               const float *const H,
+                                               const int n)
+{
+  const __m512 epssq = _mm512_set1_ps(RCD_EPSSQ);
+  int i = 0;
+  for(; i + 16 <= n; i += 16)
+  {
+    const __m512 V_Stat = _mm512_max_ps(epssq, _ld_avx512(V0 + i) + _ld_avx512(V1 + i) + _ld_avx512(V2 + i));
+    const __m512 H_Stat = _mm512_max_ps(epssq, _ld_avx512(H + i) + _ld_avx512(H + i + 1) + _ld_avx512(H + i + 2));
+    _mm512_storeu_ps(VH_Dir + i, V_Stat / (V_Stat + H_Stat));
+  }
+  return i;
+}
+
+DT_TARGET_AVX512 static int _rcd_green_avx512(float *const green,
+                                              const float *const cfa,
+                                              const float *const lpf,
+                                              const float *const VH_Dir,
+                                              const int n,
+                                              const int w1)
+{
+  const __m512 eps = _mm512_set1_ps(RCD_EPS);
+  const __m512 quarter = _mm512_set1_ps(0.25f);
+  const int w2 = 2 * w1, w3 = 3 * w1, w4 = 4 * w1;
+  int t = 0;
+  for(; t + 16 <= n; t += 16)
+  {
+    const float *const c = cfa + 2 * t;
+    const float *const vh = VH_Dir + 2 * t;
+    const float *const lp = lpf + t;
+    const __m512 cfai = _ld2_avx512(c);
+    const __m512 n1 = _ld2_avx512(c - w1), n2 = _ld2_avx512(c - w2), n3 = _ld2_avx512(c - w3), n4 = _ld2_avx512(c - w4);
+    const __m512 s1 = _ld2_avx512(c + w1), s2 = _ld2_avx512(c + w2), s3 = _ld2_avx512(c + w3), s4 = _ld2_avx512(c + w4);
+    const __m512 w_1 = _ld2_avx512(c - 1), w_2 = _ld2_avx512(c - 2), w_3 = _ld2_avx512(c - 3), w_4 = _ld2_avx512(c - 4);
+    const __m512 e1 = _ld2_avx512(c + 1), e2 = _ld2_avx512(c + 2), e3 = _ld2_avx512(c + 3), e4 = _ld2_avx512(c + 4);
+
+    const __m512 ns = _abs_avx512(n1 - s1);
+    const __m512 we = _abs_avx512(w_1 - e1);
+    const __m512 N_Grad = eps + ns + _abs_avx512(cfai - n2) + _abs_avx512(n1 - n3) + _abs_avx512(n2 - n4);
+    const __m512 S_Grad = eps + ns + _abs_avx512(cfai - s2) + _abs_avx512(s1 - s3) + _abs_avx512(s2 - s4);
+    const __m512 W_Grad = eps + we + _abs_avx512(cfai - w_2) + _abs_avx512(w_1 - w_3) + _abs_avx512(w_2 - w_4);
+    const __m512 E_Grad = eps + we + _abs_avx512(cfai - e2) + _abs_avx512(e1 - e3) + _abs_avx512(e2 - e4);
+
+    const __m512 lpfi = _ld_avx512(lp);
+    const __m512 lpfi2 = lpfi + lpfi;
+    const __m512 N_Est = n1 * lpfi2 / (eps + lpfi + _ld_avx512(lp - w1));
+    const __m512 S_Est = s1 * lpfi2 / (eps + lpfi + _ld_avx512(lp + w1));
+    const __m512 W_Est = w_1 * lpfi2 / (eps + lpfi + _ld_avx512(lp - 1));
+    const __m512 E_Est = e1 * lpfi2 / (eps + lpfi + _ld_avx512(lp + 1));
+
+    const __m512 V_Est = (S_Grad * N_Est + N_Grad * S_Est) / (N_Grad + S_Grad);
+    const __m512 H_Est = (W_Grad * E_Est + E_Grad * W_Est) / (E_Grad + W_Grad);
+
+    const __m512 VH_Neighbourhood = quarter * (_ld2_avx512(vh - w1 - 1) + _ld2_avx512(vh - w1 + 1)
+                                               + _ld2_avx512(vh + w1 - 1) + _ld2_avx512(vh + w1 + 1));
+    const __m512 VH_Disc = _disc_avx512(_ld2_avx512(vh), VH_Neighbourhood);
+
+    _st2_avx512(green + 2 * t, _interp_avx512(VH_Disc, H_Est, V_Est));
+  }
+  return t;
+}
+
+DT_TARGET_AVX512 static int _rcd_rb_at_rb_avx512(float *const rgbc,
+                                                 const float *const green,
+                                                 const float *const PQ_Dir,
+                                                 const float *const PQ_up,
+                                                 const float *const PQ_down,
+                                                 const int n,
+                                                 const int w1)
+{
+  const __m512 eps = _mm512_set1_ps(RCD_EPS);
+  const __m512 quarter = _mm512_set1_ps(0.25f);
+  const int w2 = 2 * w1, w3 = 3 * w1;
+  int t = 0;
+  for(; t + 16 <= n; t += 16)
+  {
+    const float *const c = rgbc + 2 * t;
+    const float *const g = green + 2 * t;
+    const __m512 PQ_Neighbourhood = quarter * (_ld_avx512(PQ_up + t) + _ld_avx512(PQ_up + t + 1)
+                                               + _ld_avx512(PQ_down + t) + _ld_avx512(PQ_down + t + 1));
+    const __m512 PQ_Disc = _disc_avx512(_ld_avx512(PQ_Dir + t), PQ_Neighbourhood);
+
+    const __m512 nw = _ld2_avx512(c - w1 - 1), ne = _ld2_avx512(c - w1 + 1);
+    const __m512 sw = _ld2_avx512(c + w1 - 1), se = _ld2_avx512(c + w1 + 1);
+    const __m512 g0 = _ld2_avx512(g);
+
+    const __m512 NW_Grad = eps + _abs_avx512(nw - se) + _abs_avx512(nw - _ld2_avx512(c - w3 - 3)) + _abs_avx512(g0 - _ld2_avx512(g - w2 - 2));
+    const __m512 NE_Grad = eps + _abs_avx512(ne - sw) + _abs_avx512(ne - _ld2_avx512(c - w3 + 3)) + _abs_avx512(g0 - _ld2_avx512(g - w2 + 2));
+    const __m512 SW_Grad = eps + _abs_avx512(ne - sw) + _abs_avx512(sw - _ld2_avx512(c + w3 - 3)) + _abs_avx512(g0 - _ld2_avx512(g + w2 - 2));
+    const __m512 SE_Grad = eps + _abs_avx512(nw - se) + _abs_avx512(se - _ld2_avx512(c + w3 + 3)) + _abs_avx512(g0 - _ld2_avx512(g + w2 + 2));
+
+    const __m512 NW_Est = nw - _ld2_avx512(g - w1 - 1);
+    const __m512 NE_Est = ne - _ld2_avx512(g - w1 + 1);
+    const __m512 SW_Est = sw - _ld2_avx512(g + w1 - 1);
+    const __m512 SE_Est = se - _ld2_avx512(g + w1 + 1);
+
+    const __m512 P_Est = (NW_Grad * SE_Est + SE_Grad * NW_Est) / (NW_Grad + SE_Grad);
+    const __m512 Q_Est = (NE_Grad * SW_Est + SW_Grad * NE_Est) / (NE_Grad + SW_Grad);
+
+    _st2_avx512(rgbc + 2 * t, g0 + _interp_avx512(PQ_Disc, Q_Est, P_Est));
+  }
+  return t;
+}
+
+DT_TARGET_AVX512 static int _rcd_rb_at_green_avx512(float *const red,
+                                                    float *const blue,
+                                                    const float *const green,
+                                                    const float *const VH_Dir,
+                                                    const int n,
+                                                    const int w1)
+{
+  const __m512 eps = _mm512_set1_ps(RCD_EPS);
+  const __m512 quarter = _mm512_set1_ps(0.25f);
+  const int w2 = 2 * w1, w3 = 3 * w1;
+  int t = 0;
+  for(; t + 16 <= n; t += 16)
+  {
+    const float *const g = green + 2 * t;
+    const float *const vh = VH_Dir + 2 * t;
+    const __m512 VH_Neighbourhood = quarter * (_ld2_avx512(vh - w1 - 1) + _ld2_avx512(vh - w1 + 1)
+                                               + _ld2_avx512(vh + w1 - 1) + _ld2_avx512(vh + w1 + 1));
+    const __m512 VH_Disc = _disc_avx512(_ld2_avx512(vh), VH_Neighbourhood);
+
+    const __m512 g0 = _ld2_avx512(g);
+    const __m512 N1 = eps + _abs_avx512(g0 - _ld2_avx512(g - w2));
+    const __m512 S1 = eps + _abs_avx512(g0 - _ld2_avx512(g + w2));
+    const __m512 W1 = eps + _abs_avx512(g0 - _ld2_avx512(g - 2));
+    const __m512 E1 = eps + _abs_avx512(g0 - _ld2_avx512(g + 2));
+    const __m512 gn = _ld2_avx512(g - w1), gs = _ld2_avx512(g + w1), gw = _ld2_avx512(g - 1), ge = _ld2_avx512(g + 1);
+
+    float *const rgbc[2] = { red + 2 * t, blue + 2 * t };
+    for(int k = 0; k < 2; k++)
+    {
+      const float *const c = rgbc[k];
+      const __m512 cn = _ld2_avx512(c - w1), cs = _ld2_avx512(c + w1), cw = _ld2_avx512(c - 1), ce = _ld2_avx512(c + 1);
+      const __m512 SNabs = _abs_avx512(cn - cs);
+      const __m512 EWabs = _abs_avx512(cw - ce);
+
+      const __m512 N_Grad = N1 + SNabs + _abs_avx512(cn - _ld2_avx512(c - w3));
+      const __m512 S_Grad = S1 + SNabs + _abs_avx512(cs - _ld2_avx512(c + w3));
+      const __m512 W_Grad = W1 + EWabs + _abs_avx512(cw - _ld2_avx512(c - 3));
+      const __m512 E_Grad = E1 + EWabs + _abs_avx512(ce - _ld2_avx512(c + 3));
+
+      const __m512 N_Est = cn - gn;
+      const __m512 S_Est = cs - gs;
+      const __m512 W_Est = cw - gw;
+      const __m512 E_Est = ce - ge;
+
+      const __m512 V_Est = (N_Grad * S_Est + S_Grad * N_Est) / (N_Grad + S_Grad);
+      const __m512 H_Est = (E_Grad * W_Est + W_Grad * E_Est) / (E_Grad + W_Grad);
+
+      _st2_avx512(rgbc[k], g0 + _interp_avx512(VH_Disc, H_Est, V_Est));
+    }
+  }
+  return t;
+}
+
+DT_TARGET_AVX512 static int _amaze_gradients_avx512(float *const dirwts0,
+                                                    float *const dirwts1,
+                                                    float *const delhvsqsum,
+                                                    const float *const cfa,
+                                                    const int n,
+                                                    const int v1)
+{
+  const __m512 eps = _mm512_set1_ps(AMAZE_EPS);
+  const int v2 = 2 * v1;
+  int i = 0;
+  for(; i + 16 <= n; i += 16)
+  {
+    const float *const c = cfa + i;
+    const __m512 c0 = _ld_avx512(c);
+    const __m512 delh = _abs_avx512(_ld_avx512(c + 1) - _ld_avx512(c - 1));
+    const __m512 delv = _abs_avx512(_ld_avx512(c + v1) - _ld_avx512(c - v1));
+    _mm512_storeu_ps(dirwts0 + i, eps + _abs_avx512(_ld_avx512(c + v2) - c0) + _abs_avx512(c0 - _ld_avx512(c - v2)) + delv);
+    _mm512_storeu_ps(dirwts1 + i, eps + _abs_avx512(_ld_avx512(c + 2) - c0) + _abs_avx512(c0 - _ld_avx512(c - 2)) + delh);
+    _mm512_storeu_ps(delhvsqsum + i, delh * delh + delv * delv);
+  }
+  return i;
+}
+
+DT_TARGET_AVX512 static inline __m512 _amaze_ar_avx512(const __m512 c0, const __m512 ratio, const __m512 ha)
+{
+  const __mmask16 close = _mm512_cmp_ps_mask(_abs_avx512(_mm512_set1_ps(1.0f) - ratio), _mm512_set1_ps(AMAZE_ARTHRESH), _CMP_LT_OQ);
+  return _mm512_mask_blend_ps(close, ha, c0 * ratio);
+}
+
+DT_TARGET_AVX512 static int _amaze_color_diffs_avx512(float *const vcd,
+                                                      float *const hcd,
+                                                      float *const vcdalt,
+                                                      float *const hcdalt,
+                                                      float *const dgintv,
+                                                      float *const dginth,
+                                                      const float *const cfa,
+                                                      const float *const dirwts0,
+                                                      const float *const dirwts1,
+                                                      const int n,
+                                                      const int v1,
+                                                      const gboolean fcswitch,
+                                                      const float clip_pt8)
+{
+  const __m512 eps = _mm512_set1_ps(AMAZE_EPS);
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512 clip = _mm512_set1_ps(clip_pt8);
+  // lanes where the colour difference is cfa - G
+  const __mmask16 minus_g = fcswitch ? 0x5555 : 0xaaaa;
+  const int v2 = 2 * v1;
+  int i = 0;
+  for(; i + 16 <= n; i += 16)
+  {
+    const float *const c = cfa + i;
+    const float *const d0 = dirwts0 + i;
+    const float *const d1 = dirwts1 + i;
+    const __m512 c0 = _ld_avx512(c);
+    const __m512 cu1 = _ld_avx512(c - v1), cu2 = _ld_avx512(c - v2), cd1 = _ld_avx512(c + v1), cd2 = _ld_avx512(c + v2);
+    const __m512 cl1 = _ld_avx512(c - 1), cl2 = _ld_avx512(c - 2), cr1 = _ld_avx512(c + 1), cr2 = _ld_avx512(c + 2);
+    const __m512 d0c = _ld_avx512(d0), d0u = _ld_avx512(d0 - v2), d0d = _ld_avx512(d0 + v2);
+    const __m512 d1c = _ld_avx512(d1), d1l = _ld_avx512(d1 - 2), d1r = _ld_avx512(d1 + 2);
+
+    const __m512 cru = cu1 * (d0u + d0c) / (d0u * (eps + c0) + d0c * (eps + cu2));
+    const __m512 crd = cd1 * (d0d + d0c) / (d0d * (eps + c0) + d0c * (eps + cd2));
+    const __m512 crl = cl1 * (d1l + d1c) / (d1l * (eps + c0) + d1c * (eps + cl2));
+    const __m512 crr = cr1 * (d1r + d1c) / (d1r * (eps + c0) + d1c * (eps + cr2));
+
+    const __m512 guha = cu1 + half * (c0 - cu2);
+    const __m512 gdha = cd1 + half * (c0 - cd2);
+    const __m512 glha = cl1 + half * (c0 - cl2);
+    const __m512 grha = cr1 + half * (c0 - cr2);
+
+    __m512 guar = _amaze_ar_avx512(c0, cru, guha);
+    __m512 gdar = _amaze_ar_avx512(c0, crd, gdha);
+    __m512 glar = _amaze_ar_avx512(c0, crl, glha);
+    __m512 grar = _amaze_ar_avx512(c0, crr, grha);
+
+    const __m512 hwt = _ld_avx512(d1 - 1) / (_ld_avx512(d1 - 1) + _ld_avx512(d1 + 1));
+    const __m512 vwt = _ld_avx512(d0 - v1) / (_ld_avx512(d0 + v1) + _ld_avx512(d0 - v1));
+
+    const __m512 Gintvha = vwt * gdha + (one - vwt) * guha;
+    const __m512 Ginthha = hwt * grha + (one - hwt) * glha;
+    const __m512 Gintvar = vwt * gdar + (one - vwt) * guar;
+    const __m512 Ginthar = hwt * grar + (one - hwt) * glar;
+
+    const __m512 vdiffalt = _mm512_mask_blend_ps(minus_g, Gintvha - c0, c0 - Gintvha);
+    const __m512 hdiffalt = _mm512_mask_blend_ps(minus_g, Ginthha - c0, c0 - Ginthha);
+    __m512 vdiff = _mm512_mask_blend_ps(minus_g, Gintvar - c0, c0 - Gintvar);
+    __m512 hdiff = _mm512_mask_blend_ps(minus_g, Ginthar - c0, c0 - Ginthar);
+
+    const __mmask16 clipped = _mm512_cmp_ps_mask(c0, clip, _CMP_GT_OQ)
+                              | _mm512_cmp_ps_mask(Gintvha, clip, _CMP_GT_OQ)
+                              | _mm512_cmp_ps_mask(Ginthha, clip, _CMP_GT_OQ);
+    guar = _mm512_mask_blend_ps(clipped, guar, guha);
+    gdar = _mm512_mask_blend_ps(clipped, gdar, gdha);
+    glar = _mm512_mask_blend_ps(clipped, glar, glha);
+    grar = _mm512_mask_blend_ps(clipped, grar, grha);
+    vdiff = _mm512_mask_blend_ps(clipped, vdiff, vdiffalt);
+    hdiff = _mm512_mask_blend_ps(clipped, hdiff, hdiffalt);
+
+    _mm512_storeu_ps(vcd + i, vdiff);
+    _mm512_storeu_ps(hcd + i, hdiff);
+    _mm512_storeu_ps(vcdalt + i, vdiffalt);
+    _mm512_storeu_ps(hcdalt + i, hdiffalt);
+
+    const __m512 vha = guha - gdha, var = guar - gdar, hha = glha - grha, har = glar - grar;
+    _mm512_storeu_ps(dgintv + i, _mm512_min_ps(vha * vha, var * var));
+    _mm512_storeu_ps(dginth + i, _mm512_min_ps(hha * hha, har * har));
+  }
+  return i;
+}
+
+DT_TARGET_AVX512 static int _markesteijn_homogeneity_avx512(uint8_t *const homo,
+                                                            const float *const drv,
+                                                            const int ndir,
+                                                            const int n,
+                                                            const int stride,
+                                                            const size_t plane)
+{
+  const __m512 eight = _mm512_set1_ps(8.0f);
+  const __m512i one = _mm512_set1_epi32(1);
+  int i = 0;
+  for(; i + 16 <= n; i += 16)
+  {
+    __m512 tr = _mm512_set1_ps(FLT_MAX);
+    for(int d = 0; d < ndir; d++) tr = _mm512_min_ps(_ld_avx512(drv + d * plane + i), tr);
+    tr = tr * eight;
+    for(int d = 0; d < ndir; d++)
+    {
+      const float *const dx = drv + d * plane + i;
+      __m512i count = _mm512_setzero_si512();
+      for(int v = -1; v <= 1; v++)
+        for(int h = -1; h <= 1; h++)
+          count = _mm512_mask_add_epi32(count, _mm512_cmp_ps_mask(_ld_avx512(dx + v * stride + h), tr, _CMP_LE_OQ),
+                                        count, one);
+      _mm_storeu_si128((__m128i *)(homo + d * plane + i), _mm512_cvtepi32_epi8(count));
+    }
+  }
+  return i;
+}
+
+#endif // DT_HAVE_AVX_KERNELS
+
+gboolean dt_demosaic_simd_available(void)
+{
+#ifdef DT_HAVE_AVX_KERNELS
+  return darktable.codepath.AVX2 || darktable.codepath.AVX512;
+#else
+  return FALSE;
+#endif
+}
+
+#ifdef DT_HAVE_AVX_KERNELS
+#define DT_DEMOSAIC_SIMD_DISPATCH(kernel, ...)                                                        \
+  if(darktable.codepath.AVX512) return kernel##_avx512(__VA_ARGS__);                                  \
+  if(darktable.codepath.AVX2) return kernel##_avx2(__VA_ARGS__);
+#else
+#define DT_DEMOSAIC_SIMD_DISPATCH(kernel, ...)
+#endif
+
+int dt_rcd_simd_hpf(float *const out,
+                    const float *const cfa,
+                    const int n,
+                    const int step)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_rcd_hpf, out, cfa, n, step)
+  return 0;
+}
+
+int dt_rcd_simd_vh_dir(float *const VH_Dir,
+                       const float *const V0,
+                       const float *const V1,
+                       const float *const V2,
+                       const float *const H,
+                       const int n)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_rcd_vh_dir, VH_Dir, V0, V1, V2, H, n)
+  return 0;
+}
+
+int dt_rcd_simd_green(float *const green,
+                      const float *const cfa,
+                      const float *const lpf,
+                      const float *const VH_Dir,
+                      const int n,
+                      const int stride)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_rcd_green, green, cfa, lpf, VH_Dir, n, stride)
+  return 0;
+}
+
+int dt_rcd_simd_rb_at_rb(float *const rgbc,
+                         const float *const green,
+                         const float *const PQ_Dir,
+                         const float *const PQ_up,
+                         const float *const PQ_down,
+                         const int n,
+                         const int stride)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_rcd_rb_at_rb, rgbc, green, PQ_Dir, PQ_up, PQ_down, n, stride)
+  return 0;
+}
+
+int dt_rcd_simd_rb_at_green(float *const red,
+                            float *const blue,
+                            const float *const green,
+                            const float *const VH_Dir,
+                            const int n,
+                            const int stride)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_rcd_rb_at_green, red, blue, green, VH_Dir, n, stride)
+  return 0;
+}
+
+int dt_amaze_simd_gradients(float *const dirwts0,
+                            float *const dirwts1,
+                            float *const delhvsqsum,
+                            const float *const cfa,
+                            const int n,
+                            const int stride)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_amaze_gradients, dirwts0, dirwts1, delhvsqsum, cfa, n, stride)
+  return 0;
+}
+
+int dt_amaze_simd_color_diffs(float *const vcd,
+                              float *const hcd,
+                              float *const vcdalt,
+                              float *const hcdalt,
+                              float *const dgintv,
+                              float *const dginth,
+                              const float *const cfa,
+                              const float *const dirwts0,
+                              const float *const dirwts1,
+                              const int n,
+                              const int stride,
+                              const gboolean fcswitch,
+                              const float clip_pt8)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_amaze_color_diffs, vcd, hcd, vcdalt, hcdalt, dgintv, dginth,
+                            cfa, dirwts0, dirwts1, n, stride, fcswitch, clip_pt8)
+  return 0;
+}
+
+int dt_markesteijn_simd_homogeneity(uint8_t *const homo,
+                                    const float *const drv,
+                                    const int ndir,
+                                    const int n,
+                                    const int stride,
+                                    const size_t plane)
+{
+  DT_DEMOSAIC_SIMD_DISPATCH(_markesteijn_homogeneity, homo, drv, ndir, n, stride, plane)
+  return 0;
+}
+
+#undef DT_DEMOSAIC_SIMD_DISPATCH
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,122 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/**
+ * explicitly vectorized inner loops of the rcd, amaze and x-trans demosaicers.
+ *
+ * every kernel works on one row of a demosaic tile. the pointers point at the first sensel
+ * of the row to work on and `stride` is the tile width. the kernels handle as many sensels as
+ * fit into whole vectors of 8 (AVX2) or 16 (AVX-512) and return that count, the caller finishes
+ * the rest of the row with its plain loop. kernels named "every second sensel" read and write
+ * sensel 0, 2, 4... of the row only, the others walk all sensels. without a usable cpu they return 0.
+ *
+ * the results are those of the plain loops up to float rounding.
+ */
+
+/** TRUE if the cpu can run the kernels and they aren't disabled */
+gboolean dt_demosaic_simd_available(void);
+
+/** rcd steps 1.1 and 1.2: square of the high pass filter along `step` (1 or the stride) */
+int dt_rcd_simd_hpf(float *const out,
+                    const float *const cfa,
+                    const int n,
+                    const int step);
+
+/** rcd step 1.2: vertical/horizontal discrimination from three rows of vertical and one row of
+ *  horizontal high pass, H is read from one sensel left of the target to one right of it */
+int dt_rcd_simd_vh_dir(float *const VH_Dir,
+                       const float *const V0,
+                       const float *const V1,
+                       const float *const V2,
+                       const float *const H,
+                       const int n);
+
+/** rcd step 3.1, every second sensel: green at red and blue. lpf is the packed low pass at the first target */
+int dt_rcd_simd_green(float *const green,
+                      const float *const cfa,
+                      const float *const lpf,
+                      const float *const VH_Dir,
+                      const int n,
+                      const int stride);
+
+/** rcd step 4.2, every second sensel: red at blue or blue at red into rgbc. PQ_Dir, PQ_up and PQ_down
+ *  are the packed P/Q discrimination at the target and at its upper-left and lower-left neighbours */
+int dt_rcd_simd_rb_at_rb(float *const rgbc,
+                         const float *const green,
+                         const float *const PQ_Dir,
+                         const float *const PQ_up,
+                         const float *const PQ_down,
+                         const int n,
+                         const int stride);
+
+/** rcd step 4.3, every second sensel: red and blue at green */
+int dt_rcd_simd_rb_at_green(float *const red,
+                            float *const blue,
+                            const float *const green,
+                            const float *const VH_Dir,
+                            const int n,
+                            const int stride);
+
+/** amaze: horizontal and vertical gradients */
+int dt_amaze_simd_gradients(float *const dirwts0,
+                            float *const dirwts1,
+                            float *const delhvsqsum,
+                            const float *const cfa,
+                            const int n,
+                            const int stride);
+
+/** amaze: vertical and horizontal colour differences. fcswitch is that of the first sensel */
+int dt_amaze_simd_color_diffs(float *const vcd,
+                              float *const hcd,
+                              float *const vcdalt,
+                              float *const hcdalt,
+                              float *const dgintv,
+                              float *const dginth,
+                              const float *const cfa,
+                              const float *const dirwts0,
+                              const float *const dirwts1,
+                              const int n,
+                              const int stride,
+                              const gboolean fcswitch,
+                              const float clip_pt8);
+
+/** markesteijn and fdc: homogeneity maps, the count of 3x3 neighbours per direction whose derivative
+ *  is within 8 times the smallest derivative at the sensel. homo and drv point at the row of the first
+ *  direction, the maps of the ndir directions follow each other `plane` elements apart */
+int dt_markesteijn_simd_homogeneity(uint8_t *const homo,
+                                    const float *const drv,
+                                    const int ndir,
+                                    const int n,
+                                    const int stride,
+                                    const size_t plane);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -44,6 +44,12 @@
 #define DT_CACHELINE_PIXELS 4
 #endif /* __APPLE__ && __aarch64__ */
 
+// A few hot loops have explicitly vectorized AVX2 and AVX-512 versions.  They are compiled with function
+// target attributes, so they don't depend on the build flags, and picked at runtime from darktable.codepath.
+#if (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__)
+#define DT_HAVE_AVX_KERNELS 1
+#endif
+
 // Helper to force heap vectors to be aligned on 64 byte blocks to enable AVX2
 // If this is applied to a struct member and the struct is allocated on the heap, then it must be allocated
 // on a 64 byte boundary to avoid crashes or undefined behavior because of unaligned memory access.
@@ -0,0 +1,153 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/**
+ * conversion between float and IEEE 754 half floats, used to keep pixelpipe buffers
+ * in half the memory. the plain versions round to nearest even and give the same results
+ * as the F16C instructions, which are used through the _f16c versions if available.
+ */
+
+#ifndef DT_UNIT_TEST
+#include "common/darktable.h"
+#endif
+#include "common/dttypes.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef DT_HAVE_AVX_KERNELS
+#include <immintrin.h>
+#endif
+
+static inline uint16_t dt_float_to_half(const float f)
+{
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const uint16_t sign = (x >> 16) & 0x8000;
+  const uint32_t absx = x & 0x7fffffff;
+
+  // inf stays inf, nans are made quiet and keep their upper mantissa bits
+  if(absx >= 0x7f800000)
+    return sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 | ((absx >> 13) & 0x3ff) : 0);
+  // everything from 65520 on rounds to inf
+  if(absx >= 0x477ff000)
+    return sign | 0x7c00;
+
+  uint32_t h;
+  uint32_t rest;
+  uint32_t tie;
+  if(absx < 0x38800000)
+  {
+    // subnormal half, the value in units of 2^-24
+    const uint32_t e = absx >> 23;
+    if(e < 102) return sign;
+    const uint32_t shift = 126 - e;
+    const uint32_t mant = (absx & 0x7fffff) | 0x800000;
+    h = mant >> shift;
+    rest = mant & ((1u << shift) - 1);
+    tie = 1u << (shift - 1);
+  }
+  else
+  {
+    // rebias the exponent from 127 to 15, a carry of the rounding goes into the exponent
+    h = (absx - 0x38000000) >> 13;
+    rest = absx & 0x1fff;
+    tie = 0x1000;
+  }
+  if(rest > tie || (rest == tie && (h & 1))) h++;
+  return sign | h;
+}
+
+static inline float dt_half_to_float(const uint16_t h)
+{
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  const uint32_t e = (h >> 10) & 0x1f;
+  const uint32_t mant = h & 0x3ff;
+
+  uint32_t x;
+  if(e == 0x1f)
+    x = sign | 0x7f800000 | (mant ? 0x400000 : 0) | (mant << 13);
+  else if(e)
+    x = sign | ((e + 112) << 23) | (mant << 13);
+  else
+  {
+    // zero or subnormal, exact as a float
+    const float f = (float)mant * 0x1p-24f;
+    memcpy(&x, &f, sizeof(x));
+    x |= sign;
+  }
+
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static inline void dt_float_to_half_plain(uint16_t *const out,
+                                          const float *const in,
+                                          const size_t n)
+{
+  for(size_t k = 0; k < n; k++)
+    out[k] = dt_float_to_half(in[k]);
+}
+
+static inline void dt_half_to_float_plain(float *const out,
+                                          const uint16_t *const in,
+                                          const size_t n)
+{
+  for(size_t k = 0; k < n; k++)
+    out[k] = dt_half_to_float(in[k]);
+}
+
+#ifdef DT_HAVE_AVX_KERNELS
+
+__attribute__((target("avx,f16c")))
+static inline void dt_float_to_half_f16c(uint16_t *const out,
+                                         const float *const in,
+                                         const size_t n)
+{
+  const size_t nvec = n & ~(size_t)7;
+  size_t k = 0;
+  for(; k < nvec; k += 8)
+    _mm_storeu_si128((__m128i *)(out + k),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(in + k), _MM_FROUND_TO_NEAREST_INT));
+  for(; k < n; k++)
+    out[k] = dt_float_to_half(in[k]);
+}
+
+__attribute__((target("avx,f16c")))
+static inline void dt_half_to_float_f16c(float *const out,
+                                         const uint16_t *const in,
+                                         const size_t n)
+{
+  const size_t nvec = n & ~(size_t)7;
+  size_t k = 0;
+  for(; k < nvec; k += 8)
+    _mm256_storeu_ps(out + k, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in + k))));
+  for(; k < n; k++)
+    out[k] = dt_half_to_float(in[k]);
+}
+
+#endif // DT_HAVE_AVX_KERNELS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -217,7 +217,8 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   const uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  // lots of small entries hit by all threads, spread them
+  dt_cache_init_sharded(&cache->cache, sizeof(dt_image_t), max_mem, 16);
   dt_cache_set_allocate_callback(&cache->cache, &_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &_image_cache_deallocate, cache);
 
@@ -233,9 +234,9 @@ void dt_image_cache_print(dt_image_cache_t *cache)
 {
   dt_print(DT_DEBUG_ALWAYS,
            "[image cache] fill %.2f/%.2f MB (%.2f%%)\n",
-           cache->cache.cost / (1024.0 * 1024.0),
+           dt_cache_get_cost(&cache->cache) / (1024.0 * 1024.0),
            cache->cache.cost_quota / (1024.0 * 1024.0),
-           (float)cache->cache.cost / (float)cache->cache.cost_quota);
+           (float)dt_cache_get_cost(&cache->cache) / (float)cache->cache.cost_quota);
 }
 
 dt_image_t *dt_image_cache_get(dt_image_cache_t *cache,
@@ -18,6 +18,7 @@
 
 #include <stdarg.h>
 #include "common/imagebuf.h"
+#include "common/half.h"
 
 static size_t parallel_imgop_minimum = 500000;
 static size_t parallel_imgop_maxthreads = 4;
@@ -180,6 +181,66 @@ void dt_iop_image_copy(float *const __restrict__ out,
   memcpy(out, in, nfloats * sizeof(float));
 }
 
+// number of values converted per call of the half float kernels, small
+// enough to spread even a thumbnail sized buffer over a few threads
+#define DT_HALF_CHUNK 65536
+
+static inline void _to_half(uint16_t *const out,
+                            const float *const in,
+                            const size_t n)
+{
+#ifdef DT_HAVE_AVX_KERNELS
+  if(darktable.codepath.F16C)
+  {
+    dt_float_to_half_f16c(out, in, n);
+    return;
+  }
+#endif
+  dt_float_to_half_plain(out, in, n);
+}
+
+static inline void _from_half(float *const out,
+                              const uint16_t *const in,
+                              const size_t n)
+{
+#ifdef DT_HAVE_AVX_KERNELS
+  if(darktable.codepath.F16C)
+  {
+    dt_half_to_float_f16c(out, in, n);
+    return;
+  }
+#endif
+  dt_half_to_float_plain(out, in, n);
+}
+
+void dt_iop_image_to_half(uint16_t *const __restrict__ out,
+                          const float *const __restrict__ in,
+                          const size_t nfloats)
+{
+  const size_t nchunks = (nfloats + DT_HALF_CHUNK - 1) / DT_HALF_CHUNK;
+  DT_OMP_FOR(if(nfloats > parallel_imgop_minimum))
+  for(size_t chunk = 0; chunk < nchunks; chunk++)
+  {
+    const size_t start = chunk * DT_HALF_CHUNK;
+    _to_half(out + start, in + start, MIN(DT_HALF_CHUNK, nfloats - start));
+  }
+}
+
+void dt_iop_image_from_half(float *const __restrict__ out,
+                            const uint16_t *const __restrict__ in,
+                            const size_t nfloats)
+{
+  const size_t nchunks = (nfloats + DT_HALF_CHUNK - 1) / DT_HALF_CHUNK;
+  DT_OMP_FOR(if(nfloats > parallel_imgop_minimum))
+  for(size_t chunk = 0; chunk < nchunks; chunk++)
+  {
+    const size_t start = chunk * DT_HALF_CHUNK;
+    _from_half(out + start, in + start, MIN(DT_HALF_CHUNK, nfloats - start));
+  }
+}
+
+#undef DT_HALF_CHUNK
+
 // Copy an image buffer, specifying the regions of interest.  The
 // output RoI may be larger than the input RoI, in which case the
 // result is padded with zeros.  If the output RoI is
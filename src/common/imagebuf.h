@@ -119,6 +119,17 @@ void dt_iop_image_scaled_copy(float *const __restrict__ buf,
                               const size_t height,
                               const size_t ch);
 
+// Convert an image buffer of nfloats floats to half floats and back,
+// used to keep idle pixelpipe cache lines in half the memory.  The
+// round trip is exact for values representable as half floats,
+// everything else gets rounded to the nearest of them.
+void dt_iop_image_to_half(uint16_t *const __restrict__ out,
+                          const float *const __restrict__ in,
+                          const size_t nfloats);
+void dt_iop_image_from_half(float *const __restrict__ out,
+                            const uint16_t *const __restrict__ in,
+                            const size_t nfloats);
+
 // Fill an image buffer with a specified value.
 void dt_iop_image_fill(float *const buf,
                        const float fill_value,
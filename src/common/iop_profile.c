@@ -355,10 +355,10 @@ static inline int _init_unbounded_coeffs(float *const lutr,
     if(lut[k][0] >= 0.0f)
     {
       const dt_aligned_pixel_t x = { 0.7f, 0.8f, 0.9f, 1.0f };
-      const dt_aligned_pixel_t y = { extrapolate_lut(lut[k], x[0], lutsize),
-                                     extrapolate_lut(lut[k], x[1], lutsize),
-                                     extrapolate_lut(lut[k], x[2], lutsize),
-                                     extrapolate_lut(lut[k], x[3], lutsize) };
+      const dt_aligned_pixel_t y = { dt_lut_lookup_1d(lut[k], x[0], lutsize),
+                                     dt_lut_lookup_1d(lut[k], x[1], lutsize),
+                                     dt_lut_lookup_1d(lut[k], x[2], lutsize),
+                                     dt_lut_lookup_1d(lut[k], x[3], lutsize) };
       dt_iop_estimate_exp(x, y, 4, unbounded_coeffs[k]);
 
       nonlinearlut++;
@@ -383,50 +383,14 @@ static inline void _apply_tonecurves(const float *const image_in,
                                      const float *const restrict unbounded_coeffsb,
                                      const int lutsize)
 {
-  const int ch = 4;
-  const float *const lut[3] = { lutr, lutg, lutb };
+  // linear channels are marked by negative entries and just copied
+  const float *const lut[3] = { lutr[0] >= 0.0f ? lutr : NULL,
+                                lutg[0] >= 0.0f ? lutg : NULL,
+                                lutb[0] >= 0.0f ? lutb : NULL };
   const float *const unbounded_coeffs[3] =
     { unbounded_coeffsr, unbounded_coeffsg, unbounded_coeffsb };
-  const size_t stride = (size_t)ch * width * height;
 
-  // do we have any lut to apply, or is this a linear profile?
-  if((lut[0][0] >= 0.0f)
-     && (lut[1][0] >= 0.0f)
-     && (lut[2][0] >= 0.0f))
-  {
-    DT_OMP_FOR(collapse(2))
-    for(size_t k = 0; k < stride; k += ch)
-    {
-      for(int c = 0; c < 3; c++) // for_each_channel doesn't
-                                 // vectorize, and some code needs
-                                 // image_out[3] preserved
-      {
-        image_out[k + c] = (image_in[k + c] < 1.0f)
-          ? extrapolate_lut(lut[c], image_in[k + c], lutsize)
-          : eval_exp(unbounded_coeffs[c], image_in[k + c]);
-      }
-    }
-  }
-  else if((lut[0][0] >= 0.0f)
-          || (lut[1][0] >= 0.0f)
-          || (lut[2][0] >= 0.0f))
-  {
-    DT_OMP_FOR(collapse(2))
-    for(size_t k = 0; k < stride; k += ch)
-    {
-      for(int c = 0; c < 3; c++) // for_each_channel doesn't
-                                 // vectorize, and some code needs
-                                 // image_out[3] preserved
-      {
-        if(lut[c][0] >= 0.0f)
-        {
-          image_out[k + c] = (image_in[k + c] < 1.0f)
-            ? extrapolate_lut(lut[c], image_in[k + c], lutsize)
-            : eval_exp(unbounded_coeffs[c], image_in[k + c]);
-        }
-      }
-    }
-  }
+  dt_lut_apply_1d(image_out, image_in, (size_t)width * height, lut, unbounded_coeffs, lutsize);
 }
 
 
@@ -559,10 +523,9 @@ static inline void _transform_matrix_rgb
         for(size_t c = 0; c < 3; c++)
         {
           rgb[c] = (run_lut_in[c]
-                    ? ((in[c] < 1.0f)
-                       ? extrapolate_lut(profile_info_from->lut_in[c], in[c],
-                                         profile_info_from->lutsize)
-                       : eval_exp(profile_info_from->unbounded_coeffs_in[c], in[c]))
+                    ? dt_lut_lookup_1d_unbounded(profile_info_from->lut_in[c],
+                                                 profile_info_from->unbounded_coeffs_in[c],
+                                                 in[c], profile_info_from->lutsize)
                     : in[c]);
         }
       }
@@ -582,10 +545,9 @@ static inline void _transform_matrix_rgb
         for(size_t c = 0; c < 3; c++)
         {
           out[c] = (run_lut_out[c]
-                    ? ((temp[c] < 1.0f)
-                       ? extrapolate_lut(profile_info_to->lut_out[c],
-                                         temp[c], profile_info_to->lutsize)
-                       : eval_exp(profile_info_to->unbounded_coeffs_out[c], temp[c]))
+                    ? dt_lut_lookup_1d_unbounded(profile_info_to->lut_out[c],
+                                                 profile_info_to->unbounded_coeffs_out[c],
+                                                 temp[c], profile_info_to->lutsize)
                     : temp[c]);
         }
       }
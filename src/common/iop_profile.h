@@ -23,6 +23,7 @@
 #include "common/colorspaces.h"
 #include "common/file_location.h"
 #include "common/dttypes.h"
+#include "common/lut.h"
 #include "develop/imageop.h"
 
 #ifdef HAVE_CONFIG_H
@@ -252,29 +253,6 @@ gboolean dt_ioppr_transform_image_colorspace_rgb_cl
 
 /** the following must have the matrix_in and matrix_out generated */
 
-DT_OMP_DECLARE_SIMD(aligned(lut:64))
-static inline float extrapolate_lut(const float *const lut,
-                                    const float v,
-                                    const int lutsize)
-{
-  // TODO: check if optimization is worthwhile!
-  const float ft = CLAMPS(v * (lutsize - 1), 0, lutsize - 1);
-  const int t = (ft < lutsize - 2) ? ft : lutsize - 2;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-
-
-DT_OMP_DECLARE_SIMD()
-static inline float eval_exp(const float coeff[3],
-                             const float x)
-{
-  return coeff[1] * powf(x * coeff[0], coeff[2]);
-}
-
-
 DT_OMP_DECLARE_SIMD(
   aligned(rgb_in, rgb_out, unbounded_coeffs:16)
   aligned(lut:64)
@@ -288,9 +266,7 @@ static inline void dt_ioppr_apply_trc(const dt_aligned_pixel_t rgb_in,
   for(int c = 0; c < 3; c++)
   {
     rgb_out[c] = (lut[c][0] >= 0.0f)
-      ? ((rgb_in[c] < 1.0f)
-         ? extrapolate_lut(lut[c], rgb_in[c], lutsize)
-         : eval_exp(unbounded_coeffs[c], rgb_in[c]))
+      ? dt_lut_lookup_1d_unbounded(lut[c], unbounded_coeffs[c], rgb_in[c], lutsize)
       : rgb_in[c];
   }
 }
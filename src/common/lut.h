@@ -0,0 +1,410 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/**
+ * lookup tables shared by the color modules.
+ *
+ * 1D: a curve sampled at lutsize points on [0, 1], linearly interpolated. the unbounded
+ *     variant extrapolates above 1.0 with the exp fit of dt_iop_estimate_exp().
+ * 2D: a width x height table on [0, 1]^2, bilinear.
+ * 3D: a level^3 rgb clut, red varying fastest, with trilinear, tetrahedral and pyramid
+ *     interpolation of whole buffers of rgba pixels.
+ *
+ * the single value lookups are meant to be inlined in the per-pixel loops of the modules,
+ * the buffer versions are the fast paths. the AVX2 and AVX-512 lookups take one vector of
+ * values and gather from the table, see colormatrix_simd.c.
+ */
+
+#ifndef DT_UNIT_TEST
+#include "common/darktable.h"
+#endif
+#include "common/dttypes.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef DT_HAVE_AVX_KERNELS
+#include <immintrin.h>
+#endif
+
+/* ---------------------------------------------------------------------------------------------- */
+/*  1D                                                                                            */
+/* ---------------------------------------------------------------------------------------------- */
+
+/** linear interpolation in lut, x is clamped to [0, 1] */
+DT_OMP_DECLARE_SIMD(aligned(lut:64))
+static inline float dt_lut_lookup_1d(const float *const lut,
+                                     const float x,
+                                     const int lutsize)
+{
+  const float ft = fminf(fmaxf(x * (lutsize - 1), 0.0f), lutsize - 1);
+  const int t = (ft < lutsize - 2) ? ft : lutsize - 2;
+  const float f = ft - t;
+  return lut[t] * (1.0f - f) + lut[t + 1] * f;
+}
+
+/** the exp fit of a curve above 1.0, see dt_iop_estimate_exp() */
+DT_OMP_DECLARE_SIMD()
+static inline float dt_lut_extrapolate_1d(const float *const coeffs,
+                                          const float x)
+{
+  return coeffs[1] * powf(x * coeffs[0], coeffs[2]);
+}
+
+/** linear interpolation in lut for x < 1.0, only the negatives are clipped */
+DT_OMP_DECLARE_SIMD(aligned(lut:64))
+static inline float dt_lut_lookup_1d_below_1(const float *const lut,
+                                             const float x,
+                                             const int lutsize)
+{
+  // x < 1.0, so truncating sets t <= lutsize - 2 and there is no need to clamp it
+  const float ft = fmaxf(x, 0.0f) * (lutsize - 1);
+  const int t = ft;
+  const float f = ft - t;
+  return lut[t] * (1.0f - f) + lut[t + 1] * f;
+}
+
+/** the lut below 1.0 and the exp fit above */
+DT_OMP_DECLARE_SIMD(aligned(lut:64))
+static inline float dt_lut_lookup_1d_unbounded(const float *const lut,
+                                               const float *const coeffs,
+                                               const float x,
+                                               const int lutsize)
+{
+  return (x < 1.0f) ? dt_lut_lookup_1d_below_1(lut, x, lutsize) : dt_lut_extrapolate_1d(coeffs, x);
+}
+
+/** apply one unbounded curve per channel to the rgb of npixels rgba pixels, alpha is copied.
+ *  channels with a NULL lut are copied as well. in and out may be the same buffer. */
+static inline void dt_lut_apply_1d(float *const out,
+                                   const float *const in,
+                                   const size_t npixels,
+                                   const float *const lut[3],
+                                   const float *const coeffs[3],
+                                   const int lutsize)
+{
+  DT_OMP_FOR()
+  for(size_t k = 0; k < npixels; k++)
+  {
+    dt_aligned_pixel_t pixel;
+    copy_pixel(pixel, in + 4*k);
+    for(int c = 0; c < 3; c++)
+      if(lut[c]) pixel[c] = dt_lut_lookup_1d_unbounded(lut[c], coeffs[c], pixel[c], lutsize);
+    copy_pixel(out + 4*k, pixel);
+  }
+}
+
+#ifdef DT_HAVE_AVX_KERNELS
+
+// extrapolate the few lanes above the range of the lut
+static inline void _lut_extrapolate_lanes(const float *const x,
+                                          float *const y,
+                                          const unsigned int above,
+                                          const int lanes,
+                                          const float *const coeffs)
+{
+  for(int i = 0; i < lanes; i++)
+    if(above & (1u << i))
+      y[i] = dt_lut_extrapolate_1d(coeffs, x[i]);
+}
+
+/** dt_lut_lookup_1d_unbounded() of 8 values */
+__attribute__((target("avx2")))
+static inline __m256 dt_lut_lookup_1d_unbounded_avx2(const float *const lut,
+                                                     const float *const coeffs,
+                                                     const __m256 x,
+                                                     const int lutsize)
+{
+  const __m256 below = _mm256_cmp_ps(x, _mm256_set1_ps(1.0f), _CMP_LT_OQ);
+  // lanes at or above 1.0 and NaNs look up the first entry, they are replaced below
+  const __m256 z = _mm256_and_ps(below, _mm256_max_ps(x, _mm256_setzero_ps()));
+  const __m256 ft = z * _mm256_set1_ps(lutsize - 1);
+  const __m256i t = _mm256_min_epi32(_mm256_cvttps_epi32(ft), _mm256_set1_epi32(lutsize - 2));
+  const __m256 f = ft - _mm256_cvtepi32_ps(t);
+  const __m256 l1 = _mm256_i32gather_ps(lut, t, sizeof(float));
+  const __m256 l2 = _mm256_i32gather_ps(lut + 1, t, sizeof(float));
+  __m256 y = l1 * (_mm256_set1_ps(1.0f) - f) + l2 * f;
+
+  const unsigned int above = ~_mm256_movemask_ps(below) & 0xff;
+  if(above)
+  {
+    DT_ALIGNED_ARRAY float xs[8], ys[8];
+    _mm256_store_ps(xs, x);
+    _mm256_store_ps(ys, y);
+    _lut_extrapolate_lanes(xs, ys, above, 8, coeffs);
+    y = _mm256_load_ps(ys);
+  }
+  return y;
+}
+
+/** dt_lut_lookup_1d_unbounded() of 16 values */
+__attribute__((target("avx512f")))
+static inline __m512 dt_lut_lookup_1d_unbounded_avx512(const float *const lut,
+                                                       const float *const coeffs,
+                                                       const __m512 x,
+                                                       const int lutsize)
+{
+  const __mmask16 below = _mm512_cmp_ps_mask(x, _mm512_set1_ps(1.0f), _CMP_LT_OQ);
+  const __m512 z = _mm512_maskz_max_ps(below, x, _mm512_setzero_ps());
+  const __m512 ft = z * _mm512_set1_ps(lutsize - 1);
+  const __m512i t = _mm512_min_epi32(_mm512_cvttps_epi32(ft), _mm512_set1_epi32(lutsize - 2));
+  const __m512 f = ft - _mm512_cvtepi32_ps(t);
+  const __m512 l1 = _mm512_i32gather_ps(t, lut, sizeof(float));
+  const __m512 l2 = _mm512_i32gather_ps(t, lut + 1, sizeof(float));
+  __m512 y = l1 * (_mm512_set1_ps(1.0f) - f) + l2 * f;
+
+  const unsigned int above = ~below & 0xffff;
+  if(above)
+  {
+    DT_ALIGNED_ARRAY float xs[16], ys[16];
+    _mm512_store_ps(xs, x);
+    _mm512_store_ps(ys, y);
+    _lut_extrapolate_lanes(xs, ys, above, 16, coeffs);
+    y = _mm512_load_ps(ys);
+  }
+  return y;
+}
+
+#endif // DT_HAVE_AVX_KERNELS
+
+/* ---------------------------------------------------------------------------------------------- */
+/*  2D                                                                                            */
+/* ---------------------------------------------------------------------------------------------- */
+
+/** bilinear interpolation in a width x height table, row major, x and y are clamped to [0, 1] */
+static inline float dt_lut_lookup_2d(const float *const lut,
+                                     const int width,
+                                     const int height,
+                                     const float x,
+                                     const float y)
+{
+  const float fx = fminf(fmaxf(x * (width - 1), 0.0f), width - 1);
+  const float fy = fminf(fmaxf(y * (height - 1), 0.0f), height - 1);
+  const int x0 = (fx < width - 2) ? fx : width - 2;
+  const int y0 = (fy < height - 2) ? fy : height - 2;
+  const float dx = fx - x0;
+  const float dy = fy - y0;
+
+  const float *const row0 = lut + (size_t)y0 * width + x0;
+  const float *const row1 = row0 + width;
+  const float l0 = row0[0] * (1.0f - dx) + row0[1] * dx;
+  const float l1 = row1[0] * (1.0f - dx) + row1[1] * dx;
+  return l0 * (1.0f - dy) + l1 * dy;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+/*  3D                                                                                            */
+/* ---------------------------------------------------------------------------------------------- */
+
+// unused floats at the end of a 3D clut: the entries are 3 floats but loaded as 4
+#define DT_LUT_3D_PADDING 4
+
+// the pixels are processed in blocks: the cells of the clut and the deltas inside them are
+// computed for the whole block in a vectorizable loop, then the corners are fetched and
+// interpolated with one 4-wide operation each. the 4th float of the entries is replaced by
+// the alpha of the input.
+#define DT_LUT_3D_BLOCK 64
+
+static inline void _lut_3d_cells(const float *const in,
+                                 const size_t npixels,
+                                 const int level,
+                                 int *const restrict cell,
+                                 float *const restrict dr,
+                                 float *const restrict dg,
+                                 float *const restrict db)
+{
+  const float scale = level - 1;
+  const int level2 = level * level;
+  DT_OMP_SIMD()
+  for(size_t j = 0; j < npixels; j++)
+  {
+    const float r = fminf(fmaxf(in[4*j], 0.0f), 1.0f) * scale;
+    const float g = fminf(fmaxf(in[4*j+1], 0.0f), 1.0f) * scale;
+    const float b = fminf(fmaxf(in[4*j+2], 0.0f), 1.0f) * scale;
+    const int ri = MIN((int)r, level - 2);
+    const int gi = MIN((int)g, level - 2);
+    const int bi = MIN((int)b, level - 2);
+    dr[j] = r - ri; // delta red
+    dg[j] = g - gi; // delta green
+    db[j] = b - bi; // delta blue
+    cell[j] = 3 * (ri + gi * level + bi * level2); // index of P000 in clut
+  }
+}
+
+static inline void _lut_3d_entry(const float *const entry, dt_aligned_pixel_t value)
+{
+  memcpy(value, entry, sizeof(dt_aligned_pixel_t));
+}
+
+/** trilinear interpolation of npixels rgba pixels in a clut with DT_LUT_3D_PADDING.
+ *  in and out may be the same buffer. */
+// From `HaldCLUT_correct.c' by Eskil Steenberg (http://www.quelsolaar.com) (BSD licensed)
+static inline void dt_lut_apply_3d_trilinear(const float *const in,
+                                             float *const out,
+                                             const size_t pixel_nb,
+                                             const float *const restrict clut,
+                                             const int level)
+{
+  const int r = 3, g = 3 * level, b = 3 * level * level;
+  // P000, P100, P010, P110, P001, P101, P011, P111
+  const int corner[8] = { 0, r, g, r + g, b, r + b, g + b, r + g + b };
+
+  DT_OMP_FOR()
+  for(size_t block = 0; block < pixel_nb; block += DT_LUT_3D_BLOCK)
+  {
+    const size_t npixels = MIN(DT_LUT_3D_BLOCK, pixel_nb - block);
+    const float *const input = in + 4 * block;
+    float *const output = out + 4 * block;
+    int cell[DT_LUT_3D_BLOCK];
+    float dr[DT_LUT_3D_BLOCK], dg[DT_LUT_3D_BLOCK], db[DT_LUT_3D_BLOCK];
+    _lut_3d_cells(input, npixels, level, cell, dr, dg, db);
+
+    for(size_t j = 0; j < npixels; j++)
+    {
+      dt_aligned_pixel_t P[8];
+      for(int k = 0; k < 8; k++)
+        _lut_3d_entry(clut + cell[j] + corner[k], P[k]);
+
+      dt_aligned_pixel_t res;
+      for_four_channels(c)
+      {
+        const float x00 = P[0][c] * (1 - dr[j]) + P[1][c] * dr[j];
+        const float x10 = P[2][c] * (1 - dr[j]) + P[3][c] * dr[j];
+        const float x01 = P[4][c] * (1 - dr[j]) + P[5][c] * dr[j];
+        const float x11 = P[6][c] * (1 - dr[j]) + P[7][c] * dr[j];
+        const float y0 = x00 * (1 - dg[j]) + x10 * dg[j];
+        const float y1 = x01 * (1 - dg[j]) + x11 * dg[j];
+        res[c] = y0 * (1 - db[j]) + y1 * db[j];
+      }
+      res[3] = input[4*j+3];
+      copy_pixel(output + 4*j, res);
+    }
+  }
+}
+
+/** tetrahedral interpolation, see dt_lut_apply_3d_trilinear() */
+// from OpenColorIO
+// https://github.com/imageworks/OpenColorIO/blob/master/src/OpenColorIO/ops/Lut3D/Lut3DOp.cpp
+static inline void dt_lut_apply_3d_tetrahedral(const float *const in,
+                                               float *const out,
+                                               const size_t pixel_nb,
+                                               const float *const restrict clut,
+                                               const int level)
+{
+  const int r = 3, g = 3 * level, b = 3 * level * level;
+  // the second and third corner of the tetrahedron after P000, indexed by
+  // (dr > dg) | (dg > db) << 1 | (dr > db) << 2. codes 3 and 4 can't happen.
+  const int second[8] = { b, b, g, r, b, r, g, r };
+  const int third[8] = { g + b, r + b, g + b, r + g, g + b, r + b, r + g, r + g };
+
+  DT_OMP_FOR()
+  for(size_t block = 0; block < pixel_nb; block += DT_LUT_3D_BLOCK)
+  {
+    const size_t npixels = MIN(DT_LUT_3D_BLOCK, pixel_nb - block);
+    const float *const input = in + 4 * block;
+    float *const output = out + 4 * block;
+    int cell[DT_LUT_3D_BLOCK];
+    float dr[DT_LUT_3D_BLOCK], dg[DT_LUT_3D_BLOCK], db[DT_LUT_3D_BLOCK];
+    _lut_3d_cells(input, npixels, level, cell, dr, dg, db);
+
+    for(size_t j = 0; j < npixels; j++)
+    {
+      const int code = (dr[j] > dg[j]) | ((dg[j] > db[j]) << 1) | ((dr[j] > db[j]) << 2);
+      const float max = MAX(dr[j], MAX(dg[j], db[j]));
+      const float min = MIN(dr[j], MIN(dg[j], db[j]));
+      const float mid = dr[j] + dg[j] + db[j] - max - min;
+
+      const float *const P000 = clut + cell[j];
+      dt_aligned_pixel_t P0, P1, P2, P3;
+      _lut_3d_entry(P000, P0);
+      _lut_3d_entry(P000 + second[code], P1);
+      _lut_3d_entry(P000 + third[code], P2);
+      _lut_3d_entry(P000 + r + g + b, P3);
+
+      dt_aligned_pixel_t res;
+      for_four_channels(c)
+        res[c] = (1 - max) * P0[c] + (max - mid) * P1[c] + (mid - min) * P2[c] + min * P3[c];
+      res[3] = input[4*j+3];
+      copy_pixel(output + 4*j, res);
+    }
+  }
+}
+
+/** pyramid interpolation, see dt_lut_apply_3d_trilinear() */
+// from Study on the 3D Interpolation Models Used in Color Conversion
+// http://ijetch.org/papers/318-T860.pdf
+static inline void dt_lut_apply_3d_pyramid(const float *const in,
+                                           float *const out,
+                                           const size_t pixel_nb,
+                                           const float *const restrict clut,
+                                           const int level)
+{
+  const int offset[3] = { 3, 3 * level, 3 * level * level };
+  // the pyramid is picked by the axis u with the smallest delta, v and w are the other two
+  const int axis_u[3] = { 0, 1, 2 };
+  const int axis_v[3] = { 1, 0, 0 };
+  const int axis_w[3] = { 2, 2, 1 };
+
+  DT_OMP_FOR()
+  for(size_t block = 0; block < pixel_nb; block += DT_LUT_3D_BLOCK)
+  {
+    const size_t npixels = MIN(DT_LUT_3D_BLOCK, pixel_nb - block);
+    const float *const input = in + 4 * block;
+    float *const output = out + 4 * block;
+    int cell[DT_LUT_3D_BLOCK];
+    float dr[DT_LUT_3D_BLOCK], dg[DT_LUT_3D_BLOCK], db[DT_LUT_3D_BLOCK];
+    _lut_3d_cells(input, npixels, level, cell, dr, dg, db);
+
+    for(size_t j = 0; j < npixels; j++)
+    {
+      const float delta[3] = { dr[j], dg[j], db[j] };
+      const int pyramid = (dg[j] > dr[j] && db[j] > dr[j]) ? 0
+                        : (dr[j] > dg[j] && db[j] > dg[j]) ? 1
+                        : 2;
+      const float du = delta[axis_u[pyramid]];
+      const float dv = delta[axis_v[pyramid]];
+      const float dw = delta[axis_w[pyramid]];
+      const int ov = offset[axis_v[pyramid]];
+      const int ow = offset[axis_w[pyramid]];
+
+      const float *const P000 = clut + cell[j];
+      dt_aligned_pixel_t P0, Pv, Pw, Pvw, P1;
+      _lut_3d_entry(P000, P0);
+      _lut_3d_entry(P000 + ov, Pv);
+      _lut_3d_entry(P000 + ow, Pw);
+      _lut_3d_entry(P000 + ov + ow, Pvw);
+      _lut_3d_entry(P000 + offset[0] + offset[1] + offset[2], P1);
+
+      dt_aligned_pixel_t res;
+      for_four_channels(c)
+        res[c] = P0[c] + (P1[c] - Pvw[c]) * du + (Pv[c] - P0[c]) * dv + (Pw[c] - P0[c]) * dw
+          + (Pvw[c] - Pv[c] - Pw[c] + P0[c]) * dv * dw;
+      res[3] = input[4*j+3];
+      copy_pixel(output + 4*j, res);
+    }
+  }
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -23,12 +23,16 @@
 #include "common/file_location.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/utility.h"
 #include "control/conf.h"
+#include "control/control.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
 #include "imageio/imageio_common.h"
 #include "imageio/imageio_jpeg.h"
 #include "imageio/imageio_module.h"
+#define QOI_NO_STDIO
+#include "imageio/qoi.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -44,6 +48,7 @@
 #include <unistd.h>
 
 #if !defined(_WIN32)
+#include <sys/mman.h>
 #include <sys/statvfs.h>
 #else
 //statvfs does not exist in Windows, providing implementation
@@ -85,6 +90,7 @@ struct dt_mipmap_buffer_dsc
   size_t size;
   dt_mipmap_buffer_dsc_flags flags;
   dt_colorspaces_color_profile_type_t color_space;
+  size_t mapped; // length of the mapping holding the buffer, 0 if allocated normally
 
 #if __has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)
   // do not touch!
@@ -237,6 +243,70 @@ static void _init_8(uint8_t *buf,
                     const dt_imgid_t imgid,
                     const dt_mipmap_size_t size);
 
+// full buffers can be kept in a shared mapping instead of the heap, backed
+// by an unlinked scratch file the kernel can write clean pages back to when
+// memory gets short, instead of needing swap space.
+static void *_full_buffer_alloc(const dt_mipmap_cache_t *cache,
+                                const size_t size,
+                                size_t *mapped)
+{
+  *mapped = 0;
+#if !defined(_WIN32)
+  if(cache->full_backing != DT_MIPMAP_FULL_HEAP)
+  {
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t len = (size + page - 1) / page * page;
+    int fd = -1;
+    if(cache->full_backing == DT_MIPMAP_FULL_FILE)
+    {
+      char cachedir[PATH_MAX] = { 0 };
+      dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+      gchar *scratch = g_build_filename(cachedir, "fullbuf-XXXXXX", NULL);
+      fd = g_mkstemp(scratch);
+      if(fd >= 0)
+      {
+        // the mapping keeps the file alive, and nothing is left behind on a crash
+        g_unlink(scratch);
+        if(ftruncate(fd, len))
+        {
+          close(fd);
+          fd = -1;
+        }
+      }
+      g_free(scratch);
+    }
+
+    if(cache->full_backing == DT_MIPMAP_FULL_ANONYMOUS || fd >= 0)
+    {
+      void *data = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                        fd >= 0 ? MAP_SHARED : MAP_SHARED | MAP_ANONYMOUS, fd, 0);
+      if(fd >= 0) close(fd);
+      if(data != MAP_FAILED)
+      {
+        *mapped = len;
+        return data;
+      }
+    }
+    dt_print(DT_DEBUG_CACHE,
+             "[mipmap_cache] can't map a full buffer of %zu bytes, falling back to the heap\n", size);
+  }
+#endif
+  return dt_alloc_aligned(size);
+}
+
+static void _buffer_free(void *data)
+{
+#if !defined(_WIN32)
+  const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)data;
+  if(dsc->mapped)
+  {
+    munmap(data, dsc->mapped);
+    return;
+  }
+#endif
+  dt_free_align(data);
+}
+
 // callback for the imageio core to allocate memory.
 // only needed for _F and _FULL buffers, as they change size
 // with the input image. will allocate img->width*img->height*img->bpp bytes.
@@ -257,11 +327,12 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   // so only check size and re-alloc if necessary:
   if(!buf->buf || ((void *)dsc == (void *)dt_mipmap_cache_static_dead_image) || (entry->data_size < buffer_size))
   {
-    if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image) dt_free_align(entry->data);
+    if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image) _buffer_free(entry->data);
 
     entry->data_size = 0;
 
-    entry->data = dt_alloc_aligned(buffer_size);
+    size_t mapped = 0;
+    entry->data = _full_buffer_alloc(darktable.mipmap_cache, buffer_size, &mapped);
 
     if(!entry->data)
     {
@@ -276,6 +347,7 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
 
     // set buffer size only if we're making it larger.
     dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    dsc->mapped = mapped;
   }
 
   dsc->size = buffer_size;
@@ -301,6 +373,144 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+static gboolean _disk_backend_enabled(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  return cache->cachedir[0]
+    && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+        || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8));
+}
+
+// the packed store of a level. it is used for reading and removing thumbnails
+// even if thumbnails are written to files, as long as it exists.
+static dt_thumbstore_t *_get_store(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F) return NULL;
+
+  dt_pthread_mutex_lock(&cache->store_mutex);
+  if(!cache->store_checked[mip])
+  {
+    cache->store_checked[mip] = TRUE;
+    char basename[PATH_MAX] = { 0 };
+    snprintf(basename, sizeof(basename), "%s.d/thumbs-%d", cache->cachedir, (int)mip);
+    gchar *packname = g_strdup_printf("%s.pack", basename);
+    gchar *dirname = g_path_get_dirname(basename);
+    if(cache->disk_format != DT_MIPMAP_DISK_FILES || g_file_test(packname, G_FILE_TEST_EXISTS))
+    {
+      if(!g_mkdir_with_parents(dirname, 0750))
+        cache->store[mip] = dt_thumbstore_open(basename);
+    }
+    g_free(dirname);
+    g_free(packname);
+  }
+  dt_thumbstore_t *store = cache->store[mip];
+  dt_pthread_mutex_unlock(&cache->store_mutex);
+  return store;
+}
+
+static gboolean _read_packed_thumbnail(dt_mipmap_cache_t *cache,
+                                       dt_cache_entry_t *entry,
+                                       const dt_mipmap_size_t mip)
+{
+  dt_thumbstore_t *store = _get_store(cache, mip);
+  dt_thumbstore_blob_t blob;
+  const dt_imgid_t imgid = get_imgid(entry->key);
+  if(!store || !dt_thumbstore_lookup(store, imgid, &blob)) return FALSE;
+
+  struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  uint8_t *out = (uint8_t *)entry->data + sizeof(*dsc);
+  gboolean ok = blob.width <= cache->max_width[mip] && blob.height <= cache->max_height[mip]
+    && (size_t)blob.width * blob.height * 4 <= entry->data_size - sizeof(*dsc);
+
+  if(ok && blob.codec == DT_THUMBSTORE_CODEC_QOI)
+  {
+    qoi_desc desc;
+    uint8_t *pixels = qoi_decode(blob.data, (int)blob.length, &desc, 4);
+    ok = pixels && desc.width == blob.width && desc.height == blob.height;
+    if(ok) memcpy(out, pixels, (size_t)blob.width * blob.height * 4);
+    free(pixels);
+  }
+  else if(ok)
+  {
+    dt_imageio_jpeg_t jpg;
+    ok = !dt_imageio_jpeg_decompress_header(blob.data, blob.length, &jpg)
+      && jpg.width == blob.width && jpg.height == blob.height
+      && !dt_imageio_jpeg_decompress(&jpg, out);
+  }
+
+  if(ok)
+  {
+    dt_print(DT_DEBUG_CACHE,
+             "[mipmap_cache] grab mip %d for image %" PRIu32 " from packed disk cache\n", mip, imgid);
+    dsc->width = blob.width;
+    dsc->height = blob.height;
+    dsc->iscale = 1.0f;
+    dsc->color_space = blob.color_space;
+  }
+  dt_thumbstore_blob_release(&blob);
+
+  if(!ok)
+  {
+    dt_print(DT_DEBUG_ALWAYS,
+             "[mipmap_cache] failed to decompress packed thumbnail for image %" PRIu32 "!\n", imgid);
+    dt_thumbstore_remove(store, imgid);
+  }
+  return ok;
+}
+
+static gboolean _read_thumbnail_file(dt_mipmap_cache_t *cache,
+                                     dt_cache_entry_t *entry,
+                                     const dt_mipmap_size_t mip)
+{
+  struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  gboolean loaded_from_disk = FALSE;
+
+  // try and load from disk, if successful set flag
+  char filename[PATH_MAX] = {0};
+  snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
+           get_imgid(entry->key));
+  FILE *f = g_fopen(filename, "rb");
+  if(f)
+  {
+    uint8_t *blob = 0;
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    if(len <= 0) goto read_error; // coverity madness
+    blob = (uint8_t *)dt_alloc_aligned(len);
+    if(!blob) goto read_error;
+    fseek(f, 0, SEEK_SET);
+    const int rd = fread(blob, sizeof(uint8_t), len, f);
+    if(rd != len) goto read_error;
+    dt_colorspaces_color_profile_type_t color_space;
+    dt_imageio_jpeg_t jpg;
+    if(dt_imageio_jpeg_decompress_header(blob, len, &jpg)
+       || (jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip])
+       || ((color_space = dt_imageio_jpeg_read_color_space(&jpg)) == DT_COLORSPACE_NONE) // pointless test to keep it in the if clause
+       || dt_imageio_jpeg_decompress(&jpg, (uint8_t *)entry->data + sizeof(*dsc)))
+    {
+      dt_print(DT_DEBUG_ALWAYS,
+               "[mipmap_cache] failed to decompress thumbnail for image %" PRIu32 " from `%s'!\n",
+               get_imgid(entry->key), filename);
+      goto read_error;
+    }
+    dt_print(DT_DEBUG_CACHE,
+             "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk cache\n", mip,
+             get_imgid(entry->key));
+    dsc->width = jpg.width;
+    dsc->height = jpg.height;
+    dsc->iscale = 1.0f;
+    dsc->color_space = color_space;
+    loaded_from_disk = TRUE;
+    if(0)
+    {
+read_error:
+      g_unlink(filename);
+    }
+    dt_free_align(blob);
+    fclose(f);
+  }
+  return loaded_from_disk;
+}
+
 // callback for the cache backend to initialize payload pointers
 void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
@@ -339,6 +549,7 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
     }
 
     dsc = entry->data;
+    dsc->mapped = 0;
 
     if(mip <= DT_MIPMAP_F)
     {
@@ -361,56 +572,11 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   assert(dsc->size >= sizeof(*dsc));
 
   int loaded_from_disk = 0;
-  if(mip < DT_MIPMAP_F)
+  if(mip < DT_MIPMAP_F && _disk_backend_enabled(cache, mip))
   {
-    if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
-    {
-      // try and load from disk, if successful set flag
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-               get_imgid(entry->key));
-      FILE *f = g_fopen(filename, "rb");
-      if(f)
-      {
-        uint8_t *blob = 0;
-        fseek(f, 0, SEEK_END);
-        const long len = ftell(f);
-        if(len <= 0) goto read_error; // coverity madness
-        blob = (uint8_t *)dt_alloc_aligned(len);
-        if(!blob) goto read_error;
-        fseek(f, 0, SEEK_SET);
-        const int rd = fread(blob, sizeof(uint8_t), len, f);
-        if(rd != len) goto read_error;
-        dt_colorspaces_color_profile_type_t color_space;
-        dt_imageio_jpeg_t jpg;
-        if(dt_imageio_jpeg_decompress_header(blob, len, &jpg)
-           || (jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip])
-           || ((color_space = dt_imageio_jpeg_read_color_space(&jpg)) == DT_COLORSPACE_NONE) // pointless test to keep it in the if clause
-           || dt_imageio_jpeg_decompress(&jpg, (uint8_t *)entry->data + sizeof(*dsc)))
-        {
-          dt_print(DT_DEBUG_ALWAYS,
-                   "[mipmap_cache] failed to decompress thumbnail for image %" PRIu32 " from `%s'!\n",
-                   get_imgid(entry->key), filename);
-          goto read_error;
-        }
-        dt_print(DT_DEBUG_CACHE,
-                 "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk cache\n", mip,
-                 get_imgid(entry->key));
-        dsc->width = jpg.width;
-        dsc->height = jpg.height;
-        dsc->iscale = 1.0f;
-        dsc->color_space = color_space;
-        loaded_from_disk = 1;
-        if(0)
-        {
-read_error:
-          g_unlink(filename);
-        }
-        dt_free_align(blob);
-        fclose(f);
-      }
-    }
+    // thumbnails written before switching to the packed store are still used
+    loaded_from_disk = _read_packed_thumbnail(cache, entry, mip)
+                    || _read_thumbnail_file(cache, entry, mip);
   }
 
   if(!loaded_from_disk)
@@ -441,7 +607,70 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data,
     char filename[PATH_MAX] = { 0 };
     snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
     g_unlink(filename);
+
+    dt_thumbstore_t *store = _get_store(cache, mip);
+    if(store) dt_thumbstore_remove(store, imgid);
+  }
+}
+
+// make sure we don't fill up the disk with thumbnails
+static gboolean _enough_disk_space(const char *filename)
+{
+  struct statvfs vfsbuf;
+  if(!statvfs(filename, &vfsbuf))
+  {
+    const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
+    if(free_mb < 100)
+    {
+      dt_print(DT_DEBUG_ALWAYS,
+               "[mipmap_cache] aborting image write as only %" PRId64 " MB free to write %s\n",
+               free_mb, filename);
+      return FALSE;
+    }
   }
+  else
+  {
+    dt_print(DT_DEBUG_ALWAYS,
+             "[mipmap_cache] aborting image write since couldn't determine free space available to write %s\n",
+             filename);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void _write_packed_thumbnail(dt_thumbstore_t *store,
+                                    const dt_mipmap_disk_format_t format,
+                                    const dt_imgid_t imgid,
+                                    const struct dt_mipmap_buffer_dsc *dsc)
+{
+  // as with files, don't replace existing thumbnails
+  if(dt_thumbstore_contains(store, imgid) || !_enough_disk_space(store->data_path)) return;
+
+  const uint8_t *in = (const uint8_t *)(dsc + 1);
+  uint8_t *out = NULL;
+  int len = 0;
+  dt_thumbstore_codec_t codec;
+  if(format == DT_MIPMAP_DISK_PACKED_QOI)
+  {
+    const qoi_desc desc = { .width = dsc->width, .height = dsc->height, .channels = 4, .colorspace = QOI_SRGB };
+    codec = DT_THUMBSTORE_CODEC_QOI;
+    out = qoi_encode(in, &desc, &len);
+  }
+  else
+  {
+    const int cache_quality = dt_conf_get_int("database_cache_quality");
+    codec = DT_THUMBSTORE_CODEC_JPEG;
+    out = malloc((size_t)dsc->width * dsc->height * 4);
+    len = out ? dt_imageio_jpeg_compress(in, out, dsc->width, dsc->height, MIN(100, MAX(10, cache_quality))) : 0;
+    // 1 is the error return
+    if(len <= 1) len = 0;
+  }
+
+  if(len <= 0
+     || !dt_thumbstore_insert(store, imgid, codec, dsc->width, dsc->height, dsc->color_space, out, len))
+    dt_print(DT_DEBUG_ALWAYS,
+             "[mipmap_cache] failed to write packed thumbnail for image %" PRIu32 "\n", imgid);
+  free(out);
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -458,8 +687,12 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
-      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+      else if(_disk_backend_enabled(cache, mip) && cache->disk_format != DT_MIPMAP_DISK_FILES)
+      {
+        dt_thumbstore_t *store = _get_store(cache, mip);
+        if(store) _write_packed_thumbnail(store, cache->disk_format, get_imgid(entry->key), dsc);
+      }
+      else if(_disk_backend_enabled(cache, mip))
       {
         // serialize to disk
         char filename[PATH_MAX] = {0};
@@ -474,25 +707,7 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
           if(!g_file_test(filename, G_FILE_TEST_EXISTS) && (f = g_fopen(filename, "wb")))
           {
             // first check the disk isn't full
-            struct statvfs vfsbuf;
-            if(!statvfs(filename, &vfsbuf))
-            {
-              const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
-              if(free_mb < 100)
-              {
-                dt_print(DT_DEBUG_ALWAYS,
-                         "[mipmap_cache] aborting image write as only %" PRId64 " MB free to write %s\n",
-                         free_mb, filename);
-                goto write_error;
-              }
-            }
-            else
-            {
-              dt_print(DT_DEBUG_ALWAYS,
-                       "[mipmap_cache] aborting image write since couldn't determine free space available to write %s\n",
-                       filename);
-              goto write_error;
-            }
+            if(!_enough_disk_space(filename)) goto write_error;
 
             const int cache_quality = dt_conf_get_int("database_cache_quality");
             const uint8_t *exif = NULL;
@@ -518,7 +733,7 @@ write_error:
       }
     }
   }
-  dt_free_align(entry->data);
+  _buffer_free(entry->data);
 }
 
 static uint32_t nearest_power_of_two(const uint32_t value)
@@ -531,6 +746,26 @@ static uint32_t nearest_power_of_two(const uint32_t value)
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+
+  const char *disk_format = dt_conf_get_string_const("cache_disk_format");
+  cache->disk_format = !g_strcmp0(disk_format, "packed JPEG") ? DT_MIPMAP_DISK_PACKED_JPEG
+                     : !g_strcmp0(disk_format, "packed QOI") ? DT_MIPMAP_DISK_PACKED_QOI
+                     : DT_MIPMAP_DISK_FILES;
+  dt_pthread_mutex_init(&cache->store_mutex, NULL);
+#if !defined(_WIN32)
+  const char *full_backing = dt_conf_get_string_const("cache_full_backing");
+  cache->full_backing = !g_strcmp0(full_backing, "shared mapping") ? DT_MIPMAP_FULL_ANONYMOUS
+                      : !g_strcmp0(full_backing, "scratch file") ? DT_MIPMAP_FULL_FILE
+                      : DT_MIPMAP_FULL_HEAP;
+#else
+  cache->full_backing = DT_MIPMAP_FULL_HEAP;
+#endif
+  for(int k = 0; k < DT_MIPMAP_F; k++)
+  {
+    cache->store[k] = NULL;
+    cache->store_checked[k] = FALSE;
+  }
+
   // make sure static memory is initialized
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -586,7 +821,11 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // thumbnails of all sizes share one cache. shard it as long as every shard
+  // still holds a good number of the largest ones.
+  const size_t largest = cache->buffer_size[DT_MIPMAP_F - 1];
+  const int thumb_shards = CLAMP(max_mem / (8 * largest), 1, 16);
+  dt_cache_init_sharded(&cache->mip_thumbs.cache, 0, max_mem, thumb_shards);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -615,20 +854,25 @@ void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+
+  // after the caches, they write their thumbnails when cleaned up
+  for(int k = 0; k < DT_MIPMAP_F; k++)
+    dt_thumbstore_close(cache->store[k]);
+  dt_pthread_mutex_destroy(&cache->store_mutex);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
 {
   dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] thumbs fill %.2f/%.2f MB (%.2f%%)\n",
-           cache->mip_thumbs.cache.cost / (1024.0 * 1024.0),
+           dt_cache_get_cost(&cache->mip_thumbs.cache) / (1024.0 * 1024.0),
            cache->mip_thumbs.cache.cost_quota / (1024.0 * 1024.0),
-           100.0f * (float)cache->mip_thumbs.cache.cost / (float)cache->mip_thumbs.cache.cost_quota);
+           100.0f * (float)dt_cache_get_cost(&cache->mip_thumbs.cache) / (float)cache->mip_thumbs.cache.cost_quota);
   dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] float fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
-           (uint32_t)cache->mip_f.cache.cost, (uint32_t)cache->mip_f.cache.cost_quota,
-           100.0f * (float)cache->mip_f.cache.cost / (float)cache->mip_f.cache.cost_quota);
+           (uint32_t)dt_cache_get_cost(&cache->mip_f.cache), (uint32_t)cache->mip_f.cache.cost_quota,
+           100.0f * (float)dt_cache_get_cost(&cache->mip_f.cache) / (float)cache->mip_f.cache.cost_quota);
   dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] full  fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
-           (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
-           100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+           (uint32_t)dt_cache_get_cost(&cache->mip_full.cache), (uint32_t)cache->mip_full.cache.cost_quota,
+           100.0f * (float)dt_cache_get_cost(&cache->mip_full.cache) / (float)cache->mip_full.cache.cost_quota);
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -739,10 +983,8 @@ void dt_mipmap_cache_get_with_caller(
     if(!cache->cachedir[0]) return;
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_cache_thumbnail_on_disk(cache, imgid, mip)) return;
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -922,13 +1164,8 @@ void dt_mipmap_cache_get_with_caller(
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(dt_mipmap_cache_thumbnail_on_disk(cache, imgid, mip))
+      dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = NO_IMGID;
@@ -1039,6 +1276,78 @@ void dt_mimap_cache_evict(dt_mipmap_cache_t *cache,
   }
 }
 
+gboolean dt_mipmap_cache_prefetch_full(dt_mipmap_cache_t *cache,
+                                       const dt_imgid_t imgid,
+                                       const size_t max_bytes)
+{
+  // without the job system the load would run synchronously in the caller
+  if(!dt_is_valid_imgid(imgid) || !dt_control_running()) return FALSE;
+
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!img) return FALSE;
+  // the buffer layout is only known once the image was loaded, raws keep one
+  // channel of at most float size and everything else four
+  const size_t bytes = (size_t)img->width * img->height
+                       * (dt_image_is_raw(img) ? sizeof(float) : 4 * sizeof(float));
+  dt_image_cache_read_release(darktable.image_cache, img);
+
+  if(!bytes || bytes > max_bytes) return FALSE;
+
+  dt_mipmap_cache_get(cache, NULL, imgid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+  return TRUE;
+}
+
+// downscale a raw keeping its mosaic: bayer sensels are binned in 2x2 and x-trans ones in 3x3 blocks
+static void _bin_mosaic(void *out,
+                        const void *in,
+                        const dt_image_t *image,
+                        const dt_iop_roi_t *const roi_out,
+                        const dt_iop_roi_t *const roi_in)
+{
+  if(image->buf_dsc.filters != 9u && image->buf_dsc.datatype == TYPE_FLOAT)
+  {
+    dt_iop_clip_and_zoom_mosaic_half_size_f((float *const)out, (const float *const)in, roi_out, roi_in,
+                                            roi_out->width, roi_in->width, image->buf_dsc.filters);
+  }
+  else if(image->buf_dsc.filters != 9u && image->buf_dsc.datatype == TYPE_UINT16)
+  {
+    dt_iop_clip_and_zoom_mosaic_half_size((uint16_t * const)out, (const uint16_t *)in, roi_out, roi_in,
+                                          roi_out->width, roi_in->width, image->buf_dsc.filters);
+  }
+  else if(image->buf_dsc.filters == 9u && image->buf_dsc.datatype == TYPE_UINT16)
+  {
+    dt_iop_clip_and_zoom_mosaic_third_size_xtrans((uint16_t * const)out, (const uint16_t *)in, roi_out,
+                                                  roi_in, roi_out->width, roi_in->width, image->buf_dsc.xtrans);
+  }
+  else if(image->buf_dsc.filters == 9u && image->buf_dsc.datatype == TYPE_FLOAT)
+  {
+    dt_iop_clip_and_zoom_mosaic_third_size_xtrans_f((float *const)out, (const float *)in, roi_out, roi_in,
+                                                    roi_out->width, roi_in->width, image->buf_dsc.xtrans);
+  }
+  else
+  {
+    dt_unreachable_codepath();
+  }
+}
+
+void *dt_mipmap_cache_bin_mosaic(const void *in,
+                                 const dt_image_t *image,
+                                 const float scale,
+                                 int32_t *width,
+                                 int32_t *height)
+{
+  const dt_iop_roi_t roi_in = { .width = image->width, .height = image->height, .scale = 1.0f };
+  const dt_iop_roi_t roi_out = { .width = scale * image->width, .height = scale * image->height, .scale = scale };
+
+  void *out = dt_alloc_aligned((size_t)roi_out.width * roi_out.height * dt_iop_buffer_dsc_to_bpp(&image->buf_dsc));
+  if(!out) return NULL;
+
+  _bin_mosaic(out, in, image, &roi_out, &roi_in);
+  *width = roi_out.width;
+  *height = roi_out.height;
+  return out;
+}
+
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf,
                     float *out,
                     uint32_t *width,
@@ -1098,30 +1407,7 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf,
 
   if(image->buf_dsc.filters)
   {
-    if(image->buf_dsc.filters != 9u && image->buf_dsc.datatype == TYPE_FLOAT)
-    {
-      dt_iop_clip_and_zoom_mosaic_half_size_f((float *const)out, (const float *const)buf.buf, &roi_out, &roi_in,
-                                              roi_out.width, roi_in.width, image->buf_dsc.filters);
-    }
-    else if(image->buf_dsc.filters != 9u && image->buf_dsc.datatype == TYPE_UINT16)
-    {
-      dt_iop_clip_and_zoom_mosaic_half_size((uint16_t * const)out, (const uint16_t *)buf.buf, &roi_out, &roi_in,
-                                            roi_out.width, roi_in.width, image->buf_dsc.filters);
-    }
-    else if(image->buf_dsc.filters == 9u && image->buf_dsc.datatype == TYPE_UINT16)
-    {
-      dt_iop_clip_and_zoom_mosaic_third_size_xtrans((uint16_t * const)out, (const uint16_t *)buf.buf, &roi_out,
-                                                    &roi_in, roi_out.width, roi_in.width, image->buf_dsc.xtrans);
-    }
-    else if(image->buf_dsc.filters == 9u && image->buf_dsc.datatype == TYPE_FLOAT)
-    {
-      dt_iop_clip_and_zoom_mosaic_third_size_xtrans_f(out, (const float *)buf.buf, &roi_out, &roi_in,
-                                                      roi_out.width, roi_in.width, image->buf_dsc.xtrans);
-    }
-    else
-    {
-      dt_unreachable_codepath();
-    }
+    _bin_mosaic(out, buf.buf, image, &roi_out, &roi_in);
   }
   else
   {
@@ -1177,6 +1463,45 @@ static int _write_image(dt_imageio_module_data_t *data,
   return 0;
 }
 
+// the lighttable and the crawler often ask for several sizes of one image in a row.
+// instead of processing the image again for each of them, fill the smaller sizes
+// missing in the cache from a freshly generated one.
+static void _init_smaller_8(dt_mipmap_cache_t *cache,
+                            const uint8_t *buf,
+                            const uint32_t width,
+                            const uint32_t height,
+                            const dt_colorspaces_color_profile_type_t color_space,
+                            const dt_imgid_t imgid,
+                            const dt_mipmap_size_t size)
+{
+  // the full preview is too large to be worth it
+  if(size >= DT_MIPMAP_8 || !dt_conf_get_bool("cache_mip_pyramid")) return;
+
+  dt_cache_t *thumbs = &cache->mip_thumbs.cache;
+  for(int k = size - 1; k >= DT_MIPMAP_0; k--)
+  {
+    const uint32_t key = get_key(imgid, k);
+    if(dt_cache_contains(thumbs, key) || dt_mipmap_cache_thumbnail_on_disk(cache, imgid, k)) continue;
+
+    // we are the only ones to hold the larger size, others can't be waiting for us here
+    dt_cache_entry_t *entry = dt_cache_get(thumbs, key, 'w');
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE)
+    {
+      ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
+      dt_iop_reduce_box_8(buf, width, height, (uint8_t *)(dsc + 1),
+                          cache->max_width[k], cache->max_height[k], &dsc->width, &dsc->height);
+      dsc->iscale = 1.0f;
+      dsc->color_space = color_space;
+      dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+      dt_print(DT_DEBUG_CACHE,
+               "[mipmap_cache] generate mip %d for image %d from level %d in one go\n", k, imgid, size);
+    }
+    dt_cache_release(thumbs, entry);
+  }
+}
+
 static void _init_8(uint8_t *buf,
                     uint32_t *width,
                     uint32_t *height,
@@ -1336,8 +1661,9 @@ static void _init_8(uint8_t *buf,
     return;
   }
 
+  _init_smaller_8(darktable.mipmap_cache, buf, *width, *height, *color_space, imgid, size);
+
   // TODO: various speed optimizations:
-  // TODO: also init all smaller mips!
   // TODO: use mipf, but:
   // TODO: if output is cropped, don't use mipf!
 }
@@ -1349,12 +1675,16 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace()
   return DT_COLORSPACE_DISPLAY;
 }
 
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
 {
   if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      // the copy shares the thumbnail of the source in the packed store
+      dt_thumbstore_t *store = _get_store(cache, mip);
+      if(store && dt_thumbstore_copy(store, dst_imgid, src_imgid)) continue;
+
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
@@ -1372,6 +1702,20 @@ void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint3
   }
 }
 
+gboolean dt_mipmap_cache_thumbnail_on_disk(dt_mipmap_cache_t *cache,
+                                           const dt_imgid_t imgid,
+                                           const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F || (int)mip < DT_MIPMAP_0) return FALSE;
+
+  dt_thumbstore_t *store = _get_store(cache, mip);
+  if(store && dt_thumbstore_contains(store, imgid)) return TRUE;
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
+  return dt_util_test_image_file(filename);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
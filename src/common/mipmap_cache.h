@@ -21,6 +21,7 @@
 #include "common/cache.h"
 #include "common/colorspaces.h"
 #include "common/image.h"
+#include "common/thumbstore.h"
 
 G_BEGIN_DECLS
 
@@ -73,6 +74,22 @@ typedef struct dt_mipmap_buffer_t
   dt_cache_entry_t *cache_entry;
 } dt_mipmap_buffer_t;
 
+// how thumbnails are kept on disk, see cache_disk_format
+typedef enum dt_mipmap_disk_format_t
+{
+  DT_MIPMAP_DISK_FILES = 0,       // one jpeg file per thumbnail
+  DT_MIPMAP_DISK_PACKED_JPEG = 1, // jpeg in a packed store per level
+  DT_MIPMAP_DISK_PACKED_QOI = 2,  // lossless and faster to decode, but larger
+} dt_mipmap_disk_format_t;
+
+// where full resolution image buffers are kept, see cache_full_backing
+typedef enum dt_mipmap_full_backing_t
+{
+  DT_MIPMAP_FULL_HEAP = 0,      // regular allocation
+  DT_MIPMAP_FULL_ANONYMOUS = 1, // shared anonymous mapping
+  DT_MIPMAP_FULL_FILE = 2,      // shared mapping of an unlinked scratch file
+} dt_mipmap_full_backing_t;
+
 typedef struct dt_mipmap_cache_one_t
 {
   // one cache per mipmap scale!
@@ -101,6 +118,14 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+
+  // packed thumbnail stores per level, opened on first use
+  dt_mipmap_disk_format_t disk_format;
+  dt_pthread_mutex_t store_mutex;
+  dt_thumbstore_t *store[DT_MIPMAP_F];
+  gboolean store_checked[DT_MIPMAP_F];
+
+  dt_mipmap_full_backing_t full_backing;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -139,6 +164,10 @@ void dt_mipmap_cache_remove_at_size(dt_mipmap_cache_t *cache, const dt_imgid_t i
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const dt_imgid_t imgid);
 void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const dt_imgid_t imgid, const dt_mipmap_size_t mip);
 
+// start decoding the full resolution buffer of an image on a background worker,
+// unless its estimated size is unknown or exceeds max_bytes. returns TRUE if queued.
+gboolean dt_mipmap_cache_prefetch_full(dt_mipmap_cache_t *cache, const dt_imgid_t imgid, const size_t max_bytes);
+
 // return the closest mipmap size
 // for the given window you wish to draw.
 // a dt_mipmap_size_t has always a fixed resolution associated with it,
@@ -154,12 +183,24 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
-// only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
+// only copies over the disk backend, doesn't directly affect the in-memory cache.
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
+
+// is there a thumbnail of this size in the disk backend?
+gboolean dt_mipmap_cache_thumbnail_on_disk(dt_mipmap_cache_t *cache, const dt_imgid_t imgid, const dt_mipmap_size_t mip);
 
 // return the mipmap corresponding to text value saved in prefs
 dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(const char *value);
 
+// downscale the full buffer `in` of a raw by scale in one pass, keeping the mosaic so the result can
+// go through the pixelpipe instead of the full buffer. returns a buffer of *width x *height sensels of
+// the raw's type to be freed with dt_free_align(), or NULL.
+void *dt_mipmap_cache_bin_mosaic(const void *in,
+                                 const dt_image_t *image,
+                                 const float scale,
+                                 int32_t *width,
+                                 int32_t *height);
+
 G_END_DECLS
 
 // clang-format off
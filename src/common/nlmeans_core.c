@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef DT_UNIT_TEST
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -26,6 +27,7 @@
 #include "develop/imageop_math.h"
 #include "develop/tiling.h"
 #include "iop/iop_api.h"
+#endif
 #include "common/nlmeans_core.h"
 #include <stdbool.h>
 #include <stdlib.h>
@@ -57,6 +59,15 @@
 //   the definition in src/iop/nlmeans.c and src/iop/denoiseprofile.c
 #define NUM_BUCKETS 4
 
+// the optional precheck (params->prune > 0) estimates patch distances on a copy of the image reduced by
+//   PRECHECK_SCALE in each direction.  For each band of PRECHECK_BAND rows of a chunk it narrows the columns
+//   for which a patch is worth the full computation, and skips the band entirely if there are none.  That
+//   costs one block comparison per PRECHECK_SCALE^2 pixels instead of the pixel differences and weights.
+#define PRECHECK_SCALE 4
+#define PRECHECK_BAND 8
+// upper bound for the number of separate column ranges found in a chunk
+#define PRECHECK_MAX_RUNS (SLICE_WIDTH / PRECHECK_SCALE / 2 + 2)
+
 // a structure to collect together the items which define the location of a patch relative to the pixel
 //  being denoised
 struct patch_t
@@ -67,6 +78,14 @@ struct patch_t
 };
 typedef struct patch_t patch_t;
 
+// one block of the reduced image used by the precheck
+struct coarse_block_t
+{
+  dt_aligned_pixel_t mean;
+  dt_aligned_pixel_t var;
+};
+typedef struct coarse_block_t coarse_block_t;
+
 static inline float gh(const float f)
 {
   return dt_fast_mexp2f(f) ;
@@ -275,6 +294,105 @@ static void init_column_sums(
   return;
 }
 
+// build the reduced image for the precheck: mean and variance of each channel in blocks of
+//   PRECHECK_SCALE x PRECHECK_SCALE pixels
+static coarse_block_t *init_coarse_image(
+        const float *const in,
+        const int width,
+        const int height,
+        int *cwidth,
+        int *cheight)
+{
+  const int cw = (width + PRECHECK_SCALE - 1) / PRECHECK_SCALE;
+  const int ch = (height + PRECHECK_SCALE - 1) / PRECHECK_SCALE;
+  coarse_block_t *const coarse = dt_alloc_align_type(coarse_block_t, (size_t)cw * ch);
+  if(!coarse) return NULL;
+  DT_OMP_FOR()
+  for(int cy = 0; cy < ch; cy++)
+  {
+    for(int cx = 0; cx < cw; cx++)
+    {
+      const int rmax = MIN(height, (cy + 1) * PRECHECK_SCALE);
+      const int cmax = MIN(width, (cx + 1) * PRECHECK_SCALE);
+      dt_aligned_pixel_t sum = { 0.f, 0.f, 0.f, 0.f };
+      dt_aligned_pixel_t sumsq = { 0.f, 0.f, 0.f, 0.f };
+      for(int row = cy * PRECHECK_SCALE; row < rmax; row++)
+        for(int col = cx * PRECHECK_SCALE; col < cmax; col++)
+        {
+          const float *const pixel = in + 4 * ((size_t)row * width + col);
+          for_each_channel(c,aligned(sum,sumsq,pixel:16))
+          {
+            sum[c] += pixel[c];
+            sumsq[c] += pixel[c] * pixel[c];
+          }
+        }
+      // blocks at the right and bottom edges may be partial
+      const float n = (rmax - cy * PRECHECK_SCALE) * (cmax - cx * PRECHECK_SCALE);
+      coarse_block_t *const block = coarse + (size_t)cy * cw + cx;
+      for_each_channel(c,aligned(sum,sumsq:16))
+      {
+        block->mean[c] = sum[c] / n;
+        block->var[c] = fmaxf(0.0f, sumsq[c] / n - block->mean[c] * block->mean[c]);
+      }
+    }
+  }
+  *cwidth = cw;
+  *cheight = ch;
+  return coarse;
+}
+
+// find the columns in rows row_min..row_max-1 and columns col_min..col_max-1 where the patch may get a
+//   noticeable weight.  The distance of two pixels is estimated from the blocks which contain them: the
+//   expected squared difference is the squared difference of the block means plus both block variances, so
+//   it includes noise and texture.  `wt` holds the per-channel factors which turn that into the distortion
+//   (or dissimilarity) of a whole patch.  Stores the first and one-past-last column of each range of
+//   blocks within `max_dist` in `runs` and returns the number of ranges.
+static int coarse_precheck(
+        const coarse_block_t *const coarse,
+        const int cwidth,
+        const int cheight,
+        const patch_t *const patch,
+        const int row_min,
+        const int row_max,
+        const int col_min,
+        const int col_max,
+        const dt_aligned_pixel_t wt,
+        const float max_dist,
+        int *const runs)
+{
+  const int drow = (int)floorf(patch->rows / (float)PRECHECK_SCALE + 0.5f);
+  const int dcol = (int)floorf(patch->cols / (float)PRECHECK_SCALE + 0.5f);
+  int nruns = 0;
+  gboolean in_run = FALSE;
+  for(int cx = col_min / PRECHECK_SCALE; cx <= (col_max - 1) / PRECHECK_SCALE; cx++)
+  {
+    const int px = CLAMP(cx + dcol, 0, cwidth - 1);
+    gboolean keep = FALSE;
+    for(int cy = row_min / PRECHECK_SCALE; cy <= (row_max - 1) / PRECHECK_SCALE; cy++)
+    {
+      const int py = CLAMP(cy + drow, 0, cheight - 1);
+      const coarse_block_t *const a = coarse + (size_t)cy * cwidth + cx;
+      const coarse_block_t *const b = coarse + (size_t)py * cwidth + px;
+      float dist = 0.0f;
+      for(int c = 0; c < 3; c++)
+      {
+        const float diff = a->mean[c] - b->mean[c];
+        dist += (diff * diff + a->var[c] + b->var[c]) * wt[c];
+      }
+      if(dist <= max_dist)
+      {
+        keep = TRUE;
+        break;
+      }
+    }
+    if(keep && !in_run)
+      runs[2 * nruns++] = MAX(col_min, cx * PRECHECK_SCALE);
+    if(keep)
+      runs[2 * nruns - 1] = MIN(col_max, (cx + 1) * PRECHECK_SCALE);
+    in_run = keep;
+  }
+  return nruns;
+}
 
 // determine the height of the horizontal slice each thread will process
 static int compute_slice_height(const int height)
@@ -358,6 +476,25 @@ void nlmeans_denoise(
   float *const restrict scratch_buf = dt_alloc_perthread_float(scratch_size, &padded_scratch_size);
   const int chk_height = compute_slice_height(roi_out->height);
   const int chk_width = compute_slice_width(roi_out->width);
+
+  // the optional precheck on a reduced copy of the image.  For the estimated distances, the distortion of a
+  //   patch adds up (2*radius+1)^2 pixel differences, and the dissimilarity of denoiseprofile adds the
+  //   center pixel with cp_norm
+  int cwidth = 0;
+  int cheight = 0;
+  coarse_block_t *const coarse = params->prune > 0.0f
+    ? init_coarse_image(inbuf, roi_in->width, roi_in->height, &cwidth, &cheight)
+    : NULL;
+  const float patch_area = (2 * radius + 1) * (2 * radius + 1);
+  dt_aligned_pixel_t coarse_wt;
+  for_each_channel(c)
+    coarse_wt[c] = params->center_weight < 0.0f
+      ? patch_area * params->norm[c]
+      : (patch_area * params->norm[c] + cp_norm) / (1.0f + params->center_weight);
+  // gh(x) falls below 'prune' for x > -log2(prune); turn that into the largest distance worth computing
+  const float max_dist = params->prune > 0.0f
+    ? (-log2f(MIN(params->prune, 1.0f)) + (params->center_weight < 0.0f ? 0.0f : 2.0f)) / params->sharpness
+    : FLT_MAX;
   DT_OMP_FOR(collapse(2))
   for(int chunk_top = 0 ; chunk_top < roi_out->height; chunk_top += chk_height)
   {
@@ -395,57 +532,88 @@ void nlmeans_denoise(
         const int col_min = MAX(chunk_left,-scol);
         const int col_max = MIN(chunk_right,roi_out->width - scol);
 
-        init_column_sums(col_sums,patch,inbuf,row_min,chunk_left,chunk_right,height,width,
-                         stride,radius,params->norm);
+        // the center patch is never skipped, it keeps the pixel's own value
+        const gboolean precheck = coarse && (patch->rows || patch->cols);
+        // the column sums need a full computation before the next row is processed
+        gboolean stale = TRUE;
+        // the ranges of columns for which the weights are computed
+        int runs[2 * PRECHECK_MAX_RUNS] = { col_min, col_max };
+        int nruns = 1;
         for(int row = row_min; row < row_max; row++)
         {
-          // add up the initial columns of the sliding window of total patch distortion
-          float distortion = 0.0f;
-          for(int i = col_min - radius; i < MIN(col_min+radius, col_max); i++)
+          if(precheck && (row == row_min || (row - chunk_top) % PRECHECK_BAND == 0))
+          {
+            const int band_end = MIN(row_max, row - (row - chunk_top) % PRECHECK_BAND + PRECHECK_BAND);
+            nruns = col_min < col_max
+              ? coarse_precheck(coarse,cwidth,cheight,patch,row,band_end,col_min,col_max,coarse_wt,max_dist,runs)
+              : 0;
+            if(!nruns)
+            {
+              row = band_end - 1;
+              stale = TRUE;
+              continue;
+            }
+          }
+          if(stale)
           {
-            distortion += col_sums[i];
+            init_column_sums(col_sums,patch,inbuf,row,chunk_left,chunk_right,height,width,
+                             stride,radius,params->norm);
+            stale = FALSE;
           }
-          // now proceed down the current row of the image
           const float *in = inbuf + stride * row;
           float *const out = outbuf + (size_t)4 * width * row;
           const int offset = patch->offset;
           const float sharpness = params->sharpness;
-          if(params->center_weight < 0.0f)
+          // the column sums are kept up to date in pcol_min..pcol_max-1, zero beyond
+          const int pcol_min = chunk_left - MIN(radius,MIN(chunk_left,chunk_left+scol));
+          const int pcol_max = chunk_right + MIN(radius,MIN(width-chunk_right,width-(chunk_right+scol)));
+          for(int r = 0; r < nruns; r++)
           {
-            // computation as used by denoise(non-local) iop
-            for(int col = col_min; col < col_max; col++)
+            const int col_lo = runs[2*r];
+            const int col_hi = runs[2*r+1];
+            // add up the initial columns of the sliding window of total patch distortion.  The column left of
+            //   the window is zero at col_min, but gets subtracted on entering the loop when starting later
+            float distortion = col_lo > col_min ? col_sums[col_lo-radius-1] : 0.0f;
+            for(int i = col_lo - radius; i < MIN(col_lo+radius, pcol_max); i++)
             {
-              distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
-              const float wt = gh(distortion * sharpness);
-              const float *const inpx = in+4*col;
-              const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
-              for_four_channels(c,aligned(pixel,out:16))
+              distortion += col_sums[i];
+            }
+            // now proceed along the current row of the image
+            if(params->center_weight < 0.0f)
+            {
+              // computation as used by denoise(non-local) iop
+              for(int col = col_lo; col < col_hi; col++)
               {
-                out[4*col+c] += pixel[c] * wt;
+                distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
+                const float wt = gh(distortion * sharpness);
+                const float *const inpx = in+4*col;
+                const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
+                for_four_channels(c,aligned(pixel,out:16))
+                {
+                  out[4*col+c] += pixel[c] * wt;
+                }
+                _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
               }
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
             }
-          }
-          else
-          {
-            // computation as used by denoiseprofiled iop with non-local means
-            for(int col = col_min; col < col_max; col++)
+            else
             {
-              distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
-              const float dissimilarity = (distortion + pixel_difference(in+4*col,in+4*col+offset,center_norm))
-                                           / (1.0f + params->center_weight);
-              const float wt = gh(fmaxf(0.0f, dissimilarity * sharpness - 2.0f));
-              const float *const inpx = in + 4*col;
-              const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
-              for_four_channels(c,aligned(pixel,out:16))
+              // computation as used by denoiseprofiled iop with non-local means
+              for(int col = col_lo; col < col_hi; col++)
               {
-                out[4*col+c] += pixel[c] * wt;
+                distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
+                const float dissimilarity = (distortion + pixel_difference(in+4*col,in+4*col+offset,center_norm))
+                                             / (1.0f + params->center_weight);
+                const float wt = gh(fmaxf(0.0f, dissimilarity * sharpness - 2.0f));
+                const float *const inpx = in + 4*col;
+                const dt_aligned_pixel_t pixel = { inpx[offset], inpx[offset+1], inpx[offset+2], 1.0f };
+                for_four_channels(c,aligned(pixel,out:16))
+                {
+                  out[4*col+c] += pixel[c] * wt;
+                }
+                _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
               }
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
             }
           }
-          const int pcol_min = chunk_left - MIN(radius,MIN(chunk_left,chunk_left+scol));
-          const int pcol_max = chunk_right + MIN(radius,MIN(width-chunk_right,width-(chunk_right+scol)));
           if(row < MIN(row_top, row_bot))
           {
             // top edge of patch was above top of RoI, so it had a value of zero; just add in the new row
@@ -542,6 +710,7 @@ void nlmeans_denoise(
   // clean up: free the work space
   dt_free_align(patches);
   dt_free_align(scratch_buf);
+  dt_free_align(coarse);
   return;
 }
 
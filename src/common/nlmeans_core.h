@@ -17,7 +17,9 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef DT_UNIT_TEST
 #include "iop/iop_api.h"
+#endif
 
 struct dt_nlmeans_param_t
 {
@@ -30,6 +32,7 @@ struct dt_nlmeans_param_t
   int patch_radius;	// radius of patches which are compared, 1..4
   int search_radius;	// radius around a pixel in which to compare patches (default = 7)
   int decimate;         // set to 1 to search only half the patches in the neighborhood (default = 0)
+  float prune;          // skip patches whose weight a coarse precheck estimates below this (default 0 = exact, CPU only)
   const float* const norm; // array of four per-channel weight factors
   dt_dev_pixelpipe_type_t pipetype;
   int kernel_init;	// CL: initialization (runs once)
@@ -0,0 +1,466 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/thumbstore.h"
+#ifndef DT_UNIT_TEST
+#include "common/darktable.h"
+#endif
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_THUMBSTORE_DATA_MAGIC 0x50485444u   // "DTHP"
+#define DT_THUMBSTORE_INDEX_MAGIC 0x49485444u  // "DTHI"
+#define DT_THUMBSTORE_RECORD_MAGIC 0x52485444u // "DTHR"
+#define DT_THUMBSTORE_VERSION 1
+
+// don't bother compacting small stores
+#define DT_THUMBSTORE_COMPACT_MIN ((size_t)64 << 20)
+
+typedef struct dt_thumbstore_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+} dt_thumbstore_header_t;
+
+// precedes every thumbnail in the data file
+typedef struct dt_thumbstore_record_t
+{
+  uint32_t magic;
+  uint32_t imgid;
+  uint16_t codec;
+  uint16_t color_space;
+  uint32_t width;
+  uint32_t height;
+  uint32_t length;
+} dt_thumbstore_record_t;
+
+// the index file is a log of these, a length of 0 removes the image
+typedef struct dt_thumbstore_index_t
+{
+  uint32_t imgid;
+  uint32_t length;
+  uint64_t offset;
+} dt_thumbstore_index_t;
+
+typedef struct dt_thumbstore_entry_t
+{
+  uint64_t offset; // of the record header
+  uint32_t length; // of the payload
+} dt_thumbstore_entry_t;
+
+static inline size_t _record_size(const dt_thumbstore_entry_t *e)
+{
+  return sizeof(dt_thumbstore_record_t) + e->length;
+}
+
+static gboolean _write_header(FILE *f, const uint32_t magic)
+{
+  const dt_thumbstore_header_t header = { magic, DT_THUMBSTORE_VERSION };
+  return fwrite(&header, sizeof(header), 1, f) == 1 && !fflush(f);
+}
+
+static gboolean _write_index(FILE *f, const uint32_t imgid, const dt_thumbstore_entry_t *e)
+{
+  const dt_thumbstore_index_t rec = { imgid, e ? e->length : 0, e ? e->offset : 0 };
+  return fwrite(&rec, sizeof(rec), 1, f) == 1 && !fflush(f);
+}
+
+static gboolean _valid_header(const gchar *contents, const gsize length, const uint32_t magic)
+{
+  const dt_thumbstore_header_t *header = (const dt_thumbstore_header_t *)contents;
+  return length >= sizeof(dt_thumbstore_header_t)
+    && header->magic == magic
+    && header->version == DT_THUMBSTORE_VERSION;
+}
+
+static void _set_entry(dt_thumbstore_t *store, const uint32_t imgid, const uint64_t offset, const uint32_t length)
+{
+  dt_thumbstore_entry_t *e = g_malloc(sizeof(dt_thumbstore_entry_t));
+  e->offset = offset;
+  e->length = length;
+  g_hash_table_insert(store->entries, GINT_TO_POINTER(imgid), e);
+}
+
+// start from scratch, both files are truncated
+static gboolean _reset(dt_thumbstore_t *store)
+{
+  if(store->data) fclose(store->data);
+  if(store->index) fclose(store->index);
+  store->data = g_fopen(store->data_path, "wb");
+  store->index = g_fopen(store->index_path, "wb");
+  g_hash_table_remove_all(store->entries);
+  store->data_size = sizeof(dt_thumbstore_header_t);
+  return store->data && store->index
+    && _write_header(store->data, DT_THUMBSTORE_DATA_MAGIC)
+    && _write_header(store->index, DT_THUMBSTORE_INDEX_MAGIC);
+}
+
+// rewrite the index from what we have in memory, drops the log history
+static gboolean _rewrite_index(dt_thumbstore_t *store)
+{
+  if(store->index) fclose(store->index);
+  store->index = g_fopen(store->index_path, "wb");
+  if(!store->index || !_write_header(store->index, DT_THUMBSTORE_INDEX_MAGIC)) return FALSE;
+
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, store->entries);
+  while(g_hash_table_iter_next(&it, &key, &value))
+    if(!_write_index(store->index, GPOINTER_TO_INT(key), value)) return FALSE;
+  return TRUE;
+}
+
+static gboolean _load(dt_thumbstore_t *store)
+{
+  gchar *contents = NULL;
+  gsize length = 0;
+
+  // check the data file and find its size
+  GStatBuf st;
+  FILE *f = g_fopen(store->data_path, "rb");
+  if(!f) return FALSE;
+  dt_thumbstore_header_t header = { 0 };
+  const gboolean valid_data = fread(&header, sizeof(header), 1, f) == 1
+    && _valid_header((gchar *)&header, sizeof(header), DT_THUMBSTORE_DATA_MAGIC)
+    && !g_stat(store->data_path, &st);
+  fclose(f);
+  if(!valid_data) return FALSE;
+  store->data_size = st.st_size;
+
+  if(!g_file_get_contents(store->index_path, &contents, &length, NULL)) return FALSE;
+  if(!_valid_header(contents, length, DT_THUMBSTORE_INDEX_MAGIC))
+  {
+    g_free(contents);
+    return FALSE;
+  }
+
+  // replay the log. an interrupted write might have left a partial record at the end,
+  // and the data could be missing if the data file was not synced to disk.
+  const size_t count = (length - sizeof(dt_thumbstore_header_t)) / sizeof(dt_thumbstore_index_t);
+  const dt_thumbstore_index_t *rec = (dt_thumbstore_index_t *)(contents + sizeof(dt_thumbstore_header_t));
+  gboolean consistent = sizeof(dt_thumbstore_header_t) + count * sizeof(dt_thumbstore_index_t) == length;
+  for(size_t k = 0; k < count; k++)
+  {
+    if(!rec[k].length)
+      g_hash_table_remove(store->entries, GINT_TO_POINTER(rec[k].imgid));
+    else if(rec[k].offset >= sizeof(dt_thumbstore_header_t)
+            && rec[k].offset + sizeof(dt_thumbstore_record_t) + rec[k].length <= store->data_size)
+      _set_entry(store, rec[k].imgid, rec[k].offset, rec[k].length);
+    else
+      consistent = FALSE;
+  }
+  g_free(contents);
+
+  store->data = g_fopen(store->data_path, "ab");
+  if(!store->data) return FALSE;
+  if(consistent)
+  {
+    store->index = g_fopen(store->index_path, "ab");
+    return store->index != NULL;
+  }
+  return _rewrite_index(store);
+}
+
+dt_thumbstore_t *dt_thumbstore_open(const char *basename)
+{
+  dt_thumbstore_t *store = g_malloc0(sizeof(dt_thumbstore_t));
+  dt_pthread_mutex_init(&store->lock, NULL);
+  store->data_path = g_strdup_printf("%s.pack", basename);
+  store->index_path = g_strdup_printf("%s.index", basename);
+  store->entries = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+  if(!_load(store) && !_reset(store))
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[thumbstore] can't open thumbnail store `%s'\n", store->data_path);
+    dt_thumbstore_close(store);
+    return NULL;
+  }
+
+  dt_print(DT_DEBUG_CACHE, "[thumbstore] opened `%s' with %u thumbnails, %zu bytes\n",
+           store->data_path, g_hash_table_size(store->entries), store->data_size);
+  return store;
+}
+
+static gint _sort_by_offset(gconstpointer a, gconstpointer b)
+{
+  const dt_thumbstore_entry_t *ea = *(const dt_thumbstore_entry_t **)a;
+  const dt_thumbstore_entry_t *eb = *(const dt_thumbstore_entry_t **)b;
+  return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+static gint _sort_index_by_offset(gconstpointer a, gconstpointer b)
+{
+  const dt_thumbstore_index_t *ia = (const dt_thumbstore_index_t *)a;
+  const dt_thumbstore_index_t *ib = (const dt_thumbstore_index_t *)b;
+  return ia->offset < ib->offset ? -1 : ia->offset > ib->offset;
+}
+
+static size_t _live_bytes(dt_thumbstore_t *store)
+{
+  GPtrArray *sorted = g_ptr_array_sized_new(g_hash_table_size(store->entries));
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, store->entries);
+  while(g_hash_table_iter_next(&it, &key, &value))
+    g_ptr_array_add(sorted, value);
+  g_ptr_array_sort(sorted, _sort_by_offset);
+
+  // copies share their record, count those once
+  size_t live = 0;
+  uint64_t last = 0;
+  for(guint k = 0; k < sorted->len; k++)
+  {
+    const dt_thumbstore_entry_t *e = g_ptr_array_index(sorted, k);
+    if(e->offset != last) live += _record_size(e);
+    last = e->offset;
+  }
+  g_ptr_array_free(sorted, TRUE);
+  return live;
+}
+
+// write all live records to new files and replace the old ones
+static void _compact(dt_thumbstore_t *store)
+{
+  GMappedFile *map = g_mapped_file_new(store->data_path, FALSE, NULL);
+  if(!map) return;
+  const gchar *contents = g_mapped_file_get_contents(map);
+
+  gchar *data_tmp = g_strdup_printf("%s.new", store->data_path);
+  gchar *index_tmp = g_strdup_printf("%s.new", store->index_path);
+  FILE *data = g_fopen(data_tmp, "wb");
+  FILE *index = g_fopen(index_tmp, "wb");
+  gboolean ok = data && index
+    && _write_header(data, DT_THUMBSTORE_DATA_MAGIC)
+    && _write_header(index, DT_THUMBSTORE_INDEX_MAGIC);
+
+  GArray *order = g_array_new(FALSE, FALSE, sizeof(dt_thumbstore_index_t));
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, store->entries);
+  while(g_hash_table_iter_next(&it, &key, &value))
+  {
+    const dt_thumbstore_entry_t *e = value;
+    const dt_thumbstore_index_t rec = { GPOINTER_TO_INT(key), e->length, e->offset };
+    g_array_append_val(order, rec);
+  }
+  // keep the order of the records, copies sharing one end up next to each other
+  g_array_sort(order, _sort_index_by_offset);
+
+  uint64_t size = sizeof(dt_thumbstore_header_t);
+  uint64_t last_old = 0, last_new = 0;
+  for(guint k = 0; ok && k < order->len; k++)
+  {
+    dt_thumbstore_index_t *rec = &g_array_index(order, dt_thumbstore_index_t, k);
+    if(rec->offset != last_old)
+    {
+      const size_t len = sizeof(dt_thumbstore_record_t) + rec->length;
+      ok = fwrite(contents + rec->offset, len, 1, data) == 1;
+      last_old = rec->offset;
+      last_new = size;
+      size += len;
+    }
+    rec->offset = last_new;
+    ok = ok && fwrite(rec, sizeof(*rec), 1, index) == 1;
+  }
+  ok = ok && !fflush(data) && !fflush(index);
+  if(data) fclose(data);
+  if(index) fclose(index);
+  g_mapped_file_unref(map);
+
+  if(ok)
+  {
+    // windows can't rename onto an existing file
+    g_unlink(store->data_path);
+    g_unlink(store->index_path);
+    if(g_rename(data_tmp, store->data_path) || g_rename(index_tmp, store->index_path))
+    {
+      // this leaves us without a valid store, it is created again on next start
+      dt_print(DT_DEBUG_ALWAYS, "[thumbstore] failed to replace `%s'\n", store->data_path);
+      g_unlink(store->index_path);
+    }
+    else
+      dt_print(DT_DEBUG_CACHE, "[thumbstore] compacted `%s' from %zu to %" PRIu64 " bytes\n",
+               store->data_path, store->data_size, size);
+  }
+  g_unlink(data_tmp);
+  g_unlink(index_tmp);
+
+  g_array_free(order, TRUE);
+  g_free(data_tmp);
+  g_free(index_tmp);
+}
+
+void dt_thumbstore_close(dt_thumbstore_t *store)
+{
+  if(!store) return;
+  const gboolean opened = store->data && store->index;
+  if(store->map) g_mapped_file_unref(store->map);
+  if(store->data) fclose(store->data);
+  if(store->index) fclose(store->index);
+
+  if(opened && store->data_size > DT_THUMBSTORE_COMPACT_MIN
+     && 2 * _live_bytes(store) < store->data_size)
+    _compact(store);
+
+  g_hash_table_destroy(store->entries);
+  g_free(store->data_path);
+  g_free(store->index_path);
+  dt_pthread_mutex_destroy(&store->lock);
+  g_free(store);
+}
+
+gboolean dt_thumbstore_contains(dt_thumbstore_t *store, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&store->lock);
+  const gboolean found = g_hash_table_contains(store->entries, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&store->lock);
+  return found;
+}
+
+int dt_thumbstore_count(dt_thumbstore_t *store)
+{
+  dt_pthread_mutex_lock(&store->lock);
+  const int count = g_hash_table_size(store->entries);
+  dt_pthread_mutex_unlock(&store->lock);
+  return count;
+}
+
+gboolean dt_thumbstore_lookup(dt_thumbstore_t *store, const uint32_t imgid, dt_thumbstore_blob_t *blob)
+{
+  memset(blob, 0, sizeof(dt_thumbstore_blob_t));
+
+  dt_pthread_mutex_lock(&store->lock);
+  const dt_thumbstore_entry_t *e = g_hash_table_lookup(store->entries, GINT_TO_POINTER(imgid));
+  if(!e)
+  {
+    dt_pthread_mutex_unlock(&store->lock);
+    return FALSE;
+  }
+  const uint64_t offset = e->offset;
+  const uint32_t length = e->length;
+
+  // map again if the record has been appended after the last mapping
+  if(!store->map || offset + _record_size(e) > g_mapped_file_get_length(store->map))
+  {
+    if(store->map) g_mapped_file_unref(store->map);
+    store->map = g_mapped_file_new(store->data_path, FALSE, NULL);
+  }
+  // readers keep the mapping alive while the next lookup might replace it
+  GMappedFile *map = store->map ? g_mapped_file_ref(store->map) : NULL;
+  dt_pthread_mutex_unlock(&store->lock);
+
+  if(!map) return FALSE;
+  if(offset + sizeof(dt_thumbstore_record_t) + length > g_mapped_file_get_length(map))
+  {
+    g_mapped_file_unref(map);
+    return FALSE;
+  }
+
+  const uint8_t *contents = (const uint8_t *)g_mapped_file_get_contents(map);
+  dt_thumbstore_record_t record;
+  memcpy(&record, contents + offset, sizeof(record));
+  if(record.magic != DT_THUMBSTORE_RECORD_MAGIC || record.length != length)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[thumbstore] corrupt record for image %" PRIu32 " in `%s'\n",
+             imgid, store->data_path);
+    g_mapped_file_unref(map);
+    return FALSE;
+  }
+
+  blob->data = contents + offset + sizeof(dt_thumbstore_record_t);
+  blob->length = length;
+  blob->codec = record.codec;
+  blob->width = record.width;
+  blob->height = record.height;
+  blob->color_space = record.color_space;
+  blob->map = map;
+  return TRUE;
+}
+
+void dt_thumbstore_blob_release(dt_thumbstore_blob_t *blob)
+{
+  if(blob->map) g_mapped_file_unref(blob->map);
+  memset(blob, 0, sizeof(dt_thumbstore_blob_t));
+}
+
+gboolean dt_thumbstore_insert(dt_thumbstore_t *store,
+                              const uint32_t imgid,
+                              const dt_thumbstore_codec_t codec,
+                              const uint32_t width,
+                              const uint32_t height,
+                              const int color_space,
+                              const void *data,
+                              const size_t length)
+{
+  if(!length || length > UINT32_MAX) return FALSE;
+
+  const dt_thumbstore_record_t record = { DT_THUMBSTORE_RECORD_MAGIC, imgid, codec, color_space,
+                                          width, height, length };
+  dt_pthread_mutex_lock(&store->lock);
+  const uint64_t offset = store->data_size;
+  gboolean ok = fwrite(&record, sizeof(record), 1, store->data) == 1
+    && fwrite(data, length, 1, store->data) == 1
+    && !fflush(store->data);
+  if(ok)
+  {
+    // the data has to be there before the index points to it
+    const dt_thumbstore_entry_t e = { offset, length };
+    store->data_size += _record_size(&e);
+    ok = _write_index(store->index, imgid, &e);
+    if(ok) _set_entry(store, imgid, offset, length);
+  }
+  else
+  {
+    // disk full? whatever has been written is garbage now
+    fseek(store->data, 0, SEEK_END);
+    store->data_size = MAX(offset, (uint64_t)ftell(store->data));
+  }
+  dt_pthread_mutex_unlock(&store->lock);
+  return ok;
+}
+
+void dt_thumbstore_remove(dt_thumbstore_t *store, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&store->lock);
+  if(g_hash_table_remove(store->entries, GINT_TO_POINTER(imgid)))
+    _write_index(store->index, imgid, NULL);
+  dt_pthread_mutex_unlock(&store->lock);
+}
+
+gboolean dt_thumbstore_copy(dt_thumbstore_t *store, const uint32_t dst_imgid, const uint32_t src_imgid)
+{
+  dt_pthread_mutex_lock(&store->lock);
+  const dt_thumbstore_entry_t *src = g_hash_table_lookup(store->entries, GINT_TO_POINTER(src_imgid));
+  gboolean ok = src != NULL;
+  if(ok)
+  {
+    const dt_thumbstore_entry_t e = *src;
+    ok = _write_index(store->index, dst_imgid, &e);
+    if(ok) _set_entry(store, dst_imgid, e.offset, e.length);
+  }
+  dt_pthread_mutex_unlock(&store->lock);
+  return ok;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
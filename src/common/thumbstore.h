@@ -0,0 +1,99 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+#include <glib.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/**
+ * packed on-disk store for the thumbnails of one mipmap level.
+ *
+ * instead of one small file per image, all compressed thumbnails of a level are
+ * appended to a single data file which is memory mapped for reading. a second,
+ * append-only index file maps image ids to records in the data file so opening the
+ * store doesn't need to scan the data. replaced and removed thumbnails leave garbage
+ * in the data file, it is compacted when the store is closed and more than half of
+ * it is unused.
+ */
+
+typedef enum dt_thumbstore_codec_t
+{
+  DT_THUMBSTORE_CODEC_JPEG = 0,
+  DT_THUMBSTORE_CODEC_QOI = 1,
+} dt_thumbstore_codec_t;
+
+typedef struct dt_thumbstore_t
+{
+  dt_pthread_mutex_t lock;
+  gchar *data_path;
+  gchar *index_path;
+  FILE *data;          // opened for appending
+  FILE *index;         // opened for appending
+  GMappedFile *map;    // read-only view of the data file, replaced when it grew
+  size_t data_size;    // bytes in the data file
+  GHashTable *entries; // imgid -> dt_thumbstore_entry_t
+} dt_thumbstore_t;
+
+/** a compressed thumbnail, valid until dt_thumbstore_blob_release() */
+typedef struct dt_thumbstore_blob_t
+{
+  const uint8_t *data;
+  size_t length;
+  dt_thumbstore_codec_t codec;
+  uint32_t width, height;
+  int color_space;
+  GMappedFile *map;
+} dt_thumbstore_blob_t;
+
+/** open or create the store with files <basename>.pack and <basename>.index, NULL on failure */
+dt_thumbstore_t *dt_thumbstore_open(const char *basename);
+/** close the store, compacting the data file if it is mostly garbage */
+void dt_thumbstore_close(dt_thumbstore_t *store);
+
+gboolean dt_thumbstore_contains(dt_thumbstore_t *store, const uint32_t imgid);
+
+/** get the compressed thumbnail of an image, returns FALSE if there is none */
+gboolean dt_thumbstore_lookup(dt_thumbstore_t *store, const uint32_t imgid, dt_thumbstore_blob_t *blob);
+void dt_thumbstore_blob_release(dt_thumbstore_blob_t *blob);
+
+/** append a compressed thumbnail, replacing an older one of the same image */
+gboolean dt_thumbstore_insert(dt_thumbstore_t *store,
+                              const uint32_t imgid,
+                              const dt_thumbstore_codec_t codec,
+                              const uint32_t width,
+                              const uint32_t height,
+                              const int color_space,
+                              const void *data,
+                              const size_t length);
+
+void dt_thumbstore_remove(dt_thumbstore_t *store, const uint32_t imgid);
+
+/** let dst_imgid share the thumbnail of src_imgid, returns FALSE if there is none */
+gboolean dt_thumbstore_copy(dt_thumbstore_t *store, const uint32_t dst_imgid, const uint32_t src_imgid);
+
+/** number of thumbnails in the store */
+int dt_thumbstore_count(dt_thumbstore_t *store);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,264 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/workqueue.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+void dt_workqueue_init(dt_workqueue_t *wq, const int shards, const int queues)
+{
+  wq->num_shards = MAX(1, shards);
+  wq->num_queues = CLAMP(queues, 1, DT_WORKQUEUE_MAX_QUEUES);
+  wq->shards = (dt_workqueue_shard_t *)calloc(wq->num_shards, sizeof(dt_workqueue_shard_t));
+  for(int k = 0; k < wq->num_shards; k++)
+    dt_pthread_mutex_init(&wq->shards[k].lock, NULL);
+
+  dt_atomic_set_int(&wq->next_shard, 0);
+  for(int q = 0; q < DT_WORKQUEUE_MAX_QUEUES; q++)
+  {
+    dt_atomic_set_int(&wq->queued[q], 0);
+    dt_atomic_set_int(&wq->running[q], 0);
+    wq->max_running[q] = 0;
+  }
+}
+
+void dt_workqueue_cleanup(dt_workqueue_t *wq)
+{
+  for(int k = 0; k < wq->num_shards; k++)
+    dt_pthread_mutex_destroy(&wq->shards[k].lock);
+  free(wq->shards);
+  wq->shards = NULL;
+  wq->num_shards = 0;
+}
+
+void dt_workqueue_set_max_running(dt_workqueue_t *wq, const int queue, const int max)
+{
+  wq->max_running[queue] = MAX(0, max);
+}
+
+static inline gboolean _saturated(dt_workqueue_t *wq, const int q)
+{
+  return wq->max_running[q] && dt_atomic_get_int(&wq->running[q]) >= wq->max_running[q];
+}
+
+// take a running slot of a class, fails if the class is limited and all slots are taken
+static gboolean _reserve(dt_workqueue_t *wq, const int q)
+{
+  if(!wq->max_running[q])
+  {
+    dt_atomic_add_int(&wq->running[q], 1);
+    return TRUE;
+  }
+
+  int running = dt_atomic_get_int(&wq->running[q]);
+  while(running < wq->max_running[q])
+  {
+    if(dt_atomic_CAS_int(&wq->running[q], &running, running + 1))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+// shard lock must be held for all of the following
+static void _link(dt_workqueue_shard_t *s, dt_workqueue_node_t *node, const gboolean front)
+{
+  const int q = node->queue;
+  if(front)
+  {
+    node->prev = NULL;
+    node->next = s->head[q];
+    if(s->head[q]) s->head[q]->prev = node;
+    else s->tail[q] = node;
+    s->head[q] = node;
+  }
+  else
+  {
+    node->next = NULL;
+    node->prev = s->tail[q];
+    if(s->tail[q]) s->tail[q]->next = node;
+    else s->head[q] = node;
+    s->tail[q] = node;
+  }
+}
+
+static void _unlink(dt_workqueue_t *wq, dt_workqueue_shard_t *s, dt_workqueue_node_t *node)
+{
+  const int q = node->queue;
+  if(node->prev) node->prev->next = node->next;
+  else s->head[q] = node->next;
+  if(node->next) node->next->prev = node->prev;
+  else s->tail[q] = node->prev;
+  node->prev = node->next = NULL;
+  g_atomic_int_set(&node->shard, -1);
+  dt_atomic_sub_int(&wq->queued[q], 1);
+}
+
+// the class a shard would serve next, ties go to the more urgent class
+static int _best_class(dt_workqueue_t *wq, dt_workqueue_shard_t *s, const int only, int *priority)
+{
+  int best = -1;
+  for(int q = 0; q < wq->num_queues; q++)
+  {
+    if(!s->head[q] || (only >= 0 && q != only) || _saturated(wq, q)) continue;
+    if(best < 0 || s->head[q]->priority > s->head[best]->priority) best = q;
+  }
+  *priority = best < 0 ? -1 : s->head[best]->priority;
+  return best;
+}
+
+static void _age(dt_workqueue_t *wq, dt_workqueue_shard_t *s, const int except)
+{
+  for(int q = 0; q < wq->num_queues; q++)
+    if(q != except && s->head[q]) s->head[q]->priority++;
+}
+
+static dt_workqueue_node_t *_pop_from(dt_workqueue_t *wq,
+                                      dt_workqueue_shard_t *s,
+                                      const int only,
+                                      const int min_priority)
+{
+  // another worker might have taken the last running slot of the best class, try again then
+  for(int tries = 0; tries < wq->num_queues; tries++)
+  {
+    int priority = -1;
+    const int q = _best_class(wq, s, only, &priority);
+    if(q < 0 || priority < min_priority) return NULL;
+    if(!_reserve(wq, q)) continue;
+
+    dt_workqueue_node_t *node = s->head[q];
+    _unlink(wq, s, node);
+    _age(wq, s, q);
+    return node;
+  }
+  return NULL;
+}
+
+static dt_workqueue_node_t *_steal(dt_workqueue_t *wq,
+                                   const int own,
+                                   const int only,
+                                   const int min_priority)
+{
+  // first pass avoids busy shards, second pass makes sure we don't miss anything
+  for(int pass = 0; pass < 2; pass++)
+  {
+    for(int i = 1; i < wq->num_shards; i++)
+    {
+      dt_workqueue_shard_t *s = &wq->shards[(own + i) % wq->num_shards];
+      if(pass == 0)
+      {
+        if(dt_pthread_mutex_trylock(&s->lock)) continue;
+      }
+      else
+        dt_pthread_mutex_lock(&s->lock);
+
+      dt_workqueue_node_t *node = _pop_from(wq, s, only, min_priority);
+      dt_pthread_mutex_unlock(&s->lock);
+      if(node) return node;
+    }
+  }
+  return NULL;
+}
+
+void dt_workqueue_push(dt_workqueue_t *wq,
+                       dt_workqueue_node_t *node,
+                       const int queue,
+                       const int priority,
+                       const gboolean front)
+{
+  const int shard = (dt_atomic_add_int(&wq->next_shard, 1) & INT_MAX) % wq->num_shards;
+  dt_workqueue_shard_t *s = &wq->shards[shard];
+
+  node->queue = CLAMP(queue, 0, wq->num_queues - 1);
+  node->priority = priority;
+
+  dt_pthread_mutex_lock(&s->lock);
+  _link(s, node, front);
+  g_atomic_int_set(&node->shard, shard);
+  dt_atomic_add_int(&wq->queued[node->queue], 1);
+  dt_pthread_mutex_unlock(&s->lock);
+}
+
+gboolean dt_workqueue_remove(dt_workqueue_t *wq, dt_workqueue_node_t *node)
+{
+  const int shard = g_atomic_int_get(&node->shard);
+  if(shard < 0) return FALSE;
+
+  dt_workqueue_shard_t *s = &wq->shards[shard];
+  dt_pthread_mutex_lock(&s->lock);
+  // a worker might have popped it meanwhile
+  const gboolean queued = g_atomic_int_get(&node->shard) == shard;
+  if(queued) _unlink(wq, s, node);
+  dt_pthread_mutex_unlock(&s->lock);
+  return queued;
+}
+
+static int _most_urgent(dt_workqueue_t *wq)
+{
+  for(int q = 0; q < wq->num_queues; q++)
+    if(dt_atomic_get_int(&wq->queued[q]) > 0 && !_saturated(wq, q)) return q;
+  return -1;
+}
+
+gboolean dt_workqueue_runnable(dt_workqueue_t *wq)
+{
+  return _most_urgent(wq) >= 0;
+}
+
+dt_workqueue_node_t *dt_workqueue_pop(dt_workqueue_t *wq, const int worker)
+{
+  const int urgent = _most_urgent(wq);
+  if(urgent < 0) return NULL;
+
+  const int own = MAX(0, worker) % wq->num_shards;
+  dt_workqueue_shard_t *s = &wq->shards[own];
+
+  dt_pthread_mutex_lock(&s->lock);
+  int priority = -1;
+  const int local = _best_class(wq, s, -1, &priority);
+  dt_workqueue_node_t *node = local == urgent ? _pop_from(wq, s, -1, -1) : NULL;
+  dt_pthread_mutex_unlock(&s->lock);
+  if(node) return node;
+
+  if(local < 0)
+    return _steal(wq, own, -1, -1);
+
+  // the most urgent class is only queued elsewhere. take it unless our own best item
+  // has been passed over often enough already, just like it would be in a single queue.
+  node = _steal(wq, own, urgent, priority);
+
+  dt_pthread_mutex_lock(&s->lock);
+  if(node)
+    _age(wq, s, -1);
+  else
+    node = _pop_from(wq, s, -1, -1);
+  dt_pthread_mutex_unlock(&s->lock);
+
+  return node ? node : _steal(wq, own, -1, -1);
+}
+
+void dt_workqueue_done(dt_workqueue_t *wq, const dt_workqueue_node_t *node)
+{
+  dt_atomic_sub_int(&wq->running[node->queue], 1);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
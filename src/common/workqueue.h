@@ -0,0 +1,102 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/atomic.h"
+#include "common/dtpthread.h"
+#include <glib.h>
+#include <inttypes.h>
+
+/**
+ * a work stealing queue for a pool of workers.
+ *
+ * items are spread over shards with their own lock, each worker pops from its own
+ * shard first and steals from the other ones if that is empty, so workers don't
+ * fight over a single lock.
+ * every shard holds one FIFO per priority class. the class with the lowest index is the
+ * most urgent one, the head of a class not chosen gets its priority incremented so
+ * no class starves.
+ * the nodes are embedded into the queued items, pushing and popping never allocates.
+ */
+
+#define DT_WORKQUEUE_MAX_QUEUES 8
+
+typedef struct dt_workqueue_node_t
+{
+  struct dt_workqueue_node_t *prev, *next;
+  int32_t shard;    // shard holding the node, -1 if not queued
+  int32_t queue;    // priority class
+  int32_t priority; // incremented every time another class has been preferred
+} dt_workqueue_node_t;
+
+typedef struct dt_workqueue_shard_t
+{
+  dt_pthread_mutex_t lock;
+  dt_workqueue_node_t *head[DT_WORKQUEUE_MAX_QUEUES];
+  dt_workqueue_node_t *tail[DT_WORKQUEUE_MAX_QUEUES];
+} __attribute__((aligned(64))) dt_workqueue_shard_t;
+
+typedef struct dt_workqueue_t
+{
+  int32_t num_shards;
+  int32_t num_queues;
+  dt_workqueue_shard_t *shards;
+  dt_atomic_int next_shard;                       // round robin for pushing
+  dt_atomic_int queued[DT_WORKQUEUE_MAX_QUEUES];  // per class over all shards
+  dt_atomic_int running[DT_WORKQUEUE_MAX_QUEUES]; // popped but not yet done
+  int32_t max_running[DT_WORKQUEUE_MAX_QUEUES];   // 0 is unlimited
+} dt_workqueue_t;
+
+void dt_workqueue_init(dt_workqueue_t *wq, const int shards, const int queues);
+void dt_workqueue_cleanup(dt_workqueue_t *wq);
+
+/** limit the number of items of one class being processed at the same time, 0 is unlimited */
+void dt_workqueue_set_max_running(dt_workqueue_t *wq, const int queue, const int max);
+
+/** add an item to a class, at the front if it's more important than what is queued already */
+void dt_workqueue_push(dt_workqueue_t *wq,
+                       dt_workqueue_node_t *node,
+                       const int queue,
+                       const int priority,
+                       const gboolean front);
+
+/** remove a queued item, returns FALSE if it has been popped already */
+gboolean dt_workqueue_remove(dt_workqueue_t *wq, dt_workqueue_node_t *node);
+
+/** get the next item for the given worker, NULL if there's nothing to do.
+    the item must be passed to dt_workqueue_done() after processing. */
+dt_workqueue_node_t *dt_workqueue_pop(dt_workqueue_t *wq, const int worker);
+
+/** an item returned by dt_workqueue_pop() has been processed */
+void dt_workqueue_done(dt_workqueue_t *wq, const dt_workqueue_node_t *node);
+
+/** number of queued items in a class */
+static inline int dt_workqueue_length(dt_workqueue_t *wq, const int queue)
+{
+  return dt_atomic_get_int(&wq->queued[queue]);
+}
+
+/** is there anything a worker could pop right now? */
+gboolean dt_workqueue_runnable(dt_workqueue_t *wq);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
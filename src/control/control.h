@@ -21,6 +21,7 @@
 #include "common/darktable.h"
 #include "common/dtpthread.h"
 #include "common/action.h"
+#include "common/workqueue.h"
 #include "control/settings.h"
 
 #include <gtk/gtk.h>
@@ -178,15 +179,19 @@ typedef struct dt_control_t
 
   // job management
   gboolean running;
-  gboolean export_scheduled;
   dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
   pthread_cond_t cond;
   int32_t num_threads;
   pthread_t *thread, kick_on_workers_thread, update_gphoto_thread;
-  dt_job_t **job;
+  dt_atomic_int idle_workers;
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  // all queues, one shard per worker
+  dt_workqueue_t queue;
+
+  // system foreground jobs are deduplicated, queue_mutex protects the following
+  dt_job_t **job;       // the running ones
+  GList *system_fg;     // the queued ones, most recent first
+  size_t system_fg_length;
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
@@ -27,6 +27,7 @@
 #include "common/debug.h"
 #include "common/history.h"
 #include "common/image.h"
+#include "common/mipmap_cache.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "crawler.h"
@@ -897,6 +898,15 @@ static void _update_img_thumbs(const dt_imgid_t imgid,
   // dt_history_hash_set_mipmap(imgid);
 }
 
+// thumbnails up to max_mip are processed from the full image unless they all come
+// from the embedded jpeg
+static gboolean _thumbs_from_full(const dt_imgid_t imgid,
+                                  const dt_mipmap_size_t max_mip)
+{
+  const char *min = dt_conf_get_string_const("plugins/lighttable/thumbnail_raw_min_level");
+  return max_mip > dt_mipmap_cache_get_min_mip_from_pref(min) || dt_image_altered(imgid);
+}
+
 static int _update_all_thumbs(const dt_mipmap_size_t max_mip)
 {
   int missed = 0;
@@ -911,26 +921,48 @@ static int _update_all_thumbs(const dt_mipmap_size_t max_mip)
                               "  OR thumb_maxmip < ?1",
                                 -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, max_mip);
-  while(sqlite3_step(stmt) == SQLITE_ROW && _still_thumbing())
+
+  // the next image is decoded in the background while the thumbs of the current one are made
+  const size_t prefetch_bytes = dt_get_available_mem() / 4;
+  dt_imgid_t current = NO_IMGID;
+  int64_t current_stamp = 0;
+  while(_still_thumbing())
   {
-    const dt_imgid_t imgid = sqlite3_column_int(stmt, 0);
-    const int64_t stamp = MAX(sqlite3_column_int64(stmt, 1), sqlite3_column_int64(stmt, 2));
+    dt_imgid_t imgid = NO_IMGID;
+    int64_t stamp = 0;
+    while(!dt_is_valid_imgid(imgid) && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      const dt_imgid_t id = sqlite3_column_int(stmt, 0);
 
-    char path[PATH_MAX] = { 0 };
-    gboolean from_cache = FALSE;
-    dt_image_full_path(imgid, path, sizeof(path), &from_cache);
-    const gboolean available = dt_util_test_image_file(path);
+      char path[PATH_MAX] = { 0 };
+      gboolean from_cache = FALSE;
+      dt_image_full_path(id, path, sizeof(path), &from_cache);
+      const gboolean available = dt_util_test_image_file(path);
 
-    if(available)
-    {
-      _update_img_thumbs(imgid, max_mip, stamp);
-      updated++;
+      if(available)
+      {
+        imgid = id;
+        stamp = MAX(sqlite3_column_int64(stmt, 1), sqlite3_column_int64(stmt, 2));
+      }
+      else
+      {
+        missed++;
+        dt_print(DT_DEBUG_CACHE, "[thumb crawler] '%s' id=%d NOT available\n", path, id);
+      }
     }
-    else
+
+    if(dt_is_valid_imgid(imgid) && _thumbs_from_full(imgid, max_mip))
+      dt_mipmap_cache_prefetch_full(darktable.mipmap_cache, imgid, prefetch_bytes);
+
+    if(dt_is_valid_imgid(current))
     {
-      missed++;
-      dt_print(DT_DEBUG_CACHE, "[thumb crawler] '%s' id=%d NOT available\n", path, imgid);
+      _update_img_thumbs(current, max_mip, current_stamp);
+      updated++;
     }
+
+    if(!dt_is_valid_imgid(imgid)) break;
+    current = imgid;
+    current_stamp = stamp;
   }
   sqlite3_finalize(stmt);
 
@@ -990,11 +1022,15 @@ void dt_update_thumbs_thread(void *p)
   dt_set_backthumb_time(5.0);
   int updated = 0;
 
-  // return if any thumbcache dir is not writable
+  // return if any thumbcache dir is not writable, the packed stores all live in the top one
+  const gboolean packed = darktable.mipmap_cache->disk_format != DT_MIPMAP_DISK_FILES;
   for(dt_mipmap_size_t k = DT_MIPMAP_1; k <= DT_MIPMAP_7; k++)
   {
     char dirname[PATH_MAX] = { 0 };
-    snprintf(dirname, sizeof(dirname), "%s.d/%d", darktable.mipmap_cache->cachedir, k);
+    if(packed)
+      snprintf(dirname, sizeof(dirname), "%s.d", darktable.mipmap_cache->cachedir);
+    else
+      snprintf(dirname, sizeof(dirname), "%s.d/%d", darktable.mipmap_cache->cachedir, k);
     if(g_mkdir_with_parents(dirname, 0750))
     {
       dt_print(DT_DEBUG_CACHE, "[thumb crawler] can't create mipmap dir '%s'\n", dirname);
@@ -34,6 +34,7 @@ typedef struct worker_thread_parameters_t
 
 typedef struct _dt_job_t
 {
+  dt_workqueue_node_t node; // must be first, holds priority and queue while scheduled
   dt_job_execute_callback execute;
   void *params;
   size_t params_size;
@@ -44,7 +45,6 @@ typedef struct _dt_job_t
   dt_pthread_mutex_t wait_mutex;
 
   dt_job_state_t state;
-  unsigned char priority;
   dt_job_queue_t queue;
 
   dt_job_state_change_callback state_changed_cb;
@@ -172,7 +172,7 @@ void dt_control_job_set_state_callback(_dt_job_t *job, dt_job_state_change_callb
 static void dt_control_job_print(_dt_job_t *job)
 {
   if(!job) return;
-  dt_print(DT_DEBUG_CONTROL, "%s | queue: %d | priority: %d", job->description, job->queue, job->priority);
+  dt_print(DT_DEBUG_CONTROL, "%s | queue: %d | priority: %d", job->description, job->queue, job->node.priority);
 }
 
 void dt_control_job_cancel(_dt_job_t *job)
@@ -242,65 +242,48 @@ static _dt_job_t *_control_schedule_job(dt_control_t *control)
 {
   /*
    * job scheduling works like this:
-   * - when there is a single job in the queue head with a maximal priority -> pick it
-   * - otherwise pick among the ones with the maximal priority in the following order:
+   * - every worker takes jobs from its own shard of the queues, and steals
+   *   from the others when that is empty
+   * - among the heads with the maximal priority we pick in the following order:
    *   * user foreground
    *   * system foreground
    *   * user background
+   *   * user export
    *   * system background
-   * - the jobs that didn't get picked this round get their priority incremented
+   * - the heads that didn't get picked this round get their priority incremented
+   * - only one export runs at a time
+   * see common/workqueue.c for the details.
    */
+  const int32_t threadid = dt_control_get_threadid();
+  _dt_job_t *job = (_dt_job_t *)dt_workqueue_pop(&control->queue, threadid);
+  if(!job) return NULL;
 
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  // find the job
-  _dt_job_t *job = NULL;
-  int winner_queue = DT_JOB_QUEUE_MAX;
-  int max_priority = -1;
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  if(job->queue == DT_JOB_QUEUE_SYSTEM_FG)
   {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
-    if(_job->priority > max_priority)
+    // move it from the queued to the scheduled ones (for job deduping)
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    GList *link = g_list_find(control->system_fg, job);
+    if(link)
     {
-      max_priority = _job->priority;
-      job = _job;
-      winner_queue = i;
+      control->system_fg = g_list_delete_link(control->system_fg, link);
+      control->system_fg_length--;
     }
-  }
-
-  if(!job)
-  {
+    control->job[threadid] = job;
     dt_pthread_mutex_unlock(&control->queue_mutex);
-    return NULL;
   }
 
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
-  // is strictly bigger
-  // invariant -> job is the one we are looking for
-
-  // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
-
-  // and place it in scheduled job array (for job deduping)
-  control->job[dt_control_get_threadid()] = job;
-
-  // increment the priorities of the others
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
-  {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
-  }
-
-  dt_pthread_mutex_unlock(&control->queue_mutex);
-
   return job;
 }
 
+static inline void _control_notify_workers(dt_control_t *control)
+{
+  // busy workers will come back to the queue on their own
+  if(dt_atomic_get_int(&control->idle_workers) <= 0) return;
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  pthread_cond_broadcast(&control->cond);
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+}
+
 static void _control_job_execute(_dt_job_t *job)
 {
   dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f ", DT_CTL_WORKER_RESERVED + dt_control_get_threadid(),
@@ -335,10 +318,16 @@ static gboolean _control_run_job(dt_control_t *control)
   dt_pthread_mutex_unlock(&job->wait_mutex);
 
   // remove the job from scheduled job array (for job deduping)
-  dt_pthread_mutex_lock(&control->queue_mutex);
-  control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  if(job->queue == DT_JOB_QUEUE_SYSTEM_FG)
+  {
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    control->job[dt_control_get_threadid()] = NULL;
+    dt_pthread_mutex_unlock(&control->queue_mutex);
+  }
+
+  // this might have been the export others were waiting for
+  dt_workqueue_done(&control->queue, &job->node);
+  if(dt_workqueue_runnable(&control->queue)) _control_notify_workers(control);
 
   // and free it
   dt_control_job_dispose(job);
@@ -406,21 +395,17 @@ gboolean dt_control_add_job(dt_control_t *control,
 
   job->queue = queue_id;
 
-  _dt_job_t *job_for_disposal = NULL;
-
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
-
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %d | ", dt_workqueue_length(&control->queue, queue_id));
   dt_control_job_print(job);
   dt_print_nts(DT_DEBUG_CONTROL, "\n");
 
   if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
   {
     // this is a stack with limited size and bubble up and all that stuff
-    job->priority = DT_CONTROL_FG_PRIORITY;
+    _dt_job_t *job_for_disposal = NULL;
+    _dt_job_t *job_dropped = NULL;
+
+    dt_pthread_mutex_lock(&control->queue_mutex);
 
     // check if we have already scheduled the job
     for(int k = 0; k < control->num_threads; k++)
@@ -442,7 +427,7 @@ gboolean dt_control_add_job(dt_control_t *control,
     }
 
     // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    for(GList *iter = control->system_fg; iter; iter = g_list_next(iter))
     {
       _dt_job_t *other_job = (_dt_job_t *)iter->data;
       if(_control_job_equal(job, other_job))
@@ -451,55 +436,56 @@ gboolean dt_control_add_job(dt_control_t *control,
         dt_control_job_print(other_job);
         dt_print_nts(DT_DEBUG_CONTROL, "\n");
 
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
+        control->system_fg = g_list_delete_link(control->system_fg, iter);
+        control->system_fg_length--;
 
         job_for_disposal = job;
 
-        job = other_job;
+        // a worker got hold of it meanwhile, so it's as good as scheduled
+        if(!dt_workqueue_remove(&control->queue, &other_job->node))
+          job = NULL;
+        else
+          job = other_job;
         break; // there can't be any further copy in the list
       }
     }
 
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
-
-    // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
+    if(job)
     {
-      GList *last = g_list_last(*queue);
-      _control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
+      // now we can add the new job to the stack
+      control->system_fg = g_list_prepend(control->system_fg, job);
+      control->system_fg_length++;
+      _control_job_set_state(job, DT_JOB_STATE_QUEUED);
+      dt_workqueue_push(&control->queue, &job->node, queue_id, DT_CONTROL_FG_PRIORITY, TRUE);
+
+      // and take care of the maximal queue size
+      if(control->system_fg_length > DT_CONTROL_MAX_JOBS)
+      {
+        GList *last = g_list_last(control->system_fg);
+        if(dt_workqueue_remove(&control->queue, &((_dt_job_t *)last->data)->node))
+          job_dropped = (_dt_job_t *)last->data;
+        control->system_fg = g_list_delete_link(control->system_fg, last);
+        control->system_fg_length--;
+      }
     }
 
-    control->queue_length[queue_id] = length;
+    dt_pthread_mutex_unlock(&control->queue_mutex);
+
+    // dispose of dropped jobs, if any
+    _control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose(job_for_disposal);
+    _control_job_set_state(job_dropped, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose(job_dropped);
   }
   else
   {
-    // the rest are FIFOs
-    if(queue_id == DT_JOB_QUEUE_USER_BG ||
-       queue_id == DT_JOB_QUEUE_USER_EXPORT ||
-       queue_id == DT_JOB_QUEUE_SYSTEM_BG)
-      job->priority = 0;
-    else
-      job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    // the rest are FIFOs, they don't need any global lock
+    const int priority = queue_id == DT_JOB_QUEUE_USER_FG ? DT_CONTROL_FG_PRIORITY : 0;
+    _control_job_set_state(job, DT_JOB_STATE_QUEUED);
+    dt_workqueue_push(&control->queue, &job->node, queue_id, priority, FALSE);
   }
-  _control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
 
-  // notify workers
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
-
-  // dispose of dropped job, if any
-  _control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
-  dt_control_job_dispose(job_for_disposal);
+  _control_notify_workers(control);
 
   return FALSE;
 }
@@ -581,9 +567,13 @@ static void *_control_work(void *ptr)
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid);
     if(_control_run_job(control))
     {
-      // wait for a new job.
+      // wait for a new job. jobs are pushed before the workers get notified,
+      // so checking the queue under cond_mutex makes sure we don't miss any.
       dt_pthread_mutex_lock(&control->cond_mutex);
-      dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
+      dt_atomic_add_int(&control->idle_workers, 1);
+      if(!dt_workqueue_runnable(&control->queue))
+        dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
+      dt_atomic_sub_int(&control->idle_workers, 1);
       dt_pthread_mutex_unlock(&control->cond_mutex);
     }
   }
@@ -626,6 +616,11 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->system_fg = NULL;
+  control->system_fg_length = 0;
+  dt_atomic_set_int(&control->idle_workers, 0);
+  dt_workqueue_init(&control->queue, control->num_threads, DT_JOB_QUEUE_MAX);
+  dt_workqueue_set_max_running(&control->queue, DT_JOB_QUEUE_USER_EXPORT, 1);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = TRUE;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -659,6 +654,9 @@ void dt_control_jobs_init(dt_control_t *control)
 
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
+  g_list_free(control->system_fg);
+  control->system_fg = NULL;
+  dt_workqueue_cleanup(&control->queue);
   free(control->job);
   free(control->thread);
 }
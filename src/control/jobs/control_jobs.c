@@ -1489,6 +1489,278 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
+typedef struct _export_shared_t
+{
+  dt_job_t *job;
+  dt_pthread_mutex_t lock;
+  GList *next; // the image to be exported next and its sequence number, under lock
+  int num;
+  int failed;
+  int threads, parts;
+  GList *fetch; // the next image to decode ahead and its sequence number, under lock
+  int fetch_num;
+  int prefetch;          // how many images are decoded ahead of the pipes
+  size_t prefetch_bytes; // largest full buffer to decode ahead
+  dt_imageio_encoder_t *encoder; // writes the files while the pipes go on, or NULL
+  dt_control_export_image_callback_t callback;
+  void *user_data;
+} _export_shared_t;
+
+typedef struct _export_worker_t
+{
+  _export_shared_t *shared;
+  dt_imageio_module_data_t *fdata;
+  pthread_t thread;
+} _export_worker_t;
+
+int dt_control_export_concurrency(const int requested,
+                                  dt_imageio_module_storage_t *storage,
+                                  dt_imageio_module_format_t *format,
+                                  dt_imageio_module_data_t *fdata,
+                                  const int images)
+{
+  if(requested == 1 || images < 2
+     || !storage->concurrent_store(storage)
+     || (format->flags(fdata) & FORMAT_FLAGS_NO_CONCURRENT))
+    return 1;
+
+  const int threads = dt_get_num_threads();
+  int jobs = requested;
+  if(jobs <= 0)
+  {
+    // a single pipe doesn't scale well past 8-16 threads on common export sizes,
+    // and every pipe should still have room for a few full size buffers
+    const int by_cores = threads / 8;
+    const int by_mem = dt_get_available_mem() / (4 * dt_get_singlebuffer_mem());
+    jobs = MIN(by_cores, by_mem);
+  }
+  jobs = CLAMP(jobs, 1, MIN(threads, images));
+
+  dt_print(DT_DEBUG_PERF, "[export] %d concurrent pipes with %d threads each\n",
+           jobs, MAX(1, threads / jobs));
+  return jobs;
+}
+
+// start decoding the images following the one just taken so that their raws are ready
+// when a pipe gets to them. called with the lock held.
+static void _export_prefetch(_export_shared_t *s)
+{
+  if(s->fetch_num < s->num)
+  {
+    s->fetch = s->next;
+    s->fetch_num = s->num;
+  }
+  for(; s->fetch && s->fetch_num < s->num + s->prefetch;
+      s->fetch = g_list_next(s->fetch), s->fetch_num++)
+    dt_mipmap_cache_prefetch_full(darktable.mipmap_cache,
+                                  GPOINTER_TO_INT(s->fetch->data), s->prefetch_bytes);
+}
+
+static void *_export_worker(void *data)
+{
+  _export_worker_t *w = (_export_worker_t *)data;
+  _export_shared_t *s = w->shared;
+
+#ifdef _OPENMP
+  omp_set_num_threads(s->threads);
+#endif
+  dt_set_available_mem_parts(s->parts);
+  dt_imageio_encoder_set(s->encoder);
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&s->lock);
+    GList *t = s->job && dt_control_job_get_state(s->job) == DT_JOB_STATE_CANCELLED
+      ? NULL
+      : s->next;
+    const int num = s->num;
+    if(t)
+    {
+      s->next = g_list_next(t);
+      s->num++;
+      _export_prefetch(s);
+    }
+    dt_pthread_mutex_unlock(&s->lock);
+    if(!t) break;
+
+    if(s->callback(GPOINTER_TO_INT(t->data), num, w->fdata, s->user_data))
+    {
+      dt_pthread_mutex_lock(&s->lock);
+      s->failed++;
+      dt_pthread_mutex_unlock(&s->lock);
+    }
+  }
+
+  dt_imageio_encoder_set(NULL);
+  dt_set_available_mem_parts(1);
+#ifdef _OPENMP
+  omp_set_num_threads(dt_get_num_threads());
+#endif
+  return NULL;
+}
+
+int dt_control_export_images(dt_job_t *job,
+                             GList *imgs,
+                             const int jobs,
+                             dt_imageio_module_format_t *format,
+                             dt_imageio_module_data_t *fdata,
+                             dt_control_export_image_callback_t callback,
+                             dt_control_export_done_callback_t done,
+                             void *user_data)
+{
+  _export_shared_t s = { .job = job,
+                         .next = imgs,
+                         .num = 1,
+                         .failed = 0,
+                         .parts = MAX(1, jobs),
+                         .fetch = NULL,
+                         .fetch_num = 0,
+                         .callback = callback,
+                         .user_data = user_data };
+  dt_pthread_mutex_init(&s.lock, NULL);
+  s.threads = MAX(1, dt_get_num_threads() / s.parts);
+
+  // the full buffer cache keeps two entries per worker, leave half of them to the pipes
+  // and a quarter of the memory for the decoded images waiting for one
+  s.prefetch = CLAMP(dt_conf_get_int("export_prefetch"), 0, dt_worker_threads());
+  s.prefetch_bytes = dt_get_available_mem() / (4 * MAX(1, s.prefetch));
+
+  // every pipe can develop its next image while its last one is encoded and written
+  s.encoder = dt_conf_get_bool("export_async_encode")
+    ? dt_imageio_encoder_start(s.parts, s.parts, done, user_data)
+    : NULL;
+
+  // the calling thread is one of the workers and uses the original fdata
+  _export_worker_t *workers = (_export_worker_t *)calloc(s.parts, sizeof(_export_worker_t));
+  workers[0].shared = &s;
+  workers[0].fdata = fdata;
+  int started = 1;
+  for(; started < s.parts; started++)
+  {
+    _export_worker_t *w = &workers[started];
+    w->shared = &s;
+    w->fdata = format->get_params(format);
+    if(!w->fdata) break;
+    memcpy(w->fdata, fdata, format->params_size(format));
+    if(dt_pthread_create(&w->thread, _export_worker, w))
+    {
+      format->free_params(format, w->fdata);
+      break;
+    }
+  }
+
+  _export_worker(&workers[0]);
+
+  for(int k = 1; k < started; k++)
+  {
+    pthread_join(workers[k].thread, NULL);
+    format->free_params(format, workers[k].fdata);
+  }
+  free(workers);
+  s.failed += dt_imageio_encoder_finish(s.encoder);
+  dt_pthread_mutex_destroy(&s.lock);
+
+  return s.failed;
+}
+
+typedef struct _export_job_image_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+  dt_export_metadata_t *metadata;
+  guint tagid, etagid;
+  guint total;
+  dt_atomic_int done;
+  dt_atomic_int tag_change;
+} _export_job_image_t;
+
+static void _control_export_image_progress(_export_job_image_t *d)
+{
+  const int done = dt_atomic_add_int(&d->done, 1) + 1;
+  dt_control_job_set_progress(d->job, MIN(1.0, (double)done / d->total));
+}
+
+// the file of the image is written, possibly by the background encoder
+static void _control_export_image_done(const dt_imgid_t imgid,
+                                       const int num,
+                                       const gboolean failed,
+                                       void *user_data)
+{
+  _export_job_image_t *d = (_export_job_image_t *)user_data;
+
+  if(failed)
+    dt_control_job_cancel(d->job);
+  else
+  {
+    // remove 'changed' tag from image
+    if(dt_tag_detach(d->tagid, imgid, FALSE, FALSE)) dt_atomic_set_int(&d->tag_change, TRUE);
+
+    // make sure the 'exported' tag is set on the image
+    if(dt_tag_attach(d->etagid, imgid, FALSE, FALSE)) dt_atomic_set_int(&d->tag_change, TRUE);
+
+    /* register export timestamp in cache */
+    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+  }
+
+  _control_export_image_progress(d);
+}
+
+static int _control_export_image(const dt_imgid_t imgid,
+                                 const int num,
+                                 dt_imageio_module_data_t *fdata,
+                                 void *user_data)
+{
+  _export_job_image_t *d = (_export_job_image_t *)user_data;
+  dt_job_t *job = d->job;
+  dt_control_export_t *settings = d->settings;
+  dt_imageio_module_storage_t *mstorage = d->mstorage;
+  const guint total = d->total;
+  int res = 0;
+
+  // progress message
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message), _("exporting %d / %d to %s"),
+           num, total, mstorage->name(mstorage));
+  // update the message. initialize_store() might have changed the number of images
+  dt_control_job_set_progress_message(job, message);
+
+  // check if image still exists:
+  const dt_image_t *image =
+    dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
+  if(image)
+  {
+    char imgfilename[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+    if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+    {
+      dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+      dt_print(DT_DEBUG_ALWAYS, "image `%s' is currently unavailable\n", imgfilename);
+      // dt_image_remove(imgid);
+      dt_image_cache_read_release(darktable.image_cache, image);
+    }
+    else
+    {
+      dt_image_cache_read_release(darktable.image_cache, image);
+      res = mstorage->store(mstorage, d->sdata, imgid, d->mformat, fdata,
+                            num, total, settings->high_quality, settings->upscale,
+                            settings->export_masks, settings->icc_type,
+                            settings->icc_filename, settings->icc_intent,
+                            d->metadata) != 0;
+      // if the encoder writes the file it reports back once done
+      if(!dt_imageio_encoder_deferred())
+        _control_export_image_done(imgid, num, res, d);
+      return res;
+    }
+  }
+
+  _control_export_image_progress(d);
+  return res;
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params =
@@ -1542,8 +1814,6 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   else
     dt_control_log(_("no image to export"));
 
-  double fraction = 0;
-
   fdata->max_width =
     (settings->max_width != 0 && w != 0)
     ? MIN(w, settings->max_width)
@@ -1580,61 +1850,24 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
-  {
-    const dt_imgid_t imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
-
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"),
-             num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
-
-    // check if image still exists:
-    const dt_image_t *image =
-      dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
-    {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        dt_print(DT_DEBUG_ALWAYS, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata,
-                           num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type,
-                           settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-        else
-        {
-          // remove 'changed' tag from image
-          if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-
-          // make sure the 'exported' tag is set on the image
-          if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-
-          /* register export timestamp in cache */
-          dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
-        }
-      }
-    }
+  _export_job_image_t export = { .job = job,
+                                  .settings = settings,
+                                  .mformat = mformat,
+                                  .mstorage = mstorage,
+                                  .sdata = sdata,
+                                  .metadata = &metadata,
+                                  .tagid = tagid,
+                                  .etagid = etagid,
+                                  .total = total };
+  dt_atomic_set_int(&export.done, 0);
+  dt_atomic_set_int(&export.tag_change, FALSE);
+
+  const int jobs = dt_control_export_concurrency(dt_conf_get_int("export_jobs"),
+                                                 mstorage, mformat, fdata, total);
+  dt_control_export_images(job, t, jobs, mformat, fdata,
+                           _control_export_image, _control_export_image_done, &export);
+  tag_change = dt_atomic_get_int(&export.tag_change);
 
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
-  }
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
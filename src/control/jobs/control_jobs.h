@@ -48,6 +48,38 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
                        char *style, gboolean style_append,
                        dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
                        dt_iop_color_intent_t icc_intent, const gchar *metadata_export);
+
+/** store a single image of a concurrent export, returns non-zero on failure */
+typedef int (*dt_control_export_image_callback_t)(const dt_imgid_t imgid,
+                                                   const int num,
+                                                   dt_imageio_module_data_t *fdata,
+                                                   void *user_data);
+/** called instead of the end of callback for an image whose file is written in the
+    background after callback returned, failed tells if it couldn't be written */
+typedef void (*dt_control_export_done_callback_t)(const dt_imgid_t imgid,
+                                                  const int num,
+                                                  const gboolean failed,
+                                                  void *user_data);
+/** how many images can be exported at the same time. requested 0 picks a number
+    from the core count and memory, 1 is one after the other. */
+int dt_control_export_concurrency(const int requested,
+                                  dt_imageio_module_storage_t *storage,
+                                  dt_imageio_module_format_t *format,
+                                  dt_imageio_module_data_t *fdata,
+                                  const int images);
+/** run callback for all images with up to `jobs` export pipes at the same time, each one
+    getting its share of threads and memory and a private copy of fdata. the files may
+    be written after callback returned, see dt_imageio_encoder_deferred(), done is then
+    called from the encoder thread. stops early if job gets cancelled, returns the number
+    of failed images. */
+int dt_control_export_images(dt_job_t *job,
+                             GList *imgs,
+                             const int jobs,
+                             dt_imageio_module_format_t *format,
+                             dt_imageio_module_data_t *fdata,
+                             dt_control_export_image_callback_t callback,
+                             dt_control_export_done_callback_t done,
+                             void *user_data);
 void dt_control_merge_hdr();
 void dt_control_import(GList *imgs, const char *datetime_override, const gboolean inplace);
 void dt_control_seed_denoise();
@@ -2050,7 +2050,7 @@ void dt_iop_commit_params(dt_iop_module_t *module,
 
   // 2. compute the hash only if piece is enabled
 
-  piece->hash = 0;
+  piece->hash = piece->params_hash = 0;
 
   if(piece->enabled)
   {
@@ -2071,6 +2071,9 @@ void dt_iop_commit_params(dt_iop_module_t *module,
       pos += sizeof(dt_develop_blend_params_t);
     }
 
+    /* tells if only the drawn masks changed */
+    piece->params_hash = dt_hash(DT_INITHASH, str, pos);
+
     /* and we add masks */
     dt_masks_group_get_hash_buffer(grp, str + pos);
 
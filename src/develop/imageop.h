@@ -119,7 +119,12 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_UNSAFE_COPY = 1 << 13,       // Unsafe to copy as part of history
   IOP_FLAGS_GUIDES_SPECIAL_DRAW = 1 << 14, // handle the grid drawing directly
   IOP_FLAGS_GUIDES_WIDGET = 1 << 15,      // require the guides widget
-  IOP_FLAGS_CROP_EXPOSER = 1 << 16        // offers crop exposing
+  IOP_FLAGS_CROP_EXPOSER = 1 << 16,       // offers crop exposing
+  IOP_FLAGS_CACHE_HALF_FLOAT = 1 << 17,   // output may be kept as half floats in the pixelpipe cache
+  IOP_FLAGS_ALLOW_STRIPES = 1 << 18,      // output only depends on input within the tiling overlap, no image wide
+                                          // statistics: may be processed in stripes of rows
+  IOP_FLAGS_IMAGE_STATISTICS = 1 << 19    // output depends on statistics of the whole input: exports are never
+                                          // processed in strips of rows. see image_statistics() for modes
 } dt_iop_flags_t;
 
 /** status of a module*/
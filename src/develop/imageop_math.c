@@ -93,6 +93,46 @@ void dt_iop_flip_and_zoom_8(const uint8_t *in,
   }
 }
 
+void dt_iop_reduce_box_8(const uint8_t *const in,
+                         const int32_t iw,
+                         const int32_t ih,
+                         uint8_t *const out,
+                         const int32_t ow,
+                         const int32_t oh,
+                         uint32_t *width,
+                         uint32_t *height)
+{
+  // same output size as dt_iop_flip_and_zoom_8()
+  const float scale = fmaxf(1.0, fmaxf(iw / (float)ow, ih / (float)oh));
+  const int32_t wd = *width = MIN(ow, iw / scale);
+  const int32_t ht = *height = MIN(oh, ih / scale);
+
+  DT_OMP_FOR()
+  for(int32_t j = 0; j < ht; j++)
+  {
+    const int32_t y0 = j * scale;
+    const int32_t y1 = MAX(y0 + 1, MIN(ih, (int32_t)((j + 1) * scale)));
+    uint8_t *const outrow = out + (size_t)4 * wd * j;
+    for(int32_t i = 0; i < wd; i++)
+    {
+      const int32_t x0 = i * scale;
+      const int32_t x1 = MAX(x0 + 1, MIN(iw, (int32_t)((i + 1) * scale)));
+      // 8 bit values, this can't overflow for any sane scale
+      uint32_t sum[4] = { 0, 0, 0, 0 };
+      for(int32_t y = y0; y < y1; y++)
+      {
+        const uint8_t *const px = in + (size_t)4 * ((size_t)iw * y + x0);
+        for(int32_t x = 0; x < x1 - x0; x++)
+          for_four_channels(c)
+            sum[c] += px[4 * x + c];
+      }
+      const float norm = 1.0f / ((y1 - y0) * (x1 - x0));
+      for_four_channels(c)
+        outrow[4 * i + c] = (uint8_t)MIN(255.0f, sum[c] * norm + 0.5f);
+    }
+  }
+}
+
 void dt_iop_clip_and_zoom_8(const uint8_t *i,
                             const int32_t ix,
                             const int32_t iy,
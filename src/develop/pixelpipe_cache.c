@@ -21,15 +21,404 @@
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include "libs/colorpicker.h"
+#include "common/file_location.h"
+#include "common/imagebuf.h"
 #include <stdlib.h>
 
 #define INVALID_CACHEHASH 0
 
+// persistent second tier of the cache, shared by all pipes that are allowed to use it
+#define DT_PIPECACHE_DISK_MAGIC 0x64747063u // "dtpc"
+#define DT_PIPECACHE_DISK_VERSION 2
+// a line is only worth to be kept on disk if computing it takes longer than reading it back
+#define DT_PIPECACHE_DISK_BANDWIDTH (500.0 * 1024.0 * 1024.0)
+
+typedef struct dt_pipecache_disk_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t half;     // data is stored as half floats
+  uint32_t reserved;
+  dt_hash_t hash;
+  uint64_t size;
+  dt_iop_buffer_dsc_t dsc;
+} dt_pipecache_disk_header_t;
+
+typedef struct dt_pipecache_disk_t
+{
+  dt_pthread_mutex_t lock;
+  gchar *path;
+  size_t quota;
+  size_t used;
+  uint64_t reads;
+  uint64_t writes;
+} dt_pipecache_disk_t;
+
+static dt_pipecache_disk_t _disk = { .path = NULL };
+
 static inline int _to_mb(size_t m)
 {
   return (int)((m + 0x80000lu) / 0x400lu / 0x400lu);
 }
 
+// bytes needed to keep a float buffer of size bytes as half floats
+static inline size_t _half_size(const size_t size)
+{
+  return size / sizeof(float) * sizeof(uint16_t);
+}
+
+static inline int64_t _cacheline_age(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  return (int64_t)cache->calls - cache->used[k];
+}
+
+static inline void _update_weight(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  // greedy-dual-size-frequency: lines that have been expensive to compute and are
+  // often used are kept, large lines are dropped earlier.
+  const double mb = (double)cache->size[k] / (1024.0 * 1024.0);
+  cache->weight[k] = cache->inflation
+                   + (double)cache->freq[k] * 1000.0 * cache->cost[k] / (1.0 + mb);
+}
+
+// all changes of a cacheline's hash must be done here to keep the index in sync
+static void _set_cacheline_hash(const dt_dev_pixelpipe_cache_t *cache,
+                                const int k,
+                                const dt_hash_t hash)
+{
+  if(!cache->index || k < DT_PIPECACHE_MIN)
+  {
+    cache->hash[k] = hash;
+    return;
+  }
+
+  if(cache->hash[k] != INVALID_CACHEHASH)
+    g_hash_table_remove(cache->index, &cache->hash[k]);
+
+  cache->hash[k] = hash;
+  if(hash == INVALID_CACHEHASH) return;
+
+  // there must be only one line per hash, an older one is not valid any more
+  gpointer other = NULL;
+  if(g_hash_table_lookup_extended(cache->index, &hash, NULL, &other))
+  {
+    const int j = GPOINTER_TO_INT(other);
+    g_hash_table_remove(cache->index, &cache->hash[j]);
+    cache->hash[j] = INVALID_CACHEHASH;
+    cache->ioporder[j] = 0;
+  }
+  // the key points into the hash array so it stays valid as long as the line's hash
+  g_hash_table_insert(cache->index, &cache->hash[k], GINT_TO_POINTER(k));
+}
+
+static inline int _find_cacheline(const dt_dev_pixelpipe_cache_t *cache, const dt_hash_t hash)
+{
+  gpointer line = NULL;
+  if(cache->index && g_hash_table_lookup_extended(cache->index, &hash, NULL, &line))
+    return GPOINTER_TO_INT(line);
+  return -1;
+}
+
+// the cost of a line is the time spent from requesting the line until the next cache access,
+// as the pipe always requests the output line right before processing the module.
+static void _account_pending(dt_dev_pixelpipe_cache_t *cache)
+{
+  const int k = cache->pending;
+  if(k < 0) return;
+
+  cache->pending = -1;
+  if(cache->hash[k] == INVALID_CACHEHASH) return;
+
+  cache->cost[k] = MAX(0.0, dt_get_wtime() - cache->pending_start);
+  _update_weight(cache, k);
+}
+
+static dt_dev_pixelpipe_cache_policy_t _cache_policy(void)
+{
+  return dt_conf_is_equal("pipecache_policy", "LRU")
+    ? DT_PIPECACHE_POLICY_LRU
+    : DT_PIPECACHE_POLICY_COST;
+}
+
+static void _disk_filename(char *filename, const size_t len, const dt_hash_t key)
+{
+  snprintf(filename, len, "%s/%016" PRIx64 ".pxc", _disk.path, key);
+}
+
+static gint _sort_by_mtime(gconstpointer a, gconstpointer b)
+{
+  const int64_t *fa = (const int64_t *)a;
+  const int64_t *fb = (const int64_t *)b;
+  return fa[0] < fb[0] ? -1 : (fa[0] > fb[0] ? 1 : 0);
+}
+
+// drop least recently used files until needed bytes fit into the quota, lock must be held
+static void _disk_shrink(const size_t needed)
+{
+  if(_disk.used + needed <= _disk.quota) return;
+
+  GDir *dir = g_dir_open(_disk.path, 0, NULL);
+  if(!dir) return;
+
+  // per file: mtime, size, index into names
+  GArray *files = g_array_new(FALSE, FALSE, 3 * sizeof(int64_t));
+  GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+  const gchar *name;
+  size_t used = 0;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_suffix(name, ".pxc")) continue;
+    gchar *filename = g_build_filename(_disk.path, name, NULL);
+    GStatBuf st;
+    if(!g_stat(filename, &st))
+    {
+      const int64_t info[3] = { (int64_t)st.st_mtime, (int64_t)st.st_size, names->len };
+      g_array_append_vals(files, info, 1);
+      g_ptr_array_add(names, filename);
+      used += st.st_size;
+    }
+    else
+      g_free(filename);
+  }
+  g_dir_close(dir);
+
+  // also take files written by other processes into account
+  _disk.used = used;
+  g_array_sort(files, _sort_by_mtime);
+  for(guint k = 0; k < files->len && _disk.used + needed > _disk.quota; k++)
+  {
+    const int64_t *info = &g_array_index(files, int64_t, 3 * k);
+    if(!g_unlink(g_ptr_array_index(names, info[2])))
+      _disk.used -= MIN(_disk.used, (size_t)info[1]);
+  }
+
+  g_array_free(files, TRUE);
+  g_ptr_array_free(names, TRUE);
+}
+
+void dt_dev_pixelpipe_cache_disk_init(void)
+{
+  dt_pthread_mutex_init(&_disk.lock, NULL);
+  _disk.quota = (size_t)MAX(0, dt_conf_get_int("pipecache_disk_size")) * 1024lu * 1024lu;
+  _disk.used = _disk.reads = _disk.writes = 0;
+  _disk.path = NULL;
+  if(!_disk.quota) return;
+
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  _disk.path = g_build_filename(cachedir, "pipecache", NULL);
+  if(g_mkdir_with_parents(_disk.path, 0750))
+  {
+    dt_print(DT_DEBUG_ALWAYS,
+             "[pixelpipe_cache] can't create persistent cache directory `%s'\n", _disk.path);
+    g_free(_disk.path);
+    _disk.path = NULL;
+    return;
+  }
+
+  // this also accounts for the files left by earlier sessions
+  dt_pthread_mutex_lock(&_disk.lock);
+  _disk_shrink(0);
+  dt_pthread_mutex_unlock(&_disk.lock);
+  dt_print(DT_DEBUG_PIPE | DT_DEBUG_CACHE,
+           "[pixelpipe_cache] persistent cache `%s' using %iMB of %iMB\n",
+           _disk.path, _to_mb(_disk.used), _to_mb(_disk.quota));
+}
+
+void dt_dev_pixelpipe_cache_disk_cleanup(void)
+{
+  if(_disk.path)
+    dt_print(DT_DEBUG_PIPE | DT_DEBUG_CACHE,
+             "[pixelpipe_cache] persistent cache: %" PRIu64 " lines read, %" PRIu64 " written, using %iMB\n",
+             _disk.reads, _disk.writes, _to_mb(_disk.used));
+  g_free(_disk.path);
+  _disk.path = NULL;
+  dt_pthread_mutex_destroy(&_disk.lock);
+}
+
+static gboolean _disk_enabled(const dt_dev_pixelpipe_t *pipe)
+{
+  if(!_disk.path
+     || !(pipe->type & DT_DEV_PIXELPIPE_EXPORT)
+     || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE
+     || pipe->want_detail_mask
+     || pipe->store_all_raster_masks)
+    return FALSE;
+
+  // modules skipped because of a cache hit would not provide their raster masks
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled && piece->module->raster_mask.sink.source)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+// The image id is not stable across libraries or darktable-cli runs, so the
+// source file itself and the darktable version are part of the key too.
+static dt_hash_t _disk_key(dt_dev_pixelpipe_t *pipe, const dt_hash_t hash)
+{
+  dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
+  if(cache->disk_imgid != pipe->image.id)
+  {
+    char filename[PATH_MAX] = { 0 };
+    gboolean from_cache = FALSE;
+    dt_image_full_path(pipe->image.id, filename, sizeof(filename), &from_cache);
+
+    GStatBuf st;
+    const gboolean found = !g_stat(filename, &st);
+    const int64_t fileinfo[2] = { found ? (int64_t)st.st_size : 0,
+                                  found ? (int64_t)st.st_mtime : 0 };
+
+    dt_hash_t key = dt_hash(DT_INITHASH, darktable_package_version, strlen(darktable_package_version));
+    key = dt_hash(key, filename, strlen(filename));
+    cache->disk_key = dt_hash(key, fileinfo, sizeof(fileinfo));
+    cache->disk_imgid = pipe->image.id;
+  }
+  return dt_hash(cache->disk_key, &hash, sizeof(hash));
+}
+
+static gboolean _disk_available(dt_dev_pixelpipe_t *pipe,
+                                const dt_hash_t hash,
+                                const size_t size)
+{
+  if(!_disk_enabled(pipe)) return FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), _disk_key(pipe, hash));
+  GStatBuf st;
+  if(g_stat(filename, &st)) return FALSE;
+  const size_t stored = (size_t)st.st_size - MIN((size_t)st.st_size, sizeof(dt_pipecache_disk_header_t));
+  if(stored != size && stored != _half_size(size))
+    return FALSE;
+
+  pipe->cache.disk_hash = hash;
+  return TRUE;
+}
+
+static gboolean _disk_load(dt_dev_pixelpipe_t *pipe,
+                           const dt_hash_t hash,
+                           const size_t size,
+                           void *data,
+                           dt_iop_buffer_dsc_t *dsc)
+{
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), _disk_key(pipe, hash));
+
+  GMappedFile *mf = g_mapped_file_new(filename, FALSE, NULL);
+  if(!mf) return FALSE;
+
+  const dt_pipecache_disk_header_t *header = (dt_pipecache_disk_header_t *)g_mapped_file_get_contents(mf);
+  const size_t length = g_mapped_file_get_length(mf);
+  const gboolean valid = header
+    && length >= sizeof(dt_pipecache_disk_header_t)
+    && header->magic == DT_PIPECACHE_DISK_MAGIC
+    && header->version == DT_PIPECACHE_DISK_VERSION
+    && header->hash == hash
+    && header->size == size
+    && length == sizeof(dt_pipecache_disk_header_t) + (header->half ? _half_size(size) : size);
+
+  if(valid)
+  {
+    *dsc = header->dsc;
+    const void *contents = (const char *)header + sizeof(dt_pipecache_disk_header_t);
+    if(header->half)
+      dt_iop_image_from_half((float *)data, (const uint16_t *)contents, size / sizeof(float));
+    else
+      memcpy(data, contents, size);
+    // mark as recently used for the quota handling
+    g_utime(filename, NULL);
+    dt_pthread_mutex_lock(&_disk.lock);
+    _disk.reads++;
+    dt_pthread_mutex_unlock(&_disk.lock);
+  }
+  g_mapped_file_unref(mf);
+  return valid;
+}
+
+void dt_dev_pixelpipe_cache_store(struct dt_dev_pixelpipe_t *pipe,
+                                  const dt_hash_t hash,
+                                  const void *data,
+                                  const size_t size,
+                                  const dt_iop_buffer_dsc_t *dsc)
+{
+  dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
+  const int k = cache->pending;
+  if(k < 0
+     || !data
+     || cache->data[k] != data
+     || hash == INVALID_CACHEHASH
+     || !_disk_enabled(pipe))
+    return;
+
+  // lines of modules tolerating it are kept in half the space
+  uint16_t *half = NULL;
+  if(cache->halfok[k]
+     && dsc->datatype == TYPE_FLOAT
+     && size % sizeof(float) == 0
+     && dt_conf_get_bool("pipecache_half_float/export"))
+    half = dt_alloc_aligned(_half_size(size));
+  const size_t stored = half ? _half_size(size) : size;
+
+  const size_t fsize = stored + sizeof(dt_pipecache_disk_header_t);
+  const double cost = dt_get_wtime() - cache->pending_start;
+  char filename[PATH_MAX] = { 0 };
+  const dt_hash_t key = _disk_key(pipe, hash);
+  _disk_filename(filename, sizeof(filename), key);
+  if(cost < 2.0 * (double)fsize / DT_PIPECACHE_DISK_BANDWIDTH
+     || fsize > _disk.quota / 4
+     || g_file_test(filename, G_FILE_TEST_EXISTS))
+  {
+    dt_free_align(half);
+    return;
+  }
+  if(half) dt_iop_image_to_half(half, (const float *)data, size / sizeof(float));
+
+  dt_pthread_mutex_lock(&_disk.lock);
+  _disk_shrink(fsize);
+  _disk.used += fsize;
+  dt_pthread_mutex_unlock(&_disk.lock);
+
+  // write to a temporary file first so concurrent readers never see partial data
+  gchar *tmpname = g_strdup_printf("%s/%016" PRIx64 ".XXXXXX", _disk.path, key);
+  const int fd = g_mkstemp(tmpname);
+  FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  gboolean ok = FALSE;
+  if(f)
+  {
+    const dt_pipecache_disk_header_t header = { .magic = DT_PIPECACHE_DISK_MAGIC,
+                                                .version = DT_PIPECACHE_DISK_VERSION,
+                                                .half = half != NULL,
+                                                .reserved = 0,
+                                                .hash = hash,
+                                                .size = size,
+                                                .dsc = *dsc };
+    ok = fwrite(&header, sizeof(header), 1, f) == 1
+      && fwrite(half ? (const void *)half : data, stored, 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && !g_rename(tmpname, filename);
+  }
+  else if(fd >= 0)
+    close(fd);
+
+  if(!ok) g_unlink(tmpname);
+  g_free(tmpname);
+  dt_free_align(half);
+
+  dt_pthread_mutex_lock(&_disk.lock);
+  if(ok)
+    _disk.writes++;
+  else
+    _disk.used -= MIN(_disk.used, fsize);
+  dt_pthread_mutex_unlock(&_disk.lock);
+
+  dt_print_pipe(DT_DEBUG_PIPE, ok ? "pipe cache stored" : "pipe cache store failed",
+                pipe, NULL, DT_DEVICE_NONE, NULL, NULL,
+                "%iMB%s, processing took %.3fs, hash=%" PRIx64 "\n",
+                _to_mb(stored), half ? " as half floats" : "", cost, hash);
+}
+
 gboolean dt_dev_pixelpipe_cache_init(
            struct dt_dev_pixelpipe_t *pipe,
            const int entries,
@@ -39,21 +428,43 @@ gboolean dt_dev_pixelpipe_cache_init(
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
 
   cache->entries = entries;
-  cache->allmem = cache->hits = cache->calls = cache->tests = 0;
+  cache->allmem = cache->hits = cache->calls = cache->tests = cache->lastcheck = 0;
+  cache->saved_bytes = 0;
+  cache->saved_time = 0.0;
+  cache->inflation = 0.0;
+  cache->pending = -1;
+  cache->lastline = 0;
+  cache->disk_hash = INVALID_CACHEHASH;
+  cache->disk_key = INVALID_CACHEHASH;
+  cache->disk_imgid = NO_IMGID;
   cache->memlimit = limit;
+  cache->policy = _cache_policy();
 
-  const size_t csize = sizeof(void *) + sizeof(size_t) + sizeof(dt_iop_buffer_dsc_t) + 2*sizeof(int32_t) + sizeof(uint64_t);
+  // keep all 64bit arrays first for proper alignment
+  const size_t csize = sizeof(void *) + sizeof(size_t) + sizeof(dt_hash_t) + sizeof(int64_t)
+                     + 2 * sizeof(double) + sizeof(dt_iop_buffer_dsc_t)
+                     + sizeof(int32_t) + sizeof(uint32_t) + 2 * sizeof(gboolean);
   cache->data = (void **) calloc(entries, csize);
   cache->size = (size_t *)((void *)cache->data + entries * sizeof(void *));
-  cache->dsc = (dt_iop_buffer_dsc_t *)((void *)cache->size + entries * sizeof(size_t));
-  cache->hash = (dt_hash_t *)((void *)cache->dsc + entries * sizeof(dt_iop_buffer_dsc_t));
-  cache->used = (int32_t *)((void *)cache->hash + entries * sizeof(dt_hash_t));
-  cache->ioporder = (int32_t *)((void *)cache->used + entries * sizeof(int32_t));
+  cache->hash = (dt_hash_t *)((void *)cache->size + entries * sizeof(size_t));
+  cache->used = (int64_t *)((void *)cache->hash + entries * sizeof(dt_hash_t));
+  cache->cost = (double *)((void *)cache->used + entries * sizeof(int64_t));
+  cache->weight = (double *)((void *)cache->cost + entries * sizeof(double));
+  cache->dsc = (dt_iop_buffer_dsc_t *)((void *)cache->weight + entries * sizeof(double));
+  cache->ioporder = (int32_t *)((void *)cache->dsc + entries * sizeof(dt_iop_buffer_dsc_t));
+  cache->freq = (uint32_t *)((void *)cache->ioporder + entries * sizeof(int32_t));
+  cache->halfok = (gboolean *)((void *)cache->freq + entries * sizeof(uint32_t));
+  cache->packed = (gboolean *)((void *)cache->halfok + entries * sizeof(gboolean));
+
+  // pipes with the minimum number of lines just toggle between them and never look up
+  cache->index = entries > DT_PIPECACHE_MIN
+    ? g_hash_table_new(g_int64_hash, g_int64_equal)
+    : NULL;
 
   for(int k = 0; k < entries; k++)
   {
     cache->hash[k] = INVALID_CACHEHASH;
-    cache->used[k] = 64 + k;
+    cache->used[k] = -(64 + k);
   }
   if(!size) return TRUE;
 
@@ -89,9 +500,10 @@ void dt_dev_pixelpipe_cache_cleanup(struct dt_dev_pixelpipe_t *pipe)
 
   if(pipe->type == DT_DEV_PIXELPIPE_FULL)
   {
-    dt_print(DT_DEBUG_PIPE, "Session fullpipe cache report. hits/run=%.2f, hits/test=%.3f\n",
+    dt_print(DT_DEBUG_PIPE, "Session fullpipe cache report. hits/run=%.2f, hits/test=%.3f, saved %iMB / %.3fs\n",
     (double)(cache->hits) / fmax(1.0, pipe->runs),
-    (double)(cache->hits) / fmax(1.0, cache->tests));
+    (double)(cache->hits) / fmax(1.0, cache->tests),
+    _to_mb(cache->saved_bytes), cache->saved_time);
   }
 
   for(int k = 0; k < cache->entries; k++)
@@ -101,6 +513,8 @@ void dt_dev_pixelpipe_cache_cleanup(struct dt_dev_pixelpipe_t *pipe)
   }
   free(cache->data);
   cache->data = NULL;
+  if(cache->index) g_hash_table_destroy(cache->index);
+  cache->index = NULL;
 }
 
 static dt_hash_t _dev_pixelpipe_cache_basichash(
@@ -172,47 +586,61 @@ gboolean dt_dev_pixelpipe_cache_available(
            const size_t size)
 {
   if(pipe->mask_display
-     || pipe->nocache
      || (hash == INVALID_CACHEHASH))
     return FALSE;
 
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
   cache->tests++;
   // search for hash in cache and make the sizes are identical
-  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  const int k = pipe->nocache ? -1 : _find_cacheline(cache, hash);
+  if((k >= DT_PIPECACHE_MIN && cache->size[k] == size)
+     || _disk_available(pipe, hash, size))
   {
-    if((cache->size[k] == size) && (cache->hash[k] == hash))
-    {
-      cache->hits++;
-      return TRUE;
-    }
+    cache->hits++;
+    return TRUE;
   }
   return FALSE;
 }
 
+static inline gboolean _better_victim(const dt_dev_pixelpipe_cache_t *cache,
+                                      const int k,
+                                      const int best)
+{
+  if(best == 0) return TRUE;
+  if(cache->policy == DT_PIPECACHE_POLICY_COST && cache->weight[k] != cache->weight[best])
+    return cache->weight[k] < cache->weight[best];
+  return _cacheline_age(cache, k) > _cacheline_age(cache, best);
+}
+
 // While looking for the oldest cacheline we always ignore the first two lines as they are used
-// for swapping buffers while in entries==DT_PIPECACHE_MIN or masking mode
+// for swapping buffers while in entries==DT_PIPECACHE_MIN or masking mode.
+// For the plain and used modes the cache policy decides which of the candidates is dropped.
 static int _get_oldest_cacheline(dt_dev_pixelpipe_cache_t *cache,
                                  dt_dev_pixelpipe_cache_test_t mode)
 {
-  // we never want the latest used cacheline! It was <= 0 and the weight has increased just now
-  int age = 1;
+  const gboolean weighted = mode == DT_CACHETEST_PLAIN || mode == DT_CACHETEST_USED;
   int id = 0;
   for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
   {
-    gboolean older = (cache->used[k] > age) && (k != cache->lastline);
-    if(older)
+    // we never want the latest used cacheline! It was <= 0 and the weight has increased just now
+    gboolean candidate = (_cacheline_age(cache, k) > 1) && (k != cache->lastline);
+    if(candidate)
     {
-      if(mode == DT_CACHETEST_USED)         older = cache->data[k] != NULL;
-      else if(mode == DT_CACHETEST_FREE)    older = cache->data[k] == NULL;
-      else if(mode == DT_CACHETEST_INVALID) older = cache->hash[k] == INVALID_CACHEHASH;
-      if(older)
-      {
-        age = cache->used[k];
+      if(mode == DT_CACHETEST_USED)         candidate = cache->data[k] != NULL;
+      else if(mode == DT_CACHETEST_FREE)    candidate = cache->data[k] == NULL;
+      else if(mode == DT_CACHETEST_INVALID) candidate = cache->hash[k] == INVALID_CACHEHASH;
+
+      if(candidate
+         && (weighted
+             ? _better_victim(cache, k, id)
+             : (id == 0 || _cacheline_age(cache, k) > _cacheline_age(cache, id))))
         id = k;
-      }
     }
   }
+
+  // the cost policy ages all remaining lines by the weight of the dropped one
+  if(weighted && id > 0 && cache->policy == DT_PIPECACHE_POLICY_COST)
+    cache->inflation = MAX(cache->inflation, cache->weight[id]);
   return id;
 }
 
@@ -241,6 +669,48 @@ static int _get_cacheline(struct dt_dev_pixelpipe_t *pipe)
   return cache->lastline;
 }
 
+static inline void _mark_important(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  cache->used[k] = (int64_t)cache->calls + cache->entries;
+}
+
+// bytes really allocated for a line
+static inline size_t _line_bytes(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  return cache->packed[k] ? _half_size(cache->size[k]) : cache->size[k];
+}
+
+// keep an idle line as half floats, the float buffer is replaced by one of half the size
+static gboolean _pack_cacheline(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  const size_t nfloats = cache->size[k] / sizeof(float);
+  uint16_t *half = dt_alloc_aligned(_half_size(cache->size[k]));
+  if(!half) return FALSE;
+
+  dt_iop_image_to_half(half, (const float *)cache->data[k], nfloats);
+  dt_free_align(cache->data[k]);
+  cache->data[k] = half;
+  cache->packed[k] = TRUE;
+  cache->allmem -= cache->size[k] - _half_size(cache->size[k]);
+  return TRUE;
+}
+
+// a line is always converted back to floats before it's handed out
+static gboolean _unpack_cacheline(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  if(!cache->packed[k]) return TRUE;
+
+  float *buf = dt_alloc_align_float(cache->size[k] / sizeof(float));
+  if(!buf) return FALSE;
+
+  dt_iop_image_from_half(buf, (const uint16_t *)cache->data[k], cache->size[k] / sizeof(float));
+  dt_free_align(cache->data[k]);
+  cache->data[k] = buf;
+  cache->packed[k] = FALSE;
+  cache->allmem += cache->size[k] - _half_size(cache->size[k]);
+  return TRUE;
+}
+
 // return TRUE in case of a hit
 static gboolean _get_by_hash(
           struct dt_dev_pixelpipe_t *pipe,
@@ -251,36 +721,44 @@ static gboolean _get_by_hash(
           dt_iop_buffer_dsc_t **dsc)
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
-  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  const int k = _find_cacheline(cache, hash);
+  if(k < DT_PIPECACHE_MIN) return FALSE;
+
+  if(cache->size[k] != size)
   {
-    if(cache->hash[k] == hash)
-    {
-      if(cache->size[k] != size)
-      {
-        /* We check for situation with a hash identity but buffer sizes don't match.
-           This could happen because of "hash overlaps" or other situations where the hash
-           doesn't reflect the complete status.
-           Anyway this has to be accepted as a dt bug so we always report
-        */
-        cache->hash[k] = INVALID_CACHEHASH;
-        dt_print_pipe(DT_DEBUG_ALWAYS, "CACHELINE_SIZE ERROR",
-          pipe, module, DT_DEVICE_NONE, NULL, NULL, "\n");
-      }
-      else if(pipe->mask_display || pipe->nocache)
-      {
-        // this should not happen but we make sure
-        cache->hash[k] = INVALID_CACHEHASH;
-      }
-      else
-      {
-        // we have a proper hit
-        *data = cache->data[k];
-        *dsc = &cache->dsc[k];
-        // in case of a hit it's always good to further keep the cacheline as important
-        cache->used[k] = -cache->entries;
-        return TRUE;
-      }
-    }
+    /* We check for situation with a hash identity but buffer sizes don't match.
+       This could happen because of "hash overlaps" or other situations where the hash
+       doesn't reflect the complete status.
+       Anyway this has to be accepted as a dt bug so we always report
+    */
+    _set_cacheline_hash(cache, k, INVALID_CACHEHASH);
+    dt_print_pipe(DT_DEBUG_ALWAYS, "CACHELINE_SIZE ERROR",
+      pipe, module, DT_DEVICE_NONE, NULL, NULL, "\n");
+  }
+  else if(pipe->mask_display || pipe->nocache)
+  {
+    // this should not happen but we make sure
+    _set_cacheline_hash(cache, k, INVALID_CACHEHASH);
+  }
+  else if(!_unpack_cacheline(cache, k))
+  {
+    // no memory to get the floats back, the half floats are dropped on next memory check
+    _set_cacheline_hash(cache, k, INVALID_CACHEHASH);
+    dt_print_pipe(DT_DEBUG_PIPE, "cache unpack failed",
+      pipe, module, DT_DEVICE_NONE, NULL, NULL, "\n");
+  }
+  else
+  {
+    // we have a proper hit
+    *data = cache->data[k];
+    *dsc = &cache->dsc[k];
+    // in case of a hit it's always good to further keep the cacheline as important
+    _mark_important(cache, k);
+    cache->freq[k]++;
+    _update_weight(cache, k);
+    cache->saved_bytes += size;
+    cache->saved_time += cache->cost[k];
+    return TRUE;
   }
   return FALSE;
 }
@@ -295,9 +773,9 @@ gboolean dt_dev_pixelpipe_cache_get(
            const gboolean important)
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
+  // age all entries
   cache->calls++;
-  for(int k = 0; k < cache->entries; k++)
-    cache->used[k]++; // age all entries
+  _account_pending(cache);
 
   // cache keeps history and we have a cache hit, so no new buffer
   if(cache->entries > DT_PIPECACHE_MIN
@@ -320,6 +798,16 @@ gboolean dt_dev_pixelpipe_cache_get(
   // Check both for free and non-matching (and grow or shrink buffer).
   const int cline = _get_cacheline(pipe);
 
+  // half floats of an old line are of no use for the new contents
+  if(cache->packed[cline])
+  {
+    dt_free_align(cache->data[cline]);
+    cache->allmem -= _half_size(cache->size[cline]);
+    cache->data[cline] = NULL;
+    cache->size[cline] = 0;
+    cache->packed[cline] = FALSE;
+  }
+
   if(((cache->entries == DT_PIPECACHE_MIN) && (cache->size[cline] < size))
      || ((cache->entries > DT_PIPECACHE_MIN) && (cache->size[cline] != size)))
   {
@@ -344,7 +832,7 @@ gboolean dt_dev_pixelpipe_cache_get(
   *dsc = &cache->dsc[cline];
 
   const gboolean masking = pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE;
-  cache->hash[cline]      = masking ? INVALID_CACHEHASH : hash;
+  _set_cacheline_hash(cache, cline, masking ? INVALID_CACHEHASH : hash);
 
   const dt_iop_buffer_dsc_t *cdsc = *dsc;
   dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_VERBOSE, "pipe cache get",
@@ -352,18 +840,74 @@ gboolean dt_dev_pixelpipe_cache_get(
     "%s %sline%3i(%2i) at %p. hash=%" PRIx64 "%s\n",
      dt_iop_colorspace_to_name(cdsc->cst),
      important ? "important " : "",
-     cline, cache->used[cline], cache->data[cline], cache->hash[cline],
+     cline, (int)_cacheline_age(cache, cline), cache->data[cline], cache->hash[cline],
      masking ? ". masking." : "");
 
-  cache->used[cline]      = !masking && important ? -cache->entries : 0;
+  if(!masking && important)
+    _mark_important(cache, cline);
+  else
+    cache->used[cline] = (int64_t)cache->calls;
   cache->ioporder[cline]  = module ? module->iop_order : 0;
+  cache->halfok[cline] = module && (module->flags() & IOP_FLAGS_CACHE_HALF_FLOAT);
+  cache->freq[cline] = 1;
+  cache->cost[cline] = 0.0;
+  _update_weight(cache, cline);
+
+  // the persistent cache might hold the data from an earlier run
+  if(cache->disk_hash == hash && hash != INVALID_CACHEHASH)
+  {
+    cache->disk_hash = INVALID_CACHEHASH;
+    if(*data && _disk_load(pipe, hash, size, *data, &cache->dsc[cline]))
+    {
+      dt_print_pipe(DT_DEBUG_PIPE, "disk cache HIT",
+          pipe, module, DT_DEVICE_NONE, NULL, NULL,
+          "%s, hash=%" PRIx64 "\n",
+          dt_iop_colorspace_to_name(cdsc->cst), hash);
+      return FALSE;
+    }
+    // the line doesn't hold the data for this hash, hand it back as the first free one.
+    // the caller processes as usual and requests its output line again.
+    _set_cacheline_hash(cache, cline, INVALID_CACHEHASH);
+    cache->ioporder[cline] = 0;
+    cache->used[cline] = 0;
+    cache->lastline = 0;
+    dt_print_pipe(DT_DEBUG_PIPE, "disk cache load failed",
+        pipe, module, DT_DEVICE_NONE, NULL, NULL, "hash=%" PRIx64 "\n", hash);
+    return TRUE;
+  }
 
+  cache->pending = cline;
+  cache->pending_start = dt_get_wtime();
+
+  return TRUE;
+}
+
+gboolean dt_dev_pixelpipe_cache_peek(
+           struct dt_dev_pixelpipe_t *pipe,
+           const dt_hash_t hash,
+           const size_t size,
+           void **data,
+           dt_iop_buffer_dsc_t **dsc)
+{
+  if(pipe->mask_display || pipe->nocache || hash == INVALID_CACHEHASH)
+    return FALSE;
+
+  dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
+  const int k = _find_cacheline(cache, hash);
+  if(k < DT_PIPECACHE_MIN
+     || cache->size[k] != size
+     || !cache->data[k]
+     || !_unpack_cacheline(cache, k))
+    return FALSE;
+
+  *data = cache->data[k];
+  *dsc = &cache->dsc[k];
   return TRUE;
 }
 
 static void _mark_invalid_cacheline(const dt_dev_pixelpipe_cache_t *cache, const int k)
 {
-  cache->hash[k] = INVALID_CACHEHASH;
+  _set_cacheline_hash(cache, k, INVALID_CACHEHASH);
   cache->ioporder[k] = 0;
 }
 
@@ -396,7 +940,7 @@ void dt_dev_pixelpipe_important_cacheline(
     if((cache->data[k] == data)
         && (size == cache->size[k])
         && (cache->hash[k] != INVALID_CACHEHASH))
-      cache->used[k] = -cache->entries;
+      _mark_important(cache, k);
   }
 }
 
@@ -412,12 +956,13 @@ void dt_dev_pixelpipe_invalidate_cacheline(const struct dt_dev_pixelpipe_t *pipe
 
 static size_t _free_cacheline(dt_dev_pixelpipe_cache_t *cache, const int k)
 {
-  const size_t removed = cache->size[k];
+  const size_t removed = _line_bytes(cache, k);
 
   dt_free_align(cache->data[k]);
   cache->allmem -= removed;
   cache->size[k] = 0;
   cache->data[k] = NULL;
+  cache->packed[k] = FALSE;
   _mark_invalid_cacheline(cache, k);
   return removed;
 }
@@ -429,10 +974,19 @@ static void _cline_stats(dt_dev_pixelpipe_cache_t *cache)
   {
     if(cache->data[k] != NULL) cache->lused++;
     if((cache->data[k] != NULL) && (cache->hash[k] == INVALID_CACHEHASH)) cache->linvalid++;
-    if(cache->used[k] < 0) cache->limportant++;
+    if(_cacheline_age(cache, k) < 0) cache->limportant++;
   }
 }
 
+static gboolean _half_enabled(const dt_dev_pixelpipe_t *pipe)
+{
+  if(pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW2))
+    return dt_conf_get_bool("pipecache_half_float/darkroom");
+  if(pipe->type & DT_DEV_PIXELPIPE_PREVIEW)
+    return dt_conf_get_bool("pipecache_half_float/preview");
+  return FALSE;
+}
+
 void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
@@ -441,6 +995,8 @@ void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
   // alternating buffers so no cleanup
   if(cache->entries == DT_PIPECACHE_MIN) return;
 
+  _account_pending(cache);
+
   // We always free cachelines maked as not valid
   size_t freed = 0;
 
@@ -450,6 +1006,27 @@ void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
       freed += _free_cacheline(cache, k);
   }
 
+  // lines not used by the last run are kept as half floats before dropping any
+  int packed = 0;
+  if(_half_enabled(pipe))
+  {
+    for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+    {
+      if(cache->data[k]
+         && cache->halfok[k]
+         && !cache->packed[k]
+         && cache->hash[k] != INVALID_CACHEHASH
+         && cache->used[k] >= 0
+         && (uint64_t)cache->used[k] < cache->lastcheck
+         && cache->dsc[k].datatype == TYPE_FLOAT
+         && cache->size[k] % sizeof(float) == 0
+         && cache->data[k] != (void *)pipe->backbuf
+         && _pack_cacheline(cache, k))
+        packed++;
+    }
+  }
+  cache->lastcheck = cache->calls;
+
   while(cache->memlimit && (cache->memlimit < cache->allmem))
   {
     const int k = _get_oldest_cacheline(cache, DT_CACHETEST_USED);
@@ -460,8 +1037,8 @@ void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
 
   _cline_stats(cache);
   dt_print_pipe(DT_DEBUG_PIPE, "pipe cache check", pipe, NULL, DT_DEVICE_NONE, NULL, NULL,
-    "%i lines (important=%i, used=%i). Freed %iMB. Using using %iMB, limit=%iMB\n",
-    cache->entries, cache->limportant, cache->lused,
+    "%i lines (important=%i, used=%i, half floats=%i). Freed %iMB. Using using %iMB, limit=%iMB\n",
+    cache->entries, cache->limportant, cache->lused, packed,
     _to_mb(freed), _to_mb(cache->allmem), _to_mb(cache->memlimit));
 }
 
@@ -469,13 +1046,16 @@ void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
 
+  _account_pending(cache);
   _cline_stats(cache);
   dt_print_pipe(DT_DEBUG_PIPE, "cache report", pipe, NULL, DT_DEVICE_NONE, NULL, NULL,
-    "%i lines (important=%i, used=%i, invalid=%i). Using %iMB, limit=%iMB. Hits/run=%.2f. Hits/test=%.3f\n",
+    "%i lines (important=%i, used=%i, invalid=%i). Using %iMB, limit=%iMB. Hits/run=%.2f. Hits/test=%.3f. Saved %iMB, %.3fs (%s)\n",
     cache->entries, cache->limportant, cache->lused, cache->linvalid,
     _to_mb(cache->allmem), _to_mb(cache->memlimit),
     (double)(cache->hits) / fmax(1.0, pipe->runs),
-    (double)(cache->hits) / fmax(1.0, cache->tests));
+    (double)(cache->hits) / fmax(1.0, cache->tests),
+    _to_mb(cache->saved_bytes), cache->saved_time,
+    cache->policy == DT_PIPECACHE_POLICY_COST ? "cost" : "LRU");
 }
 
 #undef INVALID_CACHEHASH
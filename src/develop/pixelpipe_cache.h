@@ -18,17 +18,26 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
 
+/** strategy used to select a cacheline to be reused or freed. */
+typedef enum dt_dev_pixelpipe_cache_policy_t
+{
+  DT_PIPECACHE_POLICY_LRU = 0,  // least recently used line is dropped first
+  DT_PIPECACHE_POLICY_COST = 1, // greedy-dual-size-frequency, weighted by module processing time
+} dt_dev_pixelpipe_cache_policy_t;
+
 /**
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
  * correctness is secured via the hash so make sure everything is included here.
  * No caching if cl_mem, instead copied cache buffers are used.
+ * Cachelines are found via a hash index, so lookups don't depend on the number of entries.
  */
 typedef struct dt_dev_pixelpipe_cache_t
 {
@@ -39,13 +48,29 @@ typedef struct dt_dev_pixelpipe_cache_t
   size_t *size;
   struct dt_iop_buffer_dsc_t *dsc;
   dt_hash_t *hash;
-  int32_t *used;
+  int64_t *used;      // value of calls when the line was used last, important lines are in the future
+  double *cost;       // time in seconds it took to compute the line contents
+  double *weight;     // priority of the line for the cost policy, lowest is dropped first
+  uint32_t *freq;     // number of hits since the line was computed
   int32_t *ioporder;
+  gboolean *halfok;   // the line's module tolerates keeping it in half floats
+  gboolean *packed;   // data holds half floats while the line is idle, size stays the float size
+  GHashTable *index;  // hash -> cacheline, only for lines >= DT_PIPECACHE_MIN
+  dt_dev_pixelpipe_cache_policy_t policy;
+  double inflation;   // weight of the latest dropped line, ages all others for the cost policy
+  int32_t pending;    // line being computed right now, its cost is known on next access
+  double pending_start;
+  dt_hash_t disk_hash;   // last hash found in the persistent cache
+  dt_hash_t disk_key;    // identifies the source file for the persistent cache
+  dt_imgid_t disk_imgid; // image the disk_key belongs to
   uint64_t calls;
+  uint64_t lastcheck;    // value of calls at the last memory check, lines used since are not idle
   int32_t lastline;
   // profiling & stats:
   uint64_t tests;
   uint64_t hits;
+  uint64_t saved_bytes;
+  double saved_time;
   uint32_t lused;
   uint32_t linvalid;
   uint32_t limportant;
@@ -77,7 +102,22 @@ dt_hash_t dt_dev_pixelpipe_cache_hash(const dt_imgid_t imgid, const struct dt_io
 gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const dt_hash_t hash,
                                const size_t size, void **data, struct dt_iop_buffer_dsc_t **dsc, struct dt_iop_module_t *module, const gboolean important);
 
-/** test availability of a cache line without destroying another, if it is not found. */
+/** look up the line for hash without touching its state or allocating a new one,
+  returns FALSE if there is none of the given size. A line kept in half floats is converted back. */
+gboolean dt_dev_pixelpipe_cache_peek(struct dt_dev_pixelpipe_t *pipe, const dt_hash_t hash,
+                                     const size_t size, void **data, struct dt_iop_buffer_dsc_t **dsc);
+
+/** store the line holding data as computed just now in the persistent cache,
+  this is only done for pipes using it and if processing took longer than reading back. */
+void dt_dev_pixelpipe_cache_store(struct dt_dev_pixelpipe_t *pipe, const dt_hash_t hash,
+                                  const void *data, const size_t size, const struct dt_iop_buffer_dsc_t *dsc);
+
+/** the persistent cache keeps expensive export pipe results across sessions on disk */
+void dt_dev_pixelpipe_cache_disk_init(void);
+void dt_dev_pixelpipe_cache_disk_cleanup(void);
+
+/** test availability of a cache line without destroying another, if it is not found.
+  Also checks the persistent cache if the pipe is using it. */
 gboolean dt_dev_pixelpipe_cache_available(struct dt_dev_pixelpipe_t *pipe, const dt_hash_t hash, const size_t size);
 
 /** invalidates all cachelines. */
@@ -92,7 +132,8 @@ void dt_dev_pixelpipe_important_cacheline(const struct dt_dev_pixelpipe_t *pipe,
 /** mark the given cache line as invalid or to be ignored */
 void dt_dev_pixelpipe_invalidate_cacheline(const struct dt_dev_pixelpipe_t *pipe, const void *data);
 
-/** print out cache lines/hashes and do a cache cleanup */
+/** print out cache lines/hashes and do a cache cleanup,
+  idle lines of modules tolerating it are kept as half floats if enabled for the pipe */
 void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe);
 void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe);
 
@@ -248,6 +248,7 @@ gboolean dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe,
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  memset(&pipe->damage, 0, sizeof(dt_dev_pixelpipe_damage_t));
   pipe->work_profile_info = NULL;
   pipe->input_profile_info = NULL;
   pipe->output_profile_info = NULL;
@@ -328,6 +329,11 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
     pipe->forms = NULL;
   }
+  if(pipe->damage.last_forms)
+  {
+    g_list_free_full(pipe->damage.last_forms, (void (*)(void *))dt_masks_free_form);
+    pipe->damage.last_forms = NULL;
+  }
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
   dt_pthread_mutex_destroy(&(pipe->mutex));
 }
@@ -1281,6 +1287,679 @@ static inline gboolean _skip_piece_on_tags(const dt_dev_pixelpipe_iop_t *piece)
           && (piece->pipe->type & DT_DEV_PIXELPIPE_BASIC);
 }
 
+// in a partial run, the output of the modules before the changed one is still cached
+// for the whole region of the last full run. copy the part needed now from there.
+static gboolean _crop_from_last_run(dt_dev_pixelpipe_t *pipe,
+                                    dt_dev_pixelpipe_iop_t *piece,
+                                    void **output,
+                                    dt_iop_buffer_dsc_t **out_format,
+                                    const dt_iop_roi_t *roi_out,
+                                    const dt_hash_t hash,
+                                    const size_t bpp,
+                                    const int pos)
+{
+  const dt_iop_roi_t *full = &pipe->damage.input_roi;
+  if(full->scale != roi_out->scale
+     || roi_out->x < full->x
+     || roi_out->y < full->y
+     || roi_out->x + roi_out->width > full->x + full->width
+     || roi_out->y + roi_out->height > full->y + full->height)
+    return FALSE;
+
+  const dt_hash_t full_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, full, pipe, pos);
+  const size_t full_size = bpp * full->width * full->height;
+  void *data = NULL;
+  dt_iop_buffer_dsc_t *dsc = NULL;
+  if(!dt_dev_pixelpipe_cache_peek(pipe, full_hash, full_size, &data, &dsc))
+    return FALSE;
+
+  **out_format = *dsc;
+  dt_dev_pixelpipe_cache_get(pipe, hash, bpp * roi_out->width * roi_out->height,
+                             output, out_format, piece->module, FALSE);
+
+  // getting a line for the output might have dropped the one we copy from
+  void *check = NULL;
+  if(!*output
+     || !dt_dev_pixelpipe_cache_peek(pipe, full_hash, full_size, &check, &dsc)
+     || check != data)
+  {
+    if(*output) dt_dev_pixelpipe_invalidate_cacheline(pipe, *output);
+    return FALSE;
+  }
+
+  const int dx = roi_out->x - full->x;
+  const int dy = roi_out->y - full->y;
+  DT_OMP_FOR()
+  for(int j = 0; j < roi_out->height; j++)
+    memcpy((char *)*output + bpp * j * roi_out->width,
+           (char *)data + bpp * ((size_t)(dy + j) * full->width + dx),
+           bpp * roi_out->width);
+
+  dt_print_pipe(DT_DEBUG_PIPE,
+      "pipe data: from last run", pipe, piece->module, DT_DEVICE_NONE, full, roi_out, "\n");
+  return TRUE;
+}
+
+// pointwise fusion: a run of modules that only work per pixel is processed in chunks
+// small enough to stay in the cpu cache, instead of writing a full buffer after each
+// of them. 8192 rgba float pixels are 128kB, input and output fit into L2.
+#define DT_PIPE_POINTWISE_CHUNK 8192
+
+static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
+                                           dt_develop_t *dev,
+                                           void **output,
+                                           void **cl_mem_output,
+                                           dt_iop_buffer_dsc_t **out_format,
+                                           const dt_iop_roi_t *roi_out,
+                                           GList *modules,
+                                           GList *pieces,
+                                           const int pos);
+
+// runs are only processed in export and thumbnail pipes on the cpu, darkroom pipes keep
+// the output of each module in the cache for interactive editing.
+static gboolean _pipe_allows_runs(dt_dev_pixelpipe_t *pipe)
+{
+#ifdef HAVE_OPENCL
+  if(_opencl_pipe_isok(pipe)) return FALSE;
+#endif
+  return !(pipe->type & DT_DEV_PIXELPIPE_BASIC)
+    && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+    && !darktable.dump_pfm_pipe
+    && !darktable.bench_module
+    && !(darktable.unmuted & DT_DEBUG_NAN);
+}
+
+static gboolean _piece_is_pointwise(dt_dev_pixelpipe_t *pipe,
+                                    dt_develop_t *dev,
+                                    dt_dev_pixelpipe_iop_t *piece,
+                                    const dt_iop_roi_t *roi)
+{
+  dt_iop_module_t *module = piece->module;
+  if(!module->process_pointwise
+     || piece->colors != 4
+     || (piece->request_histogram & DT_REQUEST_ON)
+     || _transform_for_blend(module, piece)
+     || _request_color_pick(pipe, dev, module)
+     || module->input_colorspace(module, pipe, piece) == IOP_CS_RAW)
+    return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  return !memcmp(&roi_in, roi, sizeof(dt_iop_roi_t));
+}
+
+// number of pointwise modules in the run ending at modules, first_module/first_piece
+// point to the start of the run. the pixels fed into the run must not be raw data and
+// the colorspaces must match between the modules so no conversion is needed in between.
+static int _pointwise_run(dt_dev_pixelpipe_t *pipe,
+                          dt_develop_t *dev,
+                          GList *modules,
+                          GList *pieces,
+                          const dt_iop_roi_t *roi,
+                          GList **first_module,
+                          GList **first_piece,
+                          int *first_pos)
+{
+  if(!_pipe_allows_runs(pipe) || !dt_conf_get_bool("pipe_fuse_pointwise"))
+    return 0;
+
+  int count = 0;
+  int pos = *first_pos;
+  dt_dev_pixelpipe_iop_t *first = NULL;
+  GList *m = modules;
+  GList *p = pieces;
+  for(; m; m = g_list_previous(m), p = g_list_previous(p), pos--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_skip_piece_on_tags(piece)) continue;
+
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    const gboolean ok = _piece_is_pointwise(pipe, dev, piece, roi)
+      && (!first
+          || module->output_colorspace(module, pipe, piece)
+             == first->module->input_colorspace(first->module, pipe, first));
+
+    if(!ok)
+    {
+      // whatever comes before the run has to deliver rgba floats
+      if(module->output_colorspace(module, pipe, piece) == IOP_CS_RAW) count = 0;
+      break;
+    }
+
+    first = piece;
+    *first_module = m;
+    *first_piece = p;
+    *first_pos = pos;
+    count++;
+  }
+  // the pipe input itself is never fed into a run
+  if(!m) count = 0;
+  return count > 1 ? count : 0;
+}
+
+// get the input of a run starting at first_module in the colorspace that module wants
+static gboolean _run_input(dt_dev_pixelpipe_t *pipe,
+                           dt_develop_t *dev,
+                           void **input,
+                           dt_iop_buffer_dsc_t **input_format,
+                           const dt_iop_roi_t *roi_out,
+                           GList *first_module,
+                           GList *first_piece,
+                           const int first_pos)
+{
+  void *cl_mem_input = NULL;
+  if(_dev_pixelpipe_process_rec(pipe, dev, input, &cl_mem_input, input_format, roi_out,
+                                g_list_previous(first_module),
+                                g_list_previous(first_piece), first_pos - 1))
+    return TRUE;
+
+  dt_iop_module_t *module = (dt_iop_module_t *)first_module->data;
+  dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)first_piece->data;
+  const int cst_to = module->input_colorspace(module, pipe, piece);
+  if((*input_format)->cst != cst_to)
+    dt_print_pipe(DT_DEBUG_PIPE,
+           "transform colorspace",
+           pipe, module, DT_DEVICE_CPU, roi_out, NULL, " %s -> %s\n",
+           dt_iop_colorspace_to_name((*input_format)->cst),
+           dt_iop_colorspace_to_name(cst_to));
+  dt_ioppr_transform_image_colorspace
+    (module, *input, *input, roi_out->width, roi_out->height, (*input_format)->cst,
+     cst_to, &(*input_format)->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+
+  return dt_atomic_get_int(&pipe->shutdown) ? TRUE : FALSE;
+}
+
+// process the run of count pointwise modules from first_module to modules in one pass
+static gboolean _process_pointwise_run(dt_dev_pixelpipe_t *pipe,
+                                       dt_develop_t *dev,
+                                       void **output,
+                                       dt_iop_buffer_dsc_t **out_format,
+                                       const dt_iop_roi_t *roi_out,
+                                       GList *modules,
+                                       GList *first_module,
+                                       GList *first_piece,
+                                       const int first_pos,
+                                       const int count,
+                                       const dt_hash_t hash,
+                                       const size_t bufsize)
+{
+  void *input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+
+  if(_run_input(pipe, dev, &input, &input_format, roi_out,
+                first_module, first_piece, first_pos))
+    return TRUE;
+
+  dt_times_t start;
+  dt_get_perf_times(&start);
+
+  dt_iop_module_t *module = NULL;
+  dt_dev_pixelpipe_iop_t *piece = NULL;
+
+  // formats and per run setup in pipe order, as if the modules ran one after the other
+  dt_dev_pixelpipe_iop_t **run = g_malloc_n(count, sizeof(dt_dev_pixelpipe_iop_t *));
+  dt_iop_buffer_dsc_t dsc = *input_format;
+  int n = 0;
+  for(GList *m = first_module, *p = first_piece; n < count; m = g_list_next(m), p = g_list_next(p))
+  {
+    piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_skip_piece_on_tags(piece)) continue;
+
+    module = (dt_iop_module_t *)m->data;
+    piece->processed_roi_in = piece->processed_roi_out = *roi_out;
+    piece->dsc_out = piece->dsc_in = dsc;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    pipe->dsc = piece->dsc_out;
+    if(module->process_pointwise_setup)
+      module->process_pointwise_setup(module, piece);
+    pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+    dsc = piece->dsc_out = pipe->dsc;
+    run[n++] = piece;
+
+    dt_print_pipe(DT_DEBUG_PIPE,
+       "process fused",
+       pipe, module, DT_DEVICE_CPU, roi_out, NULL, "%3i %s %i/%i\n",
+       module->iop_order, dt_iop_colorspace_to_name(pipe->dsc.cst), n, count);
+  }
+  module = (dt_iop_module_t *)modules->data;
+
+  **out_format = pipe->dsc;
+  dt_dev_pixelpipe_cache_get(pipe, hash, bufsize, output, out_format, module, FALSE);
+
+  if(dt_atomic_get_int(&pipe->shutdown))
+  {
+    g_free(run);
+    return TRUE;
+  }
+
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  if(input_format->channels == 4 && input_format->datatype == TYPE_FLOAT)
+  {
+    const float *const in = (const float *)input;
+    float *const out = (float *)*output;
+    const size_t nchunks = (npixels + DT_PIPE_POINTWISE_CHUNK - 1) / DT_PIPE_POINTWISE_CHUNK;
+    DT_OMP_FOR(schedule(static))
+    for(size_t c = 0; c < nchunks; c++)
+    {
+      const size_t offset = 4 * c * DT_PIPE_POINTWISE_CHUNK;
+      const size_t chunk = MIN(DT_PIPE_POINTWISE_CHUNK, npixels - c * DT_PIPE_POINTWISE_CHUNK);
+      run[0]->module->process_pointwise(run[0]->module, run[0], in + offset, out + offset, chunk);
+      for(int k = 1; k < count; k++)
+        run[k]->module->process_pointwise(run[k]->module, run[k], out + offset, out + offset, chunk);
+    }
+  }
+  else
+  {
+    // should not happen as we don't fuse after raw data, just don't get it wrong
+    dt_print_pipe(DT_DEBUG_ALWAYS,
+       "process fused", pipe, module, DT_DEVICE_CPU, roi_out, NULL,
+       "unexpected input with %i channels, processing modules one by one\n",
+       input_format->channels);
+    for(int k = 0; k < count; k++)
+      run[k]->module->process(run[k]->module, run[k], k ? *output : input, *output,
+                              roi_out, roi_out);
+  }
+
+  dt_show_times_f
+    (&start,
+     "[dev_pixelpipe]", "[%s] processed %i fused modules up to `%s%s' on CPU",
+     dt_dev_pixelpipe_type_to_str(pipe->type), count, module->op,
+     dt_iop_get_instance_id(module));
+
+  g_free(run);
+
+  **out_format = pipe->dsc;
+  dt_dev_pixelpipe_cache_store(pipe, hash, *output, bufsize, *out_format);
+
+  return dt_atomic_get_int(&pipe->shutdown) ? TRUE : FALSE;
+}
+
+// cache tiling: a run of modules that need no or only a few rows around each output
+// pixel is processed in stripes of full rows sized to the cpu's last level cache. each
+// module processes the stripe plus the overlap the later modules of the run still need,
+// so only the output of the last module is written as a full buffer.
+// on bayer raws the run may start with the raw modules up to demosaic, so the whole raw
+// front end of an export makes one pass over the mosaic.
+#define DT_PIPE_STRIPE_MAX_OVERLAP 32
+// the last stripe takes the remaining rows if fewer are left, some modules switch to
+// other algorithms on small buffers
+#define DT_PIPE_STRIPE_MIN_ROWS 16
+
+static size_t _stripe_cache_bytes(void)
+{
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  const long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if(l3 > 0) return l3;
+#endif
+  return 8lu << 20;
+}
+
+// floats of one stripe buffer, rounded so the second buffer starts on a cache line
+static size_t _stripe_buffer_floats(const dt_iop_roi_t *roi, const int stripe, const int margin)
+{
+  return dt_round_size((size_t)4 * roi->width * (stripe + DT_PIPE_STRIPE_MIN_ROWS + 2 * margin),
+                       DT_CACHELINE_FLOATS);
+}
+
+// rows of a stripe, input and two stripe buffers should fit into half the cache
+static int _stripe_height(const dt_iop_roi_t *roi, const int margin)
+{
+  const size_t row_bytes = 4 * sizeof(float) * roi->width;
+  const int rows = (int)(_stripe_cache_bytes() / (6 * row_bytes)) - 2 * margin;
+  // even, so stripes of a mosaic start on the bayer pattern
+  return CLAMP(rows, MAX(4 * margin, DT_PIPE_STRIPE_MIN_ROWS), roi->height) & ~1;
+}
+
+// raw modules working on stripes of a bayer mosaic that start on an even row
+static gboolean _piece_on_mosaic(dt_dev_pixelpipe_t *pipe,
+                                 dt_dev_pixelpipe_iop_t *piece,
+                                 const dt_iop_roi_t *roi)
+{
+  dt_iop_module_t *module = piece->module;
+  const uint32_t filters = pipe->image.buf_dsc.filters;
+  return module->mosaic_stripes
+    && filters && filters != 9u
+    && dt_image_is_raw(&pipe->image)
+    && module->input_colorspace(module, pipe, piece) == IOP_CS_RAW
+    && module->mosaic_stripes(module, piece, roi);
+}
+
+// pointwise modules and those opting in with IOP_FLAGS_ALLOW_STRIPES handle any part of
+// the image as long as they get their tiling overlap around it. allowing tiling alone is
+// not enough, some modules take image wide statistics from whatever part they get. raw
+// modules opt in with mosaic_stripes, one cropping the mosaic can only start a run, crop
+// is set for it.
+static gboolean _piece_in_stripes(dt_dev_pixelpipe_t *pipe,
+                                  dt_develop_t *dev,
+                                  dt_dev_pixelpipe_iop_t *piece,
+                                  const dt_iop_roi_t *roi,
+                                  int *overlap,
+                                  gboolean *crop)
+{
+  dt_iop_module_t *module = piece->module;
+  const gboolean mosaic = _piece_on_mosaic(pipe, piece, roi);
+  *crop = FALSE;
+  if(!(module->process_pointwise
+       || (piece->process_tiling_ready
+           && (mosaic || (module->flags() & IOP_FLAGS_ALLOW_STRIPES))))
+     || (piece->request_histogram & DT_REQUEST_ON)
+     || _transform_for_blend(module, piece)
+     || _request_color_pick(pipe, dev, module))
+    return FALSE;
+
+  if(!mosaic
+     && (piece->colors != 4
+         || (module->operation_tags() & IOP_TAG_DISTORT)
+         || module->input_colorspace(module, pipe, piece) == IOP_CS_RAW
+         || module->output_colorspace(module, pipe, piece) == IOP_CS_RAW))
+    return FALSE;
+
+  dt_iop_buffer_dsc_t dsc = pipe->dsc;
+  module->output_format(module, pipe, piece, &dsc);
+  if(dsc.datatype != TYPE_FLOAT
+     || (dsc.channels != 4 && !(mosaic && dsc.cst == IOP_CS_RAW)))
+    return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  if(memcmp(&roi_in, roi, sizeof(dt_iop_roi_t)))
+  {
+    if(!mosaic
+       || roi_in.x != roi->x || roi_in.y != roi->y || roi_in.scale != roi->scale
+       || roi_in.width < roi->width || roi_in.height < roi->height)
+      return FALSE;
+    *crop = TRUE;
+  }
+
+  *overlap = 0;
+  if(!module->process_pointwise)
+  {
+    dt_develop_tiling_t tiling = { 0 };
+    module->tiling_callback(module, piece, roi, roi, &tiling);
+    *overlap = (tiling.overlap + 1) & ~1;
+  }
+  return TRUE;
+}
+
+// number of modules in the stripe run ending at modules, margin is the sum of their
+// overlaps. pointwise is set if the run could be done as a pointwise run instead.
+static int _stripe_run(dt_dev_pixelpipe_t *pipe,
+                       dt_develop_t *dev,
+                       GList *modules,
+                       GList *pieces,
+                       const dt_iop_roi_t *roi,
+                       GList **first_module,
+                       GList **first_piece,
+                       int *first_pos,
+                       int *margin,
+                       gboolean *pointwise)
+{
+  if(!_pipe_allows_runs(pipe) || !dt_conf_get_bool("pipe_cache_tiling"))
+    return 0;
+
+  int count = 0;
+  int pos = *first_pos;
+  dt_dev_pixelpipe_iop_t *first = NULL;
+  gboolean crop = FALSE;
+  *margin = 0;
+  *pointwise = TRUE;
+  GList *m = modules;
+  GList *p = pieces;
+  for(; m; m = g_list_previous(m), p = g_list_previous(p), pos--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_skip_piece_on_tags(piece)) continue;
+
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    int overlap = 0;
+    if(!_piece_in_stripes(pipe, dev, piece, roi, &overlap, &crop)
+       || *margin + overlap > DT_PIPE_STRIPE_MAX_OVERLAP
+       || (!first && module->output_colorspace(module, pipe, piece) == IOP_CS_RAW))
+    {
+      // only raw modules on the mosaic take raw input
+      if(module->output_colorspace(module, pipe, piece) == IOP_CS_RAW
+         && !(first && _piece_on_mosaic(pipe, first, roi)))
+        count = 0;
+      break;
+    }
+
+    if(first
+       && (!module->process_pointwise
+           || module->output_colorspace(module, pipe, piece)
+              != first->module->input_colorspace(first->module, pipe, first)))
+      *pointwise = FALSE;
+
+    first = piece;
+    *first_module = m;
+    *first_piece = p;
+    *first_pos = pos;
+    *margin += overlap;
+    count++;
+    if(crop) break;
+  }
+  // a run reaching the pipe input starts with the first module, a raw one not cropping
+  // the mosaic gets the input image like a cropping one. that may be the image buffer
+  // itself, which must not be converted in place.
+  if(!m && first
+     && first->module->input_colorspace(first->module, pipe, first) != pipe->image.buf_dsc.cst)
+    count = 0;
+  if(first && !first->module->process_pointwise) *pointwise = FALSE;
+  return count > 1 ? count : 0;
+}
+
+// process the run of count modules from first_module to modules in stripes of stripe
+// rows, buf holds two stripe buffers and is freed here. process() expects its buffers on
+// a cache line, so every module writes to the start of a stripe buffer and the rows the
+// next one needs are moved there if they don't start on a cache line themselves.
+static gboolean _process_stripe_run(dt_dev_pixelpipe_t *pipe,
+                                    dt_develop_t *dev,
+                                    void **output,
+                                    dt_iop_buffer_dsc_t **out_format,
+                                    const dt_iop_roi_t *roi_out,
+                                    GList *modules,
+                                    GList *first_module,
+                                    GList *first_piece,
+                                    const int first_pos,
+                                    const int count,
+                                    const int stripe,
+                                    float *buf,
+                                    const dt_hash_t hash,
+                                    const size_t bufsize)
+{
+  dt_iop_roi_t roi_in = *roi_out;
+  dt_dev_pixelpipe_iop_t **run = g_malloc_n(count, sizeof(dt_dev_pixelpipe_iop_t *));
+  int n = 0;
+  for(GList *m = first_module, *p = first_piece; n < count; m = g_list_next(m), p = g_list_next(p))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_skip_piece_on_tags(piece)) continue;
+    run[n++] = piece;
+  }
+  // the first module may crop the raw mosaic
+  run[0]->module->modify_roi_in(run[0]->module, run[0], roi_out, &roi_in);
+
+  void *input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+
+  if(_run_input(pipe, dev, &input, &input_format, &roi_in,
+                first_module, first_piece, first_pos))
+  {
+    g_free(run);
+    dt_free_align(buf);
+    return TRUE;
+  }
+
+  dt_times_t start;
+  dt_get_perf_times(&start);
+
+  dt_iop_buffer_dsc_t *pre = g_malloc_n(count, sizeof(dt_iop_buffer_dsc_t));
+  // margin[k]: rows around the stripe module k has to process
+  int *margin = g_malloc0_n(count + 1, sizeof(int));
+  for(int k = count - 1; k >= 0; k--)
+  {
+    int overlap = 0;
+    gboolean crop = FALSE;
+    _piece_in_stripes(pipe, dev, run[k], roi_out, &overlap, &crop);
+    margin[k] = margin[k + 1] + overlap;
+  }
+
+  dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const size_t row = (size_t)4 * width;
+  const size_t in_row = dt_iop_buffer_dsc_to_bpp(input_format) * roi_in.width;
+  const dt_iop_order_iccprofile_info_t *const work_profile =
+    dt_ioppr_get_pipe_work_profile_info(pipe);
+  float *const stripes[2] = { buf, buf + _stripe_buffer_floats(roi_out, stripe, margin[0]) };
+  float *out = NULL;
+
+  // input rows starting off a cache line are copied to an aligned stripe, including the
+  // rows a cropping first module reads below the stripe. mosaic rows of uint16 or float
+  // rarely are a multiple of the cache line.
+  const int crop_rows = roi_in.height - height;
+  const gboolean copy_input = (in_row % DT_CACHELINE_BYTES) != 0;
+  void *in_stripe = copy_input
+    ? dt_alloc_aligned(in_row * (stripe + DT_PIPE_STRIPE_MIN_ROWS + 2 * margin[0] + crop_rows))
+    : NULL;
+  if(copy_input && !in_stripe)
+  {
+    g_free(margin);
+    g_free(pre);
+    g_free(run);
+    dt_free_align(buf);
+    return TRUE;
+  }
+
+  dt_print_pipe(DT_DEBUG_PIPE,
+     "process stripes",
+     pipe, module, DT_DEVICE_CPU, roi_out, NULL, "%i modules from %s%s, %i rows, overlap %i\n",
+     count, run[0]->module->op, g_list_previous(first_module) ? "" : " on the pipe input",
+     stripe, margin[0]);
+
+  for(int y0 = 0, y1 = 0; y0 < height; y0 = y1)
+  {
+    if(dt_atomic_get_int(&pipe->shutdown)) break;
+
+    y1 = MIN(y0 + stripe, height);
+    if(height - y1 < DT_PIPE_STRIPE_MIN_ROWS) y1 = height;
+    int a = MAX(0, y0 - margin[0]);
+    int b = MIN(height, y1 + margin[0]);
+    const void *src = (const char *)input + in_row * a;
+    if(in_stripe)
+    {
+      memcpy(in_stripe, src, in_row * (b - a + crop_rows));
+      src = in_stripe;
+    }
+    for(int k = 0; k < count; k++)
+    {
+      dt_dev_pixelpipe_iop_t *piece = run[k];
+      module = piece->module;
+
+      if(y0 == 0)
+      {
+        // formats and per run setup in pipe order, as if the modules ran one after the other
+        piece->processed_roi_in = k ? *roi_out : roi_in;
+        piece->processed_roi_out = *roi_out;
+        piece->dsc_out = piece->dsc_in = k ? run[k - 1]->dsc_out : *input_format;
+        module->output_format(module, pipe, piece, &piece->dsc_out);
+        pipe->dsc = piece->dsc_out;
+        if(module->process_pointwise && module->process_pointwise_setup)
+          module->process_pointwise_setup(module, piece);
+        pre[k] = pipe->dsc;
+      }
+      else
+        pipe->dsc = pre[k];
+
+      // mosaic modules have one channel
+      const size_t out_row = (size_t)pre[k].channels * width;
+      float *dst = stripes[k & 1];
+
+      if(module->process_pointwise
+         && piece->dsc_in.channels == 4 && piece->dsc_in.datatype == TYPE_FLOAT)
+      {
+        const size_t npixels = (size_t)width * (b - a);
+        const size_t nchunks = (npixels + DT_PIPE_POINTWISE_CHUNK - 1) / DT_PIPE_POINTWISE_CHUNK;
+        DT_OMP_FOR(schedule(static))
+        for(size_t c = 0; c < nchunks; c++)
+        {
+          const size_t offset = 4 * c * DT_PIPE_POINTWISE_CHUNK;
+          const size_t chunk = MIN(DT_PIPE_POINTWISE_CHUNK, npixels - c * DT_PIPE_POINTWISE_CHUNK);
+          module->process_pointwise(module, piece, (const float *)src + offset, dst + offset, chunk);
+        }
+      }
+      else
+      {
+        dt_iop_roi_t roi = *roi_out;
+        roi.y += a;
+        roi.height = b - a;
+        // a cropping module reads its rows from the stripe's start on
+        dt_iop_roi_t roi_stripe_in = roi;
+        if(k == 0)
+        {
+          roi_stripe_in.width = roi_in.width;
+          roi_stripe_in.height += roi_in.height - height;
+        }
+        module->process(module, piece, src, dst, &roi_stripe_in, &roi);
+      }
+
+      pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+      if(y0 == 0)
+        piece->dsc_out = pipe->dsc;
+
+      // the next module gets its colorspace and the rows it needs
+      if(k + 1 < count)
+      {
+        int cst = pipe->dsc.cst;
+        dt_iop_module_t *next = run[k + 1]->module;
+        dt_ioppr_transform_image_colorspace
+          (next, dst, dst, width, b - a, cst,
+           next->input_colorspace(next, pipe, run[k + 1]), &cst, work_profile);
+      }
+      const int a_next = MAX(0, y0 - margin[k + 1]);
+      const int b_next = MIN(height, y1 + margin[k + 1]);
+      float *next_src = dst + out_row * (a_next - a);
+      if(((uintptr_t)next_src % DT_CACHELINE_BYTES) != 0)
+      {
+        memmove(dst, next_src, sizeof(float) * out_row * (b_next - a_next));
+        next_src = dst;
+      }
+      src = next_src;
+      a = a_next;
+      b = b_next;
+    }
+
+    if(y0 == 0)
+    {
+      **out_format = pipe->dsc;
+      dt_dev_pixelpipe_cache_get(pipe, hash, bufsize, output, out_format, module, FALSE);
+      out = (float *)*output;
+    }
+    memcpy(out + row * y0, src, sizeof(float) * row * (y1 - y0));
+  }
+
+  g_free(margin);
+  g_free(pre);
+  g_free(run);
+  dt_free_align(in_stripe);
+  dt_free_align(buf);
+
+  if(!out || dt_atomic_get_int(&pipe->shutdown))
+    return TRUE;
+
+  dt_show_times_f
+    (&start,
+     "[dev_pixelpipe]", "[%s] processed %i modules in stripes up to `%s%s' on CPU",
+     dt_dev_pixelpipe_type_to_str(pipe->type), count, module->op,
+     dt_iop_get_instance_id(module));
+
+  **out_format = pipe->dsc;
+  dt_dev_pixelpipe_cache_store(pipe, hash, *output, bufsize, *out_format);
+
+  return FALSE;
+}
+
 // recursive helper for process, returns TRUE in case of unfinished work or error
 static gboolean _dev_pixelpipe_process_rec(
                  dt_dev_pixelpipe_t *pipe,
@@ -1345,18 +2024,19 @@ static gboolean _dev_pixelpipe_process_rec(
     && dt_iop_module_is(module->so, "gamma");
 
   // we also never want any cached data if in masking mode or nocache is active
-  // otherwise we check for a valid cacheline
+  // otherwise we check for a valid cacheline.
+  // nocache pipes still might use the persistent cache, this is tested while checking
   const gboolean cache_available =
       !gamma_preview
       && (pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE)
-      && !pipe->nocache
       && dt_dev_pixelpipe_cache_available(pipe, hash, bufsize);
 
-  if(cache_available)
+  // reading from the persistent cache might fail, in that case we get a fresh
+  // buffer and process as usual
+  if(cache_available
+     && !dt_dev_pixelpipe_cache_get(pipe, hash, bufsize,
+                                    output, out_format, module, TRUE))
   {
-    dt_dev_pixelpipe_cache_get(pipe, hash, bufsize,
-                               output, out_format, module, TRUE);
-
     if(dt_atomic_get_int(&pipe->shutdown))
       return TRUE;
 
@@ -1368,6 +2048,13 @@ static gboolean _dev_pixelpipe_process_rec(
     return FALSE;
   }
 
+  // 1b) partial runs take the unchanged input of the changed module from the last run
+  if(pipe->damage.active
+     && module
+     && module->iop_order < pipe->damage.iop_order
+     && _crop_from_last_run(pipe, piece, output, out_format, roi_out, hash, bpp, pos))
+    return dt_atomic_get_int(&pipe->shutdown) ? TRUE : FALSE;
+
   // 2) if history changed or exit event, abort processing?
   // preview pipe: abort on all but zoom events (same buffer anyways)
   if(dt_iop_breakpoint(dev, pipe)) return TRUE;
@@ -1455,6 +2142,33 @@ static gboolean _dev_pixelpipe_process_rec(
     dt_print_pipe(DT_DEBUG_PIPE,
                   "modify roi IN", piece->pipe, module, DT_DEVICE_NONE, &roi_in, roi_out, "ID=%i\n",
                   pipe->image.id);
+
+  // a run of modules with small support ending here is processed in stripes
+  GList *first_module = NULL;
+  GList *first_piece = NULL;
+  int first_pos = pos;
+  int margin = 0;
+  gboolean pointwise = TRUE;
+  int run = _stripe_run(pipe, dev, modules, pieces, roi_out,
+                        &first_module, &first_piece, &first_pos, &margin, &pointwise);
+  if(run && !pointwise)
+  {
+    const int stripe = _stripe_height(roi_out, margin);
+    float *buf = dt_alloc_align_float(2 * _stripe_buffer_floats(roi_out, stripe, margin));
+    if(buf)
+      return _process_stripe_run(pipe, dev, output, out_format, roi_out, modules,
+                                 first_module, first_piece, first_pos, run, stripe, buf,
+                                 hash, bufsize);
+  }
+
+  // a run of pointwise modules ending here is processed in one pass
+  first_pos = pos;
+  run = _pointwise_run(pipe, dev, modules, pieces, roi_out,
+                       &first_module, &first_piece, &first_pos);
+  if(run)
+    return _process_pointwise_run(pipe, dev, output, out_format, roi_out, modules,
+                                  first_module, first_piece, first_pos, run, hash, bufsize);
+
   // recurse to get actual data of input buffer
 
   dt_iop_buffer_dsc_t _input_format = { 0 };
@@ -2280,6 +2994,10 @@ static gboolean _dev_pixelpipe_process_rec(
   // in case we get this buffer from the cache in the future, cache some stuff:
   **out_format = piece->dsc_out = pipe->dsc;
 
+  // keep expensive results for later runs, only possible if valid in host memory
+  if(*cl_mem_output == NULL)
+    dt_dev_pixelpipe_cache_store(pipe, hash, *output, bufsize, *out_format);
+
   // special cases for active modules with available gui
   if(module
      && darktable.develop->gui_attached
@@ -2563,6 +3281,297 @@ static gboolean _dev_pixelpipe_process_rec_and_backcopy(
   return ret;
 }
 
+// pixels around a changed one which can change in the output of blending, as the
+// mask is feathered and blurred
+static int _blend_margin(const dt_dev_pixelpipe_iop_t *piece, const float scale)
+{
+  const dt_develop_blend_params_t *d = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(!d || d->mask_mode == DEVELOP_MASK_DISABLED) return 0;
+
+  const float s = scale / piece->iscale;
+  int margin = 0;
+  // the guided filter runs two box filters of this size
+  if(d->feathering_radius > 0.1f)
+    margin += 2 * MAX(1, (int)(2.0f * d->feathering_radius * s + 0.5f));
+  if(d->blur_radius > 0.1f)
+    margin += (int)ceilf(4.0f * d->blur_radius * s);
+  return margin;
+}
+
+// how far the output of a piece is affected by a changed input pixel, as told by the tiling
+// overlap or by having a pointwise kernel. FALSE if the module depends on the whole image or on the gui and might change
+// everywhere. modules asking for all they need in modify_roi_in are trusted with own_roi.
+static gboolean _piece_support(dt_dev_pixelpipe_iop_t *piece,
+                               const dt_iop_roi_t *roi,
+                               const gboolean own_roi,
+                               int *overlap,
+                               int *blend)
+{
+  *overlap = *blend = 0;
+  if(_skip_piece_on_tags(piece)) return TRUE;
+
+  dt_iop_module_t *module = piece->module;
+  if(module->request_color_pick != DT_REQUEST_COLORPICK_OFF
+     || module->request_mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE
+     || module->suppress_mask
+     || module->raster_mask.sink.source
+     || (piece->request_histogram & DT_REQUEST_ON))
+    return FALSE;
+
+  // gamma just converts to the display buffer
+  if(dt_iop_module_is(module->so, "gamma")) return TRUE;
+
+  // a pointwise module changes its output only where its input changed
+  if(module->process_pointwise)
+  {
+    *blend = _blend_margin(piece, roi->scale);
+    return TRUE;
+  }
+
+  // tiling needs to know the support of a module so we can rely on it
+  const int flags = module->flags();
+  if(own_roi && !(flags & IOP_FLAGS_ALLOW_TILING)) return TRUE;
+  if(!(flags & IOP_FLAGS_ALLOW_TILING)
+     || (flags & IOP_FLAGS_TILING_FULL_ROI)
+     || !piece->process_tiling_ready)
+    return FALSE;
+
+  dt_develop_tiling_t tiling = { 0 };
+  tiling.factor_cl = tiling.maxbuf_cl = -1;
+  module->tiling_callback(module, piece, roi, roi, &tiling);
+  *overlap = tiling.overlap;
+  *blend = _blend_margin(piece, roi->scale);
+  return TRUE;
+}
+
+static gboolean _same_form(dt_masks_form_t *a, dt_masks_form_t *b)
+{
+  const int length = dt_masks_group_get_hash_buffer_length(a);
+  if(length != dt_masks_group_get_hash_buffer_length(b)) return FALSE;
+
+  char *str_a = malloc(length);
+  char *str_b = malloc(length);
+  dt_masks_group_get_hash_buffer(a, str_a);
+  dt_masks_group_get_hash_buffer(b, str_b);
+  const gboolean same = !memcmp(str_a, str_b, length);
+  free(str_a);
+  free(str_b);
+  return same;
+}
+
+static gboolean _add_form_area(dt_dev_pixelpipe_iop_t *piece,
+                               dt_masks_form_t *form,
+                               float box[4])
+{
+  int width, height, posx, posy;
+  if(!dt_masks_get_area(piece->module, piece, form, &width, &height, &posx, &posy))
+    return FALSE;
+
+  box[0] = MIN(box[0], posx);
+  box[1] = MIN(box[1], posy);
+  box[2] = MAX(box[2], posx + width);
+  box[3] = MAX(box[3], posy + height);
+  return TRUE;
+}
+
+// bounding box of the shapes of the piece's mask which changed since the last run, in the
+// output of the module. FALSE if that can't be told.
+static gboolean _changed_forms_area(dt_dev_pixelpipe_t *pipe,
+                                    dt_dev_pixelpipe_iop_t *piece,
+                                    float box[4])
+{
+  const dt_develop_blend_params_t *d = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(!d) return FALSE;
+
+  dt_masks_form_t *grp = dt_masks_get_from_id_ext(pipe->forms, d->mask_id);
+  dt_masks_form_t *last_grp = dt_masks_get_from_id_ext(pipe->damage.last_forms, d->mask_id);
+  if(!grp || !last_grp
+     || !(grp->type & DT_MASKS_GROUP)
+     || g_list_length(grp->points) != g_list_length(last_grp->points))
+    return FALSE;
+
+  box[0] = box[1] = FLT_MAX;
+  box[2] = box[3] = -FLT_MAX;
+  for(const GList *points = grp->points, *last_points = last_grp->points;
+      points && last_points;
+      points = g_list_next(points), last_points = g_list_next(last_points))
+  {
+    const dt_masks_point_group_t *pt = (dt_masks_point_group_t *)points->data;
+    const dt_masks_point_group_t *last_pt = (dt_masks_point_group_t *)last_points->data;
+    if(pt->formid != last_pt->formid
+       || pt->state != last_pt->state
+       || pt->opacity != last_pt->opacity)
+      return FALSE;
+
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(pipe->forms, pt->formid);
+    dt_masks_form_t *last_form = dt_masks_get_from_id_ext(pipe->damage.last_forms, pt->formid);
+    if(!form || !last_form
+       || (form->type & DT_MASKS_GROUP)
+       || (last_form->type & DT_MASKS_GROUP))
+      return FALSE;
+
+    if(!_same_form(form, last_form)
+       && !(_add_form_area(piece, form, box) && _add_form_area(piece, last_form, box)))
+      return FALSE;
+  }
+  return box[0] < box[2] && box[1] < box[3];
+}
+
+#define DT_DAMAGE_EDGE_POINTS 8
+
+// decide if this run can just process the part of the output changed since the last run.
+// that's the case if only the drawn shapes of one module changed and all later modules
+// tell how far a change spreads.
+static gboolean _find_damage(dt_dev_pixelpipe_t *pipe,
+                             dt_develop_t *dev,
+                             const dt_iop_roi_t *roi)
+{
+  dt_dev_pixelpipe_damage_t *damage = &pipe->damage;
+  damage->active = FALSE;
+
+  // the fast pipe flag is set on the way in, it must be the same as last time
+  const dt_iop_module_t *gui_module = dt_dev_gui_module();
+  const dt_dev_pixelpipe_type_t type =
+    (gui_module && gui_module->flags() & IOP_FLAGS_ALLOW_FAST_PIPE)
+    ? pipe->type | DT_DEV_PIXELPIPE_FAST
+    : pipe->type & ~DT_DEV_PIXELPIPE_FAST;
+
+  if(!(pipe->type & DT_DEV_PIXELPIPE_FULL)
+     || !dt_conf_get_bool("pipe_partial_processing")
+     || pipe->nocache
+     || pipe->cache_obsolete
+     || pipe->want_detail_mask
+     || pipe->cache.entries <= DT_PIPECACHE_MIN
+     || !pipe->backbuf
+     || pipe->output_imgid != pipe->image.id
+     || pipe->backbuf_width != roi->width
+     || pipe->backbuf_height != roi->height
+     || damage->last_input != pipe->input
+     || damage->last_type != type
+     || memcmp(&damage->last_roi, roi, sizeof(dt_iop_roi_t)))
+    return FALSE;
+
+  // exactly one module changed, and only its drawn shapes
+  dt_dev_pixelpipe_iop_t *changed = NULL;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->hash == piece->last_hash) continue;
+    if(changed) return FALSE;
+    changed = piece;
+  }
+  if(!changed
+     || !changed->enabled
+     || changed->params_hash != changed->last_params_hash)
+    return FALSE;
+
+  float box[4];
+  if(!_changed_forms_area(pipe, changed, box)) return FALSE;
+
+  // the output of the changed module differs where its mask does, and modules using their
+  // shapes for processing (retouch) ask for all the input they need in modify_roi_in.
+  int overlap = 0, blend = 0;
+  if(!_piece_support(changed, roi, changed->module->flags() & IOP_FLAGS_NO_MASKS,
+                     &overlap, &blend))
+    return FALSE;
+  int spread = _blend_margin(changed, roi->scale);
+  int guard = overlap;
+  for(GList *nodes = g_list_next(g_list_find(pipe->nodes, changed)); nodes; nodes = g_list_next(nodes))
+  {
+    if(!_piece_support((dt_dev_pixelpipe_iop_t *)nodes->data, roi, FALSE, &overlap, &blend))
+      return FALSE;
+    spread += overlap + blend;
+  }
+  guard += spread;
+
+  // follow the outline of the box through later distortions into the output
+  float pts[8 * DT_DAMAGE_EDGE_POINTS];
+  for(int k = 0; k < DT_DAMAGE_EDGE_POINTS; k++)
+  {
+    const float f = (float)k / (DT_DAMAGE_EDGE_POINTS - 1);
+    const float x = box[0] + f * (box[2] - box[0]);
+    const float y = box[1] + f * (box[3] - box[1]);
+    float *p = pts + 8 * k;
+    p[0] = x;      p[1] = box[1];
+    p[2] = x;      p[3] = box[3];
+    p[4] = box[0]; p[5] = y;
+    p[6] = box[2]; p[7] = y;
+  }
+  if(!dt_dev_distort_transform_plus(dev, pipe, changed->module->iop_order,
+                                    DT_DEV_TRANSFORM_DIR_FORW_EXCL, pts, 4 * DT_DAMAGE_EDGE_POINTS))
+    return FALSE;
+
+  float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+  for(int k = 0; k < 4 * DT_DAMAGE_EDGE_POINTS; k++)
+  {
+    x0 = MIN(x0, pts[2 * k] * roi->scale - roi->x);
+    x1 = MAX(x1, pts[2 * k] * roi->scale - roi->x);
+    y0 = MIN(y0, pts[2 * k + 1] * roi->scale - roi->y);
+    y1 = MAX(y1, pts[2 * k + 1] * roi->scale - roi->y);
+  }
+
+  // two more pixels for rounding and interpolation
+  const int px0 = MAX(0, (int)floorf(x0) - spread - 2);
+  const int py0 = MAX(0, (int)floorf(y0) - spread - 2);
+  const int px1 = MIN(roi->width, (int)ceilf(x1) + spread + 2);
+  const int py1 = MIN(roi->height, (int)ceilf(y1) + spread + 2);
+
+  // changes out of sight or too large to be worth it
+  if(px1 <= px0 || py1 <= py0
+     || (size_t)(px1 - px0) * (py1 - py0) > (size_t)roi->width * roi->height / 2)
+    return FALSE;
+
+  // process a larger region so the modules' border handling doesn't show in the patch
+  const int rx0 = MAX(0, px0 - guard);
+  const int ry0 = MAX(0, py0 - guard);
+  const int rx1 = MIN(roi->width, px1 + guard);
+  const int ry1 = MIN(roi->height, py1 + guard);
+
+  damage->iop_order = changed->module->iop_order;
+  damage->input_roi = changed->full_roi_in;
+  damage->roi = (dt_iop_roi_t){ roi->x + rx0, roi->y + ry0, rx1 - rx0, ry1 - ry0, roi->scale };
+  damage->patch = (dt_iop_roi_t){ px0, py0, px1 - px0, py1 - py0, roi->scale };
+  damage->active = TRUE;
+
+  dt_print_pipe(DT_DEBUG_PIPE,
+      "pipe partial", pipe, changed->module, DT_DEVICE_NONE, roi, &damage->roi,
+      "patch %ix%i at %i/%i\n", damage->patch.width, damage->patch.height, px0, py0);
+  return TRUE;
+}
+
+// copy the newly processed part into the output of the last run
+static void _patch_backbuf(dt_dev_pixelpipe_t *pipe, const uint8_t *buf)
+{
+  const dt_iop_roi_t *patch = &pipe->damage.patch;
+  const dt_iop_roi_t *roi = &pipe->damage.roi;
+  const int dx = patch->x - (roi->x - pipe->damage.last_roi.x);
+  const int dy = patch->y - (roi->y - pipe->damage.last_roi.y);
+  DT_OMP_FOR()
+  for(int j = 0; j < patch->height; j++)
+    memcpy(pipe->backbuf + (size_t)4 * ((size_t)(patch->y + j) * pipe->backbuf_width + patch->x),
+           buf + (size_t)4 * ((size_t)(dy + j) * roi->width + dx),
+           (size_t)4 * patch->width);
+}
+
+// keep what the output in backbuf was made from, to compare the next run with
+static void _remember_run(dt_dev_pixelpipe_t *pipe, const dt_iop_roi_t *roi)
+{
+  dt_dev_pixelpipe_damage_t *damage = &pipe->damage;
+  damage->last_roi = *roi;
+  damage->last_type = pipe->type;
+  damage->last_input = pipe->input;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    piece->last_hash = piece->hash;
+    piece->last_params_hash = piece->params_hash;
+    if(!damage->active) piece->full_roi_in = piece->processed_roi_in;
+  }
+  if(damage->last_forms) g_list_free_full(damage->last_forms, (void (*)(void *))dt_masks_free_form);
+  damage->last_forms = pipe->forms;
+  pipe->forms = NULL;
+}
+
 gboolean dt_dev_pixelpipe_process(
            dt_dev_pixelpipe_t *pipe,
            dt_develop_t *dev,
@@ -2605,6 +3614,9 @@ gboolean dt_dev_pixelpipe_process(
   GList *modules = g_list_last(pipe->iop);
   GList *pieces = g_list_last(pipe->nodes);
 
+  // local changes only need part of the output to be processed again
+  _find_damage(pipe, dev, &roi);
+
 // re-entry point: in case of late opencl errors we start all over
 // again with opencl-support disabled
 restart:
@@ -2637,7 +3649,8 @@ restart:
   // run pixelpipe recursively and get error status
   const gboolean err = _dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf,
                                                                &cl_mem_out, &out_format,
-                                                               &roi,
+                                                               pipe->damage.active
+                                                               ? &pipe->damage.roi : &roi,
                                                                modules, pieces, pos);
   // get status summary of opencl queue by checking the eventlist
   const gboolean oclerr = (pipe->devid > DT_DEVICE_CPU)
@@ -2685,6 +3698,7 @@ restart:
 
     dt_dev_pixelpipe_cache_flush(pipe);
     dt_dev_pixelpipe_change(pipe, dev);
+    pipe->damage.active = FALSE;
 
     dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_OPENCL,
       "pipe restarting on CPU", pipe, NULL, old_devid, &roi, &roi, "ID=%i\n",
@@ -2693,8 +3707,8 @@ restart:
     goto restart; // try again (this time without opencl)
   }
 
-  // release resources:
-  if(pipe->forms)
+  // release resources, a finished run keeps the masks to compare the next one with
+  if(pipe->forms && (err || !(pipe->type & DT_DEV_PIXELPIPE_FULL)))
   {
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
     pipe->forms = NULL;
@@ -2710,6 +3724,7 @@ restart:
   // ... and in case of other errors ...
   if(err)
   {
+    pipe->damage.active = FALSE;
     pipe->processing = FALSE;
     return TRUE;
   }
@@ -2730,7 +3745,10 @@ restart:
 
     if(pipe->backbuf)
     {
-      memcpy(pipe->backbuf, buf, sizeof(uint8_t) * 4 * width * height);
+      if(pipe->damage.active)
+        _patch_backbuf(pipe, buf);
+      else
+        memcpy(pipe->backbuf, buf, sizeof(uint8_t) * 4 * width * height);
       pipe->backbuf_scale = scale;
       pipe->backbuf_zoom_x = pts[0] * pipe->iscale;
       pipe->backbuf_zoom_y = pts[1] * pipe->iscale;
@@ -2743,6 +3761,10 @@ restart:
   pipe->backbuf_height = height;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
+  if(pipe->type & DT_DEV_PIXELPIPE_FULL)
+    _remember_run(pipe, &roi);
+  pipe->damage.active = FALSE;
+
   if(!claimed)
     dt_dev_pixelpipe_cache_report(pipe);
 
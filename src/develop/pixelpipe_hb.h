@@ -58,6 +58,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   float iscale;        // input actually just downscaled buffer? iscale*iwidth = actual width
   int iwidth, iheight; // width and height of input buffer
   dt_hash_t hash;       // hash of params and enabled.
+  dt_hash_t params_hash; // the same without the drawn masks
   int bpc;             // bits per channel, 32 means float
   int colors;          // how many colors per pixel
   dt_iop_roi_t buf_in,
@@ -69,6 +70,10 @@ typedef struct dt_dev_pixelpipe_iop_t
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
 
+  // state as of the last run, to find out what changed for partial reprocessing
+  dt_hash_t last_hash, last_params_hash;
+  dt_iop_roi_t full_roi_in; // processed_roi_in of the last run covering the whole output
+
   GHashTable *raster_masks;
 } dt_dev_pixelpipe_iop_t;
 
@@ -97,6 +102,25 @@ typedef struct dt_dev_detail_mask_t
   float *data;
 } dt_dev_detail_mask_t;
 
+/**
+ * if only the drawn shapes of one module changed since the last run, just the part of the
+ * output they can reach is processed again and patched into the last output.
+ */
+typedef struct dt_dev_pixelpipe_damage_t
+{
+  // the last finished run, its output is in backbuf
+  dt_iop_roi_t last_roi;
+  dt_dev_pixelpipe_type_t last_type;
+  const float *last_input;
+  GList *last_forms;
+  // the current run
+  gboolean active;
+  int32_t iop_order;     // the module which changed
+  dt_iop_roi_t input_roi; // its input in the last full run
+  dt_iop_roi_t roi;       // region processed again, including margins
+  dt_iop_roi_t patch;     // part of it copied to the output, relative to the full roi
+} dt_dev_pixelpipe_damage_t;
+
 /**
  * this encapsulates the pixelpipe.
  * a develop module will need several of these:
@@ -193,6 +217,8 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // partial reprocessing of local changes
+  dt_dev_pixelpipe_damage_t damage;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
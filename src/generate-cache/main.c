@@ -27,6 +27,7 @@
 #include <stdlib.h>  // for exit, EXIT_FAILURE
 #include <string.h>  // for strcmp
 #include <unistd.h>  // for access, R_OK
+#include <glib/gstdio.h> // for g_unlink
 
 #include "common/darktable.h"    // for darktable, darktable_t, dt_cleanup, etc
 #include "common/database.h"     // for dt_database_get
@@ -45,10 +46,169 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const dt_imgid_t min_imgid, const int32_t max_imgid)
+typedef struct _generate_t
+{
+  dt_pthread_mutex_t lock;
+  dt_mipmap_size_t min_mip, max_mip;
+  GArray *imgids;         // in ascending order
+  GPtrArray *filenames;
+  gboolean *done;
+  size_t next;            // next image to hand out
+  size_t completed;       // all images before this one are done
+  size_t finished;        // number of finished images
+  int parts;              // number of workers
+  double start, last_save;
+  char resume_file[PATH_MAX];
+  gboolean resume_failed; // the resume file couldn't be written, reported once
+} _generate_t;
+
+typedef struct _generate_worker_t
+{
+  _generate_t *g;
+  pthread_t thread;
+} _generate_worker_t;
+
+static void _resume_filename(char *filename, const size_t size)
+{
+  snprintf(filename, size, "%s.d/generate-cache-resume", darktable.mipmap_cache->cachedir);
+}
+
+// the highest image id for which all images before have been done with these mip sizes
+static dt_imgid_t _resume_imgid(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip)
+{
+  char filename[PATH_MAX] = { 0 };
+  _resume_filename(filename, sizeof(filename));
+  gchar *contents = NULL;
+  int rmin = -1, rmax = -1;
+  dt_imgid_t imgid = NO_IMGID;
+  if(g_file_get_contents(filename, &contents, NULL, NULL)
+     && (sscanf(contents, "%d %d %d", &rmin, &rmax, &imgid) != 3 || rmin != min_mip || rmax != max_mip))
+    imgid = NO_IMGID;
+  g_free(contents);
+  return imgid;
+}
+
+// called with the lock held
+static void _save_resume_imgid(_generate_t *g, const gboolean force)
+{
+  const double now = dt_get_wtime();
+  if(!g->completed || (!force && now - g->last_save < 5.0)) return;
+  g->last_save = now;
+  gchar *contents = g_strdup_printf("%d %d %d\n", g->min_mip, g->max_mip,
+                                    g_array_index(g->imgids, dt_imgid_t, g->completed - 1));
+  GError *error = NULL;
+  if(!g_file_set_contents(g->resume_file, contents, -1, &error) && !g->resume_failed)
+  {
+    fprintf(stderr, _("could not write resume file '%s': %s\n"), g->resume_file, error->message);
+    g->resume_failed = TRUE;
+  }
+  g_clear_error(&error);
+  g_free(contents);
+}
+
+static void _generate_image(const _generate_t *g, const dt_imgid_t imgid)
+{
+  // the largest missing size is computed, or downsampled from a larger one on disk.
+  // we keep it locked while downsampling the smaller ones from it.
+  int source = -1;
+  gboolean missing = FALSE;
+  for(int k = g->max_mip; k >= (int)g->min_mip; k--)
+  {
+    const gboolean on_disk = dt_mipmap_cache_thumbnail_on_disk(darktable.mipmap_cache, imgid, k);
+    if(on_disk && !missing)
+      source = k;
+    else if(!on_disk && !missing)
+    {
+      missing = TRUE;
+      if(source < 0) source = k;
+    }
+  }
+  if(!missing) return;
+
+  dt_mipmap_buffer_t src;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &src, imgid, source, DT_MIPMAP_BLOCKING, 'r');
+  for(int k = source - 1; k >= (int)g->min_mip; k--)
+  {
+    if(dt_mipmap_cache_thumbnail_on_disk(darktable.mipmap_cache, imgid, k)) continue;
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+  dt_mipmap_cache_release(darktable.mipmap_cache, &src);
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+}
+
+static void *_generate_worker(void *data)
+{
+  _generate_worker_t *w = (_generate_worker_t *)data;
+  _generate_t *g = w->g;
+
+#ifdef _OPENMP
+  omp_set_num_threads(MAX(1, dt_get_num_threads() / g->parts));
+#endif
+  dt_set_available_mem_parts(g->parts);
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&g->lock);
+    const size_t k = g->next;
+    if(k < g->imgids->len) g->next++;
+    dt_pthread_mutex_unlock(&g->lock);
+    if(k >= g->imgids->len) break;
+
+    const dt_imgid_t imgid = g_array_index(g->imgids, dt_imgid_t, k);
+    _generate_image(g, imgid);
+    // thumbnail in sync with image
+    dt_history_hash_set_mipmap(imgid);
+
+    dt_pthread_mutex_lock(&g->lock);
+    g->done[k] = TRUE;
+    g->finished++;
+    while(g->completed < g->imgids->len && g->done[g->completed]) g->completed++;
+    _save_resume_imgid(g, FALSE);
+    const double elapsed = dt_get_wtime() - g->start;
+    fprintf(stderr, "image %zu/%u (%.02f%%) (id:%d, file=%s) %.2f images/s\n", g->finished, g->imgids->len,
+            100.0 * g->finished / (float)g->imgids->len, imgid,
+            (const char *)g_ptr_array_index(g->filenames, k), g->finished / MAX(elapsed, 1e-3));
+    dt_pthread_mutex_unlock(&g->lock);
+  }
+
+  dt_set_available_mem_parts(1);
+#ifdef _OPENMP
+  omp_set_num_threads(dt_get_num_threads());
+#endif
+  return NULL;
+}
+
+static int _generate_jobs(const int requested, const size_t images)
+{
+  const int threads = dt_get_num_threads();
+  int jobs = requested;
+  if(jobs <= 0)
+  {
+    // thumbnail pipes are small and don't scale well over many threads, but
+    // every pipe needs room for a few full size buffers
+    const int by_cores = threads / 4;
+    const int by_mem = dt_get_available_mem() / (4 * dt_get_singlebuffer_mem());
+    jobs = MIN(by_cores, by_mem);
+  }
+  return CLAMP(jobs, 1, MAX(1, MIN(threads, (int)images)));
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip,
+                                    const dt_mipmap_size_t max_mip,
+                                    dt_imgid_t min_imgid,
+                                    const int32_t max_imgid,
+                                    const int jobs,
+                                    const gboolean resume)
 {
   fprintf(stderr, _("creating cache directories\n"));
-  for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
+  // the packed stores create their files on first use
+  for(dt_mipmap_size_t k = min_mip;
+      k <= max_mip && darktable.mipmap_cache->disk_format == DT_MIPMAP_DISK_FILES;
+      k++)
   {
     char dirname[PATH_MAX] = { 0 };
     snprintf(dirname, sizeof(dirname), "%s.d/%d", darktable.mipmap_cache->cachedir, k);
@@ -61,68 +221,77 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // some progress counter
-  sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  _generate_t g = { .min_mip = min_mip, .max_mip = max_mip };
+  _resume_filename(g.resume_file, sizeof(g.resume_file));
+  // <cachedir>.d only exists for the per-file mipmap store, make sure the resume file has a home
+  gchar *resume_dir = g_path_get_dirname(g.resume_file);
+  if(g_mkdir_with_parents(resume_dir, 0750))
+    fprintf(stderr, _("could not create directory '%s'!\n"), resume_dir);
+  g_free(resume_dir);
+  if(resume)
   {
-    image_count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-  }
-  else
-  {
-    return 1;
-  }
-
-  if(!image_count)
-  {
-    fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
-    if(min_imgid > max_imgid)
+    const dt_imgid_t last = _resume_imgid(min_mip, max_mip);
+    if(dt_is_valid_imgid(last) && last >= min_imgid)
     {
-      fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
+      fprintf(stderr, _("resuming after image id %d\n"), last);
+      min_imgid = last + 1;
     }
   }
 
-  // go through all images:
+  // collect all images first, the workers go through them in order
+  sqlite3_stmt *stmt;
+  g.imgids = g_array_new(FALSE, FALSE, sizeof(dt_imgid_t));
+  g.filenames = g_ptr_array_new_with_free_func(g_free);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2"
+                              " ORDER BY id", -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     const dt_imgid_t imgid = sqlite3_column_int(stmt, 0);
-    const char *imgfilename = (const char*)sqlite3_column_text(stmt, 1);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid, imgfilename);
+    g_array_append_val(g.imgids, imgid);
+    g_ptr_array_add(g.filenames, g_strdup((const char *)sqlite3_column_text(stmt, 1)));
+  }
+  sqlite3_finalize(stmt);
 
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
+  if(!g.imgids->len)
+  {
+    fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
+    if(min_imgid > max_imgid)
     {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-      // if a valid thumbnail file is already on disc - do nothing
-      if(dt_util_test_image_file(filename)) continue;
-
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+      fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
     }
-
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
   }
 
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
-
+  g.parts = _generate_jobs(jobs, g.imgids->len);
+  g.done = calloc(MAX(1, g.imgids->len), sizeof(gboolean));
+  dt_pthread_mutex_init(&g.lock, NULL);
+  g.start = g.last_save = dt_get_wtime();
+  fprintf(stderr, _("generating thumbnails for %u images with %d workers\n"), g.imgids->len, g.parts);
+
+  // the calling thread is one of the workers
+  _generate_worker_t *workers = calloc(g.parts, sizeof(_generate_worker_t));
+  int started = 1;
+  for(int k = 0; k < g.parts; k++) workers[k].g = &g;
+  for(; started < g.parts; started++)
+    if(dt_pthread_create(&workers[started].thread, _generate_worker, &workers[started])) break;
+  _generate_worker(&workers[0]);
+  for(int k = 1; k < started; k++) pthread_join(workers[k].thread, NULL);
+
+  const double elapsed = dt_get_wtime() - g.start;
+  // everything done, nothing to resume
+  if(g.completed == g.imgids->len) g_unlink(g.resume_file);
+  else _save_resume_imgid(&g, TRUE);
+
+  fprintf(stderr, "done, %zu images in %.1fs (%.2f images/s)\n", g.finished, elapsed,
+          g.finished / MAX(elapsed, 1e-3));
+
+  free(workers);
+  free(g.done);
+  dt_pthread_mutex_destroy(&g.lock);
+  g_array_free(g.imgids, TRUE);
+  g_ptr_array_free(g.filenames, TRUE);
   return 0;
 }
 
@@ -132,13 +301,18 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --jobs <N> (default = 0, automatic)] [--resume]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on.\n"
+          "\n"
+          "Images are processed by --jobs workers at the same time. With --resume\n"
+          "an interrupted run with the same mipmap sizes continues after the last\n"
+          "image completed.\n",
           progname);
 }
 
@@ -164,6 +338,8 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   dt_imgid_t min_imgid = NO_IMGID;
   int32_t max_imgid = INT32_MAX;
+  int jobs = 0;
+  gboolean resume = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -199,6 +375,15 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      jobs = MAX(atoi(arg[k]), 0);
+    }
+    else if(!strcmp(arg[k], "--resume"))
+    {
+      resume = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -252,7 +437,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, jobs, resume))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
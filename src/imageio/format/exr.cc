@@ -118,15 +118,10 @@ void cleanup(dt_imageio_module_format_t *self)
 {
 }
 
-int write_image(dt_imageio_module_data_t *tmp, const char *filename, const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+static Imf::Header _exr_header(const dt_imageio_exr_t *exr,
+                               void *exif, int exif_len, dt_imgid_t imgid,
+                               dt_colorspaces_color_profile_type_t over_type, const char *over_filename)
 {
-  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
-
-  Imf::setGlobalThreadCount(dt_get_num_threads());
-
   Imf::Header header(exr->global.width, exr->global.height, 1, Imath::V2f(0, 0), 1, Imf::INCREASING_Y,
                      (Imf::Compression)exr->compression);
 
@@ -225,6 +220,21 @@ icc_end:
   header.channels().insert("G", Imf::Channel(pixel_type, 1, 1, true));
   header.channels().insert("B", Imf::Channel(pixel_type, 1, 1, true));
 
+  return header;
+}
+
+int write_image(dt_imageio_module_data_t *tmp, const char *filename, const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
+
+  Imf::setGlobalThreadCount(dt_get_num_threads());
+
+  Imf::Header header = _exr_header(exr, exif, exif_len, imgid, over_type, over_filename);
+  Imf::PixelType pixel_type = (Imf::PixelType)exr->pixel_type;
+
   Imf::FrameBuffer data;
   size_t stride;
   void *out_image = NULL;
@@ -369,6 +379,119 @@ icc_end:
   return 0;
 }
 
+typedef struct dt_imageio_exr_writer_t
+{
+  Imf::OutputFile *file;
+  int row;
+  unsigned short *buf; // half float conversion of the current strip
+  size_t buf_rows;
+} dt_imageio_exr_writer_t;
+
+void *write_image_begin(dt_imageio_module_data_t *tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, dt_imgid_t imgid)
+{
+  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
+  dt_imageio_exr_writer_t *w = (dt_imageio_exr_writer_t *)calloc(1, sizeof(dt_imageio_exr_writer_t));
+  if(!w) return NULL;
+
+  Imf::setGlobalThreadCount(dt_get_num_threads());
+  try
+  {
+    Imf::Header header = _exr_header(exr, exif, exif_len, imgid, over_type, over_filename);
+    w->file = new Imf::OutputFile(filename, header);
+  }
+  catch(const std::exception &e)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[exr export] error opening `%s': %s\n", filename, e.what());
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+int write_image_rows(dt_imageio_module_data_t *tmp, void *writer, const void *in_tmp, const int rows)
+{
+  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
+  dt_imageio_exr_writer_t *w = (dt_imageio_exr_writer_t *)writer;
+  const Imf::PixelType pixel_type = (Imf::PixelType)exr->pixel_type;
+  const size_t width = exr->global.width;
+  const size_t n = MIN(rows, exr->global.height - w->row);
+
+  // the frame buffer is addressed in image coordinates, so its base is moved up to row 0
+  Imf::FrameBuffer data;
+  if(pixel_type == Imf::PixelType::FLOAT)
+  {
+    const size_t stride = 4 * sizeof(float);
+    const char *base = (const char *)in_tmp - stride * width * w->row;
+    for(int c = 0; c < 3; c++)
+      data.insert(c == 0 ? "R" : c == 1 ? "G" : "B",
+                  Imf::Slice(pixel_type, (char *)base + c * sizeof(float), stride, stride * width));
+  }
+  else
+  {
+    if(w->buf_rows < n)
+    {
+      dt_free_align(w->buf);
+      w->buf = (unsigned short *)dt_alloc_aligned(3 * sizeof(unsigned short) * width * n);
+      w->buf_rows = w->buf ? n : 0;
+      if(!w->buf)
+      {
+        dt_print(DT_DEBUG_ALWAYS, "[exr export] error allocating image conversion buffer\n");
+        return 1;
+      }
+    }
+
+    const float *const in = (const float *)in_tmp;
+    unsigned short *const out = w->buf;
+    DT_OMP_FOR()
+    for(size_t k = 0; k < width * n; k++)
+    {
+      out[3 * k + 0] = half(in[4 * k + 0]).bits();
+      out[3 * k + 1] = half(in[4 * k + 1]).bits();
+      out[3 * k + 2] = half(in[4 * k + 2]).bits();
+    }
+
+    const size_t stride = 3 * sizeof(unsigned short);
+    const char *base = (const char *)w->buf - stride * width * w->row;
+    for(int c = 0; c < 3; c++)
+      data.insert(c == 0 ? "R" : c == 1 ? "G" : "B",
+                  Imf::Slice(pixel_type, (char *)base + c * sizeof(unsigned short), stride, stride * width));
+  }
+
+  try
+  {
+    w->file->setFrameBuffer(data);
+    w->file->writePixels(n);
+  }
+  catch(const std::exception &e)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[exr export] error writing rows: %s\n", e.what());
+    return 1;
+  }
+  w->row += n;
+  return 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *tmp, void *writer, const gboolean failed)
+{
+  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
+  dt_imageio_exr_writer_t *w = (dt_imageio_exr_writer_t *)writer;
+  int status = failed || w->row != exr->global.height ? 1 : 0;
+  try
+  {
+    delete w->file;
+  }
+  catch(const std::exception &e)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[exr export] error closing file: %s\n", e.what());
+    status = 1;
+  }
+  dt_free_align(w->buf);
+  free(w);
+  return status;
+}
+
 size_t params_size(dt_imageio_module_format_t *self)
 {
   return sizeof(dt_imageio_exr_t);
@@ -548,7 +671,7 @@ int levels(dt_imageio_module_data_t *p)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_LAYERS;
+  return FORMAT_FLAGS_SUPPORT_LAYERS | FORMAT_FLAGS_SUPPORT_STREAMING;
 }
 
 const char *mime(dt_imageio_module_data_t *data)
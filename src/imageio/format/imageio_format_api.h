@@ -84,6 +84,15 @@ REQUIRED(int, write_image, struct dt_imageio_module_data_t *data, const char *fi
                            dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                            void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                            const gboolean export_masks);
+/* incremental writing of large images processed in strips, used if flags() has FORMAT_FLAGS_SUPPORT_STREAMING.
+   begin opens the file and returns a writer, NULL on fail. rows appends the next rows from top to bottom,
+   laid out as the buffer given to write_image. end finishes and frees the writer, just cleaning up if failed is set.
+   both return != 0 on fail. */
+OPTIONAL(void *, write_image_begin, struct dt_imageio_module_data_t *data, const char *filename,
+                                    dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                                    void *exif, int exif_len, dt_imgid_t imgid);
+OPTIONAL(int, write_image_rows, struct dt_imageio_module_data_t *data, void *writer, const void *in, const int rows);
+OPTIONAL(int, write_image_end, struct dt_imageio_module_data_t *data, void *writer, const gboolean failed);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 OPTIONAL(int, levels, struct dt_imageio_module_data_t *data);
 
@@ -171,91 +171,119 @@ static void write_icc_profile(j_compress_ptr cinfo,
 #undef MAX_SEQ_NO
 
 
-int write_image(dt_imageio_module_data_t *jpg_tmp,
-                const char *filename,
-                const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type,
-                const char *over_filename,
-                void *exif, int exif_len,
-                dt_imgid_t imgid,
-                int num,
-                int total,
-                struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+typedef struct dt_imageio_jpeg_writer_t
 {
-  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
-  const uint8_t *in = (const uint8_t *)in_tmp;
+  struct jpeg_compress_struct cinfo;
   struct dt_imageio_jpeg_error_mgr jerr;
+  FILE *f;
+  uint8_t *row;
+  gchar *filename;
+  // exif is written to the file after it has been closed
+  void *exif;
+  int exif_len;
+} dt_imageio_jpeg_writer_t;
+
+static void _free_writer(dt_imageio_jpeg_writer_t *w)
+{
+  jpeg_destroy_compress(&(w->cinfo));
+  if(w->f) fclose(w->f);
+  dt_free_align(w->row);
+  g_free(w->filename);
+  free(w->exif);
+  free(w);
+}
 
-  jpg->cinfo.err = jpeg_std_error(&jerr.pub);
-  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
-  if(setjmp(jerr.setjmp_buffer))
+void *write_image_begin(dt_imageio_module_data_t *jpg_tmp,
+                        const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type,
+                        const char *over_filename,
+                        void *exif, int exif_len,
+                        dt_imgid_t imgid)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_writer_t *w = calloc(1, sizeof(dt_imageio_jpeg_writer_t));
+  if(!w) return NULL;
+
+  w->cinfo.err = jpeg_std_error(&w->jerr.pub);
+  w->jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(w->jerr.setjmp_buffer))
   {
-    jpeg_destroy_compress(&(jpg->cinfo));
-    return 1;
+    _free_writer(w);
+    return NULL;
+  }
+  jpeg_create_compress(&(w->cinfo));
+  w->f = g_fopen(filename, "wb");
+  w->row = dt_alloc_align_uint8(3 * jpg->global.width);
+  w->filename = g_strdup(filename);
+  if(exif && exif_len > 0 && (w->exif = malloc(exif_len)))
+  {
+    memcpy(w->exif, exif, exif_len);
+    w->exif_len = exif_len;
   }
-  jpeg_create_compress(&(jpg->cinfo));
-  FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
-  jpeg_stdio_dest(&(jpg->cinfo), f);
-
-  jpg->cinfo.image_width = jpg->global.width;
-  jpg->cinfo.image_height = jpg->global.height;
-  jpg->cinfo.input_components = 3;
-  jpg->cinfo.in_color_space = JCS_RGB;
-  jpeg_set_defaults(&(jpg->cinfo));
-  jpeg_set_quality(&(jpg->cinfo), jpg->quality, TRUE);
-
-  if(jpg->quality > 90) jpg->cinfo.comp_info[0].v_samp_factor = 1;
-  if(jpg->quality > 92) jpg->cinfo.comp_info[0].h_samp_factor = 1;
-  if(jpg->quality > 95) jpg->cinfo.dct_method = JDCT_FLOAT;
-  if(jpg->quality < 50) jpg->cinfo.dct_method = JDCT_IFAST;
-  if(jpg->quality < 80) jpg->cinfo.smoothing_factor = 20;
-  if(jpg->quality < 60) jpg->cinfo.smoothing_factor = 40;
-  if(jpg->quality < 40) jpg->cinfo.smoothing_factor = 60;
-  jpg->cinfo.optimize_coding = 1;
+  if(!w->f || !w->row)
+  {
+    _free_writer(w);
+    return NULL;
+  }
+  jpeg_stdio_dest(&(w->cinfo), w->f);
+
+  w->cinfo.image_width = jpg->global.width;
+  w->cinfo.image_height = jpg->global.height;
+  w->cinfo.input_components = 3;
+  w->cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&(w->cinfo));
+  jpeg_set_quality(&(w->cinfo), jpg->quality, TRUE);
+
+  if(jpg->quality > 90) w->cinfo.comp_info[0].v_samp_factor = 1;
+  if(jpg->quality > 92) w->cinfo.comp_info[0].h_samp_factor = 1;
+  if(jpg->quality > 95) w->cinfo.dct_method = JDCT_FLOAT;
+  if(jpg->quality < 50) w->cinfo.dct_method = JDCT_IFAST;
+  if(jpg->quality < 80) w->cinfo.smoothing_factor = 20;
+  if(jpg->quality < 60) w->cinfo.smoothing_factor = 40;
+  if(jpg->quality < 40) w->cinfo.smoothing_factor = 60;
+  w->cinfo.optimize_coding = 1;
 
   // Common part for all subsampling formulas:
-  jpg->cinfo.comp_info[1].h_samp_factor = 1;
-  jpg->cinfo.comp_info[1].v_samp_factor = 1;
-  jpg->cinfo.comp_info[2].h_samp_factor = 1;
-  jpg->cinfo.comp_info[2].v_samp_factor = 1;
+  w->cinfo.comp_info[1].h_samp_factor = 1;
+  w->cinfo.comp_info[1].v_samp_factor = 1;
+  w->cinfo.comp_info[2].h_samp_factor = 1;
+  w->cinfo.comp_info[2].v_samp_factor = 1;
 
   const int subsample = dt_conf_get_int("plugins/imageio/format/jpeg/subsample");
   switch(subsample)
   {
     case 1: // 1x1 1x1 1x1 (4:4:4) : No chroma subsampling
     {
-      jpg->cinfo.comp_info[0].h_samp_factor = 1;
-      jpg->cinfo.comp_info[0].v_samp_factor = 1;
+      w->cinfo.comp_info[0].h_samp_factor = 1;
+      w->cinfo.comp_info[0].v_samp_factor = 1;
       break;
     }
     case 2: // 1x2 1x1 1x1 (4:4:0) : Color sampling rate halved vertically
     {
-      jpg->cinfo.comp_info[0].h_samp_factor = 1;
-      jpg->cinfo.comp_info[0].v_samp_factor = 2;
+      w->cinfo.comp_info[0].h_samp_factor = 1;
+      w->cinfo.comp_info[0].v_samp_factor = 2;
       break;
     }
     case 3: // 2x1 1x1 1x1 (4:2:2) : Color sampling rate halved horizontally
     {
-      jpg->cinfo.comp_info[0].h_samp_factor = 2;
-      jpg->cinfo.comp_info[0].v_samp_factor = 1;
+      w->cinfo.comp_info[0].h_samp_factor = 2;
+      w->cinfo.comp_info[0].v_samp_factor = 1;
       break;
     }
     case 4: // 2x2 1x1 1x1 (4:2:0) : Color sampling rate halved horizontally and vertically
     {
-      jpg->cinfo.comp_info[0].h_samp_factor = 2;
-      jpg->cinfo.comp_info[0].v_samp_factor = 2;
+      w->cinfo.comp_info[0].h_samp_factor = 2;
+      w->cinfo.comp_info[0].v_samp_factor = 2;
       break;
     }
   }
 
   const int resolution = dt_conf_get_int("metadata/resolution");
-  jpg->cinfo.density_unit = 1;
-  jpg->cinfo.X_density = resolution;
-  jpg->cinfo.Y_density = resolution;
+  w->cinfo.density_unit = 1;
+  w->cinfo.X_density = resolution;
+  w->cinfo.Y_density = resolution;
 
-  jpeg_start_compress(&(jpg->cinfo), TRUE);
+  jpeg_start_compress(&(w->cinfo), TRUE);
 
   cmsHPROFILE out_profile =
     dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
@@ -267,32 +295,73 @@ int write_image(dt_imageio_module_data_t *jpg_tmp,
     if(buf)
     {
       cmsSaveProfileToMem(out_profile, buf, &len);
-      write_icc_profile(&(jpg->cinfo), buf, len);
+      write_icc_profile(&(w->cinfo), buf, len);
       free(buf);
     }
   }
 
-  uint8_t *row = dt_alloc_align_uint8(3 * jpg->global.width);
-  const uint8_t *buf;
-  while(jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  return w;
+}
+
+int write_image_rows(dt_imageio_module_data_t *jpg_tmp, void *writer, const void *in_tmp, const int rows)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_writer_t *w = (dt_imageio_jpeg_writer_t *)writer;
+  const uint8_t *in = (const uint8_t *)in_tmp;
+
+  if(setjmp(w->jerr.setjmp_buffer)) return 1;
+
+  for(int j = 0; j < rows && w->cinfo.next_scanline < w->cinfo.image_height; j++)
   {
     JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
+    const uint8_t *buf = in + (size_t)j * jpg->global.width * 4;
     for(int i = 0; i < jpg->global.width; i++)
-      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
-    tmp[0] = row;
-    jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
+      for(int k = 0; k < 3; k++) w->row[3 * i + k] = buf[4 * i + k];
+    tmp[0] = w->row;
+    jpeg_write_scanlines(&(w->cinfo), tmp, 1);
   }
-  jpeg_finish_compress(&(jpg->cinfo));
-  dt_free_align(row);
-  jpeg_destroy_compress(&(jpg->cinfo));
-  fclose(f);
+  return 0;
+}
 
-  if(exif) dt_exif_write_blob(exif, exif_len, filename, 1);
+static int _finish_jpeg(dt_imageio_jpeg_writer_t *w)
+{
+  if(setjmp(w->jerr.setjmp_buffer)) return 1;
 
+  jpeg_finish_compress(&(w->cinfo));
   return 0;
 }
 
+int write_image_end(dt_imageio_module_data_t *jpg_tmp, void *writer, const gboolean failed)
+{
+  dt_imageio_jpeg_writer_t *w = (dt_imageio_jpeg_writer_t *)writer;
+  int status = failed ? 1 : _finish_jpeg(w);
+  if(fclose(w->f)) status = 1;
+  w->f = NULL;
+
+  if(!status && w->exif) dt_exif_write_blob(w->exif, w->exif_len, w->filename, 1);
+
+  _free_writer(w);
+  return status;
+}
+
+int write_image(dt_imageio_module_data_t *jpg_tmp,
+                const char *filename,
+                const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type,
+                const char *over_filename,
+                void *exif, int exif_len,
+                dt_imgid_t imgid,
+                int num,
+                int total,
+                struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *writer = write_image_begin(jpg_tmp, filename, over_type, over_filename, exif, exif_len, imgid);
+  if(!writer) return 1;
+  const int status = write_image_rows(jpg_tmp, writer, in_tmp, jpg_tmp->height);
+  return write_image_end(jpg_tmp, writer, status != 0);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename,
                                                    dt_imageio_jpeg_t *jpg)
 {
@@ -523,7 +592,7 @@ const char *extension(dt_imageio_module_data_t *data)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP;
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_STREAMING;
 }
 
 void init(dt_imageio_module_format_t *self)
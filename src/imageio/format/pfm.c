@@ -28,49 +28,86 @@
 
 DT_MODULE(1)
 
-int write_image(dt_imageio_module_data_t *data, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+typedef struct dt_imageio_pfm_writer_t
+{
+  FILE *f;
+  long offset; // start of the pixel data
+  int row;     // next row to be written
+  float *buf_line;
+} dt_imageio_pfm_writer_t;
+
+void *write_image_begin(dt_imageio_module_data_t *data, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, dt_imgid_t imgid)
 {
   const dt_imageio_module_data_t *const pfm = data;
-  int status = 0;
   FILE *f = g_fopen(filename, "wb");
-  if(f)
+  if(!f) return NULL;
+
+  // align pfm header to sse, assuming the file will
+  // be mmapped to page boundaries.
+  char header[1024];
+  snprintf(header, 1024, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
+  size_t len = strlen(header);
+  fprintf(f, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
+  ssize_t off = 0;
+  while((len + 1 + off) & 0xf) off++;
+  while(off-- > 0) fprintf(f, "0");
+  fprintf(f, "\n");
+
+  dt_imageio_pfm_writer_t *w = calloc(1, sizeof(dt_imageio_pfm_writer_t));
+  if(w) w->buf_line = dt_alloc_align_float((size_t)3 * pfm->width);
+  if(!w || !w->buf_line)
+  {
+    free(w);
+    fclose(f);
+    return NULL;
+  }
+  w->f = f;
+  w->offset = ftell(f);
+  return w;
+}
+
+int write_image_rows(dt_imageio_module_data_t *data, void *writer, const void *ivoid, const int rows)
+{
+  const dt_imageio_module_data_t *const pfm = data;
+  dt_imageio_pfm_writer_t *w = (dt_imageio_pfm_writer_t *)writer;
+  const size_t rowsize = sizeof(float) * 3 * pfm->width;
+  for(int j = 0; j < rows && w->row < pfm->height; j++, w->row++)
   {
-    // align pfm header to sse, assuming the file will
-    // be mmapped to page boundaries.
-    char header[1024];
-    snprintf(header, 1024, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
-    size_t len = strlen(header);
-    fprintf(f, "PF\n%d %d\n-1.0", pfm->width, pfm->height);
-    ssize_t off = 0;
-    while((len + 1 + off) & 0xf) off++;
-    while(off-- > 0) fprintf(f, "0");
-    fprintf(f, "\n");
-    void *buf_line = dt_alloc_align_float((size_t)3 * pfm->width);
-    for(int j = 0; j < pfm->height; j++)
+    const float *in = (const float *)ivoid + 4 * (size_t)pfm->width * j;
+    float *out = w->buf_line;
+    for(int i = 0; i < pfm->width; i++, in += 4, out += 3)
     {
-      // NOTE: pfm has rows in reverse order
-      const int row_in = pfm->height - 1 - j;
-      const float *in = (const float *)ivoid + 4 * (size_t)pfm->width * row_in;
-      float *out = (float *)buf_line;
-      for(int i = 0; i < pfm->width; i++, in += 4, out += 3)
-      {
-        memcpy(out, in, sizeof(float) * 3);
-      }
-      // INFO: per-line fwrite call seems to perform best. LebedevRI, 18.04.2014
-      int cnt = fwrite(buf_line, sizeof(float) * 3, pfm->width, f);
-      if(cnt != pfm->width)
-        status = 1;
-      else
-        status = 0;
+      memcpy(out, in, sizeof(float) * 3);
     }
-    dt_free_align(buf_line);
-    buf_line = NULL;
-    fclose(f);
+    // NOTE: pfm has rows in reverse order
+    const long pos = w->offset + (long)(rowsize * (pfm->height - 1 - w->row));
+    // INFO: per-line fwrite call seems to perform best. LebedevRI, 18.04.2014
+    if(fseek(w->f, pos, SEEK_SET) || fwrite(w->buf_line, sizeof(float) * 3, pfm->width, w->f) != pfm->width)
+      return 1;
   }
-  return status;
+  return 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *data, void *writer, const gboolean failed)
+{
+  dt_imageio_pfm_writer_t *w = (dt_imageio_pfm_writer_t *)writer;
+  const int status = (fclose(w->f) != 0 || w->row != data->height) ? 1 : 0;
+  dt_free_align(w->buf_line);
+  free(w);
+  return failed ? 1 : status;
+}
+
+int write_image(dt_imageio_module_data_t *data, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *writer = write_image_begin(data, filename, over_type, over_filename, exif, exif_len, imgid);
+  if(!writer) return 1;
+  const int status = write_image_rows(data, writer, ivoid, data->height);
+  return write_image_end(data, writer, status != 0);
 }
 
 size_t params_size(dt_imageio_module_format_t *self)
@@ -105,6 +142,11 @@ int levels(dt_imageio_module_data_t *p)
   return IMAGEIO_RGB | IMAGEIO_FLOAT;
 }
 
+int flags(dt_imageio_module_data_t *data)
+{
+  return FORMAT_FLAGS_SUPPORT_STREAMING;
+}
+
 const char *mime(dt_imageio_module_data_t *data)
 {
   return "image/x-portable-floatmap";
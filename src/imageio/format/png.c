@@ -121,15 +121,27 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
 }
 #endif
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+typedef struct dt_imageio_png_writer_t
+{
+  FILE *f;
+  png_structp png_ptr;
+  png_infop info_ptr;
+} dt_imageio_png_writer_t;
+
+void *write_image_begin(dt_imageio_module_data_t *p_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, dt_imgid_t imgid)
 {
   dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
   const int width = p->global.width, height = p->global.height;
+  dt_imageio_png_writer_t *w = calloc(1, sizeof(dt_imageio_png_writer_t));
+  if(!w) return NULL;
   FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
+  if(!f)
+  {
+    free(w);
+    return NULL;
+  }
 
   png_structp png_ptr;
   png_infop info_ptr;
@@ -138,7 +150,8 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   if(!png_ptr)
   {
     fclose(f);
-    return 1;
+    free(w);
+    return NULL;
   }
 
   info_ptr = png_create_info_struct(png_ptr);
@@ -146,14 +159,16 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   {
     fclose(f);
     png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
+    free(w);
+    return NULL;
   }
 
   if(setjmp(png_jmpbuf(png_ptr)))
   {
     fclose(f);
     png_destroy_write_struct(&png_ptr, &info_ptr);
-    return 1;
+    free(w);
+    return NULL;
   }
 
   png_init_io(png_ptr, f);
@@ -281,30 +296,57 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
    */
   png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
-  png_bytep *row_pointers = dt_alloc_align_type(png_bytep, height);
+  /* swap bytes of 16 bit files to most significant bit first */
+  if(p->bpp > 8) png_set_swap(png_ptr);
 
-  if(p->bpp > 8)
-  {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
+  w->f = f;
+  w->png_ptr = png_ptr;
+  w->info_ptr = info_ptr;
+  return w;
+}
 
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
-  }
-  else
-  {
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
-  }
+int write_image_rows(dt_imageio_module_data_t *p_tmp, void *writer, const void *ivoid, const int rows)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_writer_t *w = (dt_imageio_png_writer_t *)writer;
+  const size_t stride = (size_t)4 * p->global.width * (p->bpp > 8 ? sizeof(uint16_t) : sizeof(uint8_t));
 
-  png_write_image(png_ptr, row_pointers);
+  if(setjmp(png_jmpbuf(w->png_ptr))) return 1;
 
-  dt_free_align(row_pointers);
+  for(int i = 0; i < rows; i++)
+    png_write_row(w->png_ptr, (png_bytep)ivoid + stride * i);
+  return 0;
+}
+
+static int _finish_png(dt_imageio_png_writer_t *w)
+{
+  if(setjmp(png_jmpbuf(w->png_ptr))) return 1;
 
-  png_write_end(png_ptr, info_ptr);
-  png_destroy_write_struct(&png_ptr, &info_ptr);
-  fclose(f);
+  png_write_end(w->png_ptr, w->info_ptr);
   return 0;
 }
 
+int write_image_end(dt_imageio_module_data_t *p_tmp, void *writer, const gboolean failed)
+{
+  dt_imageio_png_writer_t *w = (dt_imageio_png_writer_t *)writer;
+  int status = failed ? 1 : _finish_png(w);
+  png_destroy_write_struct(&w->png_ptr, &w->info_ptr);
+  if(fclose(w->f)) status = 1;
+  free(w);
+  return status;
+}
+
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, dt_imgid_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *writer = write_image_begin(p_tmp, filename, over_type, over_filename, exif, exif_len, imgid);
+  if(!writer) return 1;
+  const int status = write_image_rows(p_tmp, writer, ivoid, p_tmp->height);
+  return write_image_end(p_tmp, writer, status != 0);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
@@ -661,7 +703,7 @@ void gui_reset(dt_imageio_module_format_t *self)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP;
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_STREAMING;
 }
 
 // clang-format off
@@ -64,6 +64,116 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
+static void _set_compression(TIFF *tif, const dt_imageio_tiff_t *d)
+{
+  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
+  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
+  // "software vendors. This code should be considered obsolete. We recommend"
+  // "that TIFF implementations recognize and read the obsolete code but only"
+  // "write the official compression code (0x0008)."
+  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
+  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+  if(d->compress == 1)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+  else if(d->compress == 2)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    if(d->bpp == 32 || (d->bpp == 16 && d->pixelformat))
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
+    else
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+}
+
+static void _set_image_fields(TIFF *tif, const dt_imageio_tiff_t *d, const uint16_t layers)
+{
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
+  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT,
+               d->bpp == 32 || (d->bpp == 16 && d->pixelformat) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
+  if(layers == 3)
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  else
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
+
+  const int resolution = dt_conf_get_int("metadata/resolution");
+  TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
+  TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
+  TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+}
+
+// write rows [row, row + rows) from the 4 channel input buffer, rowdata holds one output row
+static int _write_rows(TIFF *tif,
+                       const dt_imageio_tiff_t *d,
+                       const uint16_t layers,
+                       const void *in_void,
+                       const int row,
+                       const int rows,
+                       void *rowdata)
+{
+  for(int y = 0; y < rows; y++)
+  {
+    const size_t offset = (size_t)4 * y * d->global.width;
+    if(d->bpp == 32)
+    {
+      const float *in = (const float *)in_void + offset;
+      float *out = (float *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, sizeof(float) * layers);
+      }
+    }
+#ifdef HAVE_IMATH
+    else if(d->bpp == 16 && d->pixelformat)
+    {
+      const float *in = (const float *)in_void + offset;
+      uint16_t *out = (uint16_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        for(int l = 0; l < layers; ++l) out[l] = imath_float_to_half(in[l]);
+      }
+    }
+#endif
+    else if(d->bpp == 16 && !d->pixelformat)
+    {
+      const uint16_t *in = (const uint16_t *)in_void + offset;
+      uint16_t *out = (uint16_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, sizeof(uint16_t) * layers);
+      }
+    }
+    else // 8bpp
+    {
+      const uint8_t *in = (const uint8_t *)in_void + offset;
+      uint8_t *out = (uint8_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, sizeof(uint8_t) * layers);
+      }
+    }
+
+    if(TIFFWriteScanline(tif, rowdata, row + y, 0) == -1)
+      return 1;
+  }
+  return 0;
+}
+
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, dt_imgid_t imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
@@ -130,28 +240,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   TIFFSetField(tif, TIFFTAG_DOCUMENTNAME, filename);
 
-  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
-  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
-  // "software vendors. This code should be considered obsolete. We recommend"
-  // "that TIFF implementations recognize and read the obsolete code but only"
-  // "write the official compression code (0x0008)."
-  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
-  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
-  if(d->compress == 1)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
-  else if(d->compress == 2)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    if(d->bpp == 32 || (d->bpp == 16 && d->pixelformat))
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-    else
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
+  _set_compression(tif, d);
 
   if(profile != NULL)
   {
@@ -227,25 +316,9 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   if(d->shortfile && layers == 3)
     dt_control_log(_("not a B&W image, will not export as grayscale"));
 
-  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
-  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
-  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT,
-               d->bpp == 32 || (d->bpp == 16 && d->pixelformat) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
-  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
-  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
-  if(layers == 3)
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-  else
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-
-  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
+  _set_image_fields(tif, d, layers);
 
   const int resolution = dt_conf_get_int("metadata/resolution");
-  TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
-  TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
-  TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
 
   const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
   if((rowdata = malloc(rowsize)) == NULL)
@@ -254,83 +327,10 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     goto exit;
   }
 
-  if(d->bpp == 32)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(float) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-#ifdef HAVE_IMATH
-  else if(d->bpp == 16 && d->pixelformat)
+  if(_write_rows(tif, d, layers, in_void, 0, d->global.height, rowdata))
   {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        for(int l = 0; l < layers; ++l) out[l] = imath_float_to_half(in[l]);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-#endif
-  else if(d->bpp == 16 && !d->pixelformat)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint16_t) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else // 8bpp
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint8_t) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
+    rc = 1;
+    goto exit;
   }
 
   rc = 0;
@@ -408,21 +408,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         else
           TIFFSetField(tif, TIFFTAG_PAGENAME, piece->module->name());
 
-        if(d->compress == 1)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
-        else if(d->compress == 2)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          if(d->bpp == 32 || (d->bpp == 16 && d->pixelformat))
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-          else
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
+        _set_compression(tif, d);
 
         TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
         TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
@@ -585,6 +571,107 @@ exit:
   return rc;
 }
 
+typedef struct dt_imageio_tiff_writer_t
+{
+  TIFF *tif;
+  void *rowdata;
+  int row;
+  gchar *filename;
+  // exif is added after the file has been closed
+  void *exif;
+  int exif_len;
+} dt_imageio_tiff_writer_t;
+
+static void _free_writer(dt_imageio_tiff_writer_t *w)
+{
+  if(w->tif) TIFFClose(w->tif);
+  free(w->rowdata);
+  g_free(w->filename);
+  free(w->exif);
+  free(w);
+}
+
+// grayscale detection needs the whole image, so streaming is only offered without it
+void *write_image_begin(dt_imageio_module_data_t *d_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, dt_imgid_t imgid)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_writer_t *w = calloc(1, sizeof(dt_imageio_tiff_writer_t));
+  if(!w) return NULL;
+
+  w->filename = g_strdup(filename);
+  w->rowdata = malloc((size_t)d->global.width * 3 * d->bpp / 8);
+  if(exif && exif_len > 0 && (w->exif = malloc(exif_len)))
+  {
+    memcpy(w->exif, exif, exif_len);
+    w->exif_len = exif_len;
+  }
+
+  // Create little endian tiff image
+#ifdef _WIN32
+  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+  w->tif = TIFFOpenW(wfilename, "wl");
+  g_free(wfilename);
+#else
+  w->tif = TIFFOpen(filename, "wl");
+#endif
+
+  if(!w->tif || !w->rowdata)
+  {
+    _free_writer(w);
+    return NULL;
+  }
+
+  TIFFSetField(w->tif, TIFFTAG_SUBFILETYPE, 0);
+  TIFFSetField(w->tif, TIFFTAG_DOCUMENTNAME, filename);
+  _set_compression(w->tif, d);
+
+  uint32_t profile_len = 0;
+  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
+  cmsSaveProfileToMem(out_profile, NULL, &profile_len);
+  uint8_t *profile = profile_len > 0 ? malloc(profile_len) : NULL;
+  if(profile)
+  {
+    cmsSaveProfileToMem(out_profile, profile, &profile_len);
+    TIFFSetField(w->tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, profile);
+    free(profile);
+  }
+
+  _set_image_fields(w->tif, d, 3);
+  return w;
+}
+
+int write_image_rows(dt_imageio_module_data_t *d_tmp, void *writer, const void *in, const int rows)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_writer_t *w = (dt_imageio_tiff_writer_t *)writer;
+  const int n = MIN(rows, d->global.height - w->row);
+  if(_write_rows(w->tif, d, 3, in, w->row, n, w->rowdata)) return 1;
+  w->row += n;
+  return 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *d_tmp, void *writer, const gboolean failed)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_writer_t *w = (dt_imageio_tiff_writer_t *)writer;
+
+  // close the file before adding exif data
+  TIFFClose(w->tif);
+  w->tif = NULL;
+
+  int rc = failed || w->row != d->global.height ? 1 : 0;
+  if(rc == 0 && w->exif)
+  {
+    rc = dt_exif_write_blob(w->exif, w->exif_len, w->filename, d->compress > 0);
+    // Until we get symbolic error status codes, if rc is 1, return 0
+    rc = (rc == 1) ? 0 : 1;
+  }
+  _free_writer(w);
+  return rc;
+}
+
 size_t params_size(dt_imageio_module_format_t *self)
 {
   return sizeof(dt_imageio_tiff_t) - sizeof(TIFF *);
@@ -956,7 +1043,9 @@ void gui_reset(dt_imageio_module_format_t *self)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_LAYERS;
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)data;
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_LAYERS
+    | (d && d->shortfile ? 0 : FORMAT_FLAGS_SUPPORT_STREAMING);
 }
 
 // clang-format off
@@ -740,6 +740,585 @@ static double _get_pipescale(dt_dev_pixelpipe_t *pipe,
   return fmin(scalex, scaley);
 }
 
+// an export on its way to the file. develop and pipe outlive
+// dt_imageio_export_with_flags() if the image is encoded in the background,
+// the other fields are only set then and owned by the struct.
+typedef struct _export_encode_t
+{
+  dt_develop_t dev;
+  dt_dev_pixelpipe_t pipe;
+  dt_imgid_t imgid;
+  gchar *filename;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *format_params;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *storage_params;
+  dt_colorspaces_color_profile_type_t icc_type;
+  gchar *icc_filename;
+  uint8_t *exif_profile;
+  int exif_len;
+  int num, total;
+  gboolean copy_metadata;
+  dt_export_metadata_t *metadata;
+} _export_encode_t;
+
+// find the exif data to be written with the exported image, returns its length
+static int _export_exif(dt_imageio_module_format_t *format,
+                        const dt_imgid_t imgid,
+                        const gboolean ignore_exif,
+                        const dt_export_metadata_t *metadata,
+                        const gboolean sRGB,
+                        const int width,
+                        const int height,
+                        uint8_t **exif_profile)
+{
+  *exif_profile = NULL;
+
+  // Check if all the metadata export flags are set for AVIF/EXR/JPEG XL/XCF (opt-in)
+  //
+  // TODO: this is a workaround as these formats do not support fine
+  // grained metadata control through dt_exif_xmp_attach_export()
+  // below due to lack of exiv2 write support
+  //
+  // Note: that this is done only when we do not ignore_exif, so we have a proper filename
+  //       otherwise the export is done in a memory buffer.
+  gboolean md_flags_set = TRUE;
+  if(!ignore_exif
+     && (!strcmp(format->mime(NULL), "image/avif")
+         || !strcmp(format->mime(NULL), "image/x-exr")
+         || !strcmp(format->mime(NULL), "image/jxl")
+         || !strcmp(format->mime(NULL), "image/x-xcf")))
+  {
+    const int32_t meta_all =
+      DT_META_EXIF | DT_META_METADATA | DT_META_GEOTAG | DT_META_TAG
+      | DT_META_HIERARCHICAL_TAG | DT_META_DT_HISTORY | DT_META_PRIVATE_TAG
+      | DT_META_SYNONYMS_TAG | DT_META_OMIT_HIERARCHY;
+    md_flags_set = metadata ? (metadata->flags & meta_all) == meta_all : FALSE;
+  }
+
+  if(ignore_exif || !md_flags_set) return 0;
+
+  // Exif data should be 65536 bytes max, but if original size is
+  // close to that, adding new tags could make it go over that... so
+  // let it be and see what happens when we write the image
+  char pathname[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+
+  // last param is dng mode, it's false here
+  return dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, width, height, FALSE);
+}
+
+// run the pipe for the rows [y, y + height) of the output
+static void _export_process(dt_dev_pixelpipe_t *pipe,
+                            dt_develop_t *dev,
+                            const int y,
+                            const int width,
+                            const int height,
+                            const double scale,
+                            const int bpp,
+                            const gboolean high_quality)
+{
+  if(high_quality || scale > 1.0f)
+  {
+    /*
+     * if high quality processing was requested, downsampling will be done
+     * at the very end of the pipe (just before border and watermark)
+     */
+    dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y, width, height, scale);
+    return;
+  }
+
+  // else, downsampling will be right after demosaic
+
+  // so we need to turn temporarily disable in-pipe late downsampling iop.
+
+  // find the finalscale module
+  dt_dev_pixelpipe_iop_t *finalscale = NULL;
+  for(const GList *nodes = g_list_last(pipe->nodes);
+      nodes;
+      nodes = g_list_previous(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
+    if(dt_iop_module_is(node->module->so, "finalscale"))
+    {
+      finalscale = node;
+      break;
+    }
+  }
+
+  if(finalscale) finalscale->enabled = FALSE;
+
+  // do the processing (8-bit with special treatment, to make sure
+  // we can use openmp further down):
+  if(bpp == 8)
+    dt_dev_pixelpipe_process(pipe, dev, 0, y, width, height, scale, DT_DEVICE_NONE);
+  else
+    dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y, width, height, scale);
+
+  if(finalscale) finalscale->enabled = TRUE;
+}
+
+// convert npixels of pipe output in place to what the format expects
+static void _export_convert(uint8_t *const outbuf,
+                            const size_t npixels,
+                            const int bpp,
+                            const gboolean display_byteorder,
+                            const gboolean high_quality)
+{
+  if(bpp == 8)
+  {
+    if(display_byteorder)
+    {
+      if(high_quality)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < npixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
+          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
+          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      // else processing output was 8-bit already, and no need to swap order
+    }
+    else // need to flip
+    {
+      // ldr output: char
+      if(high_quality)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < npixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
+          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
+          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      else
+      { // !display_byteorder, need to swap:
+        uint8_t *const buf8 = outbuf;
+        DT_OMP_FOR()
+        // just flip byte order
+        for(size_t k = 0; k < npixels; k++)
+        {
+          uint8_t tmp = buf8[4 * k + 0];
+          buf8[4 * k + 0] = buf8[4 * k + 2];
+          buf8[4 * k + 2] = tmp;
+        }
+      }
+    }
+  }
+  else if(bpp == 16)
+  {
+    // uint16_t per color channel
+    float *buff = (float *)outbuf;
+    uint16_t *buf16 = (uint16_t *)outbuf;
+    for(size_t k = 0; k < npixels; k++)
+    {
+      // convert in place
+      for(int i = 0; i < 3; i++)
+        buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
+    }
+  }
+  // else output float, no further harm done to the pixels :)
+}
+
+// TRUE if an enabled module derives its output from statistics of its whole input,
+// each strip would get its own and show seams
+static gboolean _export_needs_full_image(dt_dev_pixelpipe_t *pipe)
+{
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    if(piece->enabled
+       && ((module->flags() & IOP_FLAGS_IMAGE_STATISTICS)
+           || (module->image_statistics && module->image_statistics(module, piece))))
+    {
+      dt_print(DT_DEBUG_IMAGEIO,
+               "[dt_imageio_export_with_flags] `%s' needs the full image, no strips\n",
+               piece->module->op);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// number of rows to process at once if the export is done in strips, 0 for the full image
+static int _export_strip_rows(dt_dev_pixelpipe_t *pipe,
+                              dt_imageio_module_format_t *format,
+                              dt_imageio_module_data_t *format_params,
+                              const gboolean thumbnail_export,
+                              const gboolean export_masks,
+                              const int width,
+                              const int height)
+{
+  if(thumbnail_export
+     || export_masks
+     || !format->write_image_begin
+     || !format->write_image_rows
+     || !format->write_image_end
+     || !(format->flags(format_params) & FORMAT_FLAGS_SUPPORT_STREAMING)
+     || !dt_conf_get_bool("export_streaming"))
+    return 0;
+
+  // the pipe needs several buffers of the output size, so only images whose
+  // output alone takes a good part of the available memory are worth it
+  const size_t rowsize = (size_t)4 * sizeof(float) * width;
+  if(rowsize * height < dt_get_available_mem() / 8
+     || _export_needs_full_image(pipe))
+    return 0;
+
+  const size_t rows = MAX(64, dt_get_singlebuffer_mem() / rowsize) & ~(size_t)15;
+  return rows < height ? (int)rows : 0;
+}
+
+// process and write the image in strips of rows from top to bottom, so the pipe
+// never holds more than a strip of the output. returns TRUE on error.
+static gboolean _export_strips(dt_dev_pixelpipe_t *pipe,
+                               dt_develop_t *dev,
+                               dt_imageio_module_format_t *format,
+                               dt_imageio_module_data_t *format_params,
+                               const char *filename,
+                               const int strip_rows,
+                               const double scale,
+                               const int bpp,
+                               const gboolean high_quality,
+                               const gboolean display_byteorder,
+                               const dt_colorspaces_color_profile_type_t icc_type,
+                               const gchar *icc_filename,
+                               uint8_t *exif_profile,
+                               const int exif_len,
+                               const dt_imgid_t imgid)
+{
+  const int width = format_params->width;
+  const int height = format_params->height;
+
+  void *writer = format->write_image_begin(format_params, filename, icc_type, icc_filename,
+                                           exif_profile, exif_len, imgid);
+  if(!writer)
+  {
+    dt_print(DT_DEBUG_ALWAYS,
+             "[dt_imageio_export_with_flags] can't write `%s' in strips\n", filename);
+    return TRUE;
+  }
+
+  gboolean failed = FALSE;
+  for(int y = 0; y < height && !failed; y += strip_rows)
+  {
+    const int rows = MIN(strip_rows, height - y);
+    _export_process(pipe, dev, y, width, rows, scale, bpp, high_quality);
+
+    uint8_t *outbuf = pipe->backbuf;
+    if(outbuf == NULL || pipe->backbuf_width != width || pipe->backbuf_height != rows)
+    {
+      dt_print(DT_DEBUG_IMAGEIO,
+               "[dt_imageio_export_with_flags] no valid output buffer for rows %d-%d\n",
+               y, y + rows - 1);
+      failed = TRUE;
+      break;
+    }
+
+    _export_convert(outbuf, (size_t)width * rows, bpp, display_byteorder, high_quality);
+    failed = format->write_image_rows(format_params, writer, outbuf, rows) != 0;
+  }
+
+  failed = (format->write_image_end(format_params, writer, failed) != 0) || failed;
+  // don't leave a truncated image behind
+  if(failed) g_unlink(filename);
+  return failed;
+}
+
+// tell lua and the signal listeners about the written file
+static void _export_signal_tmpfile(const dt_imgid_t imgid,
+                                   const char *filename,
+                                   dt_imageio_module_format_t *format,
+                                   dt_imageio_module_data_t *format_params,
+                                   dt_imageio_module_storage_t *storage,
+                                   dt_imageio_module_data_t *storage_params)
+{
+  if(!strcmp(format->mime(format_params), "memory")
+     || (format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+    return;
+
+#ifdef USE_LUA
+  //Synchronous calling of lua intermediate-export-image events
+  dt_lua_lock();
+
+  lua_State *L = darktable.lua_state.state;
+
+  luaA_push(L, dt_lua_image_t, &imgid);
+
+  lua_pushstring(L, filename);
+
+  luaA_push_type(L, format->parameter_lua_type, format_params);
+
+  if(storage)
+    luaA_push_type(L, storage->parameter_lua_type, storage_params);
+  else
+    lua_pushnil(L);
+
+  dt_lua_event_trigger(L, "intermediate-export-image", 4);
+
+  dt_lua_unlock();
+#endif
+
+  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals,
+                                DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
+                                format_params, storage, storage_params);
+}
+
+struct dt_imageio_encoder_t
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  GQueue *queue;    // exports waiting for an encoder thread
+  GList *writing;   // file names being written by the encoder threads
+  int pending;      // queued and running
+  int depth;        // how many may be pending before the develop side waits
+  int failed;
+  gboolean finish;
+  int nthreads;
+  pthread_t *threads;
+  dt_imageio_encoder_done_t done;
+  void *user_data;
+};
+
+// the encoder the exports of this thread go to, if any
+static __thread dt_imageio_encoder_t *_encoder = NULL;
+// the last export of this thread was handed over to _encoder
+static __thread gboolean _deferred = FALSE;
+
+// write an export handed over by _export_defer() and free it, returns TRUE on error
+static gboolean _export_encode(_export_encode_t *e)
+{
+  const gboolean failed =
+    e->format->write_image(e->format_params, e->filename, e->pipe.backbuf, e->icc_type,
+                           e->icc_filename, e->exif_profile, e->exif_len, e->imgid,
+                           e->num, e->total, &e->pipe, FALSE) != 0;
+  if(failed)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[dt_imageio_export] could not write `%s'\n", e->filename);
+    dt_control_log(_("could not export to file `%s'!"), e->filename);
+    // the storage created the file before the encode was deferred, don't
+    // leave it behind empty or truncated
+    g_unlink(e->filename);
+  }
+  else if(e->copy_metadata
+          && (e->format->flags(e->format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+    dt_exif_xmp_attach_export(e->imgid, e->filename, e->metadata, &e->dev, &e->pipe);
+
+  dt_dev_pixelpipe_cleanup(&e->pipe);
+  dt_dev_cleanup(&e->dev);
+
+  if(!failed)
+    _export_signal_tmpfile(e->imgid, e->filename, e->format, e->format_params,
+                           e->storage, e->storage_params);
+
+  e->format->free_params(e->format, e->format_params);
+  g_free(e->filename);
+  g_free(e->icc_filename);
+  free(e->exif_profile);
+  free(e);
+  return failed;
+}
+
+static void *_encoder_thread(void *data)
+{
+  dt_imageio_encoder_t *encoder = (dt_imageio_encoder_t *)data;
+  dt_pthread_setname("export_encode");
+
+  dt_pthread_mutex_lock(&encoder->lock);
+  while(TRUE)
+  {
+    _export_encode_t *e = (_export_encode_t *)g_queue_pop_head(encoder->queue);
+    if(!e)
+    {
+      if(encoder->finish) break;
+      dt_pthread_cond_wait(&encoder->cond, &encoder->lock);
+      continue;
+    }
+    gchar *filename = g_strdup(e->filename);
+    encoder->writing = g_list_prepend(encoder->writing, filename);
+    dt_pthread_mutex_unlock(&encoder->lock);
+
+    const dt_imgid_t imgid = e->imgid;
+    const int num = e->num;
+    const gboolean failed = _export_encode(e);
+    if(encoder->done) encoder->done(imgid, num, failed, encoder->user_data);
+
+    dt_pthread_mutex_lock(&encoder->lock);
+    encoder->writing = g_list_remove(encoder->writing, filename);
+    g_free(filename);
+    encoder->pending--;
+    if(failed) encoder->failed++;
+    pthread_cond_broadcast(&encoder->cond);
+  }
+  dt_pthread_mutex_unlock(&encoder->lock);
+  return NULL;
+}
+
+// take over what the encoding needs from the caller and queue it, waiting while the
+// encoder is busy with as many images as it may hold. returns FALSE if nothing was queued.
+static gboolean _export_defer(dt_imageio_encoder_t *encoder,
+                              _export_encode_t *e,
+                              const dt_imgid_t imgid,
+                              const char *filename,
+                              dt_imageio_module_format_t *format,
+                              dt_imageio_module_data_t *format_params,
+                              dt_imageio_module_storage_t *storage,
+                              dt_imageio_module_data_t *storage_params,
+                              const dt_colorspaces_color_profile_type_t icc_type,
+                              const gchar *icc_filename,
+                              uint8_t *exif_profile,
+                              const int exif_len,
+                              const int num,
+                              const int total,
+                              const gboolean copy_metadata,
+                              dt_export_metadata_t *metadata)
+{
+  // the caller goes on with the next image using its format parameters
+  e->format_params = format->get_params(format);
+  if(!e->format_params) return FALSE;
+  memcpy(e->format_params, format_params, format->params_size(format));
+
+  e->imgid = imgid;
+  e->filename = g_strdup(filename);
+  e->format = format;
+  e->storage = storage;
+  e->storage_params = storage_params;
+  e->icc_type = icc_type;
+  e->icc_filename = g_strdup(icc_filename);
+  e->exif_profile = exif_profile;
+  e->exif_len = exif_len;
+  e->num = num;
+  e->total = total;
+  e->copy_metadata = copy_metadata;
+  e->metadata = metadata;
+
+  dt_pthread_mutex_lock(&encoder->lock);
+  while(encoder->pending >= encoder->depth)
+    dt_pthread_cond_wait(&encoder->cond, &encoder->lock);
+  g_queue_push_tail(encoder->queue, e);
+  encoder->pending++;
+  pthread_cond_broadcast(&encoder->cond);
+  dt_pthread_mutex_unlock(&encoder->lock);
+  return TRUE;
+}
+
+dt_imageio_encoder_t *dt_imageio_encoder_start(const int threads,
+                                               const int depth,
+                                               dt_imageio_encoder_done_t done,
+                                               void *user_data)
+{
+  dt_imageio_encoder_t *encoder = calloc(1, sizeof(dt_imageio_encoder_t));
+  if(!encoder) return NULL;
+
+  encoder->done = done;
+  encoder->user_data = user_data;
+
+  dt_pthread_mutex_init(&encoder->lock, NULL);
+  pthread_cond_init(&encoder->cond, NULL);
+  encoder->queue = g_queue_new();
+  encoder->depth = MAX(1, depth);
+  encoder->threads = calloc(MAX(1, threads), sizeof(pthread_t));
+  for(; encoder->threads && encoder->nthreads < MAX(1, threads); encoder->nthreads++)
+    if(dt_pthread_create(&encoder->threads[encoder->nthreads], _encoder_thread, encoder))
+      break;
+
+  if(!encoder->nthreads)
+  {
+    dt_imageio_encoder_finish(encoder);
+    return NULL;
+  }
+  return encoder;
+}
+
+void dt_imageio_encoder_set(dt_imageio_encoder_t *encoder)
+{
+  _encoder = encoder;
+  _deferred = FALSE;
+}
+
+gboolean dt_imageio_encoder_deferred(void)
+{
+  const gboolean deferred = _deferred;
+  _deferred = FALSE;
+  return deferred;
+}
+
+static gint _encode_has_file(gconstpointer a, gconstpointer b)
+{
+  return strcmp(((const _export_encode_t *)a)->filename, (const char *)b);
+}
+
+void dt_imageio_encoder_wait_file(const char *filename)
+{
+  dt_imageio_encoder_t *encoder = _encoder;
+  if(!encoder) return;
+
+  dt_pthread_mutex_lock(&encoder->lock);
+  while(g_queue_find_custom(encoder->queue, filename, _encode_has_file)
+        || g_list_find_custom(encoder->writing, filename, (GCompareFunc)strcmp))
+    dt_pthread_cond_wait(&encoder->cond, &encoder->lock);
+  dt_pthread_mutex_unlock(&encoder->lock);
+}
+
+int dt_imageio_encoder_finish(dt_imageio_encoder_t *encoder)
+{
+  if(!encoder) return 0;
+
+  dt_pthread_mutex_lock(&encoder->lock);
+  encoder->finish = TRUE;
+  pthread_cond_broadcast(&encoder->cond);
+  dt_pthread_mutex_unlock(&encoder->lock);
+
+  for(int k = 0; k < encoder->nthreads; k++)
+    pthread_join(encoder->threads[k], NULL);
+
+  const int failed = encoder->failed;
+  g_queue_free(encoder->queue);
+  pthread_cond_destroy(&encoder->cond);
+  dt_pthread_mutex_destroy(&encoder->lock);
+  free(encoder->threads);
+  free(encoder);
+  return failed;
+}
+
+// the scale to bin a raw to for a thumbnail of at most width x height,
+// 0 if the thumbnail is to be developed from the full buffer
+static float _thumbnail_draft_scale(const dt_image_t *img,
+                                    const int width,
+                                    const int height)
+{
+  if(!img->buf_dsc.filters || (img->flags & DT_IMAGE_4BAYER) || width <= 0 || height <= 0)
+    return 0.0f;
+
+  const char *draft = dt_conf_get_string_const("plugins/lighttable/thumbnail_draft_max_level");
+  const char *hq = dt_conf_get_string_const("plugins/lighttable/thumbnail_hq_min_level");
+  const dt_mipmap_size_t draft_max =
+    strcmp(draft, "always") ? dt_mipmap_cache_get_min_mip_from_pref(draft) : DT_MIPMAP_8;
+  const dt_mipmap_size_t hq_min = dt_mipmap_cache_get_min_mip_from_pref(hq);
+  const dt_mipmap_size_t level =
+    dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, width, height);
+
+  if(draft_max == DT_MIPMAP_NONE || level > draft_max || level >= hq_min)
+    return 0.0f;
+
+  // twice the thumbnail size leaves demosaic its own 2x2 or 3x3 binning down to the thumbnail
+  const float scale = fminf(2.0f * width / img->width, 2.0f * height / img->height);
+  return scale <= 0.5f ? scale : 0.0f;
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder
 // flag + high-quality override
 gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
@@ -765,11 +1344,15 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
                                  dt_export_metadata_t *metadata,
                                  const int history_end)
 {
-  dt_develop_t dev;
-  dt_dev_init(&dev, FALSE);
-  dt_dev_load_image(&dev, imgid);
+  // develop and pipe are kept beyond this function if the image is encoded in the background
+  _export_encode_t *e = calloc(1, sizeof(_export_encode_t));
+  if(!e) return TRUE;
+  dt_develop_t *dev = &e->dev;
+  dt_dev_pixelpipe_t *pipe = &e->pipe;
+  dt_dev_init(dev, FALSE);
+  dt_dev_load_image(dev, imgid);
   if(history_end != -1)
-    dt_dev_pop_history_items_ext(&dev, history_end);
+    dt_dev_pop_history_items_ext(dev, history_end);
 
   const gboolean buf_is_downscaled =
     (thumbnail_export && dt_conf_get_bool("ui/performance"));
@@ -778,6 +1361,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     dt_set_backthumb_time(600.0); // make sure we don't interfere
 
   dt_mipmap_buffer_t buf;
+  void *draft = NULL;
   if(buf_is_downscaled)
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid,
                         DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
@@ -785,7 +1369,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid,
                         DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
 
-  const dt_image_t *img = &dev.image_storage;
+  const dt_image_t *img = &dev->image_storage;
 
   if(!buf.buf || !buf.width || !buf.height)
   {
@@ -799,12 +1383,31 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   const int wd = img->width;
   const int ht = img->height;
 
+  // small raw thumbnails are developed from a mosaic binned down in one pass, the raw
+  // front end up to demosaic then doesn't run on the full sensor
+  const uint8_t *input = buf.buf;
+  int32_t input_width = buf.width;
+  int32_t input_height = buf.height;
+  float input_iscale = buf.iscale;
+  const float draft_scale = thumbnail_export && !buf_is_downscaled
+    ? _thumbnail_draft_scale(img, format_params->max_width, format_params->max_height)
+    : 0.0f;
+  if(draft_scale > 0.0f)
+    draft = dt_mipmap_cache_bin_mosaic(buf.buf, img, draft_scale, &input_width, &input_height);
+  if(draft)
+  {
+    input = draft;
+    input_iscale = (float)wd / (float)input_width;
+    dt_print(DT_DEBUG_IMAGEIO,
+             "[dt_imageio_export_with_flags] draft thumbnail of imgid %d from %ix%i sensels\n",
+             imgid, input_width, input_height);
+  }
+
   dt_times_t start;
   dt_get_perf_times(&start);
-  dt_dev_pixelpipe_t pipe;
   gboolean res = thumbnail_export
-    ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-    : dt_dev_pixelpipe_init_export(&pipe, wd, ht,
+    ? dt_dev_pixelpipe_init_thumbnail(pipe, wd, ht)
+    : dt_dev_pixelpipe_init_export(pipe, wd, ht,
                                    format->levels(format_params), export_masks);
   if(!res)
   {
@@ -815,7 +1418,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     goto error;
   }
 
-  const int final_history_end = history_end == -1 ? dev.history_end : history_end;
+  const int final_history_end = history_end == -1 ? dev->history_end : history_end;
   const gboolean use_style = !thumbnail_export && format_params->style[0] != '\0';
   const gboolean appending = format_params->style_append != FALSE;
   //  If a style is to be applied during export, add the iop params into the history
@@ -839,9 +1442,9 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
     GList *modules_used = NULL;
 
-    if(!appending) dt_dev_pop_history_items_ext(&dev, 0);
+    if(!appending) dt_dev_pop_history_items_ext(dev, 0);
 
-    dt_ioppr_update_for_style_items(&dev, style_items, appending);
+    dt_ioppr_update_for_style_items(dev, style_items, appending);
 
     for(GList *st_items = style_items; st_items; st_items = g_list_next(st_items))
     {
@@ -855,7 +1458,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
         // get iop for this operation as we need the corresponding
         // default parameters
         const dt_iop_module_t *module =
-          dt_iop_get_module_from_list(dev.iop, st_item->operation);
+          dt_iop_get_module_from_list(dev->iop, st_item->operation);
         if(module)
         {
           st_item->params_size = module->params_size;
@@ -874,7 +1477,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
       if(ok)
       {
-        dt_styles_apply_style_item(&dev, st_item, &modules_used, !autoinit && appending);
+        dt_styles_apply_style_item(dev, st_item, &modules_used, !autoinit && appending);
       }
     }
 
@@ -882,26 +1485,26 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     g_list_free_full(style_items, dt_style_item_free);
   }
   else if(history_end != -1)
-    dt_dev_pop_history_items_ext(&dev, final_history_end);
+    dt_dev_pop_history_items_ext(dev, final_history_end);
 
-  dt_ioppr_resync_modules_order(&dev);
+  dt_ioppr_resync_modules_order(dev);
 
-  dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf,
-                             buf.width, buf.height, buf.iscale);
-  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
-  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  dt_dev_pixelpipe_set_icc(pipe, icc_type, icc_filename, icc_intent);
+  dt_dev_pixelpipe_set_input(pipe, dev, (float *)input,
+                             input_width, input_height, input_iscale);
+  dt_dev_pixelpipe_create_nodes(pipe, dev);
+  dt_dev_pixelpipe_synch_all(pipe, dev);
 
   if(darktable.unmuted & DT_DEBUG_IMAGEIO)
   {
     char mbuf[1024] = { 0 };
-    for(GList *nodes = pipe.nodes; nodes; nodes = g_list_next(nodes))
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
     {
       dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
       if(piece->enabled)
       {
         const size_t used = strlen(mbuf);
-        snprintf(mbuf + used, sizeof(dev) - used, " %s", piece->module->op);
+        snprintf(mbuf + used, sizeof(mbuf) - used, " %s", piece->module->op);
       }
     }
     dt_print(DT_DEBUG_ALWAYS,"[dt_imageio_export_with_flags] %s%s%s%s%s modules:%s%s\n",
@@ -917,14 +1520,14 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   if(filter)
   {
     if(!strncmp(filter, "pre:", 4))
-      dt_dev_pixelpipe_disable_after(&pipe, filter + 4);
+      dt_dev_pixelpipe_disable_after(pipe, filter + 4);
     if(!strncmp(filter, "post:", 5))
-      dt_dev_pixelpipe_disable_before(&pipe, filter + 5);
+      dt_dev_pixelpipe_disable_before(pipe, filter + 5);
   }
 
-  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight,
-                                  &pipe.processed_width,
-                                  &pipe.processed_height);
+  dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight,
+                                  &pipe->processed_width,
+                                  &pipe->processed_height);
 
   dt_show_times(&start, "[export] creating pixelpipe");
 
@@ -934,7 +1537,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   else if(icc_type == DT_COLORSPACE_NONE)
   {
     dt_iop_module_t *colorout = NULL;
-    for(GList *modules = dev.iop; modules; modules = g_list_next(modules))
+    for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
     {
       colorout = (dt_iop_module_t *)modules->data;
       if(colorout->get_p && strcmp(colorout->op, "colorout") == 0)
@@ -957,27 +1560,27 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
   if(!thumbnail_export && width == 0 && height == 0)
   {
-    width = pipe.processed_width;
-    height = pipe.processed_height;
+    width = pipe->processed_width;
+    height = pipe->processed_height;
   }
 
   // note: not perfect but a reasonable good guess looking at overall pixelpipe requirements
   // and specific stuff in finalscale.
   const double max_possible_scale = fmin(100.0, fmax(1.0, // keep maximum allowed scale as we had in 4.6
-      (double)dt_get_available_mem() / (double)(1 + 64 * sizeof(float) * pipe.processed_width * pipe.processed_height)));
+      (double)dt_get_available_mem() / (double)(1 + 64 * sizeof(float) * pipe->processed_width * pipe->processed_height)));
 
   const gboolean doscale = upscale && ((width > 0 || height > 0) || is_scaling);
   const double max_scale = doscale ? max_possible_scale : 1.00;
 
-  double scale = _get_pipescale(&pipe, width, height, max_scale);
+  double scale = _get_pipescale(pipe, width, height, max_scale);
   float origin[2] = { 0.0f, 0.0f };
 
-  if(dt_dev_distort_backtransform_plus(&dev, &pipe, 0.0,
+  if(dt_dev_distort_backtransform_plus(dev, pipe, 0.0,
                                        DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
   {
-    if(width == 0) width = pipe.processed_width;
-    if(height == 0) height = pipe.processed_height;
-    scale = _get_pipescale(&pipe, width, height, max_scale);
+    if(width == 0) width = pipe->processed_width;
+    if(height == 0) height = pipe->processed_height;
+    scale = _get_pipescale(pipe, width, height, max_scale);
 
     if(is_scaling)
     {
@@ -992,200 +1595,84 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     }
   }
 
-  const int processed_width = floor(scale * pipe.processed_width);
-  const int processed_height = floor(scale * pipe.processed_height);
+  const int processed_width = floor(scale * pipe->processed_width);
+  const int processed_height = floor(scale * pipe->processed_height);
   const gboolean size_warning = processed_width < 1 || processed_height < 1;
   dt_print(DT_DEBUG_IMAGEIO,
            "[dt_imageio_export] %s%s imgid %d, %ix%i --> %ix%i (scale=%.4f, maxscale=%.4f)."
            " upscale=%s, hq=%s\n",
            size_warning ? "**missing size** " : "",
            thumbnail_export ? "thumbnail" : "export", imgid,
-           pipe.processed_width, pipe.processed_height,
+           pipe->processed_width, pipe->processed_height,
            processed_width, processed_height, scale, max_scale,
            upscale ? "yes" : "no",
            high_quality_processing || scale > 1.0f ? "yes" : "no");
 
   const int bpp = format->bpp(format_params);
 
+  format_params->width = processed_width;
+  format_params->height = processed_height;
+
+  uint8_t *exif_profile = NULL;
+  const int exif_len = _export_exif(format, imgid, ignore_exif, metadata, sRGB,
+                                    processed_width, processed_height, &exif_profile);
+
+  const int strip_rows = _export_strip_rows(pipe, format, format_params, thumbnail_export,
+                                            export_masks, processed_width, processed_height);
   dt_get_perf_times(&start);
-  if(high_quality_processing || scale > 1.0f)
+  if(strip_rows)
   {
-    /*
-     * if high quality processing was requested, downsampling will be done
-     * at the very end of the pipe (just before border and watermark)
-     */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0,
-                                      processed_width, processed_height, scale);
+    res = _export_strips(pipe, dev, format, format_params, filename, strip_rows, scale, bpp,
+                         high_quality_processing, display_byteorder, icc_type, icc_filename,
+                         exif_profile, exif_len, imgid);
+    dt_show_times_f(&start, "[dev_process_export]",
+                    "pixel pipeline processing in strips of %d rows", strip_rows);
   }
   else
   {
-    // else, downsampling will be right after demosaic
-
-    // so we need to turn temporarily disable in-pipe late downsampling iop.
-
-    // find the finalscale module
-    dt_dev_pixelpipe_iop_t *finalscale = NULL;
+    _export_process(pipe, dev, 0, processed_width, processed_height, scale, bpp,
+                    high_quality_processing);
+    dt_show_times(&start,
+                  thumbnail_export
+                    ? "[dev_process_thumbnail] pixel pipeline processing"
+                    : "[dev_process_export] pixel pipeline processing");
+
+    uint8_t *outbuf = pipe->backbuf;
+    if(outbuf == NULL)
     {
-      for(const GList *nodes = g_list_last(pipe.nodes);
-          nodes;
-          nodes = g_list_previous(nodes))
-      {
-        dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
-        if(dt_iop_module_is(node->module->so, "finalscale"))
-        {
-          finalscale = node;
-          break;
-        }
-      }
+      dt_print(DT_DEBUG_IMAGEIO,
+               "[dt_imageio_export_with_flags] no valid output buffer\n");
+      free(exif_profile);
+      goto error;
     }
 
-    if(finalscale) finalscale->enabled = FALSE;
-
-    // do the processing (8-bit with special treatment, to make sure
-    // we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0,
-                               processed_width, processed_height, scale, DT_DEVICE_NONE);
-    else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0,
-                                        processed_width, processed_height, scale);
-
-    if(finalscale) finalscale->enabled = TRUE;
-  }
-  dt_show_times(&start,
-                thumbnail_export
-                  ? "[dev_process_thumbnail] pixel pipeline processing"
-                  : "[dev_process_export] pixel pipeline processing");
-
-  uint8_t *outbuf = pipe.backbuf;
-  if(outbuf == NULL)
-  {
-    dt_print(DT_DEBUG_IMAGEIO,
-             "[dt_imageio_export_with_flags] no valid output buffer\n");
-    goto error;
-  }
-
-  // downconversion to low-precision formats:
-  if(bpp == 8)
-  {
-    if(display_byteorder)
+    // downconversion to low-precision formats:
+    _export_convert(outbuf, (size_t)processed_width * processed_height, bpp,
+                    display_byteorder, high_quality_processing);
+
+    // hand the pipe with its output over to the encoder and go on with the next image
+    if(_encoder
+       && !thumbnail_export
+       && !export_masks
+       && storage
+       && storage->deferred_encode(storage)
+       && !(format->flags(format_params) & FORMAT_FLAGS_NO_CONCURRENT)
+       && _export_defer(_encoder, e, imgid, filename, format, format_params,
+                        storage, storage_params, icc_type, icc_filename,
+                        exif_profile, exif_len, num, total, copy_metadata, metadata))
     {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
+      dt_free_align(draft);
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+      dt_set_backthumb_time(5.0);
+      _deferred = TRUE;
+      return FALSE;
     }
-    else // need to flip
-    {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-        DT_OMP_FOR()
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
-      }
-    }
-  }
-  else if(bpp == 16)
-  {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++)
-          buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
-      }
-  }
-  // else output float, no further harm done to the pixels :)
-
-  format_params->width = processed_width;
-  format_params->height = processed_height;
-
-  // Check if all the metadata export flags are set for AVIF/EXR/JPEG XL/XCF (opt-in)
-  //
-  // TODO: this is a workaround as these formats do not support fine
-  // grained metadata control through dt_exif_xmp_attach_export()
-  // below due to lack of exiv2 write support
-  //
-  // Note: that this is done only when we do not ignore_exif, so we have a proper filename
-  //       otherwise the export is done in a memory buffer.
-  gboolean md_flags_set = TRUE;
-  if(!ignore_exif
-     && (!strcmp(format->mime(NULL), "image/avif")
-         || !strcmp(format->mime(NULL), "image/x-exr")
-         || !strcmp(format->mime(NULL), "image/jxl")
-         || !strcmp(format->mime(NULL), "image/x-xcf")))
-  {
-    const int32_t meta_all =
-      DT_META_EXIF | DT_META_METADATA | DT_META_GEOTAG | DT_META_TAG
-      | DT_META_HIERARCHICAL_TAG | DT_META_DT_HISTORY | DT_META_PRIVATE_TAG
-      | DT_META_SYNONYMS_TAG | DT_META_OMIT_HIERARCHY;
-    md_flags_set = metadata ? (metadata->flags & meta_all) == meta_all : FALSE;
-  }
-
-  if(!ignore_exif && md_flags_set)
-  {
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes
-                                  // max, but if original size is
-                                  // close to that, adding new tags
-                                  // could make it go over that... so
-                                  // let it be and see what happens
-                                  // when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-
-    // last param is dng mode, it's false here
-    const int length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB,
-                                         processed_width, processed_height, FALSE);
 
     res = (format->write_image(format_params, filename, outbuf, icc_type,
-                              icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe, export_masks)) != 0;
-
-    free(exif_profile);
-  }
-  else
-  {
-    res = (format->write_image(format_params, filename, outbuf, icc_type,
-                              icc_filename, NULL, 0, imgid, num, total,
-                              &pipe, export_masks)) != 0;
+                               icc_filename, exif_profile, exif_len, imgid,
+                               num, total, pipe, export_masks)) != 0;
   }
+  free(exif_profile);
 
   if(res)
     goto error;
@@ -1194,52 +1681,29 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   if(copy_metadata
      && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
   {
-    dt_exif_xmp_attach_export(imgid, filename, metadata, &dev, &pipe);
+    dt_exif_xmp_attach_export(imgid, filename, metadata, dev, pipe);
     // no need to cancel the export if this fail
   }
 
-  dt_dev_pixelpipe_cleanup(&pipe);
-  dt_dev_cleanup(&dev);
+  dt_dev_pixelpipe_cleanup(pipe);
+  dt_dev_cleanup(dev);
+  free(e);
+  dt_free_align(draft);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
-  {
-#ifdef USE_LUA
-    //Synchronous calling of lua intermediate-export-image events
-    dt_lua_lock();
-
-    lua_State *L = darktable.lua_state.state;
-
-    luaA_push(L, dt_lua_image_t, &imgid);
-
-    lua_pushstring(L, filename);
-
-    luaA_push_type(L, format->parameter_lua_type, format_params);
-
-    if(storage)
-      luaA_push_type(L, storage->parameter_lua_type, storage_params);
-    else
-      lua_pushnil(L);
-
-    dt_lua_event_trigger(L, "intermediate-export-image", 4);
-
-    dt_lua_unlock();
-#endif
-
-    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals,
-                                  DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                                  format_params, storage, storage_params);
-  }
-
   if(!thumbnail_export)
+  {
+    _export_signal_tmpfile(imgid, filename, format, format_params, storage, storage_params);
     dt_set_backthumb_time(5.0);
+  }
   return FALSE; // success
 
 error:
-  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_dev_pixelpipe_cleanup(pipe);
 error_early:
-  dt_dev_cleanup(&dev);
+  dt_dev_cleanup(dev);
+  free(e);
+  dt_free_align(draft);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
   if(!thumbnail_export)
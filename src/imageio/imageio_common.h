@@ -126,6 +126,31 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid, const char *filena
                                  dt_export_metadata_t *metadata,
                                  const int history_end);
 
+/** background encoding of exports: while an encoder is set for the calling thread,
+    exports to storages allowing deferred_encode() hand the finished pipe over to the
+    encoder threads and return before the file is written. at most depth images are
+    waiting or being encoded at any time. done, if set, is called from an encoder
+    thread once the file of an image is written or failed. */
+typedef struct dt_imageio_encoder_t dt_imageio_encoder_t;
+typedef void (*dt_imageio_encoder_done_t)(const dt_imgid_t imgid,
+                                          const int num,
+                                          const gboolean failed,
+                                          void *user_data);
+dt_imageio_encoder_t *dt_imageio_encoder_start(const int threads,
+                                               const int depth,
+                                               dt_imageio_encoder_done_t done,
+                                               void *user_data);
+void dt_imageio_encoder_set(dt_imageio_encoder_t *encoder);
+/** TRUE if the last export of the calling thread since the previous call went to the
+    encoder, its result is then only known to the done callback. */
+gboolean dt_imageio_encoder_deferred(void);
+/** wait until the encoder of the calling thread, if any, has no image to write to
+    filename queued or being written. */
+void dt_imageio_encoder_wait_file(const char *filename);
+/** wait until all queued images are written and free the encoder, returns the number
+    of images which failed. */
+int dt_imageio_encoder_finish(dt_imageio_encoder_t *encoder);
+
 size_t dt_imageio_write_pos(const int i,
                             const int j,
                             const int wd,
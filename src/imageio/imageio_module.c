@@ -182,6 +182,16 @@ static gboolean default_supported(struct dt_imageio_module_storage_t *self,
 {
   return TRUE;
 }
+/** Default implementation of concurrent_store function, storage modules handle one image at a time */
+static gboolean default_concurrent_store(struct dt_imageio_module_storage_t *self)
+{
+  return FALSE;
+}
+/** Default implementation of deferred_encode function, the file is written before store() goes on */
+static gboolean default_deferred_encode(struct dt_imageio_module_storage_t *self)
+{
+  return FALSE;
+}
 /** Default implementation of dimension module function, used if storage modules does not implements
  * dimension() */
 static int _default_storage_dimension(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data,
@@ -42,7 +42,9 @@ typedef enum dt_imageio_format_flags_t
 {
   FORMAT_FLAGS_SUPPORT_XMP = 1,
   FORMAT_FLAGS_NO_TMPFILE = 2,
-  FORMAT_FLAGS_SUPPORT_LAYERS = 4
+  FORMAT_FLAGS_SUPPORT_LAYERS = 4,
+  FORMAT_FLAGS_NO_CONCURRENT = 8, // images are collected into one output and must be written in order
+  FORMAT_FLAGS_SUPPORT_STREAMING = 16 // can be written in strips of rows, see write_image_begin()
 } dt_imageio_format_flags_t;
 
 /**
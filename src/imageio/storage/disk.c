@@ -37,6 +37,8 @@
 #include "osx/osx.h"
 #endif
 #include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -67,8 +69,19 @@ typedef struct dt_imageio_disk_t
   char filename[DT_MAX_PATH_FOR_PARAMS];
   dt_disk_onconflict_actions_t onsave_action;
   dt_variables_params_t *vp;
+  GHashTable *names; // _disk_name_t of files overwritten by this export, under plugin_threadsafe
 } dt_imageio_disk_t;
 
+// a file overwritten by an export, the image num is written to it or has been
+typedef struct _disk_name_t
+{
+  int num;
+  gboolean busy; // its store() is running
+} _disk_name_t;
+
+// signalled when a file overwritten by an export is no longer busy
+static pthread_cond_t _names_cond = PTHREAD_COND_INITIALIZER;
+
 const char *name(const struct dt_imageio_module_storage_t *self)
 {
   return _("file on disk");
@@ -308,6 +321,14 @@ void gui_reset(dt_imageio_module_storage_t *self)
                   dt_bauhaus_combobox_get(d->onsave_action));
 }
 
+// create the empty file so that no other image of a concurrent export gets its name,
+// returns FALSE if the file can't be created, errno tells if it exists
+static gboolean _reserve_file(const char *filename)
+{
+  const int fd = g_open(filename, O_CREAT | O_EXCL | O_WRONLY | O_BINARY, 0666);
+  return fd >= 0 && g_close(fd, NULL);
+}
+
 int store(dt_imageio_module_storage_t *self,
           dt_imageio_module_data_t *sdata,
           const dt_imgid_t imgid,
@@ -331,14 +352,20 @@ int store(dt_imageio_module_storage_t *self,
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), &from_cache);
-  // set variable values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
-  dt_variables_set_upscale(d->vp, upscale);
-
   gboolean fail = FALSE;
+  gboolean reserved = FALSE;
+  const gboolean overwrite =
+    d->onsave_action == DT_EXPORT_ONCONFLICT_OVERWRITE
+    || d->onsave_action == DT_EXPORT_ONCONFLICT_OVERWRITE_IF_CHANGED;
+  _disk_name_t *taken = NULL;
+  gboolean rewrite = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set variable values to expand them afterwards in darktable variables
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
+    dt_variables_set_upscale(d->vp, upscale);
+
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -409,6 +436,29 @@ try_again:
   failed:
     g_free(output_dir);
 
+    // images may be exported concurrently and the file is only written
+    // later, so the name is taken here: by creating the file if it must
+    // not exist yet. images of one export overwriting the same file are
+    // written one after the other in export order, the last one wins as
+    // when exporting one image at a time. an image coming after a later
+    // one took the file would be overwritten by it and is skipped.
+    if(!fail && overwrite)
+    {
+      while((taken = g_hash_table_lookup(d->names, filename)) && taken->busy)
+        dt_pthread_cond_wait(&_names_cond, &darktable.plugin_threadsafe);
+
+      if(taken && taken->num > num)
+      {
+        dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+        dt_print(DT_DEBUG_ALWAYS,
+                 "[export_job] skipping (overwritten by image %d) `%s'\n",
+                 taken->num, filename);
+        dt_control_log(ngettext("%d/%d skipping `%s'", "%d/%d skipping `%s'", num),
+                       num, total, filename);
+        return 0;
+      }
+    }
+
     // conflict handling option: unique filename is generated if the
     // file already exists
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME)
@@ -416,7 +466,7 @@ try_again:
       int seq = 1;
 
       // increase filename suffix until a filename is generated that is unique
-      while(g_file_test(filename, G_FILE_TEST_EXISTS))
+      while(!(reserved = _reserve_file(filename)) && errno == EEXIST)
       {
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
@@ -427,7 +477,7 @@ try_again:
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_SKIP)
     {
       // check if the file exists
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
+      if(!(reserved = _reserve_file(filename)) && errno == EEXIST)
       {
         // file exists, skip
         dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
@@ -460,20 +510,49 @@ try_again:
         return 0;
       }
     }
+
+    if(!fail && overwrite)
+    {
+      rewrite = taken != NULL;
+      if(!taken)
+      {
+        taken = g_malloc0(sizeof(_disk_name_t));
+        g_hash_table_insert(d->names, g_strdup(filename), taken);
+      }
+      taken->num = num;
+      taken->busy = TRUE;
+    }
   } // end of critical block
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
   if(fail) return 1;
 
+  // the earlier image may still be written by the encoder
+  if(rewrite) dt_imageio_encoder_wait_file(filename);
+
   /* export image to file */
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality,
-                       upscale, TRUE, export_masks, icc_type,
-                       icc_filename, icc_intent, self, sdata,
-                       num, total, metadata) != 0)
+  const gboolean failed =
+    dt_imageio_export(imgid, filename, format, fdata, high_quality,
+                      upscale, TRUE, export_masks, icc_type,
+                      icc_filename, icc_intent, self, sdata,
+                      num, total, metadata) != 0;
+
+  // a deferred encode is waited for by the next image overwriting the file
+  if(taken)
+  {
+    dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+    taken->busy = FALSE;
+    pthread_cond_broadcast(&_names_cond);
+    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  }
+
+  if(failed)
   {
     dt_print(DT_DEBUG_ALWAYS,
              "[imageio_storage_disk] could not export to file: `%s'!\n",
              filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    // don't leave the empty file behind
+    if(reserved) g_unlink(filename);
     return 1;
   }
 
@@ -483,9 +562,23 @@ try_again:
   return 0;
 }
 
+gboolean concurrent_store(dt_imageio_module_storage_t *self)
+{
+  // the file name is made up and its file created under plugin_threadsafe,
+  // the rest only depends on the image
+  return TRUE;
+}
+
+gboolean deferred_encode(dt_imageio_module_storage_t *self)
+{
+  // nothing is done with the file once it is exported, its name is taken
+  // by creating it in store() before the encode is handed over
+  return TRUE;
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
-  return sizeof(dt_imageio_disk_t) - sizeof(void *);
+  return sizeof(dt_imageio_disk_t) - 2 * sizeof(void *);
 }
 
 void init(dt_imageio_module_storage_t *self)
@@ -509,6 +602,7 @@ void *get_params(dt_imageio_module_storage_t *self)
 
   d->vp = NULL;
   dt_variables_params_init(&d->vp);
+  d->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
   return d;
 }
@@ -519,6 +613,7 @@ void free_params(dt_imageio_module_storage_t *self,
   if(!params) return;
   dt_imageio_disk_t *d = (dt_imageio_disk_t *)params;
   dt_variables_params_destroy(d->vp);
+  g_hash_table_destroy(d->names);
   free(params);
 }
 
@@ -91,6 +91,12 @@ OPTIONAL(void, export_dispatched, struct dt_imageio_module_storage_t *self);
 
 OPTIONAL(char *, ask_user_confirmation, struct dt_imageio_module_storage_t *self);
 
+/* can store() be called for several images at the same time? */
+DEFAULT(gboolean, concurrent_store, struct dt_imageio_module_storage_t *self);
+/* may the file be written in the background after store() returned? only for storages
+   not using the exported file themselves. */
+DEFAULT(gboolean, deferred_encode, struct dt_imageio_module_storage_t *self);
+
 #ifdef FULL_API_H
 
 #pragma GCC visibility pop
@@ -205,6 +205,9 @@ typedef struct dt_iop_channelmixer_rbg_data_t
   dt_adaptation_t adaptation;
   dt_illuminant_t illuminant_type;
   dt_iop_channelmixer_rgb_version_t version;
+  // work profile matrices, set up per run for process_pointwise()
+  dt_colormatrix_t RGB_to_XYZ;
+  dt_colormatrix_t XYZ_to_RGB;
 } dt_iop_channelmixer_rbg_data_t;
 
 typedef struct dt_iop_channelmixer_rgb_global_data_t
@@ -243,7 +246,8 @@ const char **description(struct dt_iop_module_t *self)
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING
+         | IOP_FLAGS_CACHE_HALF_FLOAT;
 }
 
 int default_group()
@@ -748,12 +752,13 @@ static inline void _luma_chroma(const dt_aligned_pixel_t input,
   }
 }
 
+// in and out may be the same buffer. parallel is FALSE for the chunks of a fused run,
+// which are processed from several threads already and should stay in cache.
 DT_OMP_DECLARE_SIMD(aligned(in, out, XYZ_to_RGB, RGB_to_XYZ, MIX : 64) aligned(illuminant, saturation, lightness, grey:16))
-static inline void _loop_switch(const float *const restrict in,
-                                float *const restrict out,
-                                const size_t width,
-                                const size_t height,
-                                const size_t ch,
+static inline void _loop_switch(const float *const in,
+                                float *const out,
+                                const size_t npixels,
+                                const gboolean parallel,
                                 const dt_colormatrix_t XYZ_to_RGB,
                                 const dt_colormatrix_t RGB_to_XYZ,
                                 const dt_colormatrix_t MIX,
@@ -804,8 +809,8 @@ static inline void _loop_switch(const float *const restrict in,
   dt_colormatrix_t XYZ_to_RGB_trans;
   dt_colormatrix_transpose(XYZ_to_RGB_trans, XYZ_to_RGB);
 
-  DT_OMP_FOR()
-  for(size_t k = 0; k < height * width * 4; k += 4)
+  DT_OMP_FOR(if(parallel))
+  for(size_t k = 0; k < npixels * 4; k += 4)
   {
     // intermediate temp buffers
     dt_aligned_pixel_t temp_one;
@@ -960,7 +965,10 @@ static inline void _loop_switch(const float *const restrict in,
     }
 
     temp_two[3] = in[k + 3]; // alpha mask
-    copy_pixel_nontemporal(&out[k], temp_two);
+    if(parallel)
+      copy_pixel_nontemporal(&out[k], temp_two);
+    else
+      copy_pixel(&out[k], temp_two);
   }
 }
 
@@ -2100,6 +2108,105 @@ static void _set_trouble_messages(struct dt_iop_module_t *self)
   }
 }
 
+// the camera illuminant depends on the white balance of temperature.c at runtime
+static void _update_camera_illuminant(struct dt_iop_module_t *self,
+                                      dt_iop_channelmixer_rbg_data_t *data)
+{
+  if(data->illuminant_type == DT_ILLUMINANT_CAMERA)
+  {
+    // The camera illuminant is a behaviour rather than a preset of
+    // values: it uses whatever is in the RAW EXIF. But it depends on
+    // what temperature.c is doing and needs to be updated
+    // accordingly, to give a consistent result.  We initialise the
+    // CAT defaults using the temperature coeffs at startup, but if
+    // temperature is changed later, we get no notification of the
+    // change here, so we can't update the defaults.  So we need to
+    // re-run the detection at runtime…
+    float x, y;
+    dt_aligned_pixel_t custom_wb;
+    _get_white_balance_coeff(self, custom_wb);
+
+    if(find_temperature_from_raw_coeffs(&(self->dev->image_storage), custom_wb, &(x), &(y)))
+    {
+      // Convert illuminant from xyY to XYZ
+      dt_aligned_pixel_t XYZ;
+      illuminant_xy_to_XYZ(x, y, XYZ);
+
+      // Convert illuminant from XYZ to Bradford modified LMS
+      convert_any_XYZ_to_LMS(XYZ, data->illuminant, data->adaptation);
+      data->illuminant[3] = 0.f;
+    }
+    else
+    {
+      // just use whatever was defined in commit_params hoping the defaults work…
+    }
+  }
+}
+
+static void _process_pixels(const dt_iop_channelmixer_rbg_data_t *const data,
+                            const dt_colormatrix_t RGB_to_XYZ,
+                            const dt_colormatrix_t XYZ_to_RGB,
+                            const float *const in,
+                            float *const out,
+                            const size_t npixels,
+                            const gboolean parallel)
+{
+  // force loop unswitching in a controlled way
+  switch(data->adaptation)
+  {
+    case DT_ADAPTATION_FULL_BRADFORD:
+    {
+      _loop_switch(in, out, npixels, parallel,
+                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
+                   data->illuminant, data->saturation, data->lightness, data->grey,
+                   data->p, data->gamut, data->clip, data->apply_grey,
+                   DT_ADAPTATION_FULL_BRADFORD, data->version);
+      break;
+    }
+    case DT_ADAPTATION_LINEAR_BRADFORD:
+    {
+      _loop_switch(in, out, npixels, parallel,
+                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
+                   data->illuminant, data->saturation, data->lightness, data->grey,
+                   data->p, data->gamut, data->clip, data->apply_grey,
+                   DT_ADAPTATION_LINEAR_BRADFORD, data->version);
+      break;
+    }
+    case DT_ADAPTATION_CAT16:
+    {
+      _loop_switch(in, out, npixels, parallel,
+                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
+                   data->illuminant, data->saturation, data->lightness, data->grey,
+                   data->p, data->gamut, data->clip, data->apply_grey,
+                   DT_ADAPTATION_CAT16, data->version);
+      break;
+    }
+    case DT_ADAPTATION_XYZ:
+    {
+      _loop_switch(in, out, npixels, parallel,
+                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
+                   data->illuminant, data->saturation, data->lightness, data->grey,
+                   data->p, data->gamut, data->clip, data->apply_grey,
+                   DT_ADAPTATION_XYZ, data->version);
+      break;
+    }
+    case DT_ADAPTATION_RGB:
+    {
+      _loop_switch(in, out, npixels, parallel,
+                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
+                   data->illuminant, data->saturation, data->lightness, data->grey,
+                   data->p, data->gamut, data->clip, data->apply_grey,
+                   DT_ADAPTATION_RGB, data->version);
+      break;
+    }
+    case DT_ADAPTATION_LAST:
+    default:
+    {
+      break;
+    }
+  }
+}
+
 void process(struct dt_iop_module_t *self,
              dt_dev_pixelpipe_iop_t *piece,
              const void *const restrict ivoid,
@@ -2138,7 +2245,6 @@ void process(struct dt_iop_module_t *self,
   }
 
   assert(piece->colors == 4);
-  const size_t ch = 4;
 
   const float *const restrict in = (const float *const restrict)ivoid;
   float *const restrict out = (float *const restrict)ovoid;
@@ -2148,6 +2254,7 @@ void process(struct dt_iop_module_t *self,
   {
 #ifdef AI_ACTIVATED
     gboolean exit = FALSE;
+    const size_t ch = 4;
 #endif
     if(g->run_profile && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
     {
@@ -2187,90 +2294,9 @@ void process(struct dt_iop_module_t *self,
 #endif
   }
 
-  if(data->illuminant_type == DT_ILLUMINANT_CAMERA)
-  {
-    // The camera illuminant is a behaviour rather than a preset of
-    // values: it uses whatever is in the RAW EXIF. But it depends on
-    // what temperature.c is doing and needs to be updated
-    // accordingly, to give a consistent result.  We initialise the
-    // CAT defaults using the temperature coeffs at startup, but if
-    // temperature is changed later, we get no notification of the
-    // change here, so we can't update the defaults.  So we need to
-    // re-run the detection at runtime…
-    float x, y;
-    dt_aligned_pixel_t custom_wb;
-    _get_white_balance_coeff(self, custom_wb);
-
-    if(find_temperature_from_raw_coeffs(&(self->dev->image_storage), custom_wb, &(x), &(y)))
-    {
-      // Convert illuminant from xyY to XYZ
-      dt_aligned_pixel_t XYZ;
-      illuminant_xy_to_XYZ(x, y, XYZ);
-
-      // Convert illuminant from XYZ to Bradford modified LMS
-      convert_any_XYZ_to_LMS(XYZ, data->illuminant, data->adaptation);
-      data->illuminant[3] = 0.f;
-    }
-    else
-    {
-      // just use whatever was defined in commit_params hoping the defaults work…
-    }
-  }
-
-  // force loop unswitching in a controlled way
-  switch(data->adaptation)
-  {
-    case DT_ADAPTATION_FULL_BRADFORD:
-    {
-      _loop_switch(in, out, roi_out->width, roi_out->height, ch,
-                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
-                   data->illuminant, data->saturation, data->lightness, data->grey,
-                   data->p, data->gamut, data->clip, data->apply_grey,
-                   DT_ADAPTATION_FULL_BRADFORD, data->version);
-      break;
-    }
-    case DT_ADAPTATION_LINEAR_BRADFORD:
-    {
-      _loop_switch(in, out, roi_out->width, roi_out->height, ch,
-                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
-                   data->illuminant, data->saturation, data->lightness, data->grey,
-                   data->p, data->gamut, data->clip, data->apply_grey,
-                   DT_ADAPTATION_LINEAR_BRADFORD, data->version);
-      break;
-    }
-    case DT_ADAPTATION_CAT16:
-    {
-      _loop_switch(in, out, roi_out->width, roi_out->height, ch,
-                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
-                   data->illuminant, data->saturation, data->lightness, data->grey,
-                   data->p, data->gamut, data->clip, data->apply_grey,
-                   DT_ADAPTATION_CAT16, data->version);
-      break;
-    }
-    case DT_ADAPTATION_XYZ:
-    {
-      _loop_switch(in, out, roi_out->width, roi_out->height, ch,
-                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
-                   data->illuminant, data->saturation, data->lightness, data->grey,
-                   data->p, data->gamut, data->clip, data->apply_grey,
-                   DT_ADAPTATION_XYZ, data->version);
-      break;
-    }
-    case DT_ADAPTATION_RGB:
-    {
-      _loop_switch(in, out, roi_out->width, roi_out->height, ch,
-                   XYZ_to_RGB, RGB_to_XYZ, data->MIX,
-                   data->illuminant, data->saturation, data->lightness, data->grey,
-                   data->p, data->gamut, data->clip, data->apply_grey,
-                   DT_ADAPTATION_RGB, data->version);
-      break;
-    }
-    case DT_ADAPTATION_LAST:
-    default:
-    {
-      break;
-    }
-  }
+  _update_camera_illuminant(self, data);
+  _process_pixels(data, RGB_to_XYZ, XYZ_to_RGB, in, out,
+                  (size_t)roi_out->width * roi_out->height, TRUE);
 
   // run dE validation at output
   if(self->dev->gui_attached && g)
@@ -2281,6 +2307,32 @@ void process(struct dt_iop_module_t *self,
     }
 }
 
+void process_pointwise_setup(struct dt_iop_module_t *self,
+                             dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_iop_channelmixer_rbg_data_t *data = (dt_iop_channelmixer_rbg_data_t *)piece->data;
+  const struct dt_iop_order_iccprofile_info_t *const work_profile =
+    dt_ioppr_get_pipe_current_profile_info(self, piece->pipe);
+
+  if(work_profile)
+  {
+    memcpy(data->RGB_to_XYZ, work_profile->matrix_in, sizeof(data->RGB_to_XYZ));
+    memcpy(data->XYZ_to_RGB, work_profile->matrix_out, sizeof(data->XYZ_to_RGB));
+  }
+  _update_camera_illuminant(self, data);
+}
+
+void process_pointwise(struct dt_iop_module_t *self,
+                       dt_dev_pixelpipe_iop_t *piece,
+                       const float *const in,
+                       float *const out,
+                       const size_t npixels)
+{
+  const dt_iop_channelmixer_rbg_data_t *const data =
+    (dt_iop_channelmixer_rbg_data_t *)piece->data;
+  _process_pixels(data, data->RGB_to_XYZ, data->XYZ_to_RGB, in, out, npixels, FALSE);
+}
+
 #if HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self,
                dt_dev_pixelpipe_iop_t *piece,
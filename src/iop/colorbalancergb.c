@@ -159,6 +159,9 @@ typedef struct dt_iop_colorbalancergb_data_t
   size_t checker_size;
   gboolean lut_inited;
   struct dt_iop_order_iccprofile_info_t *work_profile;
+  // set up per run for process_pointwise()
+  dt_colormatrix_t input_matrix_trans, output_matrix_trans;
+  gboolean have_matrices;
 } dt_iop_colorbalancergb_data_t;
 
 typedef struct dt_iop_colorbalance_global_data_t
@@ -189,7 +192,8 @@ const char **description(struct dt_iop_module_t *self)
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING
+         | IOP_FLAGS_ALLOW_STRIPES | IOP_FLAGS_CACHE_HALF_FLOAT;
 }
 
 int default_group()
@@ -625,19 +629,15 @@ static inline float lookup_gamut(const float *const gamut_lut, const float x)
   return y_prev + ((xi != xii) ? (x_test - x_prev) * (gamut_lut[xii] - y_prev) : 0.0f);
 }
 
-void process(struct dt_iop_module_t *self,
-             dt_dev_pixelpipe_iop_t *piece,
-             const void *const ivoid,
-             void *const ovoid,
-             const dt_iop_roi_t *const roi_in,
-             const dt_iop_roi_t *const roi_out)
+// premultiplied input and output matrices for the pipe's work profile, FALSE if there is none
+static gboolean _work_profile_matrices(struct dt_iop_module_t *self,
+                                       dt_dev_pixelpipe_iop_t *piece,
+                                       dt_colormatrix_t input_matrix_trans,
+                                       dt_colormatrix_t output_matrix_trans)
 {
-  dt_iop_colorbalancergb_data_t *d = (dt_iop_colorbalancergb_data_t *)piece->data;
-  dt_iop_colorbalancergb_gui_data_t *g = (dt_iop_colorbalancergb_gui_data_t *)self->gui_data;
   const struct dt_iop_order_iccprofile_info_t *const work_profile
       = dt_ioppr_get_pipe_current_profile_info(self, piece->pipe);
-  if(work_profile == NULL) return; // no point
-
+  if(work_profile == NULL) return FALSE;
 
   // work profile can't be fetched in commit_params since it is not yet initialised
   // work_profile->matrix_in === RGB_to_XYZ
@@ -663,7 +663,6 @@ void process(struct dt_iop_module_t *self,
 
   dt_colormatrix_mul(output_matrix, XYZ_D50_to_D65_CAT16, work_profile->matrix_in); // output_matrix used as temp buffer
   dt_colormatrix_mul(input_matrix, XYZ_D65_to_LMS_2006_D65, output_matrix);
-  dt_colormatrix_t input_matrix_trans;
   dt_colormatrix_transpose(input_matrix_trans, input_matrix);
 
   // Premultiply the output matrix
@@ -674,11 +673,23 @@ void process(struct dt_iop_module_t *self,
   */
 
   dt_colormatrix_mul(output_matrix, work_profile->matrix_out, XYZ_D65_to_D50_CAT16);
-  dt_colormatrix_t output_matrix_trans;
   dt_colormatrix_transpose(output_matrix_trans, output_matrix);
+  return TRUE;
+}
 
-  const float *const restrict in = DT_IS_ALIGNED(((const float *const restrict)ivoid));
-  float *const restrict out = DT_IS_ALIGNED(((float *const restrict)ovoid));
+// in and out may be the same buffer. parallel is FALSE for the chunks of a fused run,
+// which are processed from several threads already and should stay in cache.
+static inline void _process_pixels(const dt_iop_colorbalancergb_data_t *const d,
+                                   const dt_iop_colorbalancergb_gui_data_t *const g,
+                                   const dt_colormatrix_t input_matrix_trans,
+                                   const dt_colormatrix_t output_matrix_trans,
+                                   const float *const in,
+                                   float *const out,
+                                   const size_t npixels,
+                                   const size_t out_width,
+                                   const gboolean mask_display,
+                                   const gboolean parallel)
+{
   const float *const restrict gamut_LUT = DT_IS_ALIGNED(((const float *const restrict)d->gamut_LUT));
 
   const float *const restrict global = DT_IS_ALIGNED_PIXEL((const float *const restrict)d->global);
@@ -690,10 +701,6 @@ void process(struct dt_iop_module_t *self,
   const float *const restrict saturation = DT_IS_ALIGNED_PIXEL((const float *const restrict)d->saturation);
   const float *const restrict brilliance = DT_IS_ALIGNED_PIXEL((const float *const restrict)d->brilliance);
 
-  const gint mask_display
-      = ((piece->pipe->type & DT_DEV_PIXELPIPE_FULL) && self->dev->gui_attached
-         && g && g->mask_display);
-
   // pixel size of the checker background
   const size_t checker_1 = (mask_display) ? DT_PIXEL_APPLY_DPI(d->checker_size) : 0;
   const size_t checker_2 = 2 * checker_1;
@@ -705,10 +712,7 @@ void process(struct dt_iop_module_t *self,
     { sinf(d->hue_angle),  cosf(d->hue_angle) },
   };
 
-  const size_t npixels = (size_t)roi_out->height * roi_out->width;
-  const size_t out_width = roi_out->width;
-
-  DT_OMP_FOR()
+  DT_OMP_FOR(if(parallel))
   for(size_t k  = 0; k < 4 * npixels; k += 4)
   {
     // clip pipeline RGB
@@ -987,9 +991,65 @@ void process(struct dt_iop_module_t *self,
     {
       dt_vector_clipneg(pix_out);
     }
-    copy_pixel_nontemporal(out + k, pix_out);
+    if(parallel)
+      copy_pixel_nontemporal(out + k, pix_out);
+    else
+      copy_pixel(out + k, pix_out);
+  }
+  if(parallel)
+    dt_omploop_sfence();	// ensure all nontemporal writes complete before we use them
+}
+
+void process(struct dt_iop_module_t *self,
+             dt_dev_pixelpipe_iop_t *piece,
+             const void *const ivoid,
+             void *const ovoid,
+             const dt_iop_roi_t *const roi_in,
+             const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_colorbalancergb_data_t *d = (dt_iop_colorbalancergb_data_t *)piece->data;
+  dt_iop_colorbalancergb_gui_data_t *g = (dt_iop_colorbalancergb_gui_data_t *)self->gui_data;
+
+  dt_colormatrix_t input_matrix_trans;
+  dt_colormatrix_t output_matrix_trans;
+  if(!_work_profile_matrices(self, piece, input_matrix_trans, output_matrix_trans))
+    return; // no point
+
+  const float *const restrict in = DT_IS_ALIGNED(((const float *const restrict)ivoid));
+  float *const restrict out = DT_IS_ALIGNED(((float *const restrict)ovoid));
+
+  const gint mask_display
+      = ((piece->pipe->type & DT_DEV_PIXELPIPE_FULL) && self->dev->gui_attached
+         && g && g->mask_display);
+
+  _process_pixels(d, g, input_matrix_trans, output_matrix_trans, in, out,
+                  (size_t)roi_out->height * roi_out->width, roi_out->width,
+                  mask_display, TRUE);
+}
+
+void process_pointwise_setup(struct dt_iop_module_t *self,
+                             dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_iop_colorbalancergb_data_t *d = (dt_iop_colorbalancergb_data_t *)piece->data;
+  d->have_matrices = _work_profile_matrices(self, piece, d->input_matrix_trans,
+                                            d->output_matrix_trans);
+}
+
+void process_pointwise(struct dt_iop_module_t *self,
+                       dt_dev_pixelpipe_iop_t *piece,
+                       const float *const in,
+                       float *const out,
+                       const size_t npixels)
+{
+  const dt_iop_colorbalancergb_data_t *const d = (dt_iop_colorbalancergb_data_t *)piece->data;
+  if(!d->have_matrices)
+  {
+    if(in != out) memcpy(out, in, sizeof(float) * 4 * npixels);
+    return;
   }
-  dt_omploop_sfence();	// ensure all nontemporal writes complete before we use them
+  // the mask is only displayed in the darkroom, which doesn't fuse modules
+  _process_pixels(d, NULL, d->input_matrix_trans, d->output_matrix_trans, in, out,
+                  npixels, 0, FALSE, FALSE);
 }
 
 
@@ -24,8 +24,10 @@
 #include "common/iop_profile.h"
 #include "common/colormatrices.c"
 #include "common/colorspaces.h"
+#include "common/colormatrix_simd.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/image_cache.h"
+#include "common/lut.h"
 #include "common/opencl.h"
 #include "control/control.h"
 #include "develop/develop.h"
@@ -144,7 +146,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ALLOW_STRIPES | IOP_FLAGS_ONE_INSTANCE
+         | IOP_FLAGS_CACHE_HALF_FLOAT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -606,46 +609,14 @@ static void _workicc_changed(GtkWidget *widget, gpointer user_data)
 static const dt_aligned_pixel_t zero = { 0.0f, 0.0f, 0.0f, 0.0f };
 static const dt_aligned_pixel_t one = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-static float lerp_lut(const float *const lut, const float v)
-{
-  // TODO: check if optimization is worthwhile!
-  const float ft = CLAMPS(v * (LUT_SAMPLES - 1), 0, LUT_SAMPLES - 1);
-  const int t = ft < LUT_SAMPLES - 2 ? ft : LUT_SAMPLES - 2;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-
-// call only if sure that v<1.0
-//TODO: dedup this and colorout.c
-static inline float _lerp_lut(const float *const lut, const float v)
-{
-  const float z = MAX(v,0.0f);  // clip away negatives
-  const float ft = z * (LUT_SAMPLES - 1);
-  // because v<1.0, ft must be less than (LUT_SAMPLES-1), so truncating
-  // will set t <= (LUT_SAMPLES-2) and thus we don't need to clamp it
-  // to avoid an array overrun
-  const int t = (int)ft;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-
 static inline void _apply_tone_curves(dt_aligned_pixel_t pixel,
                                       const dt_iop_colorin_data_t *const d)
 {
   // assures unbounded color management without extrapolation.  Should not be called
   // for linear profiles, as there is no need to apply a tone curve to them.
   for(int c = 0; c < 3; c++)
-    if (d->lut[c][0] >= 0.0f)
-    {
-      if(__builtin_expect(pixel[c] < 1.0f, 1))
-        pixel[c] = _lerp_lut(d->lut[c], pixel[c]);
-      else
-        pixel[c] = dt_iop_eval_exp(d->unbounded_coeffs[c], pixel[c]);
-    }
+    if(d->lut[c][0] >= 0.0f)
+      pixel[c] = dt_lut_lookup_1d_unbounded(d->lut[c], d->unbounded_coeffs[c], pixel[c], LUT_SAMPLES);
 }
 
 #ifdef HAVE_OPENCL
@@ -816,9 +787,7 @@ static void _process_cmatrix_bm(struct dt_iop_module_t *self,
     // extrapolation.
     for(int c = 0; c < 3; c++)
       cam[c] = (d->lut[c][0] >= 0.0f)
-        ? ((in[c] < 1.0f)
-           ? _lerp_lut(d->lut[c], in[c])
-           : dt_iop_eval_exp(d->unbounded_coeffs[c], in[c]))
+        ? dt_lut_lookup_1d_unbounded(d->lut[c], d->unbounded_coeffs[c], in[c], LUT_SAMPLES)
         : in[c];
     cam[3] = 0.0f; // avoid uninitialized-variable warning
 
@@ -929,6 +898,35 @@ static inline void _cmatrix_fastpath_clipping(float *const restrict out,
   }
 }
 
+// the AVX2 and AVX-512 versions of the matrix paths below, returns FALSE if the cpu has none
+static gboolean _process_cmatrix_simd(const dt_iop_colorin_data_t *const d,
+                                      float *const restrict out,
+                                      const float *const restrict in,
+                                      const size_t npixels,
+                                      const gboolean tonecurves,
+                                      const dt_aligned_pixel_t corr)
+{
+  if(!dt_colormatrix_simd_available()) return FALSE;
+
+  const gboolean clipping = (d->nrgb != NULL);
+  dt_colormatrix_curves_t curves = { .lutsize = LUT_SAMPLES };
+  for(int c = 0; c < 3; c++)
+  {
+    curves.lut[c] = d->lut[c][0] >= 0.0f ? d->lut[c] : NULL;
+    curves.coeffs[c] = d->unbounded_coeffs[c];
+  }
+
+  const size_t nthreads = dt_get_num_threads();
+  const size_t chunksize = dt_cacheline_chunks(npixels, nthreads);
+  DT_OMP_FOR()
+  for(size_t start = 0; start < npixels; start += chunksize)
+    dt_colormatrix_simd_rgb_to_Lab(out + 4 * start, in + 4 * start, MIN(chunksize, npixels - start), corr,
+                                   tonecurves ? &curves : NULL,
+                                   clipping ? d->nmatrix : NULL,
+                                   clipping ? d->lmatrix : d->cmatrix);
+  return TRUE;
+}
+
 static void process_cmatrix_fastpath(struct dt_iop_module_t *self,
                                      dt_dev_pixelpipe_iop_t *piece,
                                      const void *const ivoid,
@@ -945,6 +943,9 @@ static void process_cmatrix_fastpath(struct dt_iop_module_t *self,
   const float *const restrict in = (float*)ivoid;
   float *const restrict  out = (float*)ovoid;
 
+  if(_process_cmatrix_simd(d, out, in, npixels, FALSE, corr))
+    return;
+
   // figure out the number of pixels each thread needs to process,
   // rounded up to a multiple of the CPU's cache line size
 #ifdef _OPENMP
@@ -1071,6 +1072,9 @@ static void process_cmatrix_proper(struct dt_iop_module_t *self,
   const float *const restrict in = (float*)ivoid;
   float *const restrict  out = (float*)ovoid;
 
+  if(_process_cmatrix_simd(d, out, in, npixels, TRUE, corr))
+    return;
+
   // figure out the number of pixels each thread needs to process,
   // rounded up to a multiple of the CPU's cache line size
 #ifdef _OPENMP
@@ -1586,10 +1590,10 @@ void commit_params(struct dt_iop_module_t *self,
       d->nonlinearlut = TRUE;
 
       const float x[4] = { 0.7f, 0.8f, 0.9f, 1.0f };
-      const float y[4] = { lerp_lut(d->lut[k], x[0]),
-                           lerp_lut(d->lut[k], x[1]),
-                           lerp_lut(d->lut[k], x[2]),
-                           lerp_lut(d->lut[k], x[3]) };
+      const float y[4] = { dt_lut_lookup_1d(d->lut[k], x[0], LUT_SAMPLES),
+                           dt_lut_lookup_1d(d->lut[k], x[1], LUT_SAMPLES),
+                           dt_lut_lookup_1d(d->lut[k], x[2], LUT_SAMPLES),
+                           dt_lut_lookup_1d(d->lut[k], x[3], LUT_SAMPLES) };
       dt_iop_estimate_exp(x, y, 4, d->unbounded_coeffs[k]);
     }
     else
@@ -20,11 +20,13 @@
 #include "config.h"
 #endif
 #include "bauhaus/bauhaus.h"
+#include "common/colormatrix_simd.h"
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/dttypes.h"
 #include "common/imagebuf.h"
 #include "common/iop_profile.h"
+#include "common/lut.h"
 #include "common/opencl.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -100,7 +102,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ALLOW_STRIPES | IOP_FLAGS_ONE_INSTANCE
+         | IOP_FLAGS_CACHE_HALF_FLOAT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -289,34 +292,6 @@ static void _signal_profile_changed(gpointer instance, gpointer user_data)
   dt_dev_reprocess_center(dev);
 }
 
-#if 1
-static float lerp_lut(const float *const lut, const float v)
-{
-  // TODO: check if optimization is worthwhile!
-  const float ft = CLAMPS(v * (LUT_SAMPLES - 1), 0, LUT_SAMPLES - 1);
-  const int t = ft < LUT_SAMPLES - 2 ? ft : LUT_SAMPLES - 2;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-#endif
-
-// call only if sure that v<1.0
-static float _lerp_lut(const float *const lut, const float v)
-{
-  const float z = MAX(v,0.0f);  // clip away negatives
-  const float ft = z * (LUT_SAMPLES - 1);
-  // because v<1.0, ft must be less than (LUT_SAMPLES-1), so truncating
-  // will set t <= (LUT_SAMPLES-2) and thus we don't need to clamp it
-  // to avoid an array overrun
-  const int t = (int)ft;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -380,34 +355,13 @@ static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self,
     float *const restrict out = (float *const)ovoid;
     // out is already converted to RGB from Lab.
 
-    // do we have any lut to apply, or is this a linear profile?
-    if((d->lut[0][0] >= 0.0f) && (d->lut[1][0] >= 0.0f) && (d->lut[2][0] >= 0.0f))
-    { // apply profile
-      DT_OMP_FOR()
-      for(size_t k = 0; k < 4 * npixels; k += 4)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          out[k + c] = (out[k + c] < 1.0f) ? _lerp_lut(d->lut[c], out[k + c])
-                                           : dt_iop_eval_exp(d->unbounded_coeffs[c], out[k + c]);
-        }
-      }
-    }
-    else if((d->lut[0][0] >= 0.0f) || (d->lut[1][0] >= 0.0f) || (d->lut[2][0] >= 0.0f))
-    { // apply profile
-      DT_OMP_FOR()
-      for(size_t k = 0; k < 4 * npixels; k += 4)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          if(d->lut[c][0] >= 0.0f)
-          {
-            out[k + c] = (out[k + c] < 1.0f) ? _lerp_lut(d->lut[c], out[k + c])
-                                             : dt_iop_eval_exp(d->unbounded_coeffs[c], out[k + c]);
-          }
-        }
-      }
-    }
+    // apply the curves of the non-linear channels, linear profiles are marked by negative entries
+    const float *const lut[3] = { d->lut[0][0] >= 0.0f ? d->lut[0] : NULL,
+                                  d->lut[1][0] >= 0.0f ? d->lut[1] : NULL,
+                                  d->lut[2][0] >= 0.0f ? d->lut[2] : NULL };
+    const float *const coeffs[3] = { d->unbounded_coeffs[0], d->unbounded_coeffs[1], d->unbounded_coeffs[2] };
+    if(lut[0] || lut[1] || lut[2])
+      dt_lut_apply_1d(out, out, npixels, lut, coeffs, LUT_SAMPLES);
   }
 }
 
@@ -458,31 +412,50 @@ static void _transform_cmatrix_tonecurve(const dt_iop_colorout_data_t *const d,
     dt_aligned_pixel_t rgb; // using an aligned temporary variable lets the compiler optimize away interm. writes
     dt_Lab_to_linearRGB(in + 4*k, cmatrix_0, cmatrix_1, cmatrix_2, rgb);
     if(lut[0] >= 0.0f)
-    {
-      rgb[0] = (rgb[0] < 1.0f) ? _lerp_lut(lut, rgb[0])
-        : dt_iop_eval_exp(coeffs, rgb[0]);
-    }
+      rgb[0] = dt_lut_lookup_1d_unbounded(lut, coeffs, rgb[0], LUT_SAMPLES);
     if(lut[LUT_SAMPLES] >= 0.0f)
-    {
-      rgb[1] = (rgb[1] < 1.0f) ? _lerp_lut(lut+LUT_SAMPLES, rgb[1])
-        : dt_iop_eval_exp(coeffs+3, rgb[1]);
-    }
+      rgb[1] = dt_lut_lookup_1d_unbounded(lut + LUT_SAMPLES, coeffs + 3, rgb[1], LUT_SAMPLES);
     if(lut[2*LUT_SAMPLES] >= 0.0f)
-    {
-      rgb[2] = (rgb[2] < 1.0f) ? _lerp_lut(lut+2*LUT_SAMPLES, rgb[2])
-        : dt_iop_eval_exp(coeffs+6, rgb[2]);
-    }
+      rgb[2] = dt_lut_lookup_1d_unbounded(lut + 2*LUT_SAMPLES, coeffs + 6, rgb[2], LUT_SAMPLES);
     copy_pixel_nontemporal(out + 4*k, rgb);
   }
   dt_omploop_sfence();
 }
 
+// the AVX2 and AVX-512 kernels apply the tone curves in the same pass as the matrix
+static gboolean _transform_cmatrix_simd(const dt_iop_colorout_data_t *const d,
+                                        float *restrict out,
+                                        const float *restrict in,
+                                        const size_t npixels,
+                                        const gboolean is_linear)
+{
+  if(!dt_colormatrix_simd_available()) return FALSE;
+
+  dt_colormatrix_curves_t curves = { .lutsize = LUT_SAMPLES };
+  for(int c = 0; c < 3; c++)
+  {
+    curves.lut[c] = d->lut[c];
+    curves.coeffs[c] = d->unbounded_coeffs[c];
+  }
+
+  const size_t nthreads = dt_get_num_threads();
+  const size_t chunksize = dt_cacheline_chunks(npixels, nthreads);
+  DT_OMP_FOR()
+  for(size_t start = 0; start < npixels; start += chunksize)
+    dt_colormatrix_simd_Lab_to_rgb(out + 4 * start, in + 4 * start, MIN(chunksize, npixels - start),
+                                   d->cmatrix, is_linear ? NULL : &curves);
+  return TRUE;
+}
+
 static int _transform_cmatrix(const dt_iop_colorout_data_t *const d,
                                float *restrict out,
                                const float *restrict in,
                                const size_t npixels)
 {
   const gboolean is_linear = (d->lut[0][0] < 0.0f) || (d->lut[1][0] < 0.0f) || (d->lut[2][0] < 0.0f);
+  if(_transform_cmatrix_simd(d, out, in, npixels, is_linear))
+    return TRUE;
+
 //  const gboolean all_nonlin = (d->lut[0][0] >= 0.0f) || (d->lut[1][0] >= 0.0f) || (d->lut[2][0] >= 0.0f);
   if(is_linear || 1) //TODO: integrate tonecurve in same pass as color matrix without major speed penalty
   {
@@ -751,10 +724,10 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     if(d->lut[k][0] >= 0.0f)
     {
       const float x[4] = { 0.7f, 0.8f, 0.9f, 1.0f };
-      const float y[4] = { lerp_lut(d->lut[k], x[0]),
-                           lerp_lut(d->lut[k], x[1]),
-                           lerp_lut(d->lut[k], x[2]),
-                           lerp_lut(d->lut[k], x[3]) };
+      const float y[4] = { dt_lut_lookup_1d(d->lut[k], x[0], LUT_SAMPLES),
+                           dt_lut_lookup_1d(d->lut[k], x[1], LUT_SAMPLES),
+                           dt_lut_lookup_1d(d->lut[k], x[2], LUT_SAMPLES),
+                           dt_lut_lookup_1d(d->lut[k], x[3], LUT_SAMPLES) };
       dt_iop_estimate_exp(x, y, 4, d->unbounded_coeffs[k]);
     }
     else
@@ -110,7 +110,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_DEPRECATED | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_PREVIEW_NON_OPENCL;
+  return IOP_FLAGS_DEPRECATED | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_PREVIEW_NON_OPENCL
+         | IOP_FLAGS_IMAGE_STATISTICS;
 }
 
 const char *deprecated_msg()
@@ -97,6 +97,14 @@ int flags()
   return IOP_FLAGS_SUPPORTS_BLENDING;
 }
 
+gboolean image_statistics(struct dt_iop_module_t *self,
+                          dt_dev_pixelpipe_iop_t *piece)
+{
+  // the threshold is relative to the average edge chroma of the whole input
+  const dt_iop_defringe_data_t *d = (dt_iop_defringe_data_t *)piece->data;
+  return d->op_mode == MODE_GLOBAL_AVERAGE;
+}
+
 const char *deprecated_msg()
 {
   return _("this module is deprecated. please use the chromatic aberration module instead.");
@@ -19,6 +19,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/colorspaces.h"
 #include "common/darktable.h"
+#include "common/demosaic_simd.h"
 #include "common/interpolation.h"
 #include "common/opencl.h"
 #include "common/image_cache.h"
@@ -758,6 +759,32 @@ void process(
     color_smoothing(o, roi_out, data->color_smoothing);
 }
 
+gboolean mosaic_stripes(struct dt_iop_module_t *self,
+                        dt_dev_pixelpipe_iop_t *piece,
+                        const dt_iop_roi_t *const roi_out)
+{
+  // rcd and ppg only need the overlap from tiling_callback around each stripe, green
+  // equilibration, color smoothing, dual demosaicing and the detail mask work on the
+  // whole image.
+  const dt_iop_demosaic_data_t *d = (dt_iop_demosaic_data_t *)piece->data;
+  const dt_image_t *img = &self->dev->image_storage;
+  return (d->demosaicing_method == DT_IOP_DEMOSAIC_RCD
+          || d->demosaicing_method == DT_IOP_DEMOSAIC_PPG)
+    && d->green_eq == DT_IOP_GREEN_EQ_NO
+    && d->color_smoothing == DT_DEMOSAIC_SMOOTH_OFF
+    && !(img->flags & DT_IMAGE_4BAYER)
+    && !piece->pipe->want_detail_mask
+    && (demosaic_qual_flags(piece, img, roi_out) & DT_DEMOSAIC_FULL_SCALE);
+}
+
+gboolean image_statistics(struct dt_iop_module_t *self,
+                          dt_dev_pixelpipe_iop_t *piece)
+{
+  // full average green equilibration scales by the green ratio of the whole input
+  const dt_iop_demosaic_data_t *d = (dt_iop_demosaic_data_t *)piece->data;
+  return d->green_eq == DT_IOP_GREEN_EQ_FULL || d->green_eq == DT_IOP_GREEN_EQ_BOTH;
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(
         struct dt_iop_module_t *self,
@@ -27,6 +27,7 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "common/math.h"
+#include "common/demosaic_simd.h"
 
 extern "C" {
 
@@ -215,6 +216,9 @@ void amaze_demosaic(dt_dev_pixelpipe_iop_t *piece,
     float v;
   } s_hv;
 
+  // the explicitly vectorized kernels do the bulk of the rows, the plain loops below finish them
+  const bool simd = dt_demosaic_simd_available();
+
   DT_OMP_PRAGMA(parallel)
   {
     constexpr int cldf = 2; // factor to multiply cache line distance. 1 = 64 bytes, 2 = 128 bytes ...
@@ -405,7 +409,11 @@ void amaze_demosaic(dt_dev_pixelpipe_iop_t *piece,
 
 // horizontal and vertical gradients
         for(int rr = 2; rr < rr1 - 2; rr++)
-          for(int cc = 2, indx = (rr)*ts + cc; cc < cc1 - 2; cc++, indx++)
+        {
+          const int indx0 = rr * ts + 2;
+          const int done = simd ? dt_amaze_simd_gradients(dirwts0 + indx0, dirwts1 + indx0, delhvsqsum + indx0,
+                                                          cfa + indx0, cc1 - 4, v1) : 0;
+          for(int cc = 2 + done, indx = (rr)*ts + cc; cc < cc1 - 2; cc++, indx++)
           {
             const float delh = fabsf(cfa[indx + 1] - cfa[indx - 1]);
             const float delv = fabsf(cfa[indx + v1] - cfa[indx - v1]);
@@ -414,6 +422,7 @@ void amaze_demosaic(dt_dev_pixelpipe_iop_t *piece,
             dirwts1[indx] = eps + fabsf(cfa[indx + 2] - cfa[indx]) + fabsf(cfa[indx] - cfa[indx - 2]) + delh;
             delhvsqsum[indx] = sqrf(delh) + sqrf(delv);
           }
+        }
 
 // interpolate vertical and horizontal colour differences
 
@@ -421,7 +430,14 @@ void amaze_demosaic(dt_dev_pixelpipe_iop_t *piece,
         {
           bool fcswitch = FC(rr, 4, filters) & 1;
 
-          for(int cc = 4, indx = rr * ts + cc; cc < cc1 - 4; cc++, indx++)
+          // the kernels do whole vectors, an even number of sensels, so fcswitch stays as it is
+          const int indx0 = rr * ts + 4;
+          const int done = simd ? dt_amaze_simd_color_diffs(vcd + indx0, hcd + indx0, vcdalt + indx0, hcdalt + indx0,
+                                                            dgintv + indx0, dginth + indx0, cfa + indx0,
+                                                            dirwts0 + indx0, dirwts1 + indx0, cc1 - 8, v1,
+                                                            fcswitch, clip_pt8) : 0;
+
+          for(int cc = 4 + done, indx = rr * ts + cc; cc < cc1 - 4; cc++, indx++)
           {
 
             // colour ratios in each cardinal direction
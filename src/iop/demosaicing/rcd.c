@@ -296,7 +296,10 @@ static void rcd_demosaic(
   const int num_vertical = 1 + (height - 2 * RCD_BORDER -1) / RCD_TILEVALID;
   const int num_horizontal = 1 + (width - 2 * RCD_BORDER -1) / RCD_TILEVALID;
 
-  DT_OMP_PRAGMA(parallel firstprivate(width, height, filters, out, in, scaler, revscaler))
+  // the explicitly vectorized kernels do the bulk of the rows, the plain loops below finish them
+  const gboolean simd = dt_demosaic_simd_available();
+
+  DT_OMP_PRAGMA(parallel firstprivate(width, height, filters, out, in, scaler, revscaler, simd))
   {
     float *const VH_Dir = dt_alloc_align_float((size_t) DT_RCD_TILESIZE * DT_RCD_TILESIZE);
     // ensure that border elements which are read but never actually set below are zeroed out
@@ -349,7 +352,8 @@ static void rcd_demosaic(
         // Step 1.1: Calculate the square of the vertical and horizontal color difference high pass filter
         for(int row = 3; row < MIN(tileRows - 3, 5); row++ )
         {
-          for(int col = 4, indx = row * DT_RCD_TILESIZE + col; col < tileCols - 4; col++, indx++ )
+          const int done = simd ? dt_rcd_simd_hpf(bufferV[row - 3], cfa + row * DT_RCD_TILESIZE + 4, tileCols - 8, w1) : 0;
+          for(int col = 4 + done, indx = row * DT_RCD_TILESIZE + col; col < tileCols - 4; col++, indx++ )
           {
             bufferV[row - 3][col - 4] = sqrf((cfa[indx - w3] - cfa[indx - w1] - cfa[indx + w1] + cfa[indx + w3]) - 3.0f * (cfa[indx - w2] + cfa[indx + w2]) + 6.0f * cfa[indx]);
           }
@@ -365,15 +369,18 @@ static void rcd_demosaic(
         float* V2 = bufferV[2];
         for(int row = 4; row < tileRows - 4; row++ )
         {
-          for(int col = 3, indx = row * DT_RCD_TILESIZE + col; col < tileCols - 3; col++, indx++)
+          const int doneH = simd ? dt_rcd_simd_hpf(bufferH, cfa + row * DT_RCD_TILESIZE + 3, tileCols - 6, 1) : 0;
+          for(int col = 3 + doneH, indx = row * DT_RCD_TILESIZE + col; col < tileCols - 3; col++, indx++)
           {
             bufferH[col - 3] = sqrf((cfa[indx -  3] - cfa[indx -  1] - cfa[indx +  1] + cfa[indx +  3]) - 3.0f * (cfa[indx -  2] + cfa[indx +  2]) + 6.0f * cfa[indx]);
           }
-          for(int col = 4, indx = (row + 1) * DT_RCD_TILESIZE + col; col < tileCols - 4; col++, indx++)
+          const int doneV = simd ? dt_rcd_simd_hpf(V2, cfa + (row + 1) * DT_RCD_TILESIZE + 4, tileCols - 8, w1) : 0;
+          for(int col = 4 + doneV, indx = (row + 1) * DT_RCD_TILESIZE + col; col < tileCols - 4; col++, indx++)
           {
             V2[col - 4] = sqrf((cfa[indx - w3] - cfa[indx - w1] - cfa[indx + w1] + cfa[indx + w3]) - 3.0f * (cfa[indx - w2] + cfa[indx + w2]) + 6.0f * cfa[indx]);
           }
-          for(int col = 4, indx = row * DT_RCD_TILESIZE + col; col < tileCols - 4; col++, indx++ )
+          const int doneVH = simd ? dt_rcd_simd_vh_dir(VH_Dir + row * DT_RCD_TILESIZE + 4, V0, V1, V2, bufferH, tileCols - 8) : 0;
+          for(int col = 4 + doneVH, indx = row * DT_RCD_TILESIZE + col; col < tileCols - 4; col++, indx++ )
           {
             const float V_Stat = fmaxf(epssq,      V0[col - 4] +      V1[col - 4] +      V2[col - 4]);
             const float H_Stat = fmaxf(epssq, bufferH[col - 4] + bufferH[col - 3] + bufferH[col - 2]);
@@ -399,7 +406,10 @@ static void rcd_demosaic(
         // Step 3.1: Populate the green channel at blue and red CFA positions
         for(int row = 4; row < tileRows - 4; row++)
         {
-          for(int col = 4 + (FC(row, 0, filters) & 1), indx = row * DT_RCD_TILESIZE + col, lpindx = indx / 2; col < tileCols - 4; col += 2, indx += 2, lpindx++)
+          const int col0 = 4 + (FC(row, 0, filters) & 1);
+          const int indx0 = row * DT_RCD_TILESIZE + col0;
+          const int done = simd ? dt_rcd_simd_green(rgb[1] + indx0, cfa + indx0, lpf + indx0 / 2, VH_Dir + indx0, (tileCols - 3 - col0) / 2, w1) : 0;
+          for(int col = col0 + 2 * done, indx = row * DT_RCD_TILESIZE + col, lpindx = indx / 2; col < tileCols - 4; col += 2, indx += 2, lpindx++)
           {
             const float cfai = cfa[indx];
 
@@ -455,7 +465,12 @@ static void rcd_demosaic(
         // Step 4.2: Populate the red and blue channels at blue and red CFA positions
         for(int row = 4; row < tileRows - 4; row++)
         {
-          for(int col = 4 + (FC(row, 0, filters) & 1), indx = row * DT_RCD_TILESIZE + col, c = 2 - FC(row, col, filters), pqindx = indx / 2, pqindx2 = (indx - w1 - 1) / 2, pqindx3 = (indx + w1 - 1) / 2; col < tileCols - 4; col += 2, indx += 2, pqindx++, pqindx2++, pqindx3++)
+          const int col0 = 4 + (FC(row, 0, filters) & 1);
+          const int indx0 = row * DT_RCD_TILESIZE + col0;
+          const int c0 = 2 - FC(row, col0, filters);
+          const int done = simd ? dt_rcd_simd_rb_at_rb(rgb[c0] + indx0, rgb[1] + indx0, PQ_Dir + indx0 / 2, PQ_Dir + (indx0 - w1 - 1) / 2,
+                                                       PQ_Dir + (indx0 + w1 - 1) / 2, (tileCols - 3 - col0) / 2, w1) : 0;
+          for(int col = col0 + 2 * done, indx = row * DT_RCD_TILESIZE + col, c = c0, pqindx = indx / 2, pqindx2 = (indx - w1 - 1) / 2, pqindx3 = (indx + w1 - 1) / 2; col < tileCols - 4; col += 2, indx += 2, pqindx++, pqindx2++, pqindx3++)
           {
             // Refined P/Q diagonal local discrimination
             const float PQ_Central_Value   = PQ_Dir[pqindx];
@@ -487,7 +502,10 @@ static void rcd_demosaic(
         // Step 4.3: Populate the red and blue channels at green CFA positions
         for(int row = 4; row < tileRows - 4; row++)
         {
-          for(int col = 4 + (FC(row, 1, filters) & 1), indx = row * DT_RCD_TILESIZE + col; col < tileCols - 4; col += 2, indx +=2)
+          const int col0 = 4 + (FC(row, 1, filters) & 1);
+          const int indx0 = row * DT_RCD_TILESIZE + col0;
+          const int done = simd ? dt_rcd_simd_rb_at_green(rgb[0] + indx0, rgb[2] + indx0, rgb[1] + indx0, VH_Dir + indx0, (tileCols - 3 - col0) / 2, w1) : 0;
+          for(int col = col0 + 2 * done, indx = row * DT_RCD_TILESIZE + col; col < tileCols - 4; col += 2, indx +=2)
           {
             // Refined vertical and horizontal local discrimination
             const float VH_Central_Value = VH_Dir[indx];
@@ -37,6 +37,37 @@ static inline const short *_hexmap(
   return allhex[irow % 3][icol % 3];
 }
 
+/** 5x5 sums of the homogeneity maps along one tile row. vsum keeps the
+    sums over the five rows around the current one from call to call,
+    so rows have to be handed in from top to bottom, restarting with
+    first at the top row. **/
+static inline void _homosum_row(
+        uint8_t (*const hsum)[TS],
+        uint8_t (*const vsum)[TS],
+        uint8_t (*const homo)[TS][TS],
+        const int ndir,
+        const int row,
+        const gboolean first,
+        const int col0,
+        const int col1)
+{
+  for(int d = 0; d < ndir; d++)
+  {
+    uint8_t *const vs = vsum[d];
+    // roll the column sums down by one row instead of summing up five
+    // rows, the largest sum of 5*9 fits a byte
+    if(first)
+      for(int col = col0 - 2; col < col1 + 2; col++)
+        vs[col] = homo[d][row - 2][col] + homo[d][row - 1][col] + homo[d][row][col]
+                  + homo[d][row + 1][col] + homo[d][row + 2][col];
+    else
+      for(int col = col0 - 2; col < col1 + 2; col++)
+        vs[col] += homo[d][row + 2][col] - homo[d][row - 3][col];
+    for(int col = col0; col < col1; col++)
+      hsum[d][col] = vs[col - 2] + vs[col - 1] + vs[col] + vs[col + 1] + vs[col + 2];
+  }
+}
+
 /*
    Frank Markesteijn's algorithm for Fuji X-Trans sensors
 */
@@ -61,6 +92,7 @@ static void xtrans_markesteijn_interpolate(
   const int width = roi_out->width;
   const int height = roi_out->height;
   const unsigned ndir = 4 << (passes > 1);
+  const gboolean simd = dt_demosaic_simd_available();
 
   const size_t buffer_size = (size_t)TS * TS * (ndir * 4 + 3) * sizeof(float);
   size_t padded_buffer_size;
@@ -118,11 +150,11 @@ static void xtrans_markesteijn_interpolate(
     // each points to a TSxTS tile of single channel data
     float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
     float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
-    // homo and homosum reuse memory which is used earlier in the
-    // loop; each points to ndir single-channel TSxTS tiles
+    // homo reuses memory which is used earlier in the loop, it points
+    // to ndir single-channel TSxTS tiles. the 5x5 sums of homo are
+    // only kept for the current row in homosum.
     uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    uint8_t (*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float)
-                                                            + TS * TS * ndir * sizeof(uint8_t));
+    uint8_t homosum[8][TS], homovsum[8][TS];
 
     for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile*2))
     {
@@ -444,49 +476,43 @@ static void xtrans_markesteijn_interpolate(
       }
 
       /* Build homogeneity maps from the derivatives:                   */
-      memset(homo, 0, sizeof(uint8_t) * ndir * TS * TS);
+      // the 5x5 sums below only read the maps within pad_homo, which
+      // is pad_tile - 2, so the border needs no clearing
       const int pad_homo = (passes == 1) ? 10 : 15;
       for(int row = pad_homo; row < mrow - pad_homo; row++)
-        for(int col = pad_homo; col < mcol - pad_homo; col++)
+      {
+        const int done = simd ? dt_markesteijn_simd_homogeneity(&homo[0][row][pad_homo], &drv[0][row][pad_homo],
+                                                                 ndir, mcol - 2 * pad_homo, TS, TS * TS)
+                              : 0;
+        for(int col = pad_homo + done; col < mcol - pad_homo; col++)
         {
           float tr = FLT_MAX;
           for(unsigned d = 0; d < ndir; ++d)
             if(tr > drv[d][row][col]) tr = drv[d][row][col];
           tr *= 8;
           for(unsigned d = 0; d < ndir; ++d)
+          {
+            uint8_t count = 0;
             for(int v = -1; v <= 1; v++)
               for(int h = -1; h <= 1; h++)
-                homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
-        }
-
-      /* Build 5x5 sum of homogeneity maps for each pixel & direction */
-      for(unsigned d = 0; d < ndir; ++d)
-        for(int row = pad_tile; row < mrow - pad_tile; row++)
-        {
-          // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
-          int col = pad_tile-5;
-          uint8_t v5sum[5] = { 0 };
-          homosum[d][row][col] = 0;
-          // calculate by rolling through column sums
-          for(col++; col < mcol - pad_tile; col++)
-          {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
+                count += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+            homo[d][row][col] = count;
           }
         }
+      }
 
       /* Average the most homogeneous pixels for the final result:       */
       for(int row = pad_tile; row < mrow - pad_tile; row++)
+      {
+        // 5x5 sum of homogeneity maps for each pixel & direction
+        _homosum_row(homosum, homovsum, homo, ndir, row, row == pad_tile, pad_tile, mcol - pad_tile);
         for(int col = pad_tile; col < mcol - pad_tile; col++)
         {
           uint8_t hm[8] = { 0 };
           uint8_t maxval = 0;
           for(unsigned d = 0; d < ndir; ++d)
           {
-            hm[d] = homosum[d][row][col];
+            hm[d] = homosum[d][col];
             maxval = (maxval < hm[d] ? hm[d] : maxval);
           }
           maxval -= maxval >> 3;
@@ -509,6 +535,7 @@ static void xtrans_markesteijn_interpolate(
           for(int c = 0; c < 3; c++)
             out[4 * (width * (row + top) + col + left) + c] = avg[c]/avg[3];
         }
+      }
     }
   }
   dt_free_align(all_buffers);
@@ -540,6 +567,7 @@ static void xtrans_fdc_interpolate(
   const int width = roi_out->width;
   const int height = roi_out->height;
   static const int ndir = 4;
+  const gboolean simd = dt_demosaic_simd_available();
 
   static const float complex Minv[3][8] = {
     { 1.000000e+00f, 2.500000e-01f - 4.330127e-01f * _Complex_I, -2.500000e-01f - 4.330127e-01f * _Complex_I,
@@ -1153,11 +1181,11 @@ static void xtrans_fdc_interpolate(
     // each points to a TSxTS tile of single channel data
     float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
     float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
-    // homo and homosum reuse memory which is used earlier in the
-    // loop; each points to ndir single-channel TSxTS tiles
+    // homo reuses memory which is used earlier in the loop, it points
+    // to ndir single-channel TSxTS tiles. the 5x5 sums of homo are
+    // only kept for the current row in homosum.
     uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    uint8_t (*const homosum)[TS][TS]
-        = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float) + TS * TS * ndir * sizeof(uint8_t));
+    uint8_t homosum[4][TS], homovsum[4][TS];
     // append all fdc related buffers
     float complex *fdc_buf_start = (float complex *)(buffer + TS * TS * (ndir * 4 + 3) * sizeof(float));
     const int fdc_buf_size = TS * TS;
@@ -1442,42 +1470,37 @@ static void xtrans_fdc_interpolate(
       }
 
       /* Build homogeneity maps from the derivatives:                   */
+      // the chroma below needs the 5x5 sums from pad_fdc on, further
+      // out than the maps are calculated, so clear the border
       memset(homo, 0, sizeof(uint8_t) * ndir * TS * TS);
       const int pad_homo = 10;
       for(int row = pad_homo; row < mrow - pad_homo; row++)
-        for(int col = pad_homo; col < mcol - pad_homo; col++)
+      {
+        const int done = simd ? dt_markesteijn_simd_homogeneity(&homo[0][row][pad_homo], &drv[0][row][pad_homo],
+                                                                 ndir, mcol - 2 * pad_homo, TS, TS * TS)
+                              : 0;
+        for(int col = pad_homo + done; col < mcol - pad_homo; col++)
         {
           float tr = FLT_MAX;
           for(int d = 0; d < ndir; d++)
             if(tr > drv[d][row][col]) tr = drv[d][row][col];
           tr *= 8;
           for(int d = 0; d < ndir; d++)
-            for(int v = -1; v <= 1; v++)
-              for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
-        }
-
-      /* Build 5x5 sum of homogeneity maps for each pixel & direction */
-      for(int d = 0; d < ndir; d++)
-        for(int row = pad_tile; row < mrow - pad_tile; row++)
-        {
-          // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
-          int col = pad_tile - 5;
-          uint8_t v5sum[5] = { 0 };
-          homosum[d][row][col] = 0;
-          // calculate by rolling through column sums
-          for(col++; col < mcol - pad_tile; col++)
           {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
+            uint8_t count = 0;
+            for(int v = -1; v <= 1; v++)
+              for(int h = -1; h <= 1; h++) count += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+            homo[d][row][col] = count;
           }
         }
+      }
 
       /* Calculate chroma values in fdc:       */
       const int pad_fdc = 6;
       for(int row = pad_fdc; row < mrow - pad_fdc; row++)
+      {
+        // 5x5 sum of homogeneity maps for each pixel & direction
+        _homosum_row(homosum, homovsum, homo, ndir, row, row == pad_fdc, pad_fdc, mcol - pad_fdc);
         for(int col = pad_fdc; col < mcol - pad_fdc; col++)
         {
           int myrow, mycol;
@@ -1485,7 +1508,7 @@ static void xtrans_fdc_interpolate(
           uint8_t maxval = 0;
           for(int d = 0; d < ndir; d++)
           {
-            hm[d] = homosum[d][row][col];
+            hm[d] = homosum[d][col];
             maxval = (maxval < hm[d] ? hm[d] : maxval);
           }
           maxval -= maxval >> 3;
@@ -1547,16 +1570,19 @@ static void xtrans_fdc_interpolate(
           uv[1] = (rgbpix[0] - y) * 0.67815f;
           for(int c = 0; c < 2; c++) *(fdc_chroma + c * TS * TS + row * TS + col) = uv[c];
         }
+      }
 
       /* Average the most homogeneous pixels for the final result:       */
       for(int row = pad_tile; row < mrow - pad_tile; row++)
+      {
+        _homosum_row(homosum, homovsum, homo, ndir, row, row == pad_tile, pad_tile, mcol - pad_tile);
         for(int col = pad_tile; col < mcol - pad_tile; col++)
         {
           uint8_t hm[8] = { 0 };
           uint8_t maxval = 0;
           for(int d = 0; d < ndir; d++)
           {
-            hm[d] = homosum[d][row][col];
+            hm[d] = homosum[d][col];
             maxval = (maxval < hm[d] ? hm[d] : maxval);
           }
           maxval -= maxval >> 3;
@@ -1626,6 +1652,7 @@ static void xtrans_fdc_interpolate(
           rgbpix[2] = y + 1.77201282937288f * uv[0];
           for(int c = 0; c < 3; c++) out[4 * (width * (row + top) + col + left) + c] = rgbpix[c];
         }
+      }
     }
   }
   dt_free_align(all_buffers);
@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "bauhaus/bauhaus.h"
+#include "common/lut.h"
 #include "common/math.h"
 #include "control/control.h"
 #include "develop/develop.h"
@@ -359,31 +360,6 @@ static void evaluate_grain_lut(float *grain_lut, const float mb)
   }
 }
 
-static float dt_lut_lookup_2d_1c(const float *grain_lut, const float x, const float y)
-{
-  const float _x = CLAMPS((x + 0.5f) * (GRAIN_LUT_SIZE - 1), 0, GRAIN_LUT_SIZE - 1);
-  const float _y = CLAMPS(y * (GRAIN_LUT_SIZE - 1), 0, GRAIN_LUT_SIZE - 1);
-
-  const int _x0 = _x < GRAIN_LUT_SIZE - 2 ? _x : GRAIN_LUT_SIZE - 2;
-  const int _y0 = _y < GRAIN_LUT_SIZE - 2 ? _y : GRAIN_LUT_SIZE - 2;
-
-  const int _x1 = _x0 + 1;
-  const int _y1 = _y0 + 1;
-
-  const float x_diff = _x - _x0;
-  const float y_diff = _y - _y0;
-
-  const float l00 = grain_lut[_y0 * GRAIN_LUT_SIZE + _x0];
-  const float l01 = grain_lut[_y0 * GRAIN_LUT_SIZE + _x1];
-  const float l10 = grain_lut[_y1 * GRAIN_LUT_SIZE + _x0];
-  const float l11 = grain_lut[_y1 * GRAIN_LUT_SIZE + _x1];
-
-  const float xy0 = (1.0f - y_diff) * l00 + l10 * y_diff;
-  const float xy1 = (1.0f - y_diff) * l01 + l11 * y_diff;
-  return xy0 * (1.0f - x_diff) + xy1 * x_diff;
-}
-
-
 const char *name()
 {
   return _("grain");
@@ -495,7 +471,9 @@ void process(struct dt_iop_module_t *self,
         noise = _simplex_2d_noise(x + hash, y, zoom);
       }
 
-      out[0] = in[0] + dt_lut_lookup_2d_1c(data->grain_lut, (noise * strength) * GRAIN_LIGHTNESS_STRENGTH_SCALE, in[0] / 100.0f);
+      out[0] = in[0] + dt_lut_lookup_2d(data->grain_lut, GRAIN_LUT_SIZE, GRAIN_LUT_SIZE,
+                                        (noise * strength) * GRAIN_LIGHTNESS_STRENGTH_SCALE + 0.5f,
+                                        in[0] / 100.0f);
       out[1] = in[1];
       out[2] = in[2];
 
@@ -836,6 +836,15 @@ void process(struct dt_iop_module_t *self,
   }
 }
 
+gboolean mosaic_stripes(struct dt_iop_module_t *self,
+                        dt_dev_pixelpipe_iop_t *piece,
+                        const dt_iop_roi_t *const roi_out)
+{
+  // only clipping works sensel by sensel, the reconstructing modes look around
+  const dt_iop_highlights_data_t *d = (dt_iop_highlights_data_t *)piece->data;
+  return d->mode == DT_IOP_HIGHLIGHTS_CLIP;
+}
+
 void commit_params(struct dt_iop_module_t *self,
                    dt_iop_params_t *p1,
                    dt_dev_pixelpipe_t *pipe,
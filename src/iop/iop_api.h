@@ -275,6 +275,29 @@ DEFAULT(void, process_tiling, struct dt_iop_module_t *self,
                               const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out,
                               const int bpp);
+/** per-pixel variant of process() for modules whose output pixel only depends on the
+ *  input pixel at the same position. The pixelpipe fuses runs of such modules and calls
+ *  this for chunks of npixels rgba pixels that stay in cache, from several threads at
+ *  once, so no OpenMP in here. in and out may be the same buffer. */
+OPTIONAL(void, process_pointwise, struct dt_iop_module_t *self,
+                                  struct dt_dev_pixelpipe_iop_t *piece,
+                                  const float *const in,
+                                  float *const out,
+                                  const size_t npixels);
+/** called once before the chunks of a fused run are processed, does everything process()
+ *  would do before the pixel loop, like updating piece->data or pipe->dsc. */
+OPTIONAL(void, process_pointwise_setup, struct dt_iop_module_t *self,
+                                        struct dt_dev_pixelpipe_iop_t *piece);
+/** returns TRUE if process() can work on any stripe of full rows of a bayer mosaic
+ *  starting on an even row, so the raw modules up to demosaic can be processed in cache
+ *  sized stripes. roi_out is the roi of the whole run. */
+OPTIONAL(gboolean, mosaic_stripes, struct dt_iop_module_t *self,
+                                   struct dt_dev_pixelpipe_iop_t *piece,
+                                   const struct dt_iop_roi_t *const roi_out);
+/** returns TRUE if the output depends on statistics of the whole input with the current
+ *  parameters, for modules doing so only in some modes. see IOP_FLAGS_IMAGE_STATISTICS. */
+OPTIONAL(gboolean, image_statistics, struct dt_iop_module_t *self,
+                                     struct dt_dev_pixelpipe_iop_t *piece);
 
 #ifdef HAVE_OPENCL
 /** the opencl equivalent of process().
@@ -124,7 +124,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_DEPRECATED;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_DEPRECATED | IOP_FLAGS_IMAGE_STATISTICS;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -26,6 +26,7 @@
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
 #include "common/iop_profile.h"
+#include "common/lut.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
 #include "dtgtk/button.h"
@@ -34,6 +35,7 @@
 #include "imageio/imageio_png.h"
 #include "iop/iop_api.h"
 
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <libgen.h>
 #include <png.h>
@@ -103,9 +105,22 @@ typedef enum dt_lut3d_cols_t
 
 const char invalid_filepath_prefix[] = "INVALID >> ";
 
+// a loaded clut, shared by all pipes using the same file
+typedef struct dt_iop_lut3d_clut_t
+{
+  dt_hash_t hash;   // of the source, see _clut_hash()
+  float *clut;
+  uint16_t level;
+  int users;
+} dt_iop_lut3d_clut_t;
+
+// unused cluts kept around, e.g. for the next export or when switching back and forth
+#define DT_IOP_LUT3D_CACHED_CLUTS 2
+
 typedef struct dt_iop_lut3d_data_t
 {
   dt_iop_lut3d_params_t params;
+  dt_iop_lut3d_clut_t *shared;
   float *clut;  // cube lut pointer
   uint16_t level; // cube_size
 } dt_iop_lut3d_data_t;
@@ -116,6 +131,8 @@ typedef struct dt_iop_lut3d_global_data_t
   int kernel_lut3d_trilinear;
   int kernel_lut3d_pyramid;
   int kernel_lut3d_none;
+  dt_pthread_mutex_t clut_lock;
+  GList *cluts; // dt_iop_lut3d_clut_t, most recently used first
 } dt_iop_lut3d_global_data_t;
 
 #ifdef HAVE_GMIC
@@ -229,225 +246,6 @@ int legacy_params(dt_iop_module_t *self,
 
   return 1;
 }
-// From `HaldCLUT_correct.c' by Eskil Steenberg (http://www.quelsolaar.com) (BSD licensed)
-void correct_pixel_trilinear(const float *const in, float *const out,
-                             const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
-{
-  const int level2 = level * level;
-
-  DT_OMP_FOR()
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    const float *const input = in + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3], i, j;
-    float tmp[6];
-    dt_aligned_pixel_t rgbd;
-
-    for_each_channel(c)
-      rgbd[c] = CLIP(input[c]) * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    i = color * 3;  // P000
-    j = (color + 1) * 3;  // P100
-
-    tmp[0] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[1] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[2] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    i = (color + level) * 3;  // P010
-    j = (color + level + 1) * 3;  //P110
-
-    tmp[3] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[4] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[5] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    output[0] = tmp[0] * (1 - rgbd[1]) + tmp[3] * rgbd[1];
-    output[1] = tmp[1] * (1 - rgbd[1]) + tmp[4] * rgbd[1];
-    output[2] = tmp[2] * (1 - rgbd[1]) + tmp[5] * rgbd[1];
-
-    i = (color + level2) * 3;  // P001
-    j = (color + level2 + 1) * 3;  // P101
-
-    tmp[0] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[1] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[2] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    i = (color + level + level2) * 3;  // P011
-    j = (color + level + level2 + 1) * 3;  // P111
-
-    tmp[3] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[4] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[5] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    tmp[0] = tmp[0] * (1 - rgbd[1]) + tmp[3] * rgbd[1];
-    tmp[1] = tmp[1] * (1 - rgbd[1]) + tmp[4] * rgbd[1];
-    tmp[2] = tmp[2] * (1 - rgbd[1]) + tmp[5] * rgbd[1];
-
-    output[0] = output[0] * (1 - rgbd[2]) + tmp[0] * rgbd[2];
-    output[1] = output[1] * (1 - rgbd[2]) + tmp[1] * rgbd[2];
-    output[2] = output[2] * (1 - rgbd[2]) + tmp[2] * rgbd[2];
- }
-}
-
-// from OpenColorIO
-// https://github.com/imageworks/OpenColorIO/blob/master/src/OpenColorIO/ops/Lut3D/Lut3DOp.cpp
-void correct_pixel_tetrahedral(const float *const in, float *const out,
-                               const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
-{
-  const int level2 = level * level;
-
-  DT_OMP_FOR()
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    const float *const input = in + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3];
-    dt_aligned_pixel_t rgbd;
-    for_each_channel(c)
-      rgbd[c] = CLIP(input[c]) * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if(rgbd[0] > rgbd[1])
-    {
-      if(rgbd[1] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[1])*clut[i100] + (rgbd[1]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[1])*clut[i100+1] + (rgbd[1]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[1])*clut[i100+2] + (rgbd[1]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-      else if(rgbd[0] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[2])*clut[i100] + (rgbd[2]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[2])*clut[i100+1] + (rgbd[2]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[2])*clut[i100+2] + (rgbd[2]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[0])*clut[i001] + (rgbd[0]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[0])*clut[i001+1] + (rgbd[0]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[0])*clut[i001+2] + (rgbd[0]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-    }
-    else
-    {
-      if(rgbd[2] > rgbd[1])
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[1])*clut[i001] + (rgbd[1]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[1])*clut[i001+1] + (rgbd[1]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[1])*clut[i001+2] + (rgbd[1]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else if(rgbd[2] > rgbd[0])
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[2])*clut[i010] + (rgbd[2]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[2])*clut[i010+1] + (rgbd[2]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[2])*clut[i010+2] + (rgbd[2]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[0])*clut[i010] + (rgbd[0]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[0])*clut[i010+1] + (rgbd[0]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[0])*clut[i010+2] + (rgbd[0]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-    }
-  }
-}
-
-// from Study on the 3D Interpolation Models Used in Color Conversion
-// http://ijetch.org/papers/318-T860.pdf
-void correct_pixel_pyramid(const float *const in, float *const out,
-                           const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
-{
-  const int level2 = level * level;
-
-  DT_OMP_FOR()
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    const float *const input = in + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3];
-    dt_aligned_pixel_t rgbd;
-    for_each_channel(c)
-      rgbd[c] = CLIP(input[c]) * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if(rgbd[1] > rgbd[0] && rgbd[2] > rgbd[0])
-    {
-      output[0] = clut[i000] + (clut[i111]-clut[i011])*rgbd[0] + (clut[i010]-clut[i000])*rgbd[1] + (clut[i001]-clut[i000])*rgbd[2]
-        + (clut[i011]-clut[i001]-clut[i010]+clut[i000])*rgbd[1]*rgbd[2];
-      output[1] = clut[i000+1] + (clut[i111+1]-clut[i011+1])*rgbd[0] + (clut[i010+1]-clut[i000+1])*rgbd[1] + (clut[i001+1]-clut[i000+1])*rgbd[2]
-        + (clut[i011+1]-clut[i001+1]-clut[i010+1]+clut[i000+1])*rgbd[1]*rgbd[2];
-      output[2] = clut[i000+2] + (clut[i111+2]-clut[i011+2])*rgbd[0] + (clut[i010+2]-clut[i000+2])*rgbd[1] + (clut[i001+2]-clut[i000+2])*rgbd[2]
-        + (clut[i011+2]-clut[i001+2]-clut[i010+2]+clut[i000+2])*rgbd[1]*rgbd[2];
-    }
-    else if(rgbd[0] > rgbd[1] && rgbd[2] > rgbd[1])
-    {
-      output[0] = clut[i000] + (clut[i100]-clut[i000])*rgbd[0] + (clut[i111]-clut[i101])*rgbd[1] + (clut[i001]-clut[i000])*rgbd[2]
-        + (clut[i101]-clut[i001]-clut[i100]+clut[i000])*rgbd[0]*rgbd[2];
-      output[1] = clut[i000+1] + (clut[i100+1]-clut[i000+1])*rgbd[0] + (clut[i111+1]-clut[i101+1])*rgbd[1] + (clut[i001+1]-clut[i000+1])*rgbd[2]
-        + (clut[i101+1]-clut[i001+1]-clut[i100+1]+clut[i000+1])*rgbd[0]*rgbd[2];
-      output[2] = clut[i000+2] + (clut[i100+2]-clut[i000+2])*rgbd[0] + (clut[i111]-clut[i101+2])*rgbd[1] + (clut[i001+2]-clut[i000+2])*rgbd[2]
-        + (clut[i101+2]-clut[i001+2]-clut[i100+2]+clut[i000+2])*rgbd[0]*rgbd[2];
-    }
-    else
-    {
-      output[0] = clut[i000] + (clut[i100]-clut[i000])*rgbd[0] + (clut[i010]-clut[i000])*rgbd[1] + (clut[i111]-clut[i110])*rgbd[2]
-        + (clut[i110]-clut[i100]-clut[i010]+clut[i000])*rgbd[0]*rgbd[1];
-      output[1] = clut[i000+1] + (clut[i100+1]-clut[i000+1])*rgbd[0] + (clut[i010+1]-clut[i000+1])*rgbd[1] + (clut[i111+1]-clut[i110+1])*rgbd[2]
-        + (clut[i110+1]-clut[i100+1]-clut[i010+1]+clut[i000+1])*rgbd[0]*rgbd[1];
-      output[2] = clut[i000+2] + (clut[i100+2]-clut[i000+2])*rgbd[0] + (clut[i010+2]-clut[i000+2])*rgbd[1] + (clut[i111+2]-clut[i110+2])*rgbd[2]
-        + (clut[i110+2]-clut[i100+2]-clut[i010+2]+clut[i000+2])*rgbd[0]*rgbd[1];
-    }
-  }
-}
 
 void get_cache_filename(const char *const lutname, char *const cache_filename)
 {
@@ -470,7 +268,7 @@ uint8_t calculate_clut_compressed(dt_iop_lut3d_params_t *const p, const char *co
 
   get_cache_filename(p->lutname, cache_filename);
   buf_size_lut = (size_t)(level * level * level * 3);
-  lclut = dt_alloc_align_float(buf_size_lut);
+  lclut = dt_alloc_align_float(buf_size_lut + DT_LUT_3D_PADDING);
   if(!lclut)
   {
     dt_print(DT_DEBUG_ALWAYS, "[lut3d] error allocating buffer for gmz LUT\n");
@@ -570,7 +368,7 @@ uint16_t calculate_clut_haldclut(dt_iop_lut3d_params_t *const p, const char *con
   }
   const size_t buf_size_lut = (size_t)png.height * png.height * 3;
   dt_print(DT_DEBUG_DEV, "[lut3d] allocating %zu floats for png LUT - level %d\n", buf_size_lut, level);
-  float *lclut = dt_alloc_align_float(buf_size_lut);
+  float *lclut = dt_alloc_align_float(buf_size_lut + DT_LUT_3D_PADDING);
   if(!lclut)
   {
     dt_print(DT_DEBUG_ALWAYS, "[lut3d] error - allocating buffer for png LUT\n");
@@ -803,7 +601,7 @@ uint16_t calculate_clut_cube(const char *const filepath, float **clut)
         }
         buf_size = level * level * level * 3;
         dt_print(DT_DEBUG_DEV, "[lut3d] allocating %zu bytes for cube LUT - level %d\n", buf_size, level);
-        lclut = dt_alloc_align_float(buf_size);
+        lclut = dt_alloc_align_float(buf_size + DT_LUT_3D_PADDING);
         if(!lclut)
         {
           dt_print(DT_DEBUG_ALWAYS, "[lut3d] error - allocating buffer for cube LUT\n");
@@ -908,7 +706,7 @@ uint16_t calculate_clut_3dl(const char *const filepath, float **clut)
             }
             buf_size = level * level * level * 3;
             dt_print(DT_DEBUG_DEV, "[lut3d] allocating %zu bytes for 3dl LUT - level %d\n", buf_size, level);
-            lclut = dt_alloc_align_float(buf_size);
+            lclut = dt_alloc_align_float(buf_size + DT_LUT_3D_PADDING);
             if(!lclut)
             {
               dt_print(DT_DEBUG_ALWAYS, "[lut3d] error - allocating buffer for 3dl LUT\n");
@@ -1085,22 +883,22 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       dt_ioppr_transform_image_colorspace_rgb(ibuf, obuf, width, height,
         work_profile, lut_profile, "work profile to LUT profile");
       if(interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(obuf, obuf, (size_t)width * height, clut, level);
+        dt_lut_apply_3d_tetrahedral(obuf, obuf, (size_t)width * height, clut, level);
       else if(interpolation == DT_IOP_TRILINEAR)
-        correct_pixel_trilinear(obuf, obuf, (size_t)width * height, clut, level);
+        dt_lut_apply_3d_trilinear(obuf, obuf, (size_t)width * height, clut, level);
       else
-        correct_pixel_pyramid(obuf, obuf, (size_t)width * height, clut, level);
+        dt_lut_apply_3d_pyramid(obuf, obuf, (size_t)width * height, clut, level);
       dt_ioppr_transform_image_colorspace_rgb(obuf, obuf, width, height,
         lut_profile, work_profile, "LUT profile to work profile");
     }
     else
     {
       if(interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(ibuf, obuf, (size_t)width * height, clut, level);
+        dt_lut_apply_3d_tetrahedral(ibuf, obuf, (size_t)width * height, clut, level);
       else if(interpolation == DT_IOP_TRILINEAR)
-        correct_pixel_trilinear(ibuf, obuf, (size_t)width * height, clut, level);
+        dt_lut_apply_3d_trilinear(ibuf, obuf, (size_t)width * height, clut, level);
       else
-        correct_pixel_pyramid(ibuf, obuf, (size_t)width * height, clut, level);
+        dt_lut_apply_3d_pyramid(ibuf, obuf, (size_t)width * height, clut, level);
     }
   }
   else  // no clut
@@ -1126,6 +924,8 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_lut3d_trilinear = dt_opencl_create_kernel(program, "lut3d_trilinear");
   gd->kernel_lut3d_pyramid = dt_opencl_create_kernel(program, "lut3d_pyramid");
   gd->kernel_lut3d_none = dt_opencl_create_kernel(program, "lut3d_none");
+  dt_pthread_mutex_init(&gd->clut_lock, NULL);
+  gd->cluts = NULL;
 
 #ifdef HAVE_GMIC
   // make sure the cache dir exists
@@ -1143,6 +943,14 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_lut3d_trilinear);
   dt_opencl_free_kernel(gd->kernel_lut3d_pyramid);
   dt_opencl_free_kernel(gd->kernel_lut3d_none);
+  for(GList *l = gd->cluts; l; l = g_list_next(l))
+  {
+    dt_iop_lut3d_clut_t *entry = (dt_iop_lut3d_clut_t *)l->data;
+    dt_free_align(entry->clut);
+    free(entry);
+  }
+  g_list_free(gd->cluts);
+  dt_pthread_mutex_destroy(&gd->clut_lock);
   free(module->data);
   module->data = NULL;
 }
@@ -1185,6 +993,114 @@ static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
   return level;
 }
 
+// identifies the clut calculate_clut() would return: the compressed clut in the params, or the
+// file with its size and modification time so an edited file is read again by new pipes
+static dt_hash_t _clut_hash(const dt_iop_lut3d_params_t *const p)
+{
+  dt_hash_t hash = dt_hash(DT_INITHASH, p->filepath, strlen(p->filepath));
+  hash = dt_hash(hash, p->lutname, strlen(p->lutname));
+#ifdef HAVE_GMIC
+  if(p->nb_keypoints && p->filepath[0])
+  {
+    hash = dt_hash(hash, &p->nb_keypoints, sizeof(p->nb_keypoints));
+    return dt_hash(hash, p->c_clut, sizeof(p->c_clut));
+  }
+#endif
+  gchar *lutfolder = dt_conf_get_string("plugins/darkroom/lut3d/def_path");
+  gchar *fullpath = g_build_filename(lutfolder, p->filepath, NULL);
+  hash = dt_hash(hash, fullpath, strlen(fullpath));
+  GStatBuf st;
+  if(g_stat(fullpath, &st) == 0)
+  {
+    const int64_t stamp[2] = { st.st_size, st.st_mtime };
+    hash = dt_hash(hash, stamp, sizeof(stamp));
+  }
+  g_free(fullpath);
+  g_free(lutfolder);
+  return hash;
+}
+
+// drop unused cluts beyond the few we keep, call with the lock held
+static void _clut_trim(dt_iop_lut3d_global_data_t *gd)
+{
+  int unused = 0;
+  for(GList *l = gd->cluts; l;)
+  {
+    GList *next = g_list_next(l);
+    dt_iop_lut3d_clut_t *entry = (dt_iop_lut3d_clut_t *)l->data;
+    if(entry->users == 0 && ++unused > DT_IOP_LUT3D_CACHED_CLUTS)
+    {
+      dt_free_align(entry->clut);
+      free(entry);
+      gd->cluts = g_list_delete_link(gd->cluts, l);
+    }
+    l = next;
+  }
+}
+
+static dt_iop_lut3d_clut_t *_clut_find(dt_iop_lut3d_global_data_t *gd, const dt_hash_t hash)
+{
+  for(GList *l = gd->cluts; l; l = g_list_next(l))
+  {
+    dt_iop_lut3d_clut_t *entry = (dt_iop_lut3d_clut_t *)l->data;
+    if(entry->hash == hash)
+    {
+      entry->users++;
+      gd->cluts = g_list_remove_link(gd->cluts, l);
+      gd->cluts = g_list_concat(l, gd->cluts);
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+// get the clut for the params, loading it only if no other pipe has it. NULL if there is none.
+static dt_iop_lut3d_clut_t *_clut_acquire(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_params_t *const p)
+{
+  const dt_hash_t hash = _clut_hash(p);
+  dt_pthread_mutex_lock(&gd->clut_lock);
+  dt_iop_lut3d_clut_t *entry = _clut_find(gd, hash);
+  dt_pthread_mutex_unlock(&gd->clut_lock);
+  if(entry) return entry;
+
+  // parsing a large file takes a while, don't block the other pipes meanwhile
+  float *clut = NULL;
+  const uint16_t level = calculate_clut(p, &clut);
+  if(!level)
+  {
+    dt_free_align(clut);
+    return NULL;
+  }
+  const size_t size = (size_t)level * level * level * 3;
+  memset(clut + size, 0, sizeof(float) * DT_LUT_3D_PADDING);
+
+  dt_pthread_mutex_lock(&gd->clut_lock);
+  entry = _clut_find(gd, hash); // another pipe was faster
+  if(entry)
+    dt_free_align(clut);
+  else
+  {
+    entry = (dt_iop_lut3d_clut_t *)malloc(sizeof(dt_iop_lut3d_clut_t));
+    entry->hash = hash;
+    entry->clut = clut;
+    entry->level = level;
+    entry->users = 1;
+    gd->cluts = g_list_prepend(gd->cluts, entry);
+    _clut_trim(gd);
+  }
+  dt_pthread_mutex_unlock(&gd->clut_lock);
+  return entry;
+}
+
+static void _clut_release(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_clut_t *entry)
+{
+  if(!entry) return;
+  dt_pthread_mutex_lock(&gd->clut_lock);
+  entry->users--;
+  _clut_trim(gd);
+  dt_pthread_mutex_unlock(&gd->clut_lock);
+}
+
 #ifdef HAVE_GMIC
 static gboolean list_match_string(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, dt_iop_lut3d_gui_data_t *g)
 {
@@ -1358,13 +1274,11 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if(strcmp(p->filepath, d->params.filepath) != 0 || strcmp(p->lutname, d->params.lutname) != 0 )
   { // new clut file
-    if(d->clut)
-    { // reset current clut if any
-      dt_free_align(d->clut);
-      d->clut = NULL;
-      d->level = 0;
-    }
-    d->level = calculate_clut(p, &d->clut);
+    dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)self->global_data;
+    _clut_release(gd, d->shared);
+    d->shared = _clut_acquire(gd, p);
+    d->clut = d->shared ? d->shared->clut : NULL;
+    d->level = d->shared ? d->shared->level : 0;
   }
   memcpy(&d->params, p, sizeof(dt_iop_lut3d_params_t));
 }
@@ -1374,6 +1288,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   piece->data = malloc(sizeof(dt_iop_lut3d_data_t));
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
   memcpy(&d->params, self->default_params, sizeof(dt_iop_lut3d_params_t));
+  d->shared = NULL;
   d->clut = NULL;
   d->level = 0;
   d->params.filepath[0] = '\0';
@@ -1381,9 +1296,9 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;;
-  if(d->clut)
-    dt_free_align(d->clut);
+  dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
+  _clut_release((dt_iop_lut3d_global_data_t *)self->global_data, d->shared);
+  d->shared = NULL;
   d->clut = NULL;
   d->level = 0;
   free(piece->data);
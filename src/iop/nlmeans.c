@@ -41,7 +41,7 @@
 
 // this is the version of the modules parameters,
 // and includes version information about compile-time dt
-DT_MODULE_INTROSPECTION(2, dt_iop_nlmeans_params_t)
+DT_MODULE_INTROSPECTION(3, dt_iop_nlmeans_params_t)
 
 typedef struct dt_iop_nlmeans_params_t
 {
@@ -50,6 +50,7 @@ typedef struct dt_iop_nlmeans_params_t
   float strength; // $MIN: 0.0 $MAX: 100000.0 $DEFAULT: 50.0
   float luma;     // $MIN: 0.0 $MAX: 1.0 $DEFAULT: 0.5
   float chroma;   // $MIN: 0.0 $MAX: 1.0 $DEFAULT: 1.0
+  float prune;    // $MIN: 0.0 $MAX: 0.5 $DEFAULT: 0.0 $DESCRIPTION: "skip weak patches"
 } dt_iop_nlmeans_params_t;
 
 typedef struct dt_iop_nlmeans_gui_data_t
@@ -58,6 +59,7 @@ typedef struct dt_iop_nlmeans_gui_data_t
   GtkWidget *strength;
   GtkWidget *luma;
   GtkWidget *chroma;
+  GtkWidget *prune;
 } dt_iop_nlmeans_gui_data_t;
 
 typedef dt_iop_nlmeans_params_t dt_iop_nlmeans_data_t;
@@ -114,6 +116,15 @@ int legacy_params(dt_iop_module_t *self,
     float chroma;
   } dt_iop_nlmeans_params_v2_t;
 
+  typedef struct dt_iop_nlmeans_params_v3_t
+  {
+    float radius;
+    float strength;
+    float luma;
+    float chroma;
+    float prune;
+  } dt_iop_nlmeans_params_v3_t;
+
   if(old_version == 1)
   {
     typedef struct dt_iop_nlmeans_params_v1_t
@@ -136,6 +147,21 @@ int legacy_params(dt_iop_module_t *self,
     *new_version = 2;
     return 0;
   }
+
+  if(old_version == 2)
+  {
+    const dt_iop_nlmeans_params_v2_t *o = (dt_iop_nlmeans_params_v2_t *)old_params;
+    dt_iop_nlmeans_params_v3_t *n =
+      (dt_iop_nlmeans_params_v3_t *)malloc(sizeof(dt_iop_nlmeans_params_v3_t));
+
+    memcpy(n, o, sizeof(*o));
+    n->prune = 0.0f;
+
+    *new_params = n;
+    *new_params_size = sizeof(dt_iop_nlmeans_params_v3_t);
+    *new_version = 3;
+    return 0;
+  }
   return 1;
 }
 
@@ -398,6 +424,7 @@ void process(
                                       .patch_radius = P,
                                       .search_radius = K,
                                       .decimate = decimate,
+                                      .prune = d->prune,
                                       .norm = norm2 };
 
   nlmeans_denoise(ivoid, ovoid, roi_in, roi_out, &params);
@@ -439,6 +466,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
   memcpy(d, p, sizeof(*d));
   d->luma = MAX(0.0001f, p->luma);
   d->chroma = MAX(0.0001f, p->chroma);
+
+  // the OpenCL code always compares all patches
+  if(d->prune > 0.0f) piece->process_cl_ready = FALSE;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -471,6 +501,12 @@ void gui_init(dt_iop_module_t *self)
   g->chroma = dt_bauhaus_slider_from_params(self, N_("chroma"));
   dt_bauhaus_slider_set_format(g->chroma, "%");
   gtk_widget_set_tooltip_text(g->chroma, _("how much to smooth colors"));
+  g->prune = dt_bauhaus_slider_from_params(self, "prune");
+  dt_bauhaus_slider_set_digits(g->prune, 2);
+  gtk_widget_set_tooltip_text(g->prune, _("skip patches whose estimated weight is below this value.\n"
+                                          "faster on detailed images at a small loss of accuracy,\n"
+                                          "0 compares all patches.\n"
+                                          "values above 0 are always processed on the CPU."));
 }
 
 // clang-format off
@@ -112,8 +112,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_INCLUDE_IN_STYLES
-         | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ALLOW_STRIPES
+         | IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -469,6 +469,16 @@ void process(
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = 1.0f;
 }
 
+gboolean mosaic_stripes(struct dt_iop_module_t *self,
+                        dt_dev_pixelpipe_iop_t *piece,
+                        const dt_iop_roi_t *const roi_out)
+{
+  // the crop is taken from the rows below the stripe's start, the pipe hands us input
+  // rows starting at the stripe's first output row. that only holds for unscaled rois.
+  return roi_out->scale == piece->iscale
+    && dt_image_is_raw(&piece->pipe->image);
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(
         dt_iop_module_t *self,
@@ -109,8 +109,8 @@ typedef struct dt_iop_rgbcurve_data_t
   char filename_work[DT_IOP_COLOR_ICC_LEN];
 } dt_iop_rgbcurve_data_t;
 
-typedef float (*_curve_table_ptr)[0x10000];
-typedef float (*_coeffs_table_ptr)[3];
+typedef const float (*_curve_table_ptr)[0x10000];
+typedef const float (*_coeffs_table_ptr)[3];
 
 typedef struct dt_iop_rgbcurve_global_data_t
 {
@@ -129,7 +129,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_CACHE_HALF_FLOAT;
 }
 
 dt_iop_colorspace_type_t default_colorspace(dt_iop_module_t *self,
@@ -1891,6 +1891,58 @@ cleanup:
 }
 #endif
 
+static inline void _apply_curves(const dt_iop_rgbcurve_data_t *const d,
+                                 const dt_iop_order_iccprofile_info_t *const work_profile,
+                                 const float *const in,
+                                 float *const out)
+{
+  const float xm_L = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_R][0];
+  const float xm_g = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_G][0];
+  const float xm_b = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_B][0];
+  const int autoscale = d->params.curve_autoscale;
+  const _curve_table_ptr table = d->table;
+  const _coeffs_table_ptr unbounded_coeffs = d->unbounded_coeffs;
+
+  if(autoscale == DT_S_SCALE_MANUAL_RGB)
+  {
+    out[0] = (in[0] < xm_L) ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[0] * 0x10000ul), 0, 0xffff)]
+                            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[0]);
+    out[1] = (in[1] < xm_g) ? table[DT_IOP_RGBCURVE_G][CLAMP((int)(in[1] * 0x10000ul), 0, 0xffff)]
+                            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_G], in[1]);
+    out[2] = (in[2] < xm_b) ? table[DT_IOP_RGBCURVE_B][CLAMP((int)(in[2] * 0x10000ul), 0, 0xffff)]
+                            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_B], in[2]);
+  }
+  else if(autoscale == DT_S_SCALE_AUTOMATIC_RGB)
+  {
+    if(d->params.preserve_colors == DT_RGB_NORM_NONE)
+    {
+      for(int c = 0; c < 3; c++)
+      {
+        out[c] = (in[c] < xm_L)
+          ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[c] * 0x10000ul), 0, 0xffff)]
+          : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[c]);
+      }
+    }
+    else
+    {
+      float ratio = 1.f;
+      const float lum = dt_rgb_norm(in, d->params.preserve_colors, work_profile);
+      if(lum > 0.f)
+      {
+        const float curve_lum = (lum < xm_L)
+          ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(lum * 0x10000ul), 0, 0xffff)]
+          : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], lum);
+        ratio = curve_lum / lum;
+      }
+      for(size_t c = 0; c < 3; c++)
+      {
+        out[c] = (ratio * in[c]);
+      }
+    }
+  }
+  out[3] = in[3];
+}
+
 void process(struct dt_iop_module_t *self,
              dt_dev_pixelpipe_iop_t *piece,
              const void *const ivoid,
@@ -1912,59 +1964,31 @@ void process(struct dt_iop_module_t *self,
   dt_iop_rgbcurve_data_t *const restrict d = (dt_iop_rgbcurve_data_t *)(piece->data);
   _generate_curve_lut(piece->pipe, d);
 
-  const float xm_L = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_R][0];
-  const float xm_g = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_G][0];
-  const float xm_b = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_B][0];
-
-  const int width = roi_out->width;
-  const int height = roi_out->height;
-  const size_t npixels = (size_t)width * height;
-  const int autoscale = d->params.curve_autoscale;
-  const _curve_table_ptr restrict table = d->table;
-  const _coeffs_table_ptr restrict unbounded_coeffs = d->unbounded_coeffs;
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
 
   DT_OMP_FOR()
-  for(int y = 0; y < 4*npixels; y += 4)
-  {
-    if(autoscale == DT_S_SCALE_MANUAL_RGB)
-    {
-      out[y+0] = (in[y+0] < xm_L) ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[y+0] * 0x10000ul), 0, 0xffff)]
-                                  : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[y+0]);
-      out[y+1] = (in[y+1] < xm_g) ? table[DT_IOP_RGBCURVE_G][CLAMP((int)(in[y+1] * 0x10000ul), 0, 0xffff)]
-                                  : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_G], in[y+1]);
-      out[y+2] = (in[y+2] < xm_b) ? table[DT_IOP_RGBCURVE_B][CLAMP((int)(in[y+2] * 0x10000ul), 0, 0xffff)]
-                                  : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_B], in[y+2]);
-    }
-    else if(autoscale == DT_S_SCALE_AUTOMATIC_RGB)
-    {
-      if(d->params.preserve_colors == DT_RGB_NORM_NONE)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          out[y+c] = (in[y+c] < xm_L)
-            ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[y+c] * 0x10000ul), 0, 0xffff)]
-            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[y+c]);
-        }
-      }
-      else
-      {
-        float ratio = 1.f;
-        const float lum = dt_rgb_norm(in + y, d->params.preserve_colors, work_profile);
-        if(lum > 0.f)
-        {
-          const float curve_lum = (lum < xm_L)
-            ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(lum * 0x10000ul), 0, 0xffff)]
-            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], lum);
-          ratio = curve_lum / lum;
-        }
-        for(size_t c = 0; c < 3; c++)
-        {
-          out[y+c] = (ratio * in[y+c]);
-        }
-      }
-    }
-    out[y+3] = in[y+3];
-  }
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+    _apply_curves(d, work_profile, in + k, out + k);
+}
+
+void process_pointwise_setup(struct dt_iop_module_t *self,
+                             dt_dev_pixelpipe_iop_t *piece)
+{
+  _generate_curve_lut(piece->pipe, (dt_iop_rgbcurve_data_t *)piece->data);
+}
+
+void process_pointwise(struct dt_iop_module_t *self,
+                       dt_dev_pixelpipe_iop_t *piece,
+                       const float *const in,
+                       float *const out,
+                       const size_t npixels)
+{
+  const dt_iop_order_iccprofile_info_t *const work_profile =
+    dt_ioppr_get_pipe_work_profile_info(piece->pipe);
+  const dt_iop_rgbcurve_data_t *const d = (dt_iop_rgbcurve_data_t *)piece->data;
+
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+    _apply_curves(d, work_profile, in + k, out + k);
 }
 
 #undef DT_GUI_CURVE_EDITOR_INSET
@@ -174,6 +174,8 @@ typedef struct dt_iop_sigmoid_data_t
   float rotation[3];
   float purity;
   dt_iop_sigmoid_base_primaries_t base_primaries;
+  // set up per run for process_pointwise()
+  dt_colormatrix_t pipe_to_base, base_to_rendering, rendering_to_pipe;
 } dt_iop_sigmoid_data_t;
 
 typedef struct dt_iop_sigmoid_gui_data_t
@@ -212,7 +214,7 @@ const char **description(struct dt_iop_module_t *self)
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_CACHE_HALF_FLOAT;
 }
 
 int default_group()
@@ -568,17 +570,10 @@ static void _pixel_channel_order(const dt_aligned_pixel_t pix_in, dt_iop_sigmoid
   }
 }
 
-void process_loglogistic_rgb_ratio(dt_dev_pixelpipe_iop_t *piece,
-                                   const void *const ivoid,
-                                   void *const ovoid,
-                                   const dt_iop_roi_t *const roi_in,
-                                   const dt_iop_roi_t *const roi_out)
+static inline void _loglogistic_rgb_ratio(const dt_iop_sigmoid_data_t *const module_data,
+                                          const float *const pix_in,
+                                          float *const pix_out)
 {
-  const dt_iop_sigmoid_data_t *module_data = (dt_iop_sigmoid_data_t *)piece->data;
-  const float *const in = (const float *)ivoid;
-  float *const out = (float *)ovoid;
-  const size_t npixels = (size_t)roi_in->width * roi_in->height;
-
   const float white_target = module_data->white_target;
   const float black_target = module_data->black_target;
   const float paper_exp = module_data->paper_exposure;
@@ -586,76 +581,87 @@ void process_loglogistic_rgb_ratio(dt_dev_pixelpipe_iop_t *piece,
   const float contrast_power = module_data->film_power;
   const float skew_power = module_data->paper_power;
 
-  DT_OMP_FOR()
-  for(size_t k = 0; k < 4 * npixels; k += 4)
-  {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
-    dt_aligned_pixel_t pre_out;
-    dt_aligned_pixel_t pix_in_strict_positive;
+  const float alpha = pix_in[3];
+  dt_aligned_pixel_t pre_out;
+  dt_aligned_pixel_t pix_in_strict_positive;
 
-    // Force negative values to zero
-    _desaturate_negative_values(pix_in, pix_in_strict_positive);
+  // Force negative values to zero
+  _desaturate_negative_values(pix_in, pix_in_strict_positive);
 
-    // Preserve color ratios by applying the tone curve on a luma estimate and then scale the RGB tripplet uniformly
-    const float luma = (pix_in_strict_positive[0] + pix_in_strict_positive[1] + pix_in_strict_positive[2]) / 3.0f;
-    const float mapped_luma
-        = _generalized_loglogistic_sigmoid(luma, white_target, paper_exp, film_fog, contrast_power, skew_power);
+  // Preserve color ratios by applying the tone curve on a luma estimate and then scale the RGB tripplet uniformly
+  const float luma = (pix_in_strict_positive[0] + pix_in_strict_positive[1] + pix_in_strict_positive[2]) / 3.0f;
+  const float mapped_luma
+      = _generalized_loglogistic_sigmoid(luma, white_target, paper_exp, film_fog, contrast_power, skew_power);
 
-    if(luma > 1e-9)
-    {
-      const float scaling_factor = mapped_luma / luma;
-      for_each_channel(c, aligned(pix_in_strict_positive, pix_out))
-      {
-        pre_out[c] = scaling_factor * pix_in_strict_positive[c];
-      }
-    }
-    else
+  if(luma > 1e-9)
+  {
+    const float scaling_factor = mapped_luma / luma;
+    for_each_channel(c, aligned(pix_in_strict_positive, pre_out))
     {
-      for_each_channel(c, aligned(pix_in_strict_positive, pix_out))
-      {
-        pre_out[c] = mapped_luma;
-      }
+      pre_out[c] = scaling_factor * pix_in_strict_positive[c];
     }
-
-    // RGB index order sorted by value;
-    dt_iop_sigmoid_value_order_t pixel_value_order;
-    _pixel_channel_order(pre_out, &pixel_value_order);
-    const float pixel_min = pre_out[pixel_value_order.min];
-    const float pixel_max = pre_out[pixel_value_order.max];
-
-    // Chroma relative display gamut and scene "mapping" gamut.
-    const float epsilon = 1e-6;
-    const float display_border_vs_chroma_white
-        = (white_target - mapped_luma)
-          / (pixel_max - mapped_luma + epsilon); // "Distance" to max channel = white_target
-    const float display_border_vs_chroma_black
-        = (black_target - mapped_luma)
-          / (pixel_min - mapped_luma - epsilon); // "Distance" to min_channel = black_target
-    const float display_border_vs_chroma = fminf(display_border_vs_chroma_white, display_border_vs_chroma_black);
-    const float chroma_vs_mapping_border
-        = (mapped_luma - pixel_min) / (mapped_luma + epsilon); // "Distance" to min channel = 0.0
-
-    // Hyperbolic gamut compression
-    // Small chroma values, i.e., colors close to the acromatic axis are preserved while large chroma values are
-    // compressed.
-
-    const float pixel_chroma_adjustment = 1.0f / (chroma_vs_mapping_border * display_border_vs_chroma + epsilon);
-    const float hyperbolic_chroma = 2.0f * chroma_vs_mapping_border
-                                    / (1.0f - chroma_vs_mapping_border * chroma_vs_mapping_border + epsilon)
-                                    * pixel_chroma_adjustment;
-
-    const float hyperbolic_z = sqrtf(hyperbolic_chroma * hyperbolic_chroma + 1.0f);
-    const float chroma_factor = hyperbolic_chroma / (1.0f + hyperbolic_z) * display_border_vs_chroma;
-
-    for_each_channel(c, aligned(pre_out, pix_out))
+  }
+  else
+  {
+    for_each_channel(c, aligned(pre_out))
     {
-      pix_out[c] = mapped_luma + chroma_factor * (pre_out[c] - mapped_luma);
+      pre_out[c] = mapped_luma;
     }
+  }
 
-    // Copy over the alpha channel
-    pix_out[3] = pix_in[3];
+  // RGB index order sorted by value;
+  dt_iop_sigmoid_value_order_t pixel_value_order;
+  _pixel_channel_order(pre_out, &pixel_value_order);
+  const float pixel_min = pre_out[pixel_value_order.min];
+  const float pixel_max = pre_out[pixel_value_order.max];
+
+  // Chroma relative display gamut and scene "mapping" gamut.
+  const float epsilon = 1e-6;
+  const float display_border_vs_chroma_white
+      = (white_target - mapped_luma)
+        / (pixel_max - mapped_luma + epsilon); // "Distance" to max channel = white_target
+  const float display_border_vs_chroma_black
+      = (black_target - mapped_luma)
+        / (pixel_min - mapped_luma - epsilon); // "Distance" to min_channel = black_target
+  const float display_border_vs_chroma = fminf(display_border_vs_chroma_white, display_border_vs_chroma_black);
+  const float chroma_vs_mapping_border
+      = (mapped_luma - pixel_min) / (mapped_luma + epsilon); // "Distance" to min channel = 0.0
+
+  // Hyperbolic gamut compression
+  // Small chroma values, i.e., colors close to the acromatic axis are preserved while large chroma values are
+  // compressed.
+
+  const float pixel_chroma_adjustment = 1.0f / (chroma_vs_mapping_border * display_border_vs_chroma + epsilon);
+  const float hyperbolic_chroma = 2.0f * chroma_vs_mapping_border
+                                  / (1.0f - chroma_vs_mapping_border * chroma_vs_mapping_border + epsilon)
+                                  * pixel_chroma_adjustment;
+
+  const float hyperbolic_z = sqrtf(hyperbolic_chroma * hyperbolic_chroma + 1.0f);
+  const float chroma_factor = hyperbolic_chroma / (1.0f + hyperbolic_z) * display_border_vs_chroma;
+
+  for_each_channel(c, aligned(pre_out))
+  {
+    pix_out[c] = mapped_luma + chroma_factor * (pre_out[c] - mapped_luma);
   }
+
+  // Copy over the alpha channel
+  pix_out[3] = alpha;
+}
+
+void process_loglogistic_rgb_ratio(dt_dev_pixelpipe_iop_t *piece,
+                                   const void *const ivoid,
+                                   void *const ovoid,
+                                   const dt_iop_roi_t *const roi_in,
+                                   const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_sigmoid_data_t *module_data = (dt_iop_sigmoid_data_t *)piece->data;
+  const float *const in = (const float *)ivoid;
+  float *const out = (float *)ovoid;
+  const size_t npixels = (size_t)roi_in->width * roi_in->height;
+
+  DT_OMP_FOR()
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+    _loglogistic_rgb_ratio(module_data, in + k, out + k);
 }
 
 // Linear interpolation of hue that also preserve sum of channels
@@ -705,6 +711,51 @@ static inline void _preserve_hue_and_energy(const dt_aligned_pixel_t pix_in,
   }
 }
 
+static inline void _loglogistic_per_channel(const dt_iop_sigmoid_data_t *const module_data,
+                                            const dt_colormatrix_t pipe_to_base,
+                                            const dt_colormatrix_t base_to_rendering,
+                                            const dt_colormatrix_t rendering_to_pipe,
+                                            const float *const pix_in,
+                                            float *const pix_out)
+{
+  const float white_target = module_data->white_target;
+  const float paper_exp = module_data->paper_exposure;
+  const float film_fog = module_data->film_fog;
+  const float contrast_power = module_data->film_power;
+  const float skew_power = module_data->paper_power;
+  const float hue_preservation = module_data->hue_preservation;
+
+  const float alpha = pix_in[3];
+  dt_aligned_pixel_t pix_in_base, pix_in_strict_positive;
+  dt_aligned_pixel_t per_channel;
+
+  // Convert to "base primaries"
+  dt_apply_transposed_color_matrix(pix_in, pipe_to_base, pix_in_base);
+
+  // Force negative values to zero
+  _desaturate_negative_values(pix_in_base, pix_in_strict_positive);
+
+  dt_aligned_pixel_t rendering_RGB;
+  dt_apply_transposed_color_matrix(pix_in_strict_positive, base_to_rendering, rendering_RGB);
+
+  for_each_channel(c, aligned(rendering_RGB, per_channel))
+  {
+    per_channel[c] = _generalized_loglogistic_sigmoid(rendering_RGB[c], white_target, paper_exp, film_fog,
+                                                      contrast_power, skew_power);
+  }
+
+  // Hue correction by scaling the middle value relative to the max and min values.
+  dt_iop_sigmoid_value_order_t pixel_value_order;
+  dt_aligned_pixel_t per_channel_hue_corrected;
+  _pixel_channel_order(rendering_RGB, &pixel_value_order);
+  _preserve_hue_and_energy(rendering_RGB, per_channel, per_channel_hue_corrected, pixel_value_order,
+                           hue_preservation);
+  dt_apply_transposed_color_matrix(per_channel_hue_corrected, rendering_to_pipe, pix_out);
+
+  // Copy over the alpha channel
+  pix_out[3] = alpha;
+}
+
 void process_loglogistic_per_channel(struct dt_develop_t *dev,
                                      dt_dev_pixelpipe_iop_t *piece,
                                      const void *const ivoid, void *const ovoid,
@@ -717,13 +768,6 @@ void process_loglogistic_per_channel(struct dt_develop_t *dev,
   float *const out = (float *)ovoid;
   const size_t npixels = (size_t)roi_in->width * roi_in->height;
 
-  const float white_target = module_data->white_target;
-  const float paper_exp = module_data->paper_exposure;
-  const float film_fog = module_data->film_fog;
-  const float contrast_power = module_data->film_power;
-  const float skew_power = module_data->paper_power;
-  const float hue_preservation = module_data->hue_preservation;
-
   const dt_iop_order_iccprofile_info_t *pipe_work_profile = dt_ioppr_get_pipe_work_profile_info(piece->pipe);
   const dt_iop_order_iccprofile_info_t *base_profile = _get_base_profile(dev, pipe_work_profile, module_data->base_primaries);
   dt_colormatrix_t pipe_to_base, base_to_rendering, rendering_to_pipe;
@@ -731,38 +775,8 @@ void process_loglogistic_per_channel(struct dt_develop_t *dev,
 
   DT_OMP_FOR()
   for(size_t k = 0; k < 4 * npixels; k += 4)
-  {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
-    dt_aligned_pixel_t pix_in_base, pix_in_strict_positive;
-    dt_aligned_pixel_t per_channel;
-
-    // Convert to "base primaries"
-    dt_apply_transposed_color_matrix(pix_in, pipe_to_base, pix_in_base);
-
-    // Force negative values to zero
-    _desaturate_negative_values(pix_in_base, pix_in_strict_positive);
-
-    dt_aligned_pixel_t rendering_RGB;
-    dt_apply_transposed_color_matrix(pix_in_strict_positive, base_to_rendering, rendering_RGB);
-
-    for_each_channel(c, aligned(rendering_RGB, per_channel))
-    {
-      per_channel[c] = _generalized_loglogistic_sigmoid(rendering_RGB[c], white_target, paper_exp, film_fog,
-                                                        contrast_power, skew_power);
-    }
-
-    // Hue correction by scaling the middle value relative to the max and min values.
-    dt_iop_sigmoid_value_order_t pixel_value_order;
-    dt_aligned_pixel_t per_channel_hue_corrected;
-    _pixel_channel_order(rendering_RGB, &pixel_value_order);
-    _preserve_hue_and_energy(rendering_RGB, per_channel, per_channel_hue_corrected, pixel_value_order,
-                             hue_preservation);
-    dt_apply_transposed_color_matrix(per_channel_hue_corrected, rendering_to_pipe, pix_out);
-
-    // Copy over the alpha channel
-    pix_out[3] = pix_in[3];
-  }
+    _loglogistic_per_channel(module_data, pipe_to_base, base_to_rendering, rendering_to_pipe,
+                             in + k, out + k);
 }
 
 /** process, all real work is done here. */
@@ -786,6 +800,39 @@ void process(struct dt_iop_module_t *self,
   }
 }
 
+void process_pointwise_setup(struct dt_iop_module_t *self,
+                             dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_iop_sigmoid_data_t *module_data = (dt_iop_sigmoid_data_t *)piece->data;
+  if(module_data->color_processing != DT_SIGMOID_METHOD_PER_CHANNEL) return;
+
+  const dt_iop_order_iccprofile_info_t *pipe_work_profile = dt_ioppr_get_pipe_work_profile_info(piece->pipe);
+  const dt_iop_order_iccprofile_info_t *base_profile = _get_base_profile(self->dev, pipe_work_profile, module_data->base_primaries);
+  _calculate_adjusted_primaries(module_data, pipe_work_profile, base_profile, module_data->pipe_to_base,
+                                module_data->base_to_rendering, module_data->rendering_to_pipe);
+}
+
+void process_pointwise(struct dt_iop_module_t *self,
+                       dt_dev_pixelpipe_iop_t *piece,
+                       const float *const in,
+                       float *const out,
+                       const size_t npixels)
+{
+  const dt_iop_sigmoid_data_t *module_data = (dt_iop_sigmoid_data_t *)piece->data;
+
+  if(module_data->color_processing == DT_SIGMOID_METHOD_PER_CHANNEL)
+  {
+    for(size_t k = 0; k < 4 * npixels; k += 4)
+      _loglogistic_per_channel(module_data, module_data->pipe_to_base, module_data->base_to_rendering,
+                               module_data->rendering_to_pipe, in + k, out + k);
+  }
+  else // DT_SIGMOID_METHOD_RGB_RATIO
+  {
+    for(size_t k = 0; k < 4 * npixels; k += 4)
+      _loglogistic_rgb_ratio(module_data, in + k, out + k);
+  }
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self,
                dt_dev_pixelpipe_iop_t *piece,
@@ -875,7 +922,13 @@ void cleanup_global(dt_iop_module_so_t *module)
 
 void init_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = calloc(1, sizeof(dt_iop_sigmoid_data_t));
+  piece->data = dt_calloc1_align_type(dt_iop_sigmoid_data_t);
+}
+
+void cleanup_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_free_align(piece->data);
+  piece->data = NULL;
 }
 
 void gui_changed(dt_iop_module_t *self, GtkWidget *w, void *previous)
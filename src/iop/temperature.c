@@ -639,6 +639,14 @@ void process(struct dt_iop_module_t *self,
   _publish_chroma(piece);
 }
 
+gboolean mosaic_stripes(struct dt_iop_module_t *self,
+                        dt_dev_pixelpipe_iop_t *piece,
+                        const dt_iop_roi_t *const roi_out)
+{
+  // the coefficients only depend on the sensel's position in the pattern
+  return TRUE;
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self,
                dt_dev_pixelpipe_iop_t *piece,
@@ -110,7 +110,7 @@ static int generate_cache(lua_State *L)
   const int min = luaL_checkinteger(L, 3);
   const int max = luaL_checkinteger(L, 4);
 
-  if(create_dirs)
+  if(create_dirs && darktable.mipmap_cache->disk_format == DT_MIPMAP_DISK_FILES)
   {
     for(dt_mipmap_size_t k = min; k <= max; k++)
     {
@@ -130,12 +130,8 @@ static int generate_cache(lua_State *L)
 
   for(int k = max; k >= min && k >= 0; k--)
   {
-    char filename[PATH_MAX] = { 0 };
-    snprintf(filename, sizeof(filename),
-             "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-    // if a valid thumbnail file is already on disc - do nothing
-    if(dt_util_test_image_file(filename)) continue;
+    // if a valid thumbnail is already on disc - do nothing
+    if(dt_mipmap_cache_thumbnail_on_disk(darktable.mipmap_cache, imgid, k)) continue;
     // else, generate thumbnail and store in mipmap cache.
     dt_mipmap_buffer_t buf;
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
@@ -61,6 +61,18 @@ static const char *name_wrapper(const struct dt_imageio_module_storage_t *self)
 
 static void empty_wrapper(struct dt_imageio_module_storage_t *self){};
 
+// the lua callbacks are run one after the other anyway
+static gboolean concurrent_store_wrapper(struct dt_imageio_module_storage_t *self)
+{
+  return FALSE;
+}
+
+// the lua store callback gets the written file
+static gboolean deferred_encode_wrapper(struct dt_imageio_module_storage_t *self)
+{
+  return FALSE;
+}
+
 static int default_supported_wrapper(struct dt_imageio_module_storage_t *self,
                                      struct dt_imageio_module_format_t *format)
 {
@@ -391,6 +403,8 @@ static dt_imageio_module_storage_t ref_storage = {
   .free_params = free_params_wrapper,
   .set_params = set_params_wrapper,
   .export_dispatched = empty_wrapper,
+  .concurrent_store = concurrent_store_wrapper,
+  .deferred_encode = deferred_encode_wrapper,
   .ask_user_confirmation = ask_user_confirmation_wrapper,
   .parameter_lua_type = LUAA_INVALID_TYPE,
   .version = version_wrapper,
@@ -1,6 +1,6 @@
 /*
     This file is part of darktable,
-    Copyright (C) 2011-2023 darktable developers.
+    Copyright (C) 2011-2024 darktable developers.
 
     darktable is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -18,111 +18,207 @@
 
 
 #define DT_UNIT_TEST
-// define dt alloc_aligned, so we don't need to include the rest of dt:
-#define dt_alloc_aligned(A, B) malloc(B)
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
+// define the few bits of dt the cache needs, so we don't need to include the rest of dt:
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#define dt_alloc_aligned(A) malloc(A)
+#define dt_free_align(A) free(A)
+#define dt_print(A, ...) fprintf(stderr, __VA_ARGS__)
+#define DT_DEBUG_ALWAYS 0
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#ifndef __has_feature
+#define __has_feature(x) 0
+#endif
+static inline double dt_get_debug_wtime(void)
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec - 1290608000 + (1.0 / 1000000.0) * time.tv_usec;
+}
 
-// unit test for the concurrent hopscotch hashmap and the LRU cache built on top of it.
+// unit test and benchmark for the sharded LRU cache
 #include "common/cache.h"
 #include "common/cache.c"
 
 #include <assert.h>
-#include <stdio.h>
-#include <stdlib.h>
-#ifdef _OPENMP
-#include <omp.h>
-#endif
 
-int32_t alloc_dummy(void *data, const uint32_t key, int32_t *cost, void **buf)
+#define NUM_KEYS 100000
+#define BENCH_KEYS 5000       // about the thumbnails of a few lighttable pages
+#define BENCH_LOOKUPS 4000000
+#define BENCH_MISSES 2000000
+
+static void alloc_dummy(void *data, dt_cache_entry_t *entry)
 {
-  *cost = 1; // also the default
-  *buf = (void *)(long int)key;
-  // request write lock for our buffer?
-  return 0;
+  entry->data = malloc(sizeof(uint32_t));
+  entry->data_size = sizeof(uint32_t);
+  entry->cost = 1; // also the default
+  *(uint32_t *)entry->data = entry->key;
 }
 
-int main(int argc, char *arg[])
+static void free_dummy(void *data, dt_cache_entry_t *entry)
 {
-  dt_cache_t cache;
-  // dt_cache_init(&cache, 110000, 16, 64, 100000);
-  // really hammer it, make quota insanely low:
-  dt_cache_init(&cache, 110000, 16, 64, 100);
-  dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  free(entry->data);
+}
 
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache, stderr) num_threads(16)
-#endif
-  for(int k = 0; k < 100000; k++)
+static void _cache_init(dt_cache_t *cache, const size_t quota, const int shards)
+{
+  dt_cache_init_sharded(cache, sizeof(uint32_t), quota, shards);
+  dt_cache_set_allocate_callback(cache, alloc_dummy, NULL);
+  dt_cache_set_cleanup_callback(cache, free_dummy, NULL);
+}
+
+static int _count(const uint32_t key, const void *data, void *user_data)
+{
+  assert(*(const uint32_t *)data == key);
+  (*(int *)user_data)++;
+  return 0;
+}
+
+typedef struct worker_t
+{
+  dt_cache_t *cache;
+  pthread_t thread;
+  uint32_t first, step, end; // keys handled by this thread
+  uint32_t seed;
+  int lookups;
+} worker_t;
+
+// every key inserted once by one thread, checked while locked and released.
+static void *_insert(void *data)
+{
+  worker_t *w = (worker_t *)data;
+  for(uint32_t k = w->first; k < w->end; k += w->step)
   {
-    void *data = (void *)(long int)k;
-    const int size = 0; // dt_cache_size(&cache);
-    const int con1 = dt_cache_contains(&cache, k);
-    const int val1 = (int)(long int)dt_cache_read_get(&cache, k);
-    const int val2 = (int)(long int)dt_cache_read_get(&cache, k);
-    // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1, val2,
-    // con1, con2);
-    const int con2 = dt_cache_contains(&cache, k);
+    const int con1 = dt_cache_contains(w->cache, k);
+    // new entries come write locked since we have an allocate callback
+    dt_cache_entry_t *e = dt_cache_get(w->cache, k, 'r');
+    // locked entries are never kicked out
+    const int con2 = dt_cache_contains(w->cache, k);
     assert(con1 == 0);
     assert(con2 == 1);
-    assert(val2 == k);
-    dt_cache_read_release(&cache, k);
-    dt_cache_read_release(&cache, k);
+    assert(e->key == k);
+    assert(*(uint32_t *)e->data == k);
+    dt_cache_release(w->cache, e);
+    (void)con1;
+    (void)con2;
   }
-  dt_cache_print_locked(&cache);
-  // fprintf(stderr, "\n");
-  fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
-
-  const int size = dt_cache_size(&cache);
-  const int lru_cnt = lru_check_consistency(&cache);
-  const int lru_cnt_r = lru_check_consistency_reverse(&cache);
-  // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-  assert(size == lru_cnt);
-  assert(lru_cnt_r == lru_cnt);
-  fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
+  return NULL;
+}
 
+// like scrolling through a lighttable: read hits on random keys
+static void *_lookup(void *data)
+{
+  worker_t *w = (worker_t *)data;
+  uint32_t seed = w->seed;
+  for(int i = 0; i < w->lookups; i++)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    const uint32_t k = (seed >> 8) % w->end;
+    dt_cache_entry_t *e = dt_cache_get(w->cache, k, 'r');
+    assert(*(uint32_t *)e->data == k);
+    dt_cache_release(w->cache, e);
+  }
+  return NULL;
+}
+
+static void _run(dt_cache_t *cache, const int threads, void *(*fn)(void *), const uint32_t end,
+                 const int lookups)
+{
+  worker_t *w = (worker_t *)calloc(threads, sizeof(worker_t));
+  for(int t = 0; t < threads; t++)
+  {
+    w[t].cache = cache;
+    w[t].first = t;
+    w[t].step = threads;
+    w[t].end = end;
+    w[t].seed = 12345 + t;
+    w[t].lookups = lookups;
+    pthread_create(&w[t].thread, NULL, fn, w + t);
+  }
+  for(int t = 0; t < threads; t++) pthread_join(w[t].thread, NULL);
+  free(w);
+}
+
+// walk the lru list both ways, returns the number of entries
+static int _lru_check(dt_cache_shard_t *shard)
+{
+  int forward = 0, backward = 0;
+  dt_cache_entry_t *prev = NULL;
+  for(dt_cache_entry_t *e = shard->lru_head; e; prev = e, e = e->lru_next, forward++)
+    assert(e->lru_prev == prev);
+  assert(prev == shard->lru_tail);
+  for(dt_cache_entry_t *e = shard->lru_tail; e; e = e->lru_prev) backward++;
+  assert(forward == backward);
+  (void)backward;
+  return forward;
+}
+
+static void _test(const int shards, const size_t quota)
+{
+  dt_cache_t cache;
+  _cache_init(&cache, quota, shards);
+  _run(&cache, 16, _insert, NUM_KEYS, 0);
+
+  int entries = 0;
+  dt_cache_for_all(&cache, _count, &entries);
+  assert(entries == (int)dt_cache_get_cost(&cache));
+  for(int k = 0; k < cache.num_shards; k++)
+  {
+    dt_cache_shard_t *shard = cache.shards + k;
+    assert(_lru_check(shard) == g_hash_table_size(shard->hashtable));
+    assert(shard->cost == g_hash_table_size(shard->hashtable));
+  }
+  fprintf(stderr, "[passed] %d shards, quota %zu: inserted %d entries concurrently, %d left\n",
+          shards, quota, NUM_KEYS, entries);
   dt_cache_cleanup(&cache);
+}
 
+static double _bench(const int shards, const int threads)
+{
+  const int lookups = BENCH_LOOKUPS / threads;
+  dt_cache_t cache;
+  _cache_init(&cache, 2 * BENCH_KEYS, shards);
+  _run(&cache, 1, _insert, BENCH_KEYS, 0);
 
+  const double start = dt_get_debug_wtime();
+  _run(&cache, threads, _lookup, BENCH_KEYS, lookups);
+  const double end = dt_get_debug_wtime();
 
+  dt_cache_cleanup(&cache);
+  return (double)lookups * threads / (end - start);
+}
+
+// like importing or scrolling through a huge collection: every get is a miss
+// and kicks out the oldest entry, so this measures entry allocation and lru upkeep.
+static double _bench_misses(void)
+{
+  dt_cache_t cache;
+  _cache_init(&cache, 1000, 1);
+  const double start = dt_get_debug_wtime();
+  _run(&cache, 1, _insert, BENCH_MISSES, 0);
+  const double end = dt_get_debug_wtime();
+  dt_cache_cleanup(&cache);
+  return BENCH_MISSES / (end - start);
+}
+
+int main(int argc, char *arg[])
+{
+  _test(1, 100);
+  _test(16, 100);
+  _test(1, 2);     // a lot of threads fighting over a single entry
+  _test(16, 1000000);
+
+  fprintf(stderr, "single thread misses/s with eviction: %.0f\n", _bench_misses());
+
+  const int max_threads = argc > 1 ? atoi(arg[1]) : 64;
+  fprintf(stderr, "threads   1 shard lookups/s   16 shards lookups/s\n");
+  for(int threads = 1; threads <= max_threads; threads *= 2)
   {
-    // now a harder case: a cache with only one entry and a lot of threads fighting over it:
-    dt_cache_t cache2;
-    // really hammer it, make quota insanely low:
-    // capacity 1 num threads 1 cache line size 64 ignored, quota 2 (80% => 1)
-    dt_cache_init(&cache2, 1, 1, 64, 2);
-    dt_cache_set_allocate_callback(&cache2, alloc_dummy, NULL);
-
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache2, stderr) num_threads(16)
-#endif
-    for(int k = 0; k < 100000; k++)
-    {
-      void *data = (void *)(long int)k;
-      const int size = 0; // dt_cache_size(&cache);
-      const int con1 = dt_cache_contains(&cache2, k);
-      const int val1 = (int)(long int)dt_cache_read_get(&cache2, k);
-      const int val2 = (int)(long int)dt_cache_read_get(&cache2, k);
-      // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1,
-      // val2, con1, con2);
-      const int con2 = dt_cache_contains(&cache2, k);
-      assert(con1 == 0);
-      assert(con2 == 1);
-      assert(val2 == k);
-      dt_cache_read_release(&cache2, k);
-      dt_cache_read_release(&cache2, k);
-    }
-    dt_cache_print_locked(&cache2);
-    // fprintf(stderr, "\n");
-    fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
-
-    const int size = dt_cache_size(&cache2);
-    const int lru_cnt = lru_check_consistency(&cache2);
-    const int lru_cnt_r = lru_check_consistency_reverse(&cache2);
-    // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-    assert(size == lru_cnt);
-    assert(lru_cnt_r == lru_cnt);
-    fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
-    dt_cache_cleanup(&cache2);
+    const double single = _bench(1, threads);
+    const double sharded = _bench(16, threads);
+    fprintf(stderr, "%7d   %17.0f   %19.0f\n", threads, single, sharded);
   }
 
   exit(0);
@@ -132,4 +228,3 @@ int main(int argc, char *arg[])
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
 // clang-format on
-
@@ -0,0 +1,330 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test and benchmark for the AVX2 and AVX-512 kernels of the colorin and colorout
+// matrix paths: the results are compared to the plain per-pixel code of the modules
+// and the throughput of all versions is reported.
+
+#define DT_UNIT_TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+typedef struct dt_codepath_t
+{
+  unsigned int AVX2 : 1;
+  unsigned int AVX512 : 1;
+} dt_codepath_t;
+
+static struct
+{
+  dt_codepath_t codepath;
+} darktable;
+
+#define DT_OMP_SIMD(clauses)
+#define DT_OMP_DECLARE_SIMD(clauses)
+#define DT_OMP_FOR(clauses)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+static inline void copy_pixel(float *const out, const float *const in)
+{
+  for(int c = 0; c < 4; c++) out[c] = in[c];
+}
+
+#include "common/colormatrix_simd.c"
+
+#include <assert.h>
+
+#define NUM_PIXELS (1 << 22)
+#define NUM_TEST_PIXELS 100003 // not a multiple of the vector size
+#define LUT_SAMPLES 0x10000
+
+// max difference to the plain code. the kernels may use fused multiply-adds, and the gamma
+// curve is steep near 0, Lab values are up to a few hundred and rgb values a few units.
+#define TOLERANCE_LAB 2e-3f
+#define TOLERANCE_RGB 1e-4f
+
+static double _wtime(void)
+{
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+/* the plain code of colorin and colorout, see colorspaces_inline_conversions.h */
+
+static inline float _lab_f(const float x)
+{
+  const float epsilon = 216.0f / 24389.0f;
+  const float kappa = 24389.0f / 27.0f;
+  if(x <= epsilon) return (kappa * x + 16.0f) / 116.0f;
+  union { float f; uint32_t i; } a = { .f = x };
+  a.i = a.i / 3 + 709921077;
+  const float a3 = a.f * a.f * a.f;
+  return a.f * (a3 + x + x) / (a3 + a3 + x);
+}
+
+static inline float _lab_f_inv(const float x)
+{
+  const float epsilon = 0.20689655172413796f;
+  const float kappa = 24389.0f / 27.0f;
+  return (x > epsilon) ? x * x * x : (116.0f * x - 16.0f) / kappa;
+}
+
+static inline float _curve(const dt_colormatrix_curves_t *const curves, const int c, const float v)
+{
+  if(v >= 1.0f) return curves->coeffs[c][1] * powf(v * curves->coeffs[c][0], curves->coeffs[c][2]);
+  const float ft = MAX(v, 0.0f) * (curves->lutsize - 1);
+  const int t = MIN((int)ft, curves->lutsize - 2);
+  const float f = ft - t;
+  return curves->lut[c][t] * (1.0f - f) + curves->lut[c][t + 1] * f;
+}
+
+static void _matrix(const dt_colormatrix_t m, float *const v)
+{
+  const float r = m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2];
+  const float g = m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2];
+  const float b = m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2];
+  v[0] = r;
+  v[1] = g;
+  v[2] = b;
+}
+
+static void _plain_rgb_to_Lab(float *const out,
+                              const float *const in,
+                              const size_t npixels,
+                              const dt_aligned_pixel_t corr,
+                              const dt_colormatrix_curves_t *const curves,
+                              const dt_colormatrix_t nmatrix,
+                              const dt_colormatrix_t matrix)
+{
+  for(size_t k = 0; k < npixels; k++)
+  {
+    float v[3] = { in[4 * k] * corr[0], in[4 * k + 1] * corr[1], in[4 * k + 2] * corr[2] };
+    for(int c = 0; c < 3; c++)
+      if(curves && curves->lut[c]) v[c] = _curve(curves, c, v[c]);
+    if(nmatrix)
+    {
+      _matrix(nmatrix, v);
+      for(int c = 0; c < 3; c++) v[c] = MIN(MAX(v[c], 0.0f), 1.0f);
+    }
+    _matrix(matrix, v);
+    const float fx = _lab_f(v[0] * (1.0f / 0.9642f));
+    const float fy = _lab_f(v[1]);
+    const float fz = _lab_f(v[2] * (1.0f / 0.8249f));
+    out[4 * k] = 116.0f * fy - 16.0f;
+    out[4 * k + 1] = 500.0f * (fx - fy);
+    out[4 * k + 2] = -200.0f * (fz - fy);
+    out[4 * k + 3] = 0.0f;
+  }
+}
+
+static void _plain_Lab_to_rgb(float *const out,
+                              const float *const in,
+                              const size_t npixels,
+                              const dt_colormatrix_t matrix,
+                              const dt_colormatrix_curves_t *const curves)
+{
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float fy = (in[4 * k] + 16.0f) * (1.0f / 116.0f);
+    const float fx = in[4 * k + 1] * (1.0f / 500.0f);
+    const float fz = in[4 * k + 2] * (-1.0f / 200.0f);
+    float v[3] = { 0.9642f * _lab_f_inv(fx + fy), _lab_f_inv(fy), 0.8249f * _lab_f_inv(fz + fy) };
+    _matrix(matrix, v);
+    for(int c = 0; c < 3; c++)
+      if(curves && curves->lut[c]) v[c] = _curve(curves, c, v[c]);
+    for(int c = 0; c < 3; c++) out[4 * k + c] = v[c];
+    out[4 * k + 3] = 0.0f;
+  }
+}
+
+/* test data */
+
+static float *_lut[3];
+static float _coeffs[3][3];
+static dt_colormatrix_curves_t _curves;
+
+// rec709 to XYZ D50 and back, and a camera-ish matrix
+static const dt_colormatrix_t _to_xyz = { { 0.4360747f, 0.3850649f, 0.1430804f, 0.0f },
+                                          { 0.2225045f, 0.7168786f, 0.0606169f, 0.0f },
+                                          { 0.0139322f, 0.0971045f, 0.7141733f, 0.0f } };
+static const dt_colormatrix_t _from_xyz = { { 3.1338561f, -1.6168667f, -0.4906146f, 0.0f },
+                                            { -0.9787684f, 1.9161415f, 0.0334540f, 0.0f },
+                                            { 0.0719453f, -0.2289914f, 1.4052427f, 0.0f } };
+static const dt_colormatrix_t _camera = { { 0.62f, 0.29f, 0.06f, 0.0f },
+                                          { 0.27f, 0.84f, -0.11f, 0.0f },
+                                          { 0.02f, -0.19f, 1.02f, 0.0f } };
+static const dt_aligned_pixel_t _corr = { 1.9f, 1.0f, 1.4f, 1.0f };
+
+static void _init_curves(void)
+{
+  // gamma 2.4, and its power function continued above 1.0
+  for(int c = 0; c < 3; c++)
+  {
+    _lut[c] = malloc(sizeof(float) * LUT_SAMPLES);
+    for(int k = 0; k < LUT_SAMPLES; k++) _lut[c][k] = powf(k / (float)(LUT_SAMPLES - 1), 1.0f / 2.4f);
+    _coeffs[c][0] = 1.0f;
+    _coeffs[c][1] = 1.0f;
+    _coeffs[c][2] = 1.0f / 2.4f;
+    _curves.lut[c] = _lut[c];
+    _curves.coeffs[c] = _coeffs[c];
+  }
+  _curves.lutsize = LUT_SAMPLES;
+}
+
+static void _fill(float *const buf, const size_t npixels, const float lo, const float hi[3])
+{
+  uint32_t seed = 42;
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 4; c++)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      const float r = (seed >> 8) / (float)(1 << 24);
+      buf[4 * k + c] = c < 3 ? lo + r * (hi[c] - lo) : 1.0f;
+    }
+}
+
+static float _max_diff(const float *const a, const float *const b, const size_t npixels)
+{
+  float diff = 0.0f;
+  for(size_t k = 0; k < 4 * npixels; k++) diff = MAX(diff, fabsf(a[k] - b[k]));
+  return diff;
+}
+
+typedef enum { PLAIN, AVX2, AVX512 } path_t;
+static const char *_names[] = { "plain", "AVX2", "AVX-512" };
+
+static void _set_path(const path_t path)
+{
+  darktable.codepath.AVX2 = path == AVX2;
+  darktable.codepath.AVX512 = path == AVX512;
+}
+
+static void _rgb_to_Lab(const path_t path, float *out, const float *in, const size_t npixels, const int variant)
+{
+  const dt_colormatrix_curves_t *curves = variant & 1 ? &_curves : NULL;
+  const float(*nmatrix)[4] = variant & 2 ? _from_xyz : NULL;
+  const float(*matrix)[4] = variant & 2 ? _to_xyz : _camera;
+  if(path == PLAIN)
+    _plain_rgb_to_Lab(out, in, npixels, _corr, curves, nmatrix, matrix);
+  else
+  {
+    _set_path(path);
+    dt_colormatrix_simd_rgb_to_Lab(out, in, npixels, _corr, curves, nmatrix, matrix);
+  }
+}
+
+static void _Lab_to_rgb(const path_t path, float *out, const float *in, const size_t npixels, const int variant)
+{
+  const dt_colormatrix_curves_t *curves = variant & 1 ? &_curves : NULL;
+  if(path == PLAIN)
+    _plain_Lab_to_rgb(out, in, npixels, _from_xyz, curves);
+  else
+  {
+    _set_path(path);
+    dt_colormatrix_simd_Lab_to_rgb(out, in, npixels, _from_xyz, curves);
+  }
+}
+
+static const char *_variants[] = { "matrix", "tone curves", "gamut clipping", "curves + clipping" };
+
+int main(int argc, char *arg[])
+{
+  __builtin_cpu_init();
+  const path_t best = __builtin_cpu_supports("avx512f") ? AVX512 : __builtin_cpu_supports("avx2") ? AVX2 : PLAIN;
+  if(best == PLAIN)
+  {
+    fprintf(stderr, "[skipped] the cpu supports neither AVX2 nor AVX-512\n");
+    exit(0);
+  }
+  _init_curves();
+
+  float *rgb = aligned_alloc(64, sizeof(float) * 4 * NUM_PIXELS);
+  float *Lab = aligned_alloc(64, sizeof(float) * 4 * NUM_PIXELS);
+  float *ref = aligned_alloc(64, sizeof(float) * 4 * NUM_PIXELS);
+  float *res = aligned_alloc(64, sizeof(float) * 4 * NUM_PIXELS);
+  // a bit below 0 and above 1 to check the clipping and the extrapolation of the curves
+  _fill(rgb, NUM_PIXELS, -0.05f, (const float[3]){ 0.6f, 1.1f, 0.8f });
+  _fill(Lab, NUM_PIXELS, -10.0f, (const float[3]){ 110.0f, 120.0f, 120.0f });
+  for(size_t k = 0; k < NUM_PIXELS; k++)
+  {
+    Lab[4 * k + 1] -= 65.0f;
+    Lab[4 * k + 2] -= 65.0f;
+  }
+
+  // results, also at an unaligned output and with a tail that doesn't fill a vector
+  for(path_t path = AVX2; path <= best; path++)
+    for(int variant = 0; variant < 4; variant++)
+    {
+      _rgb_to_Lab(PLAIN, ref, rgb, NUM_TEST_PIXELS, variant);
+      _rgb_to_Lab(path, res, rgb, NUM_TEST_PIXELS, variant);
+      const float diff = _max_diff(ref, res, NUM_TEST_PIXELS);
+      _rgb_to_Lab(path, res + 4, rgb, NUM_TEST_PIXELS - 1, variant);
+      const float diff_unaligned = _max_diff(ref, res + 4, NUM_TEST_PIXELS - 1);
+      fprintf(stderr, "[%s] rgb to Lab, %-17s max difference %g\n", _names[path], _variants[variant], diff);
+      assert(diff < TOLERANCE_LAB && diff_unaligned < TOLERANCE_LAB);
+
+      if(variant > 1) continue;
+      _Lab_to_rgb(PLAIN, ref, Lab, NUM_TEST_PIXELS, variant);
+      _Lab_to_rgb(path, res, Lab, NUM_TEST_PIXELS, variant);
+      const float diff2 = _max_diff(ref, res, NUM_TEST_PIXELS);
+      fprintf(stderr, "[%s] Lab to rgb, %-17s max difference %g\n", _names[path], _variants[variant], diff2);
+      assert(diff2 < TOLERANCE_RGB);
+      (void)diff_unaligned;
+    }
+  fprintf(stderr, "[passed] results match the plain code\n");
+
+  // single thread throughput
+  const int runs = argc > 1 ? atoi(arg[1]) : 5;
+  fprintf(stderr, "Mpixels/s                 ");
+  for(path_t path = PLAIN; path <= best; path++) fprintf(stderr, "%10s", _names[path]);
+  fprintf(stderr, "\n");
+  for(int variant = 0; variant < 5; variant++)
+  {
+    fprintf(stderr, "%-26s", variant < 4 ? _variants[variant] : "Lab to rgb + curves");
+    for(path_t path = PLAIN; path <= best; path++)
+    {
+      double best_time = 1e9;
+      for(int r = 0; r < runs; r++)
+      {
+        const double start = _wtime();
+        if(variant < 4)
+          _rgb_to_Lab(path, res, rgb, NUM_PIXELS, variant);
+        else
+          _Lab_to_rgb(path, res, Lab, NUM_PIXELS, 1);
+        best_time = MIN(best_time, _wtime() - start);
+      }
+      fprintf(stderr, "%10.0f", NUM_PIXELS / best_time * 1e-6);
+    }
+    fprintf(stderr, "\n");
+  }
+
+  for(int c = 0; c < 3; c++) free(_lut[c]);
+  free(rgb);
+  free(Lab);
+  free(ref);
+  free(res);
+  exit(0);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
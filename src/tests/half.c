@@ -0,0 +1,144 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for the half float conversions of common/half.h: the plain versions have to
+// give the same bits as the F16C instructions for all halves and for floats around every
+// rounding boundary.
+
+#define DT_UNIT_TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "common/half.h"
+
+#include <assert.h>
+
+static uint32_t _random(uint32_t *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return *state;
+}
+
+static float _from_bits(const uint32_t x)
+{
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static uint32_t _to_bits(const float f)
+{
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+int main(int argc, char *argv[])
+{
+  // all halves go to float and back unchanged, nans at least stay nans
+  for(uint32_t h = 0; h < 0x10000; h++)
+  {
+    const float f = dt_half_to_float(h);
+    const int nan = ((h >> 10) & 0x1f) == 0x1f && (h & 0x3ff);
+    assert(nan ? isnan(f) : dt_float_to_half(f) == h);
+  }
+
+  // a few known values
+  assert(dt_float_to_half(1.0f) == 0x3c00);
+  assert(dt_float_to_half(-2.0f) == 0xc000);
+  assert(dt_float_to_half(65504.0f) == 0x7bff);
+  assert(dt_float_to_half(65519.0f) == 0x7bff);
+  assert(dt_float_to_half(65520.0f) == 0x7c00);
+  assert(dt_float_to_half(0x1p-24f) == 0x0001);
+  assert(dt_float_to_half(0x1p-25f) == 0x0000);
+  assert(dt_float_to_half(0x1.8p-25f) == 0x0001);
+  assert(dt_half_to_float(0x3555) == 0x1.554p-2f);
+
+#ifdef DT_HAVE_AVX_KERNELS
+  __builtin_cpu_init();
+  if(!__builtin_cpu_supports("f16c"))
+  {
+    printf("no F16C, only the plain conversion was tested\n");
+    return 0;
+  }
+
+  // halves to floats, bit exact including nans
+  const size_t nhalves = 0x10000;
+  uint16_t *halves = malloc(sizeof(uint16_t) * nhalves);
+  float *plain = malloc(sizeof(float) * nhalves);
+  float *f16c = malloc(sizeof(float) * nhalves);
+  for(size_t k = 0; k < nhalves; k++) halves[k] = k;
+  dt_half_to_float_plain(plain, halves, nhalves);
+  dt_half_to_float_f16c(f16c, halves, nhalves);
+  for(size_t k = 0; k < nhalves; k++)
+    assert(_to_bits(plain[k]) == _to_bits(f16c[k]));
+
+  // floats to halves: every half, the values between two halves, random bits
+  const size_t nfloats = 1 << 22;
+  float *floats = malloc(sizeof(float) * nfloats);
+  uint16_t *hplain = malloc(sizeof(uint16_t) * nfloats);
+  uint16_t *hf16c = malloc(sizeof(uint16_t) * nfloats);
+  uint32_t state = 12345;
+  size_t n = 0;
+  for(uint32_t h = 0; h < 0x7c00; h++)
+  {
+    const uint32_t x = _to_bits(dt_half_to_float(h));
+    const uint32_t next = _to_bits(dt_half_to_float(h + 1));
+    const uint32_t mid = x + (next - x) / 2;
+    const uint32_t values[] = { x, mid - 1, mid, mid + 1 };
+    for(int i = 0; i < 4; i++)
+    {
+      floats[n++] = _from_bits(values[i]);
+      floats[n++] = _from_bits(values[i] | 0x80000000u);
+    }
+  }
+  while(n < nfloats)
+    floats[n++] = _from_bits(_random(&state));
+
+  dt_float_to_half_plain(hplain, floats, nfloats);
+  dt_float_to_half_f16c(hf16c, floats, nfloats);
+  size_t errors = 0;
+  for(size_t k = 0; k < nfloats; k++)
+  {
+    if(hplain[k] != hf16c[k])
+    {
+      if(errors++ < 10)
+        printf("%a (0x%08x): plain 0x%04x, F16C 0x%04x\n",
+               floats[k], _to_bits(floats[k]), hplain[k], hf16c[k]);
+    }
+  }
+  assert(errors == 0);
+
+  free(halves);
+  free(plain);
+  free(f16c);
+  free(floats);
+  free(hplain);
+  free(hf16c);
+#endif
+
+  printf("all half float tests passed\n");
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
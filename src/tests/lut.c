@@ -0,0 +1,371 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test and benchmark for the shared lookup tables of common/lut.h: the lookups are
+// compared to straightforward per-pixel versions, the 3D interpolations have to reproduce
+// an affine clut exactly, and the throughput of the buffer versions is reported.
+
+#define DT_UNIT_TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define DT_OMP_SIMD(clauses)
+#define DT_OMP_DECLARE_SIMD(clauses)
+#define DT_OMP_FOR(clauses)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+static inline void copy_pixel(float *const out, const float *const in)
+{
+  for(int c = 0; c < 4; c++) out[c] = in[c];
+}
+
+#include "common/lut.h"
+
+#include <assert.h>
+
+#define NUM_PIXELS (1 << 22)
+#define NUM_TEST_PIXELS 100003 // not a multiple of the block size
+#define LUT_SAMPLES 0x10000
+
+static double _wtime(void)
+{
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+static float *_alloc_pixels(const size_t npixels)
+{
+  return aligned_alloc(64, sizeof(float) * 4 * npixels);
+}
+
+static float _random(uint32_t *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return (*state >> 8) / 16777216.0f;
+}
+
+// values in [-0.1, 1.3), so that clipping and extrapolation are covered
+static void _fill(float *const buf, const size_t npixels)
+{
+  uint32_t state = 1;
+  for(size_t k = 0; k < 4 * npixels; k++)
+    buf[k] = 1.4f * _random(&state) - 0.1f;
+}
+
+/* the per-pixel code the modules had */
+
+static float _ref_lookup_1d(const float *const lut, const float v, const int lutsize)
+{
+  const float ft = fminf(fmaxf(v * (lutsize - 1), 0.0f), lutsize - 1);
+  const int t = ft < lutsize - 2 ? ft : lutsize - 2;
+  const float f = ft - t;
+  return lut[t] * (1.0f - f) + lut[t + 1] * f;
+}
+
+static float _ref_lookup_2d(const float *const lut, const int size, const float x, const float y)
+{
+  const float _x = fminf(fmaxf(x * (size - 1), 0.0f), size - 1);
+  const float _y = fminf(fmaxf(y * (size - 1), 0.0f), size - 1);
+  const int _x0 = _x < size - 2 ? _x : size - 2;
+  const int _y0 = _y < size - 2 ? _y : size - 2;
+  const float x_diff = _x - _x0;
+  const float y_diff = _y - _y0;
+  const float l00 = lut[_y0 * size + _x0];
+  const float l01 = lut[_y0 * size + _x0 + 1];
+  const float l10 = lut[(_y0 + 1) * size + _x0];
+  const float l11 = lut[(_y0 + 1) * size + _x0 + 1];
+  const float xy0 = (1.0f - y_diff) * l00 + l10 * y_diff;
+  const float xy1 = (1.0f - y_diff) * l01 + l11 * y_diff;
+  return xy0 * (1.0f - x_diff) + xy1 * x_diff;
+}
+
+static void _ref_tetrahedral(const float *const in, float *const out, const size_t npixels,
+                             const float *const clut, const int level)
+{
+  const int level2 = level * level;
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float *const input = in + 4 * k;
+    float *const output = out + 4 * k;
+    const float r = fminf(fmaxf(input[0], 0.0f), 1.0f) * (level - 1);
+    const float g = fminf(fmaxf(input[1], 0.0f), 1.0f) * (level - 1);
+    const float b = fminf(fmaxf(input[2], 0.0f), 1.0f) * (level - 1);
+    const int rgbi[3] = { MIN((int)r, level - 2), MIN((int)g, level - 2), MIN((int)b, level - 2) };
+    const float dr = r - rgbi[0], dg = g - rgbi[1], db = b - rgbi[2];
+    const size_t i000 = rgbi[0] + rgbi[1] * level + rgbi[2] * level2;
+    const size_t i100 = i000 + 1, i010 = i000 + level, i110 = i010 + 1;
+    const size_t i001 = i000 + level2, i101 = i001 + 1, i011 = i001 + level, i111 = i011 + 1;
+    for(int c = 0; c < 3; c++)
+    {
+      const float c000 = clut[3 * i000 + c], c100 = clut[3 * i100 + c], c010 = clut[3 * i010 + c];
+      const float c110 = clut[3 * i110 + c], c001 = clut[3 * i001 + c], c101 = clut[3 * i101 + c];
+      const float c011 = clut[3 * i011 + c], c111 = clut[3 * i111 + c];
+      if(dr > dg)
+      {
+        if(dg > db)
+          output[c] = (1 - dr) * c000 + (dr - dg) * c100 + (dg - db) * c110 + db * c111;
+        else if(dr > db)
+          output[c] = (1 - dr) * c000 + (dr - db) * c100 + (db - dg) * c101 + dg * c111;
+        else
+          output[c] = (1 - db) * c000 + (db - dr) * c001 + (dr - dg) * c101 + dg * c111;
+      }
+      else
+      {
+        if(db > dg)
+          output[c] = (1 - db) * c000 + (db - dg) * c001 + (dg - dr) * c011 + dr * c111;
+        else if(db > dr)
+          output[c] = (1 - dg) * c000 + (dg - db) * c010 + (db - dr) * c011 + dr * c111;
+        else
+          output[c] = (1 - dg) * c000 + (dg - dr) * c010 + (dr - db) * c110 + db * c111;
+      }
+    }
+    output[3] = input[3];
+  }
+}
+
+// an affine function of rgb, all interpolations have to reproduce it
+static void _affine(const float r, const float g, const float b, float *const out)
+{
+  out[0] = 0.1f + 0.7f * r + 0.2f * g - 0.1f * b;
+  out[1] = 0.05f - 0.3f * r + 0.9f * g + 0.3f * b;
+  out[2] = 0.2f * r + 0.1f * g + 0.6f * b;
+}
+
+static float *_make_clut(const int level, const int affine)
+{
+  float *clut = calloc((size_t)3 * level * level * level + DT_LUT_3D_PADDING, sizeof(float));
+  for(int b = 0; b < level; b++)
+    for(int g = 0; g < level; g++)
+      for(int r = 0; r < level; r++)
+      {
+        const float R = r / (float)(level - 1), G = g / (float)(level - 1), B = b / (float)(level - 1);
+        float *const entry = clut + 3 * ((size_t)r + level * (g + (size_t)level * b));
+        if(affine)
+          _affine(R, G, B, entry);
+        else
+        {
+          entry[0] = powf(R, 0.8f) * 0.9f + 0.05f * sinf(10.0f * G);
+          entry[1] = G * G * 0.7f + 0.2f * B + 0.1f * R * R;
+          entry[2] = sqrtf(B) * 0.8f + 0.1f * R * G;
+        }
+      }
+  return clut;
+}
+
+static float *_make_curve(const int lutsize, float coeffs[3])
+{
+  float *lut = malloc(sizeof(float) * lutsize);
+  for(int k = 0; k < lutsize; k++) lut[k] = powf(k / (float)(lutsize - 1), 1.0f / 2.4f);
+  // what dt_iop_estimate_exp() gives for this curve, close enough for the test
+  coeffs[0] = 1.0f;
+  coeffs[1] = 1.0f;
+  coeffs[2] = 1.0f / 2.4f;
+  return lut;
+}
+
+static float _max_diff(const float *const a, const float *const b, const size_t npixels)
+{
+  float max = 0.0f;
+  for(size_t k = 0; k < 4 * npixels; k++) max = fmaxf(max, fabsf(a[k] - b[k]));
+  return max;
+}
+
+static void _test_1d(void)
+{
+  float coeffs[3];
+  float *lut = _make_curve(LUT_SAMPLES, coeffs);
+  uint32_t state = 7;
+  for(int k = 0; k < 1000000; k++)
+  {
+    const float x = 1.4f * _random(&state) - 0.1f;
+    assert(dt_lut_lookup_1d(lut, x, LUT_SAMPLES) == _ref_lookup_1d(lut, x, LUT_SAMPLES));
+    const float expected = x < 1.0f ? _ref_lookup_1d(lut, x, LUT_SAMPLES)
+                                    : coeffs[1] * powf(x * coeffs[0], coeffs[2]);
+    assert(dt_lut_lookup_1d_unbounded(lut, coeffs, x, LUT_SAMPLES) == expected);
+    (void)expected;
+  }
+  assert(dt_lut_lookup_1d(lut, 1.0f, LUT_SAMPLES) == lut[LUT_SAMPLES - 1]);
+  assert(dt_lut_lookup_1d(lut, -1.0f, LUT_SAMPLES) == lut[0]);
+
+  // the buffer version, with one linear channel
+  float *in = _alloc_pixels(NUM_TEST_PIXELS);
+  float *out = _alloc_pixels(NUM_TEST_PIXELS);
+  _fill(in, NUM_TEST_PIXELS);
+  const float *const luts[3] = { lut, NULL, lut };
+  const float *const curve_coeffs[3] = { coeffs, coeffs, coeffs };
+  dt_lut_apply_1d(out, in, NUM_TEST_PIXELS, luts, curve_coeffs, LUT_SAMPLES);
+  for(size_t k = 0; k < NUM_TEST_PIXELS; k++)
+  {
+    assert(out[4*k] == dt_lut_lookup_1d_unbounded(lut, coeffs, in[4*k], LUT_SAMPLES));
+    assert(out[4*k+1] == in[4*k+1]);
+    assert(out[4*k+3] == in[4*k+3]);
+  }
+
+#ifdef DT_HAVE_AVX_KERNELS
+  if(__builtin_cpu_supports("avx2"))
+  {
+    for(size_t k = 0; k + 8 <= NUM_TEST_PIXELS; k += 8)
+    {
+      DT_ALIGNED_ARRAY float y[8];
+      _mm256_store_ps(y, dt_lut_lookup_1d_unbounded_avx2(lut, coeffs, _mm256_loadu_ps(in + k), LUT_SAMPLES));
+      for(int i = 0; i < 8; i++)
+        assert(fabsf(y[i] - dt_lut_lookup_1d_unbounded(lut, coeffs, in[k + i], LUT_SAMPLES)) < 1e-6f);
+    }
+  }
+  if(__builtin_cpu_supports("avx512f"))
+  {
+    for(size_t k = 0; k + 16 <= NUM_TEST_PIXELS; k += 16)
+    {
+      DT_ALIGNED_ARRAY float y[16];
+      _mm512_store_ps(y, dt_lut_lookup_1d_unbounded_avx512(lut, coeffs, _mm512_loadu_ps(in + k), LUT_SAMPLES));
+      for(int i = 0; i < 16; i++)
+        assert(fabsf(y[i] - dt_lut_lookup_1d_unbounded(lut, coeffs, in[k + i], LUT_SAMPLES)) < 1e-6f);
+    }
+  }
+#endif
+  free(in);
+  free(out);
+  free(lut);
+  fprintf(stderr, "[passed] 1D lookups\n");
+}
+
+static void _test_2d(void)
+{
+  const int size = 128;
+  float *lut = malloc(sizeof(float) * size * size);
+  for(int k = 0; k < size * size; k++) lut[k] = sinf(0.01f * k) + 0.001f * k;
+  uint32_t state = 3;
+  for(int k = 0; k < 1000000; k++)
+  {
+    const float x = 1.4f * _random(&state) - 0.2f;
+    const float y = 1.4f * _random(&state) - 0.2f;
+    assert(fabsf(dt_lut_lookup_2d(lut, size, size, x, y) - _ref_lookup_2d(lut, size, x, y)) < 1e-5f);
+  }
+  free(lut);
+  fprintf(stderr, "[passed] 2D lookups\n");
+}
+
+static void _test_3d(void)
+{
+  float *in = _alloc_pixels(NUM_TEST_PIXELS);
+  float *out = _alloc_pixels(NUM_TEST_PIXELS);
+  float *ref = _alloc_pixels(NUM_TEST_PIXELS);
+  _fill(in, NUM_TEST_PIXELS);
+
+  // an affine clut is reproduced exactly by all interpolations, inside the clut
+  float *clut = _make_clut(17, 1);
+  void (*apply[3])(const float *, float *, size_t, const float *, int)
+    = { dt_lut_apply_3d_trilinear, dt_lut_apply_3d_tetrahedral, dt_lut_apply_3d_pyramid };
+  for(int m = 0; m < 3; m++)
+  {
+    apply[m](in, out, NUM_TEST_PIXELS, clut, 17);
+    for(size_t k = 0; k < NUM_TEST_PIXELS; k++)
+    {
+      const float *const p = in + 4 * k;
+      float expected[3];
+      _affine(fminf(fmaxf(p[0], 0.0f), 1.0f), fminf(fmaxf(p[1], 0.0f), 1.0f), fminf(fmaxf(p[2], 0.0f), 1.0f),
+              expected);
+      for(int c = 0; c < 3; c++) assert(fabsf(out[4*k+c] - expected[c]) < 1e-5f);
+      assert(out[4*k+3] == p[3]);
+    }
+  }
+  free(clut);
+
+  // tetrahedral against the if/else version of OpenColorIO, also in place
+  clut = _make_clut(33, 0);
+  _ref_tetrahedral(in, ref, NUM_TEST_PIXELS, clut, 33);
+  dt_lut_apply_3d_tetrahedral(in, out, NUM_TEST_PIXELS, clut, 33);
+  assert(_max_diff(out, ref, NUM_TEST_PIXELS) < 1e-6f);
+  memcpy(out, in, sizeof(float) * 4 * NUM_TEST_PIXELS);
+  dt_lut_apply_3d_tetrahedral(out, out, NUM_TEST_PIXELS, clut, 33);
+  assert(_max_diff(out, ref, NUM_TEST_PIXELS) < 1e-6f);
+  free(clut);
+
+  free(in);
+  free(out);
+  free(ref);
+  fprintf(stderr, "[passed] 3D interpolations\n");
+}
+
+static void _bench(void)
+{
+  float *in = _alloc_pixels(NUM_PIXELS);
+  float *out = _alloc_pixels(NUM_PIXELS);
+  _fill(in, NUM_PIXELS);
+
+  float coeffs[3];
+  float *lut = _make_curve(LUT_SAMPLES, coeffs);
+  const float *const luts[3] = { lut, lut, lut };
+  const float *const curve_coeffs[3] = { coeffs, coeffs, coeffs };
+  double best = 1e9;
+  for(int rep = 0; rep < 3; rep++)
+  {
+    const double start = _wtime();
+    dt_lut_apply_1d(out, in, NUM_PIXELS, luts, curve_coeffs, LUT_SAMPLES);
+    best = fmin(best, _wtime() - start);
+  }
+  fprintf(stderr, "Mpixels/s (one thread)\n");
+  fprintf(stderr, "1D, 3 curves            %8.0f\n", NUM_PIXELS / best * 1e-6);
+  free(lut);
+
+  const int levels[2] = { 33, 65 };
+  for(int l = 0; l < 2; l++)
+  {
+    float *clut = _make_clut(levels[l], 0);
+    double per_pixel = 1e9, tetra = 1e9, tri = 1e9, pyr = 1e9;
+    for(int rep = 0; rep < 3; rep++)
+    {
+      double start = _wtime();
+      _ref_tetrahedral(in, out, NUM_PIXELS, clut, levels[l]);
+      per_pixel = fmin(per_pixel, _wtime() - start);
+      start = _wtime();
+      dt_lut_apply_3d_tetrahedral(in, out, NUM_PIXELS, clut, levels[l]);
+      tetra = fmin(tetra, _wtime() - start);
+      start = _wtime();
+      dt_lut_apply_3d_trilinear(in, out, NUM_PIXELS, clut, levels[l]);
+      tri = fmin(tri, _wtime() - start);
+      start = _wtime();
+      dt_lut_apply_3d_pyramid(in, out, NUM_PIXELS, clut, levels[l]);
+      pyr = fmin(pyr, _wtime() - start);
+    }
+    fprintf(stderr, "3D %d^3, tetrahedral    %8.0f (per pixel %.0f)\n", levels[l], NUM_PIXELS / tetra * 1e-6,
+            NUM_PIXELS / per_pixel * 1e-6);
+    fprintf(stderr, "3D %d^3, trilinear      %8.0f\n", levels[l], NUM_PIXELS / tri * 1e-6);
+    fprintf(stderr, "3D %d^3, pyramid        %8.0f\n", levels[l], NUM_PIXELS / pyr * 1e-6);
+    free(clut);
+  }
+  free(in);
+  free(out);
+}
+
+int main(int argc, char *arg[])
+{
+  _test_1d();
+  _test_2d();
+  _test_3d();
+  _bench();
+  exit(0);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
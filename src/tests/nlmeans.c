@@ -0,0 +1,319 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark for the precheck of non-local means (dt_nlmeans_param_t.prune). noisy synthetic
+// images are denoised with the settings of denoise (profiled) and astrophoto denoise for a range
+// of prune values, reporting the time, the psnr against the clean image and the psnr against
+// the exact result (prune = 0). everything runs on a single thread.
+//
+// the image is processed in chunks of columns and the precheck may start a run of columns
+// anywhere in a chunk. a final test denoises the image and a copy shifted by half a chunk with
+// a large patch radius: the deviation from the exact result in the columns left of a chunk edge
+// must be the one of the same image columns inside a chunk of the shifted copy.
+
+#define DT_UNIT_TEST
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <xmmintrin.h>
+
+#include "common/dttypes.h"
+
+typedef struct dt_iop_roi_t
+{
+  int x, y, width, height;
+  float scale;
+} dt_iop_roi_t;
+
+typedef int dt_dev_pixelpipe_type_t;
+
+#define DT_OMP_FOR(clauses)
+#define __DT_CLONE_TARGETS__
+#define dt_alloc_align_type(TYPE, count) ((TYPE *)aligned_alloc(64, ((sizeof(TYPE) * (count)) + 63) & ~(size_t)63))
+#define dt_alloc_align_float(count) dt_alloc_align_type(float, count)
+#define dt_get_perthread(buf, padsize) (buf)
+#define dt_free_align(buf) free(buf)
+
+static inline float *dt_alloc_perthread_float(const size_t n, size_t *padded_size)
+{
+  *padded_size = (n + 15) & ~(size_t)15;
+  return dt_alloc_align_float(*padded_size);
+}
+
+static inline float dt_fast_mexp2f(const float x)
+{
+  const int i1 = 0x3f800000; // bit representation of 2^0
+  const int i2 = 0x3f000000; // bit representation of 2^-1
+  const int k0 = i1 + (int)(x * (i2 - i1));
+  union {
+    float f;
+    int i;
+  } k;
+  k.i = k0 >= 0x800000 ? k0 : 0;
+  return k.f;
+}
+
+#include "common/nlmeans_core.c"
+
+static double _wtime(void)
+{
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+static uint32_t _hash(const int x, const int y)
+{
+  uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u;
+  return (h ^ (h >> 13)) * 1274126177u;
+}
+
+// gaussian noise of sigma 1 from two hashes
+static float _noise(const int x, const int y, const int c)
+{
+  const float u1 = ((_hash(4 * x + c, y) >> 8) + 1) / 16777217.0f;
+  const float u2 = (_hash(y, 4 * x + c) >> 8) / 16777216.0f;
+  return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+// 0: smooth gradients with a disc, a sine texture and a checkerboard
+// 1: cells of 16x16 pixels in random colours, high contrast everywhere
+static void _clean_pixel(dt_aligned_pixel_t out, const int image, const int x, const int y, const int width,
+                         const int height)
+{
+  if(image == 1)
+  {
+    const uint32_t h = _hash(x / 16, y / 16);
+    out[0] = 5.0f + 0.8f * ((h >> 8) & 63);
+    out[1] = 5.0f + 0.8f * ((h >> 14) & 63);
+    out[2] = 5.0f + 0.8f * ((h >> 20) & 63);
+    out[3] = 0.0f;
+    return;
+  }
+  dt_aligned_pixel_t v = { 10.0f + 20.0f * x / width, 15.0f + 10.0f * y / height, 20.0f, 0.0f };
+  const float dx = x - width / 3.0f, dy = y - height / 2.0f;
+  if(dx * dx + dy * dy < 0.04f * width * width)
+  {
+    v[0] = 35.0f;
+    v[1] = 8.0f;
+    v[2] = 12.0f;
+  }
+  if(x > width / 2 && y < height / 2)
+  {
+    const float t = 6.0f * sinf(0.15f * x) * sinf(0.11f * y);
+    for(int c = 0; c < 3; c++) v[c] += t;
+  }
+  if(x > 2 * width / 3 && y > height / 2 && ((x / 12 + y / 12) & 1))
+    for(int c = 0; c < 3; c++) v[c] += 12.0f;
+  for_four_channels(c) out[c] = v[c];
+}
+
+static double _psnr(const float *const a, const float *const b, const size_t npixels, const float peak)
+{
+  double err = 0.0;
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 3; c++)
+    {
+      const double d = a[4 * k + c] - b[4 * k + c];
+      err += d * d;
+    }
+  return err > 0.0 ? 10.0 * log10(peak * peak * 3.0 * npixels / err) : INFINITY;
+}
+
+// noisy pixel of an image at column x, which may be left of the image
+static void _noisy_pixel(float *const out, const int image, const int x, const int y, const int width,
+                         const int height)
+{
+  _clean_pixel(out, image, x, y, width, height);
+  for(int c = 0; c < 3; c++) out[c] += _noise(x, y, c);
+}
+
+// deviation of prune > 0 from the exact result per column, averaged over the rows
+static void _column_error(const float *const noisy, const dt_iop_roi_t *const roi,
+                          const dt_nlmeans_param_t *const params, double *const err)
+{
+  const size_t n = (size_t)4 * roi->width * roi->height;
+  float *const exact = dt_alloc_align_float(n);
+  float *const res = dt_alloc_align_float(n);
+  dt_nlmeans_param_t p = *params;
+  p.prune = 0.0f;
+  nlmeans_denoise(noisy, exact, roi, roi, &p);
+  nlmeans_denoise(noisy, res, roi, roi, params);
+  for(int x = 0; x < roi->width; x++)
+  {
+    err[x] = 0.0;
+    for(int y = 0; y < roi->height; y++)
+      for(int c = 0; c < 3; c++)
+      {
+        const size_t k = 4 * ((size_t)y * roi->width + x) + c;
+        err[x] += fabs(res[k] - exact[k]) / roi->height;
+      }
+  }
+  free(exact);
+  free(res);
+}
+
+// returns TRUE if the columns left of the chunk edges deviate more than elsewhere
+static gboolean _seam_test(const int width, const int height)
+{
+  const int P = 6, K = 7;
+  const int chunk = compute_slice_width(width);
+  const int shift = chunk / 2;
+  const dt_iop_roi_t roi = { .width = width, .height = height, .scale = 1.0f };
+  const dt_iop_roi_t roi_shifted = { .width = width + shift, .height = height, .scale = 1.0f };
+  const int chunk_shifted = compute_slice_width(roi_shifted.width);
+  const dt_aligned_pixel_t norm = { 1.0f, 1.0f, 1.0f, 1.0f };
+  const dt_nlmeans_param_t params = { .scattering = 0.0f,
+                                      .scale = 1.0f,
+                                      .luma = 1.0f,
+                                      .chroma = 1.0f,
+                                      .center_weight = -1.0f,
+                                      .sharpness = 0.02f / ((2 * P + 1) * (2 * P + 1)),
+                                      .patch_radius = P,
+                                      .search_radius = K,
+                                      .decimate = 0,
+                                      .prune = 0.1f,
+                                      .norm = norm };
+
+  float *const noisy = dt_alloc_align_float((size_t)4 * roi_shifted.width * height);
+  double *const err = calloc(width, sizeof(double));
+  double *const err_shifted = calloc(roi_shifted.width, sizeof(double));
+
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+      _noisy_pixel(noisy + 4 * ((size_t)y * width + x), 1, x, y, width, height);
+  _column_error(noisy, &roi, &params, err);
+
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < roi_shifted.width; x++)
+      _noisy_pixel(noisy + 4 * ((size_t)y * roi_shifted.width + x), 1, x - shift, y, width, height);
+  _column_error(noisy, &roi_shifted, &params, err_shifted);
+
+  // columns left of a chunk edge, away from the image borders and the chunk edges of the copy
+  double edge = 0.0, inside = 0.0, excess = 0.0;
+  for(int x = P + K; x < width - P - K; x++)
+  {
+    const int to_edge = chunk - 1 - x % chunk;
+    const int xs = x + shift;
+    const int to_edge_shifted = MIN(xs % chunk_shifted, chunk_shifted - 1 - xs % chunk_shifted);
+    if(to_edge < P && to_edge_shifted > P + K)
+    {
+      edge += err[x];
+      inside += err_shifted[xs];
+      excess = MAX(excess, err[x] - err_shifted[xs]);
+    }
+  }
+  fprintf(stderr, "\nchunk edges, patch radius %d, prune %.2f: deviation %.4f at the edges, %.4f inside, "
+          "largest excess in a column %.4f\n", P, params.prune, edge, inside, excess);
+
+  free(noisy);
+  free(err);
+  free(err_shifted);
+  return excess > 1e-3;
+}
+
+static const char *_images[] = { "gradients and edges", "16x16 cells" };
+static const char *_modes[] = { "denoise (profiled)", "astrophoto denoise" };
+static const float _prune[] = { 0.0f, 0.01f, 0.05f, 0.1f, 0.25f, 0.5f };
+#define NUM_PRUNE (sizeof(_prune) / sizeof(_prune[0]))
+
+int main(int argc, char *arg[])
+{
+  const int width = argc > 1 ? atoi(arg[1]) : 1024;
+  const int height = argc > 2 ? atoi(arg[2]) : 768;
+  const int runs = argc > 3 ? atoi(arg[3]) : 1;
+  const size_t npixels = (size_t)width * height;
+  const dt_iop_roi_t roi = { .width = width, .height = height, .scale = 1.0f };
+
+  float *const clean = dt_alloc_align_float(4 * npixels);
+  float *const noisy = dt_alloc_align_float(4 * npixels);
+  float *const exact = dt_alloc_align_float(4 * npixels);
+  float *const out = dt_alloc_align_float(4 * npixels);
+
+  for(int image = 0; image < 2; image++)
+  {
+    for(int y = 0; y < height; y++)
+      for(int x = 0; x < width; x++)
+      {
+        const size_t k = 4 * ((size_t)y * width + x);
+        _clean_pixel(clean + k, image, x, y, width, height);
+        for(int c = 0; c < 4; c++) noisy[k + c] = clean[k + c] + (c < 3 ? _noise(x, y, c) : 0.0f);
+      }
+
+    for(int mode = 0; mode < 2; mode++)
+    {
+      // denoise (profiled) after the anscombe transform with default settings, noise of sigma 1.
+      // astrophoto denoise uses its own sharpness and no center weight, scaled to the same noise.
+      const int P = mode ? 2 : 1;
+      const dt_aligned_pixel_t norm = { 1.0f, 1.0f, 1.0f, 1.0f };
+      const float sharpness = mode ? 0.02f / ((2 * P + 1) * (2 * P + 1)) : 0.045f / ((2 * P + 1) * (2 * P + 1));
+
+      fprintf(stderr, "\n%s, %s, %dx%d, noisy psnr %.2f dB\n", _images[image], _modes[mode], width, height,
+              _psnr(noisy, clean, npixels, 40.0f));
+      fprintf(stderr, "   prune     ms/run    psnr (dB)   vs exact (dB)\n");
+      for(size_t p = 0; p < NUM_PRUNE; p++)
+      {
+        const dt_nlmeans_param_t params = { .scattering = 0.0f,
+                                            .scale = 1.0f,
+                                            .luma = 1.0f,
+                                            .chroma = 1.0f,
+                                            .center_weight = mode ? -1.0f : 0.1f,
+                                            .sharpness = sharpness,
+                                            .patch_radius = P,
+                                            .search_radius = 7,
+                                            .decimate = 0,
+                                            .prune = _prune[p],
+                                            .norm = norm };
+        float *const res = p ? out : exact;
+        const double start = _wtime();
+        for(int r = 0; r < runs; r++) nlmeans_denoise(noisy, res, &roi, &roi, &params);
+        const double ms = (_wtime() - start) / runs * 1e3;
+        for(size_t k = 0; k < 4 * npixels; k++)
+          if(!isfinite(res[k]))
+          {
+            fprintf(stderr, "[failed] prune %g: pixel %zu is not finite\n", _prune[p], k / 4);
+            exit(1);
+          }
+        fprintf(stderr, "%8.2f %10.1f %12.2f %15.2f\n", _prune[p], ms, _psnr(res, clean, npixels, 40.0f),
+                _psnr(res, exact, npixels, 40.0f));
+      }
+    }
+  }
+
+  free(clean);
+  free(noisy);
+  free(exact);
+  free(out);
+
+  if(_seam_test(width, MIN(height, 256)))
+  {
+    fprintf(stderr, "[failed] seam at the chunk edges\n");
+    return 1;
+  }
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,220 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test and benchmark for the packed thumbnail store: insert, replace,
+// remove and copy thumbnails, reopen the store, check that a torn index write
+// is recovered, and compare lookups to reading one file per thumbnail.
+
+#define DT_UNIT_TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#define dt_print(A, ...) fprintf(stderr, __VA_ARGS__)
+#define DT_DEBUG_ALWAYS 0
+#define DT_DEBUG_CACHE 0
+#include "common/thumbstore.h"
+#include "common/thumbstore.c"
+
+#include <assert.h>
+
+#define NUM_THUMBS 20000
+#define THUMB_SIZE 20000 // about a compressed mip2
+
+static double _wtime(void)
+{
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+static void _fill(uint8_t *buf, const uint32_t imgid, const size_t len)
+{
+  for(size_t k = 0; k < len; k++) buf[k] = (uint8_t)(imgid * 31 + k);
+}
+
+static gboolean _check(dt_thumbstore_t *store, const uint32_t imgid, const uint32_t content, const size_t len)
+{
+  dt_thumbstore_blob_t blob;
+  if(!dt_thumbstore_lookup(store, imgid, &blob)) return FALSE;
+  uint8_t *expected = malloc(len);
+  _fill(expected, content, len);
+  const gboolean ok = blob.length == len
+    && blob.width == content && blob.height == 2 * content
+    && blob.codec == DT_THUMBSTORE_CODEC_QOI
+    && !memcmp(blob.data, expected, len);
+  free(expected);
+  dt_thumbstore_blob_release(&blob);
+  return ok;
+}
+
+static void _insert(dt_thumbstore_t *store, const uint32_t imgid, const size_t len)
+{
+  uint8_t *buf = malloc(len);
+  _fill(buf, imgid, len);
+  const gboolean ok = dt_thumbstore_insert(store, imgid, DT_THUMBSTORE_CODEC_QOI, imgid, 2 * imgid, 1, buf, len);
+  assert(ok);
+  (void)ok;
+  free(buf);
+}
+
+static size_t _len(const uint32_t imgid)
+{
+  return 100 + imgid % 1000;
+}
+
+static void _test(const char *base)
+{
+  dt_thumbstore_t *store = dt_thumbstore_open(base);
+  assert(store);
+  for(uint32_t k = 1; k <= 1000; k++) _insert(store, k, _len(k));
+  for(uint32_t k = 1; k <= 1000; k += 2) _insert(store, k, _len(k)); // replace
+  for(uint32_t k = 1; k <= 1000; k += 10) dt_thumbstore_remove(store, k);
+  assert(dt_thumbstore_copy(store, 2000, 2));
+  assert(!dt_thumbstore_copy(store, 2001, 11));
+  assert(dt_thumbstore_count(store) == 901);
+  dt_thumbstore_close(store);
+
+  // everything is still there after reopening
+  store = dt_thumbstore_open(base);
+  assert(dt_thumbstore_count(store) == 901);
+  for(uint32_t k = 1; k <= 1000; k++)
+  {
+    const gboolean found = _check(store, k, k, _len(k));
+    assert(found == (k % 10 != 1));
+    (void)found;
+  }
+  assert(_check(store, 2000, 2, _len(2)));
+  dt_thumbstore_close(store);
+
+  // a torn write of the index: the partial entry is dropped
+  gchar *index_path = g_strdup_printf("%s.index", base);
+  FILE *f = fopen(index_path, "ab");
+  fwrite("xyz", 3, 1, f);
+  fclose(f);
+  store = dt_thumbstore_open(base);
+  assert(dt_thumbstore_count(store) == 901);
+  _insert(store, 3000, 500);
+  assert(_check(store, 3000, 3000, 500));
+  dt_thumbstore_close(store);
+  store = dt_thumbstore_open(base);
+  assert(dt_thumbstore_count(store) == 902);
+  assert(_check(store, 3000, 3000, 500));
+  assert(_check(store, 4, 4, _len(4)));
+  dt_thumbstore_close(store);
+  g_free(index_path);
+
+  fprintf(stderr, "[passed] insert, replace, remove, copy, reopen and recovery\n");
+}
+
+static void _bench(const char *base, const char *dir)
+{
+  uint8_t *buf = malloc(THUMB_SIZE);
+  dt_thumbstore_t *store = dt_thumbstore_open(base);
+  double start = _wtime();
+  for(uint32_t k = 1; k <= NUM_THUMBS; k++)
+  {
+    _fill(buf, k, THUMB_SIZE);
+    dt_thumbstore_insert(store, k, DT_THUMBSTORE_CODEC_QOI, k, k, 1, buf, THUMB_SIZE);
+  }
+  const double packed_write = NUM_THUMBS / (_wtime() - start);
+  dt_thumbstore_close(store);
+
+  start = _wtime();
+  for(uint32_t k = 1; k <= NUM_THUMBS; k++)
+  {
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%" PRIu32 ".jpg", dir, k);
+    _fill(buf, k, THUMB_SIZE);
+    FILE *f = fopen(filename, "wb");
+    fwrite(buf, THUMB_SIZE, 1, f);
+    fclose(f);
+  }
+  const double files_write = NUM_THUMBS / (_wtime() - start);
+
+  store = dt_thumbstore_open(base);
+  start = _wtime();
+  size_t sum = 0;
+  for(uint32_t k = 1; k <= NUM_THUMBS; k++)
+  {
+    dt_thumbstore_blob_t blob;
+    if(dt_thumbstore_lookup(store, k, &blob))
+    {
+      memcpy(buf, blob.data, blob.length);
+      sum += buf[k % THUMB_SIZE];
+      dt_thumbstore_blob_release(&blob);
+    }
+  }
+  const double packed_read = NUM_THUMBS / (_wtime() - start);
+  dt_thumbstore_close(store);
+
+  // this is what the mipmap cache did before
+  start = _wtime();
+  for(uint32_t k = 1; k <= NUM_THUMBS; k++)
+  {
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%" PRIu32 ".jpg", dir, k);
+    FILE *f = fopen(filename, "rb");
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(fread(buf, len, 1, f) == 1) sum += buf[k % THUMB_SIZE];
+    fclose(f);
+  }
+  const double files_read = NUM_THUMBS / (_wtime() - start);
+
+  for(uint32_t k = 1; k <= NUM_THUMBS; k++)
+  {
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%" PRIu32 ".jpg", dir, k);
+    g_unlink(filename);
+  }
+  free(buf);
+
+  fprintf(stderr, "thumbnails/s      packed store   one file each\n");
+  fprintf(stderr, "write           %14.0f %15.0f\n", packed_write, files_write);
+  fprintf(stderr, "read (warm)     %14.0f %15.0f   (%zu)\n", packed_read, files_read, sum);
+}
+
+static void _remove_store(const char *base)
+{
+  gchar *path = g_strdup_printf("%s.pack", base);
+  g_unlink(path);
+  g_free(path);
+  path = g_strdup_printf("%s.index", base);
+  g_unlink(path);
+  g_free(path);
+}
+
+int main(int argc, char *arg[])
+{
+  const char *dir = argc > 1 ? arg[1] : "/tmp";
+  gchar *base = g_strdup_printf("%s/dt-thumbstore-test", dir);
+  _remove_store(base);
+  _test(base);
+  _remove_store(base);
+  _bench(base, dir);
+  _remove_store(base);
+  g_free(base);
+  exit(0);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
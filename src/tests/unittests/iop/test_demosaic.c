@@ -0,0 +1,265 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Unit tests for the explicitly vectorized rcd, amaze and markesteijn kernels: the demosaicers
+ * must give the same result with and without them, up to float rounding.
+ */
+
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "iop/demosaic.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+// the mosaic is in [0, 1.3], the kernels only reorder a few float operations:
+#define E 1e-5f
+
+// odd sizes, so rows and tiles end with partial vectors:
+#define MOSAIC_WIDTH 421
+#define MOSAIC_HEIGHT 317
+
+typedef enum codepath_t
+{
+  CODEPATH_PLAIN,
+  CODEPATH_AVX2,
+  CODEPATH_AVX512
+} codepath_t;
+
+typedef void (*demosaic_fn)(dt_dev_pixelpipe_iop_t *piece,
+                            float *out,
+                            const float *in,
+                            const int width,
+                            const int height,
+                            const uint32_t filters);
+
+// X-Trans III
+static const uint8_t xtrans_pattern[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                              { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+// RGGB and GBRG, and the marker for X-Trans
+static const uint32_t bayer_filters[] = { 0x94949494u, 0x16161616u };
+static const uint32_t xtrans_filters[] = { 9u };
+
+/*
+ * HELPERS
+ */
+
+// smooth gradients, sharp edges and some deterministic noise
+static float _mosaic_value(const int x, const int y)
+{
+  uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  const float noise = (h >> 8) / 16777216.0f;
+  const float edges = ((x / 37 + y / 29) & 1) ? 0.4f : 0.0f;
+  return 0.45f + 0.35f * sinf(0.09f * x + 0.2f * sinf(0.05f * y)) * cosf(0.13f * y) + 0.08f * noise + edges;
+}
+
+static gboolean _use_codepath(const codepath_t codepath)
+{
+#ifdef DT_HAVE_AVX_KERNELS
+  if(codepath == CODEPATH_AVX2 && !__builtin_cpu_supports("avx2")) return FALSE;
+  if(codepath == CODEPATH_AVX512 && !__builtin_cpu_supports("avx512f")) return FALSE;
+  darktable.codepath.AVX2 = codepath == CODEPATH_AVX2;
+  darktable.codepath.AVX512 = codepath == CODEPATH_AVX512;
+  return TRUE;
+#else
+  return codepath == CODEPATH_PLAIN;
+#endif
+}
+
+static void _rcd(dt_dev_pixelpipe_iop_t *piece,
+                 float *out,
+                 const float *in,
+                 const int width,
+                 const int height,
+                 const uint32_t filters)
+{
+  dt_iop_roi_t roi = { .width = width, .height = height, .scale = 1.0f };
+  rcd_demosaic(piece, out, in, &roi, &roi, filters);
+}
+
+static void _amaze(dt_dev_pixelpipe_iop_t *piece,
+                   float *out,
+                   const float *in,
+                   const int width,
+                   const int height,
+                   const uint32_t filters)
+{
+  const dt_iop_roi_t roi = { .width = width, .height = height, .scale = 1.0f };
+  amaze_demosaic(piece, in, out, &roi, &roi, filters);
+}
+
+static void _markesteijn_1pass(dt_dev_pixelpipe_iop_t *piece,
+                               float *out,
+                               const float *in,
+                               const int width,
+                               const int height,
+                               const uint32_t filters)
+{
+  const dt_iop_roi_t roi = { .width = width, .height = height, .scale = 1.0f };
+  xtrans_markesteijn_interpolate(out, in, &roi, &roi, xtrans_pattern, 1);
+}
+
+static void _markesteijn_3pass(dt_dev_pixelpipe_iop_t *piece,
+                               float *out,
+                               const float *in,
+                               const int width,
+                               const int height,
+                               const uint32_t filters)
+{
+  const dt_iop_roi_t roi = { .width = width, .height = height, .scale = 1.0f };
+  xtrans_markesteijn_interpolate(out, in, &roi, &roi, xtrans_pattern, 3);
+}
+
+static void _compare_codepath(const demosaic_fn demosaic,
+                              const codepath_t codepath,
+                              const uint32_t *filters,
+                              const int nfilters)
+{
+  if(!_use_codepath(codepath)) skip();
+
+  const int width = MOSAIC_WIDTH;
+  const int height = MOSAIC_HEIGHT;
+  const size_t npixels = (size_t)width * height;
+  float *in = dt_alloc_align_float(npixels);
+  float *ref = dt_alloc_align_float(4 * npixels);
+  float *out = dt_alloc_align_float(4 * npixels);
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+      in[(size_t)y * width + x] = _mosaic_value(x, y);
+
+  dt_dev_pixelpipe_t pipe = { 0 };
+  for(int c = 0; c < 3; c++) pipe.dsc.processed_maximum[c] = 1.0f;
+  dt_dev_pixelpipe_iop_t piece = { .pipe = &pipe };
+
+  for(int f = 0; f < nfilters; f++)
+  {
+    const codepath_t wanted = codepath;
+    _use_codepath(CODEPATH_PLAIN);
+    demosaic(&piece, ref, in, width, height, filters[f]);
+    _use_codepath(wanted);
+    demosaic(&piece, out, in, width, height, filters[f]);
+
+    for(int y = 0; y < height; y++)
+      for(int x = 0; x < width; x++)
+        for(int c = 0; c < 3; c++)
+        {
+          const size_t k = 4 * ((size_t)y * width + x) + c;
+          if(fabsf(out[k] - ref[k]) >= E)
+            TR_BUG("filters %x, x %d, y %d, c %d: %e instead of %e", filters[f], x, y, c, out[k], ref[k]);
+          assert_float_equal(out[k], ref[k], E);
+        }
+  }
+
+  _use_codepath(CODEPATH_PLAIN);
+  dt_free_align(in);
+  dt_free_align(ref);
+  dt_free_align(out);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_rcd_avx2(void **state)
+{
+  _compare_codepath(_rcd, CODEPATH_AVX2, bayer_filters, 2);
+}
+
+static void test_rcd_avx512(void **state)
+{
+  _compare_codepath(_rcd, CODEPATH_AVX512, bayer_filters, 2);
+}
+
+static void test_amaze_avx2(void **state)
+{
+  _compare_codepath(_amaze, CODEPATH_AVX2, bayer_filters, 2);
+}
+
+static void test_amaze_avx512(void **state)
+{
+  _compare_codepath(_amaze, CODEPATH_AVX512, bayer_filters, 2);
+}
+
+static void test_markesteijn_1pass_avx2(void **state)
+{
+  _compare_codepath(_markesteijn_1pass, CODEPATH_AVX2, xtrans_filters, 1);
+}
+
+static void test_markesteijn_1pass_avx512(void **state)
+{
+  _compare_codepath(_markesteijn_1pass, CODEPATH_AVX512, xtrans_filters, 1);
+}
+
+static void test_markesteijn_3pass_avx2(void **state)
+{
+  _compare_codepath(_markesteijn_3pass, CODEPATH_AVX2, xtrans_filters, 1);
+}
+
+static void test_markesteijn_3pass_avx512(void **state)
+{
+  _compare_codepath(_markesteijn_3pass, CODEPATH_AVX512, xtrans_filters, 1);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_rcd_avx2),
+    cmocka_unit_test(test_rcd_avx512),
+    cmocka_unit_test(test_amaze_avx2),
+    cmocka_unit_test(test_amaze_avx512),
+    cmocka_unit_test(test_markesteijn_1pass_avx2),
+    cmocka_unit_test(test_markesteijn_1pass_avx512),
+    cmocka_unit_test(test_markesteijn_3pass_avx2),
+    cmocka_unit_test(test_markesteijn_3pass_avx512)
+  };
+
+  // markesteijn sizes its per thread buffers for darktable's thread count, as dt_init() would
+  darktable.num_openmp_threads = dt_get_num_procs();
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+
+  TR_DEBUG("epsilon = %e", E);
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
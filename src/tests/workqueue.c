@@ -0,0 +1,170 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// stress test and benchmark for the work stealing job queue.
+// lots of tiny jobs are pushed by the workers themselves (like thumbnail
+// and import jobs do) and by an outside thread, jobs/second is reported
+// for a growing number of workers, with one shard (a single lock as
+// the old scheduler had) and with one shard per worker.
+
+#define DT_UNIT_TEST
+#include "common/atomic.c"
+#include "common/workqueue.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define NUM_JOBS 1000000
+#define NUM_QUEUES 5
+#define EXPORT_QUEUE 3
+
+typedef struct job_t
+{
+  dt_workqueue_node_t node; // must be first
+  int done;
+} job_t;
+
+typedef struct bench_t
+{
+  dt_workqueue_t wq;
+  job_t *jobs;
+  dt_atomic_int pushed;
+  dt_atomic_int finished;
+  dt_atomic_int exporting;
+  int threads;
+} bench_t;
+
+typedef struct worker_t
+{
+  bench_t *b;
+  int id;
+  pthread_t thread;
+} worker_t;
+
+static double _wtime(void)
+{
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+static gboolean _push_next(bench_t *b)
+{
+  const int k = dt_atomic_add_int(&b->pushed, 1);
+  if(k >= NUM_JOBS) return FALSE;
+  const int queue = k % NUM_QUEUES;
+  dt_workqueue_push(&b->wq, &b->jobs[k].node, queue, queue == 0 || queue == 1 ? 4 : 0, queue == 1);
+  return TRUE;
+}
+
+static void *_producer(void *data)
+{
+  bench_t *b = (bench_t *)data;
+  while(_push_next(b)) {}
+  return NULL;
+}
+
+static void *_worker(void *data)
+{
+  worker_t *w = (worker_t *)data;
+  bench_t *b = w->b;
+  while(dt_atomic_get_int(&b->finished) < NUM_JOBS)
+  {
+    dt_workqueue_node_t *node = dt_workqueue_pop(&b->wq, w->id);
+    if(!node) continue;
+
+    job_t *job = (job_t *)node;
+    const gboolean exporting = node->queue == EXPORT_QUEUE;
+    if(exporting)
+    {
+      const int others = dt_atomic_add_int(&b->exporting, 1);
+      assert(others == 0);
+    }
+
+    // jobs spawn new ones
+    job->done++;
+    _push_next(b);
+
+    if(exporting)
+      dt_atomic_sub_int(&b->exporting, 1);
+    dt_workqueue_done(&b->wq, node);
+    dt_atomic_add_int(&b->finished, 1);
+  }
+  return NULL;
+}
+
+static double _run(const int threads, const int shards)
+{
+  bench_t b;
+  b.jobs = (job_t *)calloc(NUM_JOBS, sizeof(job_t));
+  b.threads = threads;
+  dt_atomic_set_int(&b.pushed, 0);
+  dt_atomic_set_int(&b.finished, 0);
+  dt_atomic_set_int(&b.exporting, 0);
+  dt_workqueue_init(&b.wq, shards, NUM_QUEUES);
+  dt_workqueue_set_max_running(&b.wq, EXPORT_QUEUE, 1);
+
+  worker_t *workers = (worker_t *)calloc(threads, sizeof(worker_t));
+  pthread_t producer;
+
+  const double start = _wtime();
+  pthread_create(&producer, NULL, _producer, &b);
+  for(int k = 0; k < threads; k++)
+  {
+    workers[k].b = &b;
+    workers[k].id = k;
+    pthread_create(&workers[k].thread, NULL, _worker, &workers[k]);
+  }
+  pthread_join(producer, NULL);
+  for(int k = 0; k < threads; k++) pthread_join(workers[k].thread, NULL);
+  const double elapsed = _wtime() - start;
+
+  for(int k = 0; k < NUM_JOBS; k++) assert(b.jobs[k].done == 1);
+  for(int q = 0; q < NUM_QUEUES; q++)
+  {
+    assert(dt_workqueue_length(&b.wq, q) == 0);
+    assert(dt_atomic_get_int(&b.wq.running[q]) == 0);
+  }
+
+  dt_workqueue_cleanup(&b.wq);
+  free(workers);
+  free(b.jobs);
+  return NUM_JOBS / elapsed;
+}
+
+int main(int argc, char *arg[])
+{
+  const int max_threads = argc > 1 ? atoi(arg[1]) : 64;
+  fprintf(stderr, "workers   single lock jobs/s   sharded jobs/s\n");
+  for(int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    const double single = _run(threads, 1);
+    const double sharded = _run(threads, threads);
+    fprintf(stderr, "%7d   %18.0f   %14.0f\n", threads, single, sharded);
+  }
+  fprintf(stderr, "[passed] all jobs processed exactly once, at most one export at a time\n");
+  exit(0);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
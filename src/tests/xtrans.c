@@ -0,0 +1,378 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2024 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test and benchmark for the x-trans demosaicers. the homogeneity stage of markesteijn
+// and fdc is compared to the version with full tile planes it replaced, and markesteijn 1-pass,
+// 3-pass and fdc are run on a synthetic x-trans mosaic with the plain code and with the AVX2
+// and AVX-512 kernels. everything runs on a single thread.
+
+#define DT_UNIT_TEST
+#include <assert.h>
+#include <complex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "common/dttypes.h"
+
+typedef struct dt_codepath_t
+{
+  unsigned int AVX2 : 1;
+  unsigned int AVX512 : 1;
+} dt_codepath_t;
+
+static struct
+{
+  dt_codepath_t codepath;
+} darktable;
+
+typedef struct dt_iop_roi_t
+{
+  int x, y, width, height;
+  float scale;
+} dt_iop_roi_t;
+
+// all fdc wants to know about the module is the iso of the image
+struct dt_iop_module_t
+{
+  struct
+  {
+    struct
+    {
+      int exif_iso;
+    } image_storage;
+  } *dev;
+};
+
+#define DT_OMP_FOR(clauses)
+#define DT_DEBUG_ALWAYS 0
+#define dt_print(level, ...) fprintf(stderr, __VA_ARGS__)
+#define CLAMPS(A, L, H) ((A) > (L) ? ((A) < (H) ? (A) : (H)) : (L))
+#define dt_get_perthread(buf, padsize) (buf)
+#define dt_free_align(buf) free(buf)
+
+static inline float sqrf(const float a)
+{
+  return a * a;
+}
+
+static inline int dt_conf_get_int(const char *name)
+{
+  return 800; // plugins/darkroom/demosaic/fdc_xover_iso
+}
+
+static inline void *dt_alloc_perthread(const size_t n, const size_t objsize, size_t *padded_size)
+{
+  *padded_size = (n * objsize + 63) & ~(size_t)63;
+  return aligned_alloc(64, *padded_size);
+}
+
+static inline int FCxtrans(const int row, const int col, const dt_iop_roi_t *const roi,
+                           const uint8_t (*const xtrans)[6])
+{
+  int irow = row + 600;
+  int icol = col + 600;
+  if(roi)
+  {
+    irow += roi->y;
+    icol += roi->x;
+  }
+  return xtrans[irow % 6][icol % 6];
+}
+
+#include "common/demosaic_simd.c"
+#include "iop/demosaicing/xtrans.c"
+
+#define TS 122
+
+// the tiles of markesteijn 1-pass, 3-pass and fdc: directions, pad_homo and pad_tile
+static const int _tiles[3][3] = { { 4, 10, 12 }, { 8, 15, 17 }, { 4, 10, 13 } };
+
+static const uint8_t _xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                       { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+
+typedef enum path_t
+{
+  PLAIN,
+  AVX2,
+  AVX512
+} path_t;
+
+static const char *_names[] = { "plain", "AVX2", "AVX-512" };
+
+static double _wtime(void)
+{
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+static void _set_path(const path_t path)
+{
+  darktable.codepath.AVX2 = path == AVX2;
+  darktable.codepath.AVX512 = path == AVX512;
+}
+
+static uint32_t _hash(const int x, const int y)
+{
+  uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u;
+  return (h ^ (h >> 13)) * 1274126177u;
+}
+
+// smooth gradients, sharp edges, fine lines and some noise
+static float _mosaic_value(const int x, const int y)
+{
+  const float noise = (_hash(x, y) >> 8) / 16777216.0f;
+  const float edges = ((x / 37 + y / 29) & 1) ? 0.4f : 0.0f;
+  const float lines = ((x + 2 * y) % 23 == 0) ? 0.2f : 0.0f;
+  return 0.45f + 0.35f * sinf(0.09f * x + 0.2f * sinf(0.05f * y)) * cosf(0.13f * y) + 0.05f * noise + edges + lines;
+}
+
+/* the homogeneity stage: maps and their 5x5 sums for a tile of derivatives */
+
+// as it was: the maps cleared and added up, and a plane of 5x5 sums rolled along the columns
+static void _homogeneity_planes(uint8_t (*const homosum)[TS][TS],
+                                uint8_t (*const homo)[TS][TS],
+                                float (*const drv)[TS][TS],
+                                const int ndir,
+                                const int pad_homo,
+                                const int pad_tile)
+{
+  const int mrow = TS, mcol = TS;
+  memset(homo, 0, sizeof(uint8_t) * ndir * TS * TS);
+  for(int row = pad_homo; row < mrow - pad_homo; row++)
+    for(int col = pad_homo; col < mcol - pad_homo; col++)
+    {
+      float tr = FLT_MAX;
+      for(int d = 0; d < ndir; d++)
+        if(tr > drv[d][row][col]) tr = drv[d][row][col];
+      tr *= 8;
+      for(int d = 0; d < ndir; d++)
+        for(int v = -1; v <= 1; v++)
+          for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+    }
+
+  for(int d = 0; d < ndir; d++)
+    for(int row = pad_tile; row < mrow - pad_tile; row++)
+    {
+      int col = pad_tile - 5;
+      uint8_t v5sum[5] = { 0 };
+      homosum[d][row][col] = 0;
+      for(col++; col < mcol - pad_tile; col++)
+      {
+        uint8_t colsum = 0;
+        for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
+        homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
+        v5sum[col % 5] = colsum;
+      }
+    }
+}
+
+// as it is now: the maps from the kernels, the sums rolled down the rows. the row sums are
+// copied out to compare them.
+static void _homogeneity_rows(uint8_t (*const homosum)[TS][TS],
+                              uint8_t (*const homo)[TS][TS],
+                              float (*const drv)[TS][TS],
+                              const int ndir,
+                              const int pad_homo,
+                              const int pad_tile)
+{
+  const int mrow = TS, mcol = TS;
+  const gboolean simd = dt_demosaic_simd_available();
+  for(int row = pad_homo; row < mrow - pad_homo; row++)
+  {
+    const int done = simd ? dt_markesteijn_simd_homogeneity(&homo[0][row][pad_homo], &drv[0][row][pad_homo],
+                                                             ndir, mcol - 2 * pad_homo, TS, TS * TS)
+                          : 0;
+    for(int col = pad_homo + done; col < mcol - pad_homo; col++)
+    {
+      float tr = FLT_MAX;
+      for(int d = 0; d < ndir; d++)
+        if(tr > drv[d][row][col]) tr = drv[d][row][col];
+      tr *= 8;
+      for(int d = 0; d < ndir; d++)
+      {
+        uint8_t count = 0;
+        for(int v = -1; v <= 1; v++)
+          for(int h = -1; h <= 1; h++) count += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+        homo[d][row][col] = count;
+      }
+    }
+  }
+
+  uint8_t rowsum[8][TS], vsum[8][TS];
+  for(int row = pad_tile; row < mrow - pad_tile; row++)
+  {
+    _homosum_row(rowsum, vsum, homo, ndir, row, row == pad_tile, pad_tile, mcol - pad_tile);
+    for(int d = 0; d < ndir; d++)
+      memcpy(&homosum[d][row][pad_tile], &rowsum[d][pad_tile], mcol - 2 * pad_tile);
+  }
+}
+
+// squared differences of a smooth signal with some texture, many ties of the threshold
+static void _fill_drv(float (*const drv)[TS][TS], const int ndir, const int seed)
+{
+  for(int d = 0; d < ndir; d++)
+    for(int row = 0; row < TS; row++)
+      for(int col = 0; col < TS; col++)
+      {
+        const uint32_t h = _hash(col + 1000 * d, row + 7919 * seed);
+        const float texture = (h & 0xff) < 16 ? 0.0f : (h >> 8) / 16777216.0f;
+        drv[d][row][col] = sqrf(0.02f * (1 + d) * texture + 0.01f * sinf(0.1f * (row + col * (d + 1))));
+      }
+}
+
+/* the demosaicers on a whole mosaic */
+
+static void _demosaic(const int algo, float *const out, const float *const in, const int width, const int height)
+{
+  const dt_iop_roi_t roi = { .width = width, .height = height, .scale = 1.0f };
+  if(algo == 2)
+  {
+    struct { struct { int exif_iso; } image_storage; } dev = { { 200 } };
+    struct dt_iop_module_t self = { .dev = (void *)&dev };
+    xtrans_fdc_interpolate(&self, out, in, &roi, &roi, _xtrans);
+  }
+  else
+    xtrans_markesteijn_interpolate(out, in, &roi, &roi, _xtrans, algo == 0 ? 1 : 3);
+}
+
+static const char *_algos[] = { "markesteijn 1-pass", "markesteijn 3-pass", "frequency domain chroma" };
+
+static float _max_diff(const float *const a, const float *const b, const size_t n)
+{
+  float diff = 0.0f;
+  for(size_t k = 0; k < n; k++)
+    if((k & 3) != 3) diff = fmaxf(diff, fabsf(a[k] - b[k]));
+  return diff;
+}
+
+int main(int argc, char *arg[])
+{
+  __builtin_cpu_init();
+  const path_t best = __builtin_cpu_supports("avx512f") ? AVX512 : __builtin_cpu_supports("avx2") ? AVX2 : PLAIN;
+  const int width = argc > 1 ? atoi(arg[1]) : 3000;
+  const int height = argc > 2 ? atoi(arg[2]) : 2000;
+  const int runs = argc > 3 ? atoi(arg[3]) : 3;
+
+  // the homogeneity stage against the one it replaced, same maps and sums with every code path
+  float (*drv)[TS][TS] = aligned_alloc(64, sizeof(float) * 8 * TS * TS);
+  uint8_t (*homo)[TS][TS] = aligned_alloc(64, 8 * TS * TS);
+  uint8_t (*ref)[TS][TS] = aligned_alloc(64, 8 * TS * TS);
+  uint8_t (*res)[TS][TS] = aligned_alloc(64, 8 * TS * TS);
+  for(int t = 0; t < 3; t++)
+  {
+    const int ndir = _tiles[t][0], pad_homo = _tiles[t][1], pad_tile = _tiles[t][2];
+    for(int seed = 0; seed < 4; seed++)
+    {
+      _fill_drv(drv, ndir, seed);
+      _homogeneity_planes(ref, homo, drv, ndir, pad_homo, pad_tile);
+      for(path_t path = PLAIN; path <= best; path++)
+      {
+        _set_path(path);
+        _homogeneity_rows(res, homo, drv, ndir, pad_homo, pad_tile);
+        for(int d = 0; d < ndir; d++)
+          for(int row = pad_tile; row < TS - pad_tile; row++)
+            for(int col = pad_tile; col < TS - pad_tile; col++)
+              if(res[d][row][col] != ref[d][row][col])
+              {
+                fprintf(stderr, "[%s] %s: homogeneity sum %d instead of %d at %d, %d, direction %d\n",
+                        _names[path], _algos[t], res[d][row][col], ref[d][row][col], col, row, d);
+                exit(1);
+              }
+      }
+    }
+  }
+  fprintf(stderr, "[passed] homogeneity sums match the tile plane version\n");
+
+  fprintf(stderr, "\nhomogeneity stage, us/tile      planes");
+  for(path_t path = PLAIN; path <= best; path++) fprintf(stderr, "%10s", _names[path]);
+  fprintf(stderr, "\n");
+  const int reps = 200;
+  for(int t = 0; t < 3; t++)
+  {
+    const int ndir = _tiles[t][0], pad_homo = _tiles[t][1], pad_tile = _tiles[t][2];
+    fprintf(stderr, "%-26s", _algos[t]);
+    _fill_drv(drv, ndir, 0);
+    double start = _wtime();
+    for(int r = 0; r < reps; r++) _homogeneity_planes(ref, homo, drv, ndir, pad_homo, pad_tile);
+    fprintf(stderr, "%12.1f", (_wtime() - start) / reps * 1e6);
+    for(path_t path = PLAIN; path <= best; path++)
+    {
+      _set_path(path);
+      start = _wtime();
+      for(int r = 0; r < reps; r++) _homogeneity_rows(res, homo, drv, ndir, pad_homo, pad_tile);
+      fprintf(stderr, "%10.1f", (_wtime() - start) / reps * 1e6);
+    }
+    fprintf(stderr, "\n");
+  }
+  free(drv);
+  free(homo);
+  free(ref);
+  free(res);
+
+  // whole mosaics: the kernels must not change a single value
+  const size_t npixels = (size_t)width * height;
+  float *in = aligned_alloc(64, sizeof(float) * npixels);
+  float *out_ref = aligned_alloc(64, sizeof(float) * 4 * npixels);
+  float *out = aligned_alloc(64, sizeof(float) * 4 * npixels);
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++) in[(size_t)y * width + x] = _mosaic_value(x, y);
+
+  fprintf(stderr, "\n%dx%d mosaic, ms                ", width, height);
+  for(path_t path = PLAIN; path <= best; path++) fprintf(stderr, "%10s", _names[path]);
+  fprintf(stderr, "\n");
+  for(int algo = 0; algo < 3; algo++)
+  {
+    fprintf(stderr, "%-38s", _algos[algo]);
+    for(path_t path = PLAIN; path <= best; path++)
+    {
+      _set_path(path);
+      double best_time = 1e9;
+      for(int r = 0; r < runs; r++)
+      {
+        const double start = _wtime();
+        _demosaic(algo, path == PLAIN ? out_ref : out, in, width, height);
+        best_time = MIN(best_time, _wtime() - start);
+      }
+      fprintf(stderr, "%10.0f", best_time * 1e3);
+      if(path != PLAIN && _max_diff(out_ref, out, 4 * npixels) != 0.0f)
+      {
+        fprintf(stderr, "\n[%s] %s differs from the plain code by %g\n", _names[path], _algos[algo],
+                _max_diff(out_ref, out, 4 * npixels));
+        exit(1);
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+  fprintf(stderr, "[passed] results match the plain code\n");
+
+  free(in);
+  free(out_ref);
+  free(out);
+  exit(0);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on